@@ -0,0 +1,89 @@
+#pragma once
+// ---------------------------------------------------------------------------
+// Batch scaffolding shared by the single-file tools: the RsvCRC sign and
+// validate --batch modes, RockwellFTArchiveDirTesting --bulk and
+// ParEdDocument --batch. Each tool is one .cpp, so this is header-only.
+//
+//   std::vector<std::wstring> paths;
+//   BatchFiles::Collect(spec, L"*.mer", paths);
+//   int threads = BatchFiles::PoolSize(requested, MAX_THREADS, paths.size());
+//   double wallMs = BatchFiles::RunPool(threads, [&](int id) { ... });
+// ---------------------------------------------------------------------------
+
+#include <windows.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+
+namespace BatchFiles {
+
+inline bool HasWildcard(const std::wstring& s) {
+    return s.find_first_of(L"*?") != std::wstring::npos;
+}
+
+// Directory (every file matching dirPattern in it, e.g. L"*.mer"), glob,
+// or list file (one path per line, # starts a comment). False if the
+// source cannot be read; an empty match is not an error.
+inline bool Collect(const std::wstring& spec, const wchar_t* dirPattern, std::vector<std::wstring>& paths) {
+    DWORD attrs = GetFileAttributesW(spec.c_str());
+    bool isDir = attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+    if (isDir || HasWildcard(spec)) {
+        std::wstring dir = spec;
+        std::wstring pattern = spec;
+        if (isDir) {
+            if (dir.back() != L'\\' && dir.back() != L'/') dir += L'\\';
+            pattern = dir + dirPattern;
+        } else {
+            size_t slash = spec.find_last_of(L"\\/");
+            dir = (slash == std::wstring::npos) ? L"" : spec.substr(0, slash + 1);
+        }
+        WIN32_FIND_DATAW fd;
+        HANDLE hFind = FindFirstFileW(pattern.c_str(), &fd);
+        if (hFind == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+        do {
+            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) paths.push_back(dir + fd.cFileName);
+        } while (FindNextFileW(hFind, &fd));
+        FindClose(hFind);
+        return true;
+    }
+
+    FILE* f = _wfopen(spec.c_str(), L"r, ccs=UTF-8");
+    if (!f) return false;
+    wchar_t line[MAX_PATH * 2];
+    while (fgetws(line, _countof(line), f)) {
+        std::wstring p(line);
+        while (!p.empty() && (p.back() == L'\n' || p.back() == L'\r' || p.back() == L' ')) p.pop_back();
+        if (!p.empty() && p[0] != L'#') paths.push_back(p);
+    }
+    fclose(f);
+    return true;
+}
+
+// Worker count: requested, else one per core (4 if unknown), at most
+// maxThreads and never more than there are items
+inline int PoolSize(int requested, int maxThreads, size_t items) {
+    int threads = requested;
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 4;
+    if (threads > maxThreads) threads = maxThreads;
+    if (threads > (int)items) threads = (int)items;
+    return threads;
+}
+
+// worker(id) on threads threads, id 0..threads-1, joined before it
+// returns. Returns the wall time in ms.
+template <class Worker>
+inline double RunPool(int threads, Worker worker) {
+    LARGE_INTEGER freq, t0, t1;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++)
+        pool.emplace_back(worker, t);
+    for (auto& th : pool) th.join();
+    QueryPerformanceCounter(&t1);
+    return (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / (double)freq.QuadPart;
+}
+
+} // namespace BatchFiles
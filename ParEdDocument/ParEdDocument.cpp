@@ -1,5 +1,8 @@
 // ParEdTypeInfo.cpp
 // Build x86: cl /EHsc /W4 /nologo ParEdTypeInfo.cpp ole32.lib oleaut32.lib shlwapi.lib
+//
+// Single document (type info dump and probe):  ParEdDocument <path-to-par>
+// Batch conversion:  ParEdDocument --batch <dir|glob|list.txt> <out-dir> [--verbose]
 
 #include <windows.h>
 #include <ole2.h>
@@ -12,6 +15,7 @@
 #include <string>
 #include <ocidl.h>       // IProvideClassInfo
 #include <conio.h>
+#include "../Common/BatchFiles.h"
 
 #pragma comment(lib, "Ole32.lib")
 #pragma comment(lib, "OleAut32.lib")
@@ -180,14 +184,24 @@ static void DumpTypeInfo(ITypeInfo* pti) {
     pti->ReleaseTypeAttr(ta);
 }
 
-// Try invoke by name; supports 0-arg or 1-arg(BSTR) calls.
-// If it finds multiple overload-ish entries, it tries the first matching arity.
-static HRESULT TryInvokeByName(
+// One way of calling a method: its DISPID, invoke flags and argument count
+// (0, or 1 for a BSTR path). Resolved from the type info once and reusable
+// on any instance of the same class.
+struct ResolvedCall {
+    DISPID dispid = DISPID_UNKNOWN;
+    WORD flags = DISPATCH_METHOD;
+    UINT cArgs = 0;
+};
+
+// The 0-arg and 1-arg entries for methodName (first of each, 0-arg first).
+// Prefers INVOKE_FUNC / PROPGET entries with the name's MEMBERID.
+static HRESULT ResolveCallShapes(
     IDispatch* disp,
     ITypeInfo* pti,
-    const wchar_t* methodName,          // <-- const now
-    const wchar_t* maybePathBstr
+    const wchar_t* methodName,
+    std::vector<ResolvedCall>& shapes
 ) {
+    shapes.clear();
     if (!disp || !pti || !methodName) return E_INVALIDARG;
 
     // Resolve name -> MEMBERID using the typeinfo to avoid locale/name mangling issues.
@@ -205,47 +219,66 @@ static HRESULT TryInvokeByName(
         memid = (MEMBERID)id;
     }
 
-    // Find a FUNCDESC with matching memid (and prefer INVOKE_FUNC / PROPGET)
     TYPEATTR* ta = nullptr;
     hr = pti->GetTypeAttr(&ta);
     if (FAILED(hr) || !ta) return hr;
 
-    FUNCDESC* chosen0 = nullptr;  // 0-arg
-    FUNCDESC* chosen1b = nullptr; // 1-arg maybe bstr/variant
-
-    for (UINT i = 0; i < (UINT)ta->cFuncs; i++) {
+    bool have0 = false, have1 = false;
+    ResolvedCall call0, call1;
+    for (UINT i = 0; i < (UINT)ta->cFuncs && !(have0 && have1); i++) {
         FUNCDESC* fd = nullptr;
         if (FAILED(pti->GetFuncDesc(i, &fd)) || !fd) continue;
 
         if (fd->memid == memid && (fd->invkind == INVOKE_FUNC || fd->invkind == INVOKE_PROPERTYGET)) {
-            if (fd->cParams == 0 && !chosen0) {
-                chosen0 = fd;
-                continue; // keep fd
+            WORD flags = (fd->invkind == INVOKE_PROPERTYGET) ? DISPATCH_PROPERTYGET : DISPATCH_METHOD;
+            if (fd->cParams == 0 && !have0) {
+                call0 = { (DISPID)fd->memid, flags, 0 };
+                have0 = true;
             }
-            else if (fd->cParams == 1 && !chosen1b) {
-                chosen1b = fd;
-                continue; // keep fd
+            else if (fd->cParams == 1 && !have1) {
+                call1 = { (DISPID)fd->memid, flags, 1 };
+                have1 = true;
             }
         }
 
         pti->ReleaseFuncDesc(fd);
-        if (chosen0 && chosen1b) break;
     }
 
     pti->ReleaseTypeAttr(ta);
 
-    auto doInvoke = [&](DISPID dispid, WORD flags, VARIANT* args, UINT cArgs) -> HRESULT {
-        DISPPARAMS dp{};
-        dp.cArgs = cArgs;
-        dp.rgvarg = args;
+    if (have0) shapes.push_back(call0);
+    if (have1) shapes.push_back(call1);
+    return S_OK;
+}
 
-        VARIANT ret{};
-        VariantInit(&ret);
-        EXCEPINFO ex{};
-        UINT argErr = 0;
+// Invoke a resolved call; a 1-arg call passes path as a BSTR
+static HRESULT InvokeResolved(
+    IDispatch* disp,
+    const ResolvedCall& call,
+    const wchar_t* methodName,
+    const wchar_t* path,
+    bool print
+) {
+    // args are passed right-to-left in rgvarg (only 1 arg here)
+    VARIANT arg{};
+    VariantInit(&arg);
+    if (call.cArgs == 1) {
+        arg.vt = VT_BSTR;
+        arg.bstrVal = SysAllocString(path);
+    }
+
+    DISPPARAMS dp{};
+    dp.cArgs = call.cArgs;
+    dp.rgvarg = call.cArgs ? &arg : nullptr;
 
-        HRESULT r = disp->Invoke(dispid, IID_NULL, LOCALE_USER_DEFAULT, flags, &dp, &ret, &ex, &argErr);
+    VARIANT ret{};
+    VariantInit(&ret);
+    EXCEPINFO ex{};
+    UINT argErr = 0;
 
+    HRESULT r = disp->Invoke(call.dispid, IID_NULL, LOCALE_USER_DEFAULT, call.flags, &dp, &ret, &ex, &argErr);
+
+    if (print) {
         std::printf("  Invoke(%ls) -> 0x%08lX", methodName, (long)r);
         if (FAILED(r)) {
             std::printf(" (argErr=%u)\n", argErr);
@@ -253,42 +286,34 @@ static HRESULT TryInvokeByName(
         else {
             std::printf("  ret.vt=%u\n", (unsigned)ret.vt);
         }
-
-        VariantClear(&ret);
-        return r;
-    };
-
-    HRESULT best = E_FAIL;
-
-    if (chosen0) {
-        DISPID id = (DISPID)chosen0->memid;
-        WORD flags = (chosen0->invkind == INVOKE_PROPERTYGET) ? DISPATCH_PROPERTYGET : DISPATCH_METHOD;
-        best = doInvoke(id, flags, nullptr, 0);
-        pti->ReleaseFuncDesc(chosen0);
-
-        if (SUCCEEDED(best)) {
-            if (chosen1b) pti->ReleaseFuncDesc(chosen1b);
-            return best;
-        }
     }
 
-    if (chosen1b && maybePathBstr) {
-        // args are passed right-to-left in rgvarg (only 1 arg here)
-        VARIANT arg{};
-        VariantInit(&arg);
-        arg.vt = VT_BSTR;
-        arg.bstrVal = SysAllocString(maybePathBstr);
+    SysFreeString(ex.bstrSource);
+    SysFreeString(ex.bstrDescription);
+    SysFreeString(ex.bstrHelpFile);
+    VariantClear(&ret);
+    VariantClear(&arg);
+    return r;
+}
 
-        DISPID id = (DISPID)chosen1b->memid;
-        WORD flags = (chosen1b->invkind == INVOKE_PROPERTYGET) ? DISPATCH_PROPERTYGET : DISPATCH_METHOD;
-        best = doInvoke(id, flags, &arg, 1);
+// Try invoke by name; supports 0-arg or 1-arg(BSTR) calls.
+// If it finds multiple overload-ish entries, it tries the first matching arity.
+static HRESULT TryInvokeByName(
+    IDispatch* disp,
+    ITypeInfo* pti,
+    const wchar_t* methodName,          // <-- const now
+    const wchar_t* maybePathBstr
+) {
+    std::vector<ResolvedCall> shapes;
+    HRESULT hr = ResolveCallShapes(disp, pti, methodName, shapes);
+    if (FAILED(hr)) return hr;
 
-        VariantClear(&arg);
-        pti->ReleaseFuncDesc(chosen1b);
-        return best;
+    HRESULT best = E_FAIL;
+    for (const auto& call : shapes) {
+        if (call.cArgs == 1 && !maybePathBstr) break;
+        best = InvokeResolved(disp, call, methodName, maybePathBstr, true);
+        if (SUCCEEDED(best) || call.cArgs == 1) return best;
     }
-
-    if (chosen1b) pti->ReleaseFuncDesc(chosen1b);
     return best;
 }
 
@@ -355,15 +380,234 @@ static HRESULT GetDefaultInterfaceTypeInfoFromCoclass(ITypeInfo* coclassTI, ITyp
     return E_NOINTERFACE;
 }
 
+// ---------------------------------------------------------------------------
+// Batch mode: convert every document of a directory, glob or list file in
+// one process. The type info is read and AOASave resolved on the first
+// document only, so a document costs its load and save. Only the 1-BSTR
+// shape writes to the output path; without it every document fails (the
+// 0-arg shape would save the source in place). The instance is kept from
+// one document to the next; a load it refuses is retried on a fresh one,
+// and only if that succeeds is a fresh one created per document after.
+// ---------------------------------------------------------------------------
+
+struct BatchDoc {
+    std::wstring path;
+    std::wstring outPath;
+    HRESULT hr = E_PENDING;
+    const char* step = "";      // where it failed
+    double loadMs = 0.0, saveMs = 0.0;
+};
+
+// Same load as single-document mode: IInitializeWithStream over the file
+static HRESULT LoadDocument(IDispatch* disp, const wchar_t* path, bool verbose) {
+    IInitializeWithStream* pInit = nullptr;
+    HRESULT hr = disp->QueryInterface(__uuidof(IInitializeWithStream), (void**)&pInit);
+    if (verbose) PrintHresult("QI(IInitializeWithStream)", hr);
+    if (FAILED(hr) || !pInit) return FAILED(hr) ? hr : E_NOINTERFACE;
+
+    IStream* stm = nullptr;
+    hr = SHCreateStreamOnFileEx(path, STGM_READ | STGM_SHARE_DENY_NONE, FILE_ATTRIBUTE_NORMAL,
+        FALSE, nullptr, &stm);
+    if (verbose) PrintHresult("SHCreateStreamOnFileEx(parPath)", hr);
+    if (SUCCEEDED(hr) && stm) {
+        hr = pInit->Initialize(stm, STGM_READ);
+        if (verbose) PrintHresult("IInitializeWithStream::Initialize(stream, STGM_READ)", hr);
+        stm->Release();
+    }
+    pInit->Release();
+    return hr;
+}
+
+// The interface type info single-document mode dumps: GetTypeInfo(0) or
+// IProvideClassInfo, pivoted from a coclass to its default interface
+static HRESULT GetInvokeTypeInfo(IDispatch* disp, ITypeInfo** outTI) {
+    *outTI = nullptr;
+    ITypeInfo* ti = nullptr;
+    UINT n = 0;
+    if (SUCCEEDED(disp->GetTypeInfoCount(&n)) && n > 0)
+        disp->GetTypeInfo(0, LOCALE_USER_DEFAULT, &ti);
+    if (!ti) GetTypeInfoViaProvideClassInfo(disp, &ti);
+    if (!ti) return E_NOINTERFACE;
+
+    TYPEATTR* ta = nullptr;
+    bool isCoclass = false;
+    if (SUCCEEDED(ti->GetTypeAttr(&ta)) && ta) {
+        isCoclass = (ta->typekind == TKIND_COCLASS);
+        ti->ReleaseTypeAttr(ta);
+    }
+    if (isCoclass) {
+        ITypeInfo* defIface = nullptr;
+        if (SUCCEEDED(GetDefaultInterfaceTypeInfoFromCoclass(ti, &defIface)) && defIface) {
+            ti->Release();
+            ti = defIface;
+        }
+    }
+    *outTI = ti; // caller releases
+    return S_OK;
+}
+
+static double ElapsedMs(const LARGE_INTEGER& from, const LARGE_INTEGER& freq) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)(now.QuadPart - from.QuadPart) * 1000.0 / (double)freq.QuadPart;
+}
+
+static int RunBatch(const std::wstring& spec, const std::wstring& outDir, const GUID& clsid, bool verbose) {
+    std::vector<std::wstring> paths;
+    if (!BatchFiles::Collect(spec, L"*.par", paths)) {
+        fwprintf(stderr, L"Cannot read document source: %ls\n", spec.c_str());
+        return 2;
+    }
+    if (paths.empty()) {
+        fwprintf(stderr, L"No PAR files in: %ls\n", spec.c_str());
+        return 2;
+    }
+    if (!CreateDirectoryW(outDir.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        fwprintf(stderr, L"CreateDirectoryW failed (%lu) for: %ls\n", GetLastError(), outDir.c_str());
+        return 8;
+    }
+    std::wstring outRoot = outDir;
+    if (outRoot.back() != L'\\' && outRoot.back() != L'/') outRoot += L'\\';
+
+    std::vector<BatchDoc> docs(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        docs[i].path = paths[i];
+        size_t slash = paths[i].find_last_of(L"\\/");
+        docs[i].outPath = outRoot + paths[i].substr(slash == std::wstring::npos ? 0 : slash + 1);
+    }
+
+    LARGE_INTEGER freq, batchStart;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&batchStart);
+
+    IDispatch* pDisp = nullptr;
+    bool reuseInstance = true;          // until a fresh instance loads what a reused one refused
+    bool shapesResolved = false;
+    bool haveSave = false;
+    ResolvedCall saveCall;              // AOASave(BSTR path)
+    double resolveMs = 0.0;
+
+    for (auto& doc : docs) {
+        LARGE_INTEGER t0;
+        QueryPerformanceCounter(&t0);
+
+        bool reused = pDisp != nullptr;
+        if (!pDisp) {
+            doc.hr = CoCreateInstance(clsid, nullptr, CLSCTX_LOCAL_SERVER, IID_IDispatch, (void**)&pDisp);
+            if (FAILED(doc.hr) || !pDisp) {
+                if (SUCCEEDED(doc.hr)) doc.hr = E_NOINTERFACE;
+                pDisp = nullptr;
+                doc.step = "create";
+                continue;
+            }
+        }
+        doc.hr = LoadDocument(pDisp, doc.path.c_str(), verbose);
+        if (FAILED(doc.hr) && reused) {
+            // Retry on a fresh instance. If that loads it, the old one refused
+            // because it already held a document: one instance per document
+            // from here on. If not, the document itself is bad.
+            pDisp->Release();
+            pDisp = nullptr;
+            doc.hr = CoCreateInstance(clsid, nullptr, CLSCTX_LOCAL_SERVER, IID_IDispatch, (void**)&pDisp);
+            if (SUCCEEDED(doc.hr) && pDisp) {
+                doc.hr = LoadDocument(pDisp, doc.path.c_str(), verbose);
+                if (SUCCEEDED(doc.hr)) reuseInstance = false;
+            }
+            else {
+                if (SUCCEEDED(doc.hr)) doc.hr = E_NOINTERFACE;
+                pDisp = nullptr;
+            }
+        }
+        doc.loadMs = ElapsedMs(t0, freq);
+        if (FAILED(doc.hr) || !pDisp) {
+            doc.step = "load";
+        }
+        else {
+            if (!shapesResolved) {
+                LARGE_INTEGER tr;
+                QueryPerformanceCounter(&tr);
+                ITypeInfo* ti = nullptr;
+                if (SUCCEEDED(GetInvokeTypeInfo(pDisp, &ti))) {
+                    if (verbose) {
+                        std::printf("\n=== Dumping methods from selected typeinfo ===\n");
+                        DumpTypeInfo(ti);
+                    }
+                    std::vector<ResolvedCall> shapes;
+                    shapesResolved = SUCCEEDED(ResolveCallShapes(pDisp, ti, L"AOASave", shapes));
+                    for (const auto& call : shapes) {
+                        if (call.cArgs != 1) continue;
+                        saveCall = call;
+                        haveSave = true;
+                    }
+                    ti->Release();
+                }
+                resolveMs = ElapsedMs(tr, freq);
+                if (haveSave) {
+                    std::printf("AOASave: DISPID 0x%08lX, 1 arg, resolved in %.1f ms\n",
+                        (long)saveCall.dispid, resolveMs);
+                }
+                else if (shapesResolved) {
+                    std::printf("AOASave: no 1-BSTR shape; batch mode does not save in place\n");
+                }
+            }
+
+            LARGE_INTEGER ts;
+            QueryPerformanceCounter(&ts);
+            doc.step = "save";
+            if (haveSave)
+                doc.hr = InvokeResolved(pDisp, saveCall, L"AOASave", doc.outPath.c_str(), verbose);
+            else
+                doc.hr = shapesResolved ? DISP_E_MEMBERNOTFOUND : TYPE_E_ELEMENTNOTFOUND;
+            doc.saveMs = ElapsedMs(ts, freq);
+        }
+        if (SUCCEEDED(doc.hr)) doc.step = "";
+
+        if (!reuseInstance && pDisp) {
+            pDisp->Release();
+            pDisp = nullptr;
+        }
+    }
+    if (pDisp) pDisp->Release();
+    double wallMs = ElapsedMs(batchStart, freq);
+
+    int ok = 0;
+    double loadTotal = 0.0, saveTotal = 0.0;
+    std::printf("\n%-6s %-7s %-10s %10s %10s  %s\n", "#", "result", "hr", "load ms", "save ms", "path");
+    for (size_t i = 0; i < docs.size(); i++) {
+        const BatchDoc& d = docs[i];
+        if (SUCCEEDED(d.hr)) ok++;
+        loadTotal += d.loadMs;
+        saveTotal += d.saveMs;
+        std::printf("%-6u %-7s 0x%08lX %10.1f %10.1f  %ls\n", (unsigned)i + 1,
+            SUCCEEDED(d.hr) ? "OK" : d.step, (long)d.hr, d.loadMs, d.saveMs, d.path.c_str());
+    }
+    std::printf("%u document(s): %d converted, %d failed, load %.1f ms, save %.1f ms, "
+        "resolve %.1f ms, %.1f ms wall, instance %s\n",
+        (unsigned)docs.size(), ok, (int)docs.size() - ok, loadTotal, saveTotal, resolveMs, wallMs,
+        reuseInstance ? "reused" : "per document");
+    return (ok == (int)docs.size()) ? 0 : 1;
+}
+
 int wmain(int argc, wchar_t** argv) {
-    if (argc < 2) {
-        fwprintf(stderr, L"Usage: %s <path-to-par>\n", argv[0]);
+    const wchar_t* batchSpec = nullptr;
+    const wchar_t* batchOut = nullptr;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (_wcsicmp(argv[i], L"--batch") == 0 && i + 2 < argc) { batchSpec = argv[++i]; batchOut = argv[++i]; }
+        else if (_wcsicmp(argv[i], L"--verbose") == 0) verbose = true;
+    }
+
+    if (argc < 2 || (!batchSpec && argv[1][0] == L'-')) {
+        fwprintf(stderr, L"Usage: %s <path-to-par>\n"
+                         L"       %s --batch <dir|glob|list.txt> <out-dir> [--verbose]\n", argv[0], argv[0]);
         return 2;
     }
     const wchar_t* parPath = argv[1];
 
-    std::printf("Press any key to continue...\n");
-    _getch();
+    if (!batchSpec) {
+        std::printf("Press any key to continue...\n");
+        _getch();
+    }
 
     HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
     if (FAILED(hr)) {
@@ -379,6 +623,12 @@ int wmain(int argc, wchar_t** argv) {
         return 4;
     }
 
+    if (batchSpec) {
+        int rc = RunBatch(batchSpec, batchOut, clsid, verbose);
+        CoUninitialize();
+        return rc;
+    }
+
     IDispatch* pDisp = nullptr;
     hr = CoCreateInstance(clsid, nullptr, CLSCTX_LOCAL_SERVER, IID_IDispatch, (void**)&pDisp);
     PrintHresult("CoCreateInstance(ParEd, IID_IDispatch)", hr);
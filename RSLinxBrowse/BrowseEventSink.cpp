@@ -15,11 +15,13 @@ BrowseEventSink::BrowseEventSink()
     : m_refCount(1)
     , m_browseStarted(false)
     , m_browseEnded(false)
+    , m_hProgress(CreateEventW(nullptr, FALSE, FALSE, nullptr))
 {
 }
 
 BrowseEventSink::~BrowseEventSink()
 {
+    if (m_hProgress) CloseHandle(m_hProgress);
 }
 
 // ========================================
@@ -167,6 +169,8 @@ STDMETHODIMP BrowseEventSink::OnBrowseEnded(IUnknown* pBus)
         m_browseStateCallback(false);
     }
 
+    if (m_hProgress) SetEvent(m_hProgress);
+
     return S_OK;
 }
 
@@ -185,6 +189,8 @@ STDMETHODIMP BrowseEventSink::OnBrowseAddressFound(IUnknown* pBus, VARIANT addr)
         m_deviceFoundCallback(address);
     }
 
+    if (m_hProgress) SetEvent(m_hProgress);
+
     return S_OK;
 }
 
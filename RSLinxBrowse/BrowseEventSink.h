@@ -47,6 +47,11 @@ public:
     bool IsBrowseStarted() const { return m_browseStarted; }
     bool IsBrowseEnded() const { return m_browseEnded; }
 
+    // Auto-reset event, signaled on every device found and on browse end.
+    // Wait on it with MsgWaitForMultipleObjects: the events arrive as COM
+    // calls on this STA, so the waiting thread must keep pumping messages.
+    HANDLE GetProgressEvent() const { return m_hProgress; }
+
     // ========================================
     // IUnknown implementation
     // ========================================
@@ -74,6 +79,7 @@ private:
     std::vector<std::wstring> m_discoveredDevices;
     bool m_browseStarted;
     bool m_browseEnded;
+    HANDLE m_hProgress;
 
     DeviceFoundCallback m_deviceFoundCallback;
     BrowseStateCallback m_browseStateCallback;
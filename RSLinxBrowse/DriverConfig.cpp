@@ -11,64 +11,11 @@
  */
 
 #include "DriverConfig.h"
+#include "IdentityScanner.h"
 #include <iostream>
 #include <iomanip>
 #include <chrono>
 
-// EtherNet/IP constants
-#define ENCAP_PORT          44818   // 0xAF12
-#define CMD_LIST_IDENTITY   0x0063
-#define ITEM_ID_IDENTITY    0x000C
-
-// EtherNet/IP Encapsulation Header (24 bytes)
-#pragma pack(push, 1)
-struct EncapsulationHeader
-{
-    WORD    command;        // Command code
-    WORD    length;         // Data length (after header)
-    DWORD   sessionHandle;  // Session handle (0 for unconnected)
-    DWORD   status;         // Status (0 for request)
-    BYTE    senderContext[8]; // Sender context (echoed in response)
-    DWORD   options;        // Options (0)
-};
-#pragma pack(pop)
-
-DriverConfig::DriverConfig()
-    : m_wsaInitialized(false)
-{
-}
-
-DriverConfig::~DriverConfig()
-{
-    CleanupWinsock();
-}
-
-bool DriverConfig::InitWinsock()
-{
-    if (m_wsaInitialized)
-        return true;
-
-    WSADATA wsaData;
-    int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (result != 0)
-    {
-        std::wcerr << L"[ERROR] WSAStartup failed: " << result << std::endl;
-        return false;
-    }
-
-    m_wsaInitialized = true;
-    return true;
-}
-
-void DriverConfig::CleanupWinsock()
-{
-    if (m_wsaInitialized)
-    {
-        WSACleanup();
-        m_wsaInitialized = false;
-    }
-}
-
 std::vector<std::wstring> DriverConfig::ReadNodeTable(const std::wstring& driverName)
 {
     std::vector<std::wstring> ips;
@@ -186,273 +133,38 @@ std::vector<CIPDevice> DriverConfig::ScanNodeTable(const std::wstring& driverNam
 
 std::vector<CIPDevice> DriverConfig::ScanIPs(const std::vector<std::wstring>& ipAddresses, DWORD timeoutMs)
 {
-    std::vector<CIPDevice> devices;
-
-    if (ipAddresses.empty())
-        return devices;
-
-    if (!InitWinsock())
-        return devices;
-
-    // Create UDP socket
-    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock == INVALID_SOCKET)
-    {
-        std::wcerr << L"[ERROR] socket() failed: " << WSAGetLastError() << std::endl;
-        return devices;
-    }
-
-    // Bind to any local address
-    sockaddr_in localAddr = {};
-    localAddr.sin_family = AF_INET;
-    localAddr.sin_addr.s_addr = INADDR_ANY;
-    localAddr.sin_port = 0;
-
-    if (bind(sock, (sockaddr*)&localAddr, sizeof(localAddr)) == SOCKET_ERROR)
-    {
-        std::wcerr << L"[ERROR] bind() failed: " << WSAGetLastError() << std::endl;
-        closesocket(sock);
-        return devices;
-    }
-
-    // Build ListIdentity request
-    EncapsulationHeader request = {};
-    request.command = CMD_LIST_IDENTITY;
-    request.length = 0;
-    request.sessionHandle = 0;
-    request.status = 0;
-    memset(request.senderContext, 0, 8);
-    request.senderContext[0] = 'R';
-    request.senderContext[1] = 'S';
-    request.options = 0;
-
-    // Send directed ListIdentity to each IP
-    std::wcout << L"[INFO] Sending CIP ListIdentity to " << ipAddresses.size()
-               << L" device(s) on port " << ENCAP_PORT << L"..." << std::endl;
-
-    int sentCount = 0;
+    std::vector<DWORD> targets;
     for (const auto& ip : ipAddresses)
     {
-        sockaddr_in destAddr = {};
-        destAddr.sin_family = AF_INET;
-        destAddr.sin_port = htons(ENCAP_PORT);
-
-        // Convert wide string IP to narrow
-        char narrowIP[64] = {};
-        WideCharToMultiByte(CP_ACP, 0, ip.c_str(), -1, narrowIP, sizeof(narrowIP), NULL, NULL);
-
-        // Use inet_pton for the conversion
-        if (inet_pton(AF_INET, narrowIP, &destAddr.sin_addr) != 1)
-        {
+        std::vector<DWORD> one;
+        std::wstring error;
+        if (IdentityScanner::ParseTargets(ip, one, error, 1))
+            targets.push_back(one[0]);
+        else
             std::wcerr << L"[WARN] Invalid IP: " << ip << std::endl;
-            continue;
-        }
-
-        int sent = sendto(sock, (char*)&request, sizeof(request), 0,
-                          (sockaddr*)&destAddr, sizeof(destAddr));
-        if (sent == SOCKET_ERROR)
-        {
-            std::wcerr << L"[WARN] sendto " << ip << L" failed: " << WSAGetLastError() << std::endl;
-            continue;
-        }
-
-        std::wcout << L"  -> " << ip << std::endl;
-        sentCount++;
     }
+    if (targets.empty())
+        return {};
 
-    std::wcout << L"[OK] Sent to " << sentCount << L" device(s), waiting for responses ("
-               << timeoutMs / 1000 << L"s timeout)..." << std::endl;
-
-    // Collect responses
-    devices = ParseResponses(sock, timeoutMs, ipAddresses.size());
-
-    closesocket(sock);
-    return devices;
-}
-
-std::vector<CIPDevice> DriverConfig::ParseResponses(SOCKET sock, DWORD timeoutMs, size_t expectedCount)
-{
-    std::vector<CIPDevice> devices;
-    BYTE buffer[4096];
-
-    auto startTime = std::chrono::steady_clock::now();
-
-    while (true)
-    {
-        auto now = std::chrono::steady_clock::now();
-        DWORD elapsed = static_cast<DWORD>(
-            std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count());
-        if (elapsed >= timeoutMs)
-            break;
-
-        // Early exit if we got all expected responses
-        if (devices.size() >= expectedCount)
-        {
-            std::wcout << L"[OK] All " << expectedCount << L" devices responded" << std::endl;
-            break;
-        }
-
-        // Set receive timeout
-        DWORD remaining = timeoutMs - elapsed;
-        DWORD recvTimeout = (remaining < 500) ? remaining : 500;
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&recvTimeout, sizeof(recvTimeout));
-
-        sockaddr_in fromAddr = {};
-        int fromLen = sizeof(fromAddr);
-
-        int received = recvfrom(sock, (char*)buffer, sizeof(buffer), 0,
-                                (sockaddr*)&fromAddr, &fromLen);
-
-        if (received == SOCKET_ERROR)
-        {
-            int err = WSAGetLastError();
-            if (err == WSAETIMEDOUT || err == WSAEWOULDBLOCK)
-                continue;
-            break;
-        }
-
-        if (received < (int)sizeof(EncapsulationHeader))
-            continue;
-
-        // Verify it's a ListIdentity response
-        EncapsulationHeader* header = (EncapsulationHeader*)buffer;
-        if (header->command != CMD_LIST_IDENTITY)
-            continue;
+    std::wcout << L"[INFO] Sending CIP ListIdentity to " << targets.size()
+               << L" device(s) on port 44818..." << std::endl;
 
-        // Parse the identity data
-        CIPDevice device;
-        device.online = true;
-        if (ParseListIdentityResponse(buffer + sizeof(EncapsulationHeader),
-                                       received - sizeof(EncapsulationHeader),
-                                       fromAddr, device))
-        {
-            // Check for duplicate
-            bool isDuplicate = false;
-            for (const auto& existing : devices)
-            {
-                if (existing.ipAddress == device.ipAddress)
-                {
-                    isDuplicate = true;
-                    break;
-                }
-            }
-
-            if (!isDuplicate)
-            {
-                devices.push_back(device);
-                std::wcout << L"  [ONLINE] " << device.ipAddress;
-                if (!device.productName.empty())
-                    std::wcout << L" - " << device.productName;
-                std::wcout << std::endl;
-            }
-        }
-    }
+    ScanOptions options;
+    options.replyTimeoutMs = timeoutMs;
+    IdentityScanner scanner;
+    std::vector<CIPDevice> devices = scanner.Scan(targets, options, [](const CIPDevice& device) {
+        std::wcout << L"  [ONLINE] " << device.ipAddress;
+        if (!device.productName.empty())
+            std::wcout << L" - " << device.productName;
+        std::wcout << std::endl;
+    });
 
+    const ScanStats& stats = scanner.Stats();
+    if (stats.responded - stats.unsolicited >= stats.targets)
+        std::wcout << L"[OK] All " << stats.targets << L" devices responded" << std::endl;
     return devices;
 }
 
-bool DriverConfig::ParseListIdentityResponse(const BYTE* data, int dataLen,
-                                             const sockaddr_in& fromAddr, CIPDevice& device)
-{
-    // Response data format (after encapsulation header):
-    // Item Count (2 bytes)
-    // For each item:
-    //   Item Type ID (2 bytes): 0x000C
-    //   Item Length (2 bytes)
-    //   Protocol Version (2 bytes)
-    //   Socket Address (16 bytes)
-    //   Vendor ID (2 bytes, little-endian)
-    //   Device Type (2 bytes, little-endian)
-    //   Product Code (2 bytes, little-endian)
-    //   Revision Major (1 byte)
-    //   Revision Minor (1 byte)
-    //   Status (2 bytes, little-endian)
-    //   Serial Number (4 bytes, little-endian)
-    //   Product Name Length (1 byte)
-    //   Product Name (variable, ASCII)
-    //   State (1 byte)
-
-    if (dataLen < 2)
-        return false;
-
-    WORD itemCount = *(WORD*)data;
-    data += 2;
-    dataLen -= 2;
-
-    if (itemCount < 1)
-        return false;
-
-    if (dataLen < 4)
-        return false;
-
-    WORD itemTypeId = *(WORD*)data;
-    WORD itemLength = *(WORD*)(data + 2);
-    data += 4;
-    dataLen -= 4;
-
-    if (itemTypeId != ITEM_ID_IDENTITY)
-        return false;
-
-    if (dataLen < itemLength || itemLength < 33)
-        return false;
-
-    // Protocol version (skip)
-    data += 2;
-
-    // Socket Address (16 bytes) - skip but extract IP
-    data += 16;
-
-    // Use the actual source IP from recvfrom
-    char ipStr[32];
-    inet_ntop(AF_INET, &fromAddr.sin_addr, ipStr, sizeof(ipStr));
-
-    wchar_t wideIp[32];
-    MultiByteToWideChar(CP_ACP, 0, ipStr, -1, wideIp, 32);
-    device.ipAddress = wideIp;
-
-    // Vendor ID
-    device.vendorId = *(WORD*)data;
-    data += 2;
-
-    // Device Type
-    device.deviceType = *(WORD*)data;
-    data += 2;
-
-    // Product Code
-    device.productCode = *(WORD*)data;
-    data += 2;
-
-    // Revision
-    device.revisionMajor = data[0];
-    device.revisionMinor = data[1];
-    data += 2;
-
-    // Status
-    device.status = *(WORD*)data;
-    data += 2;
-
-    // Serial Number
-    device.serialNumber = *(DWORD*)data;
-    data += 4;
-
-    // Product Name
-    BYTE nameLen = data[0];
-    data += 1;
-
-    if (nameLen > 0 && nameLen <= 128)
-    {
-        char nameBuffer[129] = {};
-        memcpy(nameBuffer, data, nameLen);
-        nameBuffer[nameLen] = '\0';
-
-        wchar_t wideName[129] = {};
-        MultiByteToWideChar(CP_ACP, 0, nameBuffer, -1, wideName, 129);
-        device.productName = wideName;
-    }
-
-    return true;
-}
-
 std::vector<std::wstring> DriverConfig::GetIPAddresses(const std::vector<CIPDevice>& devices)
 {
     std::vector<std::wstring> ips;
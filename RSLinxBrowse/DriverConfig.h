@@ -35,19 +35,18 @@ struct CIPDevice
     WORD status;
     DWORD serialNumber;
     bool online;  // true if device responded
+    double rttMs; // request to first reply (IdentityScanner)
 };
 
 class DriverConfig
 {
 public:
-    DriverConfig();
-    ~DriverConfig();
-
     /**
-     * Scan specific IPs for EtherNet/IP devices using directed ListIdentity.
+     * Scan specific IPs for EtherNet/IP devices using directed ListIdentity
+     * (IdentityScanner with default pacing and retries).
      *
      * @param ipAddresses  List of IP addresses to probe
-     * @param timeoutMs    How long to wait for all responses (default 5 seconds)
+     * @param timeoutMs    How long to wait for a host after its last attempt (default 5 seconds)
      * @return Vector of discovered devices (only those that responded)
      */
     std::vector<CIPDevice> ScanIPs(const std::vector<std::wstring>& ipAddresses, DWORD timeoutMs = 5000);
@@ -74,13 +73,4 @@ public:
      * Print device details to console.
      */
     static void PrintDevices(const std::vector<CIPDevice>& devices);
-
-private:
-    bool m_wsaInitialized;
-
-    bool InitWinsock();
-    void CleanupWinsock();
-
-    std::vector<CIPDevice> ParseResponses(SOCKET sock, DWORD timeoutMs, size_t expectedCount);
-    bool ParseListIdentityResponse(const BYTE* data, int dataLen, const sockaddr_in& fromAddr, CIPDevice& device);
 };
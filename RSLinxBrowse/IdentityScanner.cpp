@@ -0,0 +1,496 @@
+/**
+ * IdentityScanner.cpp
+ *
+ * Paced, retrying EtherNet/IP ListIdentity sweep over one UDP socket.
+ * Packet format follows ODVA EtherNet/IP specification.
+ */
+
+#include "IdentityScanner.h"
+#include <iostream>
+#include <chrono>
+#include <deque>
+#include <queue>
+#include <unordered_set>
+
+// EtherNet/IP constants
+#define ENCAP_PORT          44818   // 0xAF12
+#define CMD_LIST_IDENTITY   0x0063
+#define ITEM_ID_IDENTITY    0x000C
+
+// EtherNet/IP Encapsulation Header (24 bytes)
+#pragma pack(push, 1)
+struct EncapsulationHeader
+{
+    WORD    command;        // Command code
+    WORD    length;         // Data length (after header)
+    DWORD   sessionHandle;  // Session handle (0 for unconnected)
+    DWORD   status;         // Status (0 for request)
+    BYTE    senderContext[8]; // Sender context (echoed in response)
+    DWORD   options;        // Options (0)
+};
+#pragma pack(pop)
+
+// senderContext: 'R' 'S' u32 target index, u8 attempt, 0
+#define CONTEXT_TAG0  'R'
+#define CONTEXT_TAG1  'S'
+
+typedef std::chrono::steady_clock ScanClock;
+
+static long long ElapsedUs(ScanClock::time_point from, ScanClock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+IdentityScanner::IdentityScanner()
+    : m_wsaInitialized(false)
+{
+}
+
+IdentityScanner::~IdentityScanner()
+{
+    if (m_wsaInitialized)
+        WSACleanup();
+}
+
+std::wstring IdentityScanner::FormatIP(DWORD ip)
+{
+    wchar_t buf[16];
+    swprintf_s(buf, L"%u.%u.%u.%u", (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+    return buf;
+}
+
+static bool ParseIPv4(const std::wstring& s, DWORD& out)
+{
+    unsigned a, b, c, d;
+    wchar_t tail;
+    if (swscanf_s(s.c_str(), L"%u.%u.%u.%u%c", &a, &b, &c, &d, &tail, 1) != 4)
+        return false;
+    if (a > 255 || b > 255 || c > 255 || d > 255)
+        return false;
+    out = (a << 24) | (b << 16) | (c << 8) | d;
+    return true;
+}
+
+static std::wstring Trim(const std::wstring& s)
+{
+    size_t first = s.find_first_not_of(L" \t");
+    if (first == std::wstring::npos) return L"";
+    size_t last = s.find_last_not_of(L" \t");
+    return s.substr(first, last - first + 1);
+}
+
+bool IdentityScanner::ParseTargets(const std::wstring& spec, std::vector<DWORD>& out,
+                                   std::wstring& error, size_t maxHosts)
+{
+    std::unordered_set<DWORD> seen;
+    auto add = [&](DWORD ip) -> bool {
+        if (!seen.insert(ip).second) return true;
+        if (out.size() >= maxHosts)
+        {
+            error = L"more than " + std::to_wstring(maxHosts) + L" hosts";
+            return false;
+        }
+        out.push_back(ip);
+        return true;
+    };
+
+    size_t start = 0;
+    while (start <= spec.size())
+    {
+        size_t comma = spec.find(L',', start);
+        std::wstring item = Trim(spec.substr(start, comma == std::wstring::npos ? std::wstring::npos : comma - start));
+        start = (comma == std::wstring::npos) ? spec.size() + 1 : comma + 1;
+        if (item.empty()) continue;
+
+        DWORD first = 0, last = 0;
+        size_t slash = item.find(L'/');
+        size_t dash = item.find(L'-');
+        if (slash != std::wstring::npos)
+        {
+            // CIDR block
+            DWORD base;
+            int prefix = _wtoi(item.c_str() + slash + 1);
+            if (!ParseIPv4(item.substr(0, slash), base) || prefix < 8 || prefix > 32)
+            {
+                error = L"bad CIDR block '" + item + L"' (prefix /8../32)";
+                return false;
+            }
+            DWORD mask = (prefix == 32) ? 0xFFFFFFFF : ~(0xFFFFFFFFu >> prefix);
+            first = base & mask;
+            last = first | ~mask;
+            if (prefix <= 30) { first++; last--; }   // network and broadcast
+        }
+        else if (dash != std::wstring::npos)
+        {
+            // Range: a.b.c.d-a.b.c.e or a.b.c.d-e
+            std::wstring hi = item.substr(dash + 1);
+            if (!ParseIPv4(item.substr(0, dash), first))
+            {
+                error = L"bad range '" + item + L"'";
+                return false;
+            }
+            if (hi.find(L'.') == std::wstring::npos)
+            {
+                int lastOctet = _wtoi(hi.c_str());
+                if (hi.empty() || lastOctet < 0 || lastOctet > 255)
+                {
+                    error = L"bad range '" + item + L"'";
+                    return false;
+                }
+                last = (first & 0xFFFFFF00) | (DWORD)lastOctet;
+            }
+            else if (!ParseIPv4(hi, last))
+            {
+                error = L"bad range '" + item + L"'";
+                return false;
+            }
+            if (last < first)
+            {
+                error = L"range '" + item + L"' ends before it starts";
+                return false;
+            }
+        }
+        else if (!ParseIPv4(item, first))
+        {
+            error = L"bad address '" + item + L"'";
+            return false;
+        }
+        else
+        {
+            last = first;
+        }
+
+        if ((unsigned long long)last - first + 1 > maxHosts)
+        {
+            error = L"'" + item + L"' is more than " + std::to_wstring(maxHosts) + L" hosts";
+            return false;
+        }
+        for (unsigned long long ip = first; ip <= last; ip++)
+            if (!add((DWORD)ip)) return false;
+    }
+
+    if (out.empty())
+    {
+        error = L"no targets";
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+struct TargetState
+{
+    int attempts = 0;
+    bool answered = false;
+    bool expired = false;
+    ScanClock::time_point sentAt[8];   // per attempt, for the RTT of the one answered
+};
+
+// Retry or give-up timer for one target
+struct TargetTimer
+{
+    ScanClock::time_point due;
+    size_t index;
+    bool operator>(const TargetTimer& o) const { return due > o.due; }
+};
+
+}
+
+std::vector<CIPDevice> IdentityScanner::Scan(const std::vector<DWORD>& targets, const ScanOptions& options,
+                                             const DeviceCallback& onDevice)
+{
+    std::vector<CIPDevice> devices;
+    m_stats = ScanStats();
+    m_stats.targets = (int)targets.size();
+    if (targets.empty())
+        return devices;
+
+    if (!m_wsaInitialized)
+    {
+        WSADATA wsaData;
+        int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+        if (result != 0)
+        {
+            std::wcerr << L"[ERROR] WSAStartup failed: " << result << std::endl;
+            return devices;
+        }
+        m_wsaInitialized = true;
+    }
+
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET)
+    {
+        std::wcerr << L"[ERROR] socket() failed: " << WSAGetLastError() << std::endl;
+        return devices;
+    }
+
+    sockaddr_in localAddr = {};
+    localAddr.sin_family = AF_INET;
+    localAddr.sin_addr.s_addr = INADDR_ANY;
+    localAddr.sin_port = 0;
+    if (bind(sock, (sockaddr*)&localAddr, sizeof(localAddr)) == SOCKET_ERROR)
+    {
+        std::wcerr << L"[ERROR] bind() failed: " << WSAGetLastError() << std::endl;
+        closesocket(sock);
+        return devices;
+    }
+
+    // Non-blocking, with room for a burst of replies from a whole subnet
+    u_long nonBlocking = 1;
+    ioctlsocket(sock, FIONBIO, &nonBlocking);
+    int rcvBuf = 1 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&rcvBuf, sizeof(rcvBuf));
+
+    const int maxAttempts = 1 + (options.retries < 0 ? 0 : (options.retries > 7 ? 7 : options.retries));
+    const long long sendGapUs = options.ratePerSec > 0 ? 1000000LL / options.ratePerSec : 0;
+
+    std::vector<TargetState> state(targets.size());
+    std::unordered_map<DWORD, size_t> indexOf;   // network-order IP -> target
+    indexOf.reserve(targets.size() * 2);
+    for (size_t i = 0; i < targets.size(); i++)
+        indexOf.emplace(htonl(targets[i]), i);
+    std::unordered_set<DWORD> reported;          // dedup, covers unsolicited replies too
+
+    std::deque<size_t> sendQueue;
+    for (size_t i = 0; i < targets.size(); i++) sendQueue.push_back(i);
+    std::priority_queue<TargetTimer, std::vector<TargetTimer>, std::greater<TargetTimer>> timers;
+    size_t pending = targets.size();
+
+    EncapsulationHeader request = {};
+    request.command = CMD_LIST_IDENTITY;
+
+    auto startTime = ScanClock::now();
+    auto nextSend = startTime;
+    BYTE buffer[4096];
+
+    while (pending > 0)
+    {
+        auto now = ScanClock::now();
+
+        // Timers that came due: resend, or give up after the last attempt
+        while (!timers.empty() && timers.top().due <= now)
+        {
+            size_t i = timers.top().index;
+            timers.pop();
+            TargetState& t = state[i];
+            if (t.answered || t.expired) continue;
+            if (t.attempts < maxAttempts) sendQueue.push_back(i);
+            else { t.expired = true; pending--; }
+        }
+
+        // Paced sends: everything that is due, catching up after a long wait
+        while (!sendQueue.empty() && now >= nextSend)
+        {
+            size_t i = sendQueue.front();
+            sendQueue.pop_front();
+            TargetState& t = state[i];
+            if (t.answered) continue;
+
+            sockaddr_in destAddr = {};
+            destAddr.sin_family = AF_INET;
+            destAddr.sin_port = htons(ENCAP_PORT);
+            destAddr.sin_addr.s_addr = htonl(targets[i]);
+
+            DWORD index32 = (DWORD)i;
+            request.senderContext[0] = CONTEXT_TAG0;
+            request.senderContext[1] = CONTEXT_TAG1;
+            memcpy(&request.senderContext[2], &index32, 4);
+            request.senderContext[6] = (BYTE)t.attempts;
+
+            t.sentAt[t.attempts] = now;
+            t.attempts++;
+            if (sendto(sock, (char*)&request, sizeof(request), 0,
+                       (sockaddr*)&destAddr, sizeof(destAddr)) != SOCKET_ERROR)
+                m_stats.sent++;
+
+            DWORD waitMs = (t.attempts < maxAttempts)
+                ? options.retryMs << (t.attempts - 1)
+                : options.replyTimeoutMs;
+            timers.push({ now + std::chrono::milliseconds(waitMs), i });
+            nextSend = (sendGapUs > 0) ? nextSend + std::chrono::microseconds(sendGapUs) : now;
+            if (nextSend < now - std::chrono::milliseconds(50))
+                nextSend = now;   // don't burst to make up for a stall
+        }
+
+        // Sleep in WSAPoll until the next send or timer at the latest
+        auto wakeAt = now + std::chrono::milliseconds(100);
+        if (!sendQueue.empty() && nextSend < wakeAt) wakeAt = nextSend;
+        if (!timers.empty() && timers.top().due < wakeAt) wakeAt = timers.top().due;
+        long long waitUs = ElapsedUs(now, wakeAt);
+        int waitMs = waitUs <= 0 ? 0 : (int)((waitUs + 999) / 1000);
+
+        WSAPOLLFD pfd = {};
+        pfd.fd = sock;
+        pfd.events = POLLRDNORM;
+        int ready = WSAPoll(&pfd, 1, waitMs);
+        if (ready == SOCKET_ERROR)
+        {
+            std::wcerr << L"[ERROR] WSAPoll failed: " << WSAGetLastError() << std::endl;
+            break;
+        }
+        if (ready == 0 || !(pfd.revents & (POLLRDNORM | POLLERR)))
+            continue;
+
+        // Drain everything queued on the socket
+        while (true)
+        {
+            sockaddr_in fromAddr = {};
+            int fromLen = sizeof(fromAddr);
+            int received = recvfrom(sock, (char*)buffer, sizeof(buffer), 0,
+                                    (sockaddr*)&fromAddr, &fromLen);
+            if (received == SOCKET_ERROR)
+            {
+                // WSAECONNRESET: ICMP port unreachable from a closed host, keep going
+                if (WSAGetLastError() == WSAECONNRESET) continue;
+                break;
+            }
+            auto recvTime = ScanClock::now();
+
+            if (received < (int)sizeof(EncapsulationHeader))
+                continue;
+            EncapsulationHeader* header = (EncapsulationHeader*)buffer;
+            if (header->command != CMD_LIST_IDENTITY)
+                continue;
+            if (reported.count(fromAddr.sin_addr.s_addr))
+                continue;   // duplicate reply (a retry crossed the first answer)
+
+            CIPDevice device = {};
+            device.online = true;
+            if (!ParseListIdentityResponse(buffer + sizeof(EncapsulationHeader),
+                                           received - (int)sizeof(EncapsulationHeader),
+                                           fromAddr, device))
+                continue;
+            reported.insert(fromAddr.sin_addr.s_addr);
+
+            auto it = indexOf.find(fromAddr.sin_addr.s_addr);
+            if (it != indexOf.end())
+            {
+                TargetState& t = state[it->second];
+                int attempt = t.attempts - 1;
+                DWORD echoed = 0;
+                memcpy(&echoed, &header->senderContext[2], 4);
+                if (header->senderContext[0] == CONTEXT_TAG0 && echoed == (DWORD)it->second &&
+                    header->senderContext[6] < t.attempts)
+                    attempt = header->senderContext[6];
+                device.rttMs = ElapsedUs(t.sentAt[attempt], recvTime) / 1000.0;
+                if (!t.answered && !t.expired) pending--;
+                t.answered = true;
+            }
+            else
+            {
+                m_stats.unsolicited++;
+            }
+
+            m_stats.responded++;
+            devices.push_back(device);
+            if (onDevice) onDevice(device);
+        }
+    }
+
+    closesocket(sock);
+    m_stats.elapsedMs = (DWORD)(ElapsedUs(startTime, ScanClock::now()) / 1000);
+    return devices;
+}
+
+bool IdentityScanner::ParseListIdentityResponse(const BYTE* data, int dataLen,
+                                                const sockaddr_in& fromAddr, CIPDevice& device)
+{
+    // Response data format (after encapsulation header):
+    // Item Count (2 bytes)
+    // For each item:
+    //   Item Type ID (2 bytes): 0x000C
+    //   Item Length (2 bytes)
+    //   Protocol Version (2 bytes)
+    //   Socket Address (16 bytes)
+    //   Vendor ID (2 bytes, little-endian)
+    //   Device Type (2 bytes, little-endian)
+    //   Product Code (2 bytes, little-endian)
+    //   Revision Major (1 byte)
+    //   Revision Minor (1 byte)
+    //   Status (2 bytes, little-endian)
+    //   Serial Number (4 bytes, little-endian)
+    //   Product Name Length (1 byte)
+    //   Product Name (variable, ASCII)
+    //   State (1 byte)
+
+    if (dataLen < 2)
+        return false;
+
+    WORD itemCount = *(WORD*)data;
+    data += 2;
+    dataLen -= 2;
+
+    if (itemCount < 1)
+        return false;
+
+    if (dataLen < 4)
+        return false;
+
+    WORD itemTypeId = *(WORD*)data;
+    WORD itemLength = *(WORD*)(data + 2);
+    data += 4;
+    dataLen -= 4;
+
+    if (itemTypeId != ITEM_ID_IDENTITY)
+        return false;
+
+    if (dataLen < itemLength || itemLength < 33)
+        return false;
+
+    // Protocol version (skip)
+    data += 2;
+
+    // Socket Address (16 bytes) - skip but extract IP
+    data += 16;
+
+    // Use the actual source IP from recvfrom
+    char ipStr[32];
+    inet_ntop(AF_INET, &fromAddr.sin_addr, ipStr, sizeof(ipStr));
+
+    wchar_t wideIp[32];
+    MultiByteToWideChar(CP_ACP, 0, ipStr, -1, wideIp, 32);
+    device.ipAddress = wideIp;
+
+    // Vendor ID
+    device.vendorId = *(WORD*)data;
+    data += 2;
+
+    // Device Type
+    device.deviceType = *(WORD*)data;
+    data += 2;
+
+    // Product Code
+    device.productCode = *(WORD*)data;
+    data += 2;
+
+    // Revision
+    device.revisionMajor = data[0];
+    device.revisionMinor = data[1];
+    data += 2;
+
+    // Status
+    device.status = *(WORD*)data;
+    data += 2;
+
+    // Serial Number
+    device.serialNumber = *(DWORD*)data;
+    data += 4;
+
+    // Product Name (must fit in the item: 33 fixed bytes precede it)
+    BYTE nameLen = data[0];
+    data += 1;
+
+    if (nameLen > 0 && nameLen <= 128 && 33 + nameLen <= itemLength)
+    {
+        char nameBuffer[129] = {};
+        memcpy(nameBuffer, data, nameLen);
+        nameBuffer[nameLen] = '\0';
+
+        wchar_t wideName[129] = {};
+        MultiByteToWideChar(CP_ACP, 0, nameBuffer, -1, wideName, 129);
+        device.productName = wideName;
+    }
+
+    return true;
+}
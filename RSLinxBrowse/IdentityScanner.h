@@ -0,0 +1,80 @@
+/**
+ * IdentityScanner.h
+ *
+ * Concurrent EtherNet/IP ListIdentity scanner.
+ * Sends directed ListIdentity (0x0063) datagrams to a target set at a
+ * paced rate from one non-blocking UDP socket, resends to hosts that
+ * have not answered with exponential backoff, and receives with WSAPoll
+ * between sends, so replies are drained while the sweep is still going.
+ *
+ * Every device is reported through the callback the moment its first
+ * reply arrives, with the round-trip time of the request it answered
+ * (the attempt number rides in the echoed sender context).
+ *
+ * Targets: "10.0.0.5", "10.0.0.0/22", "10.0.0.10-10.0.0.60",
+ * "10.0.0.10-60", comma separated.
+ */
+
+#pragma once
+
+#include "DriverConfig.h"
+#include <functional>
+#include <unordered_map>
+
+struct ScanOptions
+{
+    int   ratePerSec = 1000;      // datagrams per second (0 = unpaced)
+    int   retries = 2;            // resends to a host that has not answered
+    DWORD retryMs = 300;          // wait before the first resend, doubled per resend
+    DWORD replyTimeoutMs = 1000;  // wait after a host's last attempt before giving up
+};
+
+struct ScanStats
+{
+    int targets = 0;
+    int sent = 0;        // datagrams, retries included
+    int responded = 0;
+    int unsolicited = 0; // replies from hosts outside the target set
+    DWORD elapsedMs = 0;
+};
+
+class IdentityScanner
+{
+public:
+    typedef std::function<void(const CIPDevice& device)> DeviceCallback;
+
+    IdentityScanner();
+    ~IdentityScanner();
+
+    /**
+     * Expand a target spec into IPv4 addresses (host byte order, in order,
+     * duplicates dropped). CIDR blocks up to /30 skip the network and
+     * broadcast addresses. At most maxHosts addresses are accepted.
+     *
+     * @return false with error set on a malformed item or too many hosts
+     */
+    static bool ParseTargets(const std::wstring& spec, std::vector<DWORD>& out,
+                             std::wstring& error, size_t maxHosts = 65536);
+
+    /**
+     * Scan the targets; onDevice runs on this thread for each responsive host.
+     *
+     * @return Responsive devices in reply order
+     */
+    std::vector<CIPDevice> Scan(const std::vector<DWORD>& targets, const ScanOptions& options,
+                                const DeviceCallback& onDevice = DeviceCallback());
+
+    const ScanStats& Stats() const { return m_stats; }
+
+    static std::wstring FormatIP(DWORD hostOrderIP);
+
+    /**
+     * Parse the data after the encapsulation header of a ListIdentity reply.
+     */
+    static bool ParseListIdentityResponse(const BYTE* data, int dataLen,
+                                          const sockaddr_in& fromAddr, CIPDevice& device);
+
+private:
+    bool m_wsaInitialized;
+    ScanStats m_stats;
+};
@@ -13,6 +13,7 @@
 #include <thread>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 
 // Helper: Try calling IOnlineEnumerator::Start() at a specific vtable slot with SEH protection
 // Must be a standalone C-style function (no C++ objects with destructors) for __try/__except
@@ -739,13 +740,16 @@ bool TopologyBrowser::BrowseDriver(const std::wstring& driverName, std::vector<s
         return false;
     }
 
-    // Step 5: Wait for devices - pump COM messages and poll XML
+    // Step 5: Wait for devices - pump COM messages until the sink reports the
+    // browse ended. Device-found and browse-ended events signal the sink's
+    // progress event; the topology XML is only read once, afterwards.
     std::wcout << L"Waiting for devices (" << timeoutMs / 1000 << L" seconds)..." << std::endl;
 
     auto startTime = std::chrono::steady_clock::now();
     DWORD elapsed = 0;
-    DWORD lastPollTime = 0;
-    const DWORD pollInterval = 5000;
+    DWORD lastReportTime = 0;
+    const DWORD reportInterval = 5000;
+    HANDLE hProgress = sinkConnected ? pSink->GetProgressEvent() : nullptr;
 
     while (elapsed < timeoutMs)
     {
@@ -762,24 +766,23 @@ bool TopologyBrowser::BrowseDriver(const std::wstring& driverName, std::vector<s
             break;
         }
 
-        if (elapsed - lastPollTime >= pollInterval)
+        if (elapsed - lastReportTime >= reportInterval)
         {
-            std::wstring pollFile = L"C:\\temp\\topology_poll.xml";
-            if (SaveTopologyXML(pollFile))
-            {
-                std::vector<std::wstring> xmlDevices = ParseDevicesFromXML(pollFile, driverName);
-                std::wcout << L"  [POLL " << elapsed / 1000 << L"s] "
-                          << xmlDevices.size() << L" device(s) in topology XML";
-                if (sinkConnected)
-                    std::wcout << L", " << pSink->GetDiscoveredDevices().size() << L" via events";
-                std::wcout << std::endl;
-                for (const auto& dev : xmlDevices)
-                    std::wcout << L"    XML device: " << dev << std::endl;
-            }
-            lastPollTime = elapsed;
+            std::wcout << L"  [WAIT " << elapsed / 1000 << L"s] ";
+            if (sinkConnected)
+                std::wcout << pSink->GetDiscoveredDevices().size() << L" device(s) via events";
+            else
+                std::wcout << L"no event sink, topology XML read at the end";
+            std::wcout << std::endl;
+            lastReportTime = elapsed;
         }
 
-        Sleep(100);
+        // Sleep until a COM call or sink event arrives, the next report is due,
+        // or the browse times out
+        DWORD wait = reportInterval - (elapsed - lastReportTime);
+        if (wait > timeoutMs - elapsed) wait = timeoutMs - elapsed;
+        MsgWaitForMultipleObjects(hProgress ? 1 : 0, hProgress ? &hProgress : nullptr,
+                                  FALSE, wait, QS_ALLINPUT);
 
         auto now = std::chrono::steady_clock::now();
         elapsed = static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count());
@@ -787,8 +790,13 @@ bool TopologyBrowser::BrowseDriver(const std::wstring& driverName, std::vector<s
 
     std::wcout << L"[OK] Browse wait complete" << std::endl;
 
-    // Step 6: Collect results
+    // Step 6: Collect results - event addresses first, then the topology XML.
+    // An XML entry ("name (address)") replaces the bare address an event
+    // reported for it; entries for addresses no event reported are appended.
     discoveredDevices = pSink->GetDiscoveredDevices();
+    std::unordered_map<std::wstring, size_t> byAddress;
+    for (size_t i = 0; i < discoveredDevices.size(); i++)
+        byAddress.emplace(discoveredDevices[i], i);
 
     std::wstring finalXml = L"C:\\temp\\topology_final.xml";
     if (SaveTopologyXML(finalXml))
@@ -796,12 +804,21 @@ bool TopologyBrowser::BrowseDriver(const std::wstring& driverName, std::vector<s
         std::vector<std::wstring> xmlDevices = ParseDevicesFromXML(finalXml, driverName);
         for (const auto& xmlDev : xmlDevices)
         {
-            bool found = false;
-            for (const auto& existing : discoveredDevices)
+            std::wstring address = xmlDev;
+            size_t open = xmlDev.rfind(L" (");
+            if (open != std::wstring::npos && xmlDev.back() == L')')
+                address = xmlDev.substr(open + 2, xmlDev.size() - open - 3);
+
+            auto it = byAddress.find(address);
+            if (it == byAddress.end())
+            {
+                byAddress.emplace(address, discoveredDevices.size());
+                discoveredDevices.push_back(xmlDev);
+            }
+            else if (discoveredDevices[it->second] == address)
             {
-                if (existing == xmlDev) { found = true; break; }
+                discoveredDevices[it->second] = xmlDev;
             }
-            if (!found) discoveredDevices.push_back(xmlDev);
         }
     }
 
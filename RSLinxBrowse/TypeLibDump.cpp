@@ -5,8 +5,16 @@
  * This reveals the exact interface definitions, method signatures, and DISPIDs
  * for RSLinx topology browsing.
  *
- * Build: cl /EHsc TypeLibDump.cpp ole32.lib oleaut32.lib
+ * Build: cl /EHsc TypeLibDump.cpp ole32.lib oleaut32.lib uuid.lib
  * Run: TypeLibDump.exe
+ *
+ * Generator mode writes RSLinxHook's ComLayout.h from the same libraries:
+ *   TypeLibDump.exe --header ..\RSLinxHook\ComLayout.h [typelib ...]
+ * The bindings are the current header's kMembers: every DISPID the hook
+ * calls is resolved by member name, every vtable slot is checked for its
+ * parameter count, with the same lookups as the hook's startup check
+ * (TypeInfoLookup.h). Nothing is written if any binding fails to resolve.
+ * Re-run after an RSLinx upgrade.
  */
 
 #ifndef WIN32_LEAN_AND_MEAN
@@ -19,9 +27,14 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <vector>
+#include <cstdio>
+#include "../RSLinxHook/ComLayout.h"
+#include "../RSLinxHook/TypeInfoLookup.h"
 
 #pragma comment(lib, "ole32.lib")
 #pragma comment(lib, "oleaut32.lib")
+#pragma comment(lib, "uuid.lib")
 
 std::wstring VarTypeToString(VARTYPE vt)
 {
@@ -246,10 +259,227 @@ void DumpTypeLib(const wchar_t* path, const wchar_t* label)
     pTypeLib->Release();
 }
 
-int wmain()
+// ============================================================
+// Generator mode (--header)
+// ============================================================
+
+// What the hook binds is the member list of the current ComLayout.h:
+// its names, interfaces, slots and parameter counts are kept, its DISPIDs
+// are looked up again. Add a binding to kMembers there, then regenerate.
+struct ResolvedBinding {
+    const ComLayout::Member* b;
+    DISPID dispid;
+    bool described;            // vtable slot: interface found in a library
+};
+
+static bool ResolveBinding(const std::vector<ITypeLib*>& libs, const ComLayout::Member& b, ResolvedBinding& r)
+{
+    r.b = &b;
+    r.dispid = DISPID_UNKNOWN;
+    r.described = false;
+
+    if (b.kind == 0)
+    {
+        int params = TypeInfoLookup::LookupSlotParams(libs.data(), (int)libs.size(), b.iid, b.slot,
+                                                      r.described);
+        if (!r.described || params == b.params) return true;   // undescribed: kept as called
+        std::wcerr << L"[ERROR] " << b.iface << L"::" << b.name << L": slot " << b.slot
+                   << L" takes " << params << L" parameter(s), expected " << b.params << std::endl;
+        return false;
+    }
+
+    bool described;
+    r.dispid = TypeInfoLookup::LookupDispMember(libs.data(), (int)libs.size(), b.iid, b.name, b.kind,
+                                                described);
+    if (r.dispid != DISPID_UNKNOWN) return true;
+    std::wcerr << L"[ERROR] " << b.iface << L"::" << b.name << L": no "
+               << (b.kind == DISPATCH_METHOD ? L"method" : L"property get")
+               << L" of that name in the type libraries" << std::endl;
+    return false;
+}
+
+static void WriteGuidLiteral(FILE* f, const GUID& g)
+{
+    fwprintf(f, L"{ 0x%08lX, 0x%04X, 0x%04X, { ", g.Data1, g.Data2, g.Data3);
+    for (int i = 0; i < 8; i++)
+        fwprintf(f, L"0x%02X%s", g.Data4[i], i < 7 ? L", " : L" } }");
+}
+
+static void WriteDispid(FILE* f, DISPID id)
+{
+    if (id >= 0x10000 || id < 0) fwprintf(f, L"0x%08lX", (unsigned long)id);
+    else fwprintf(f, L"%ld", id);
+}
+
+static const wchar_t* KindName(WORD kind)
+{
+    return (kind == DISPATCH_METHOD) ? L"DISPATCH_METHOD" : L"DISPATCH_PROPERTYGET";
+}
+
+static bool WriteLayoutHeader(const wchar_t* outPath, const std::vector<ResolvedBinding>& bindings)
+{
+    FILE* f = nullptr;
+    if (_wfopen_s(&f, outPath, L"w") != 0 || !f)
+    {
+        std::wcerr << L"[ERROR] Cannot write " << outPath << std::endl;
+        return false;
+    }
+
+    fwprintf(f,
+        L"#pragma once\n"
+        L"// ============================================================\n"
+        L"// ComLayout.h - GENERATED by TypeLibDump --header, do not edit\n"
+        L"// Regenerate after an RSLinx upgrade, against the installed type libraries:\n"
+        L"//   TypeLibDump.exe --header ..\\RSLinxHook\\ComLayout.h\n"
+        L"// DISPIDs are looked up by member name. Vtable slots are the ones the\n"
+        L"// hook calls, checked for their parameter count where a library\n"
+        L"// describes the interface. VerifyComLayout repeats both checks at hook\n"
+        L"// startup.\n"
+        L"// ============================================================\n"
+        L"\n"
+        L"#include <windows.h>\n"
+        L"#include <oleauto.h>\n"
+        L"\n"
+        L"namespace ComLayout {\n"
+        L"\n"
+        L"template <DISPID Id, WORD Kind>\n"
+        L"struct DispMember {\n"
+        L"    static constexpr DISPID id = Id;\n"
+        L"    static constexpr WORD kind = Kind;\n"
+        L"};\n"
+        L"\n"
+        L"template <int Slot>\n"
+        L"struct VtblSlot {\n"
+        L"    static constexpr int slot = Slot;\n"
+        L"};\n"
+        L"\n"
+        L"// pDisp->Invoke with the member's DISPID and invoke kind\n"
+        L"template <DISPID Id, WORD Kind>\n"
+        L"inline HRESULT Invoke(IDispatch* pDisp, DispMember<Id, Kind>, DISPPARAMS* dp, VARIANT* result,\n"
+        L"                      EXCEPINFO* excep = nullptr, UINT* argErr = nullptr)\n"
+        L"{\n"
+        L"    return pDisp->Invoke(Id, IID_NULL, LOCALE_USER_DEFAULT, Kind, dp, result, excep, argErr);\n"
+        L"}\n"
+        L"\n"
+        L"// One bound member, as VerifyComLayout checks it. An all-zero iid means\n"
+        L"// the member is searched for in every interface of the libraries.\n"
+        L"struct Member {\n"
+        L"    const wchar_t* iface;\n"
+        L"    GUID iid;\n"
+        L"    const wchar_t* name;\n"
+        L"    WORD kind;      // DISPATCH_METHOD / DISPATCH_PROPERTYGET; 0 = vtable slot\n"
+        L"    DISPID dispid;  // kind != 0\n"
+        L"    int slot;       // kind == 0\n"
+        L"    int params;     // kind == 0: parameter count at that slot\n"
+        L"};\n");
+
+    // One namespace per interface, in binding order
+    for (size_t i = 0; i < bindings.size(); i++)
+    {
+        const ComLayout::Member& b = *bindings[i].b;
+        if (i > 0 && wcscmp(bindings[i - 1].b->iface, b.iface) == 0) continue;
+
+        if (b.iid == GUID_NULL)
+            fwprintf(f, L"\nnamespace %s {    // any interface\n", b.iface);
+        else
+        {
+            wchar_t guidStr[64];
+            StringFromGUID2(b.iid, guidStr, 64);
+            fwprintf(f, L"\nnamespace %s {    // %s\n", b.iface, guidStr);
+        }
+        for (size_t j = i; j < bindings.size() && wcscmp(bindings[j].b->iface, b.iface) == 0; j++)
+        {
+            const ResolvedBinding& r = bindings[j];
+            if (r.b->kind == 0)
+            {
+                fwprintf(f, L"    constexpr VtblSlot<%d> %s{};", r.b->slot, r.b->name);
+                fputws(r.described ? L"\n" : L"    // not described by the type libraries\n", f);
+                continue;
+            }
+            fwprintf(f, L"    constexpr DispMember<");
+            WriteDispid(f, r.dispid);
+            fwprintf(f, L", %s> %s{};\n", KindName(r.b->kind), r.b->name);
+        }
+        fwprintf(f, L"}\n");
+    }
+
+    fwprintf(f, L"\nconstexpr Member kMembers[] = {\n");
+    for (const ResolvedBinding& r : bindings)
+    {
+        const ComLayout::Member& b = *r.b;
+        fwprintf(f, L"    { L\"%s\", ", b.iface);
+        WriteGuidLiteral(f, b.iid);
+        fwprintf(f, L",\n      L\"%s\", ", b.name);
+        if (b.kind == 0)
+            fwprintf(f, L"0, DISPID_UNKNOWN, %d, %d },\n", b.slot, b.params);
+        else
+        {
+            fwprintf(f, L"%s, ", KindName(b.kind));
+            WriteDispid(f, r.dispid);
+            fwprintf(f, L", -1, -1 },\n");
+        }
+    }
+    fwprintf(f, L"};\n\n} // namespace ComLayout\n");
+    fclose(f);
+    return true;
+}
+
+int GenerateLayoutHeader(const wchar_t* outPath, const std::vector<const wchar_t*>& paths)
+{
+    std::vector<ITypeLib*> libs;
+    for (const wchar_t* path : paths)
+    {
+        ITypeLib* pTypeLib = nullptr;
+        HRESULT hr = LoadTypeLib(path, &pTypeLib);
+        if (FAILED(hr))
+        {
+            std::wcerr << L"[WARN] LoadTypeLib failed: " << path
+                       << L" hr=0x" << std::hex << hr << std::dec << std::endl;
+            continue;
+        }
+        libs.push_back(pTypeLib);
+    }
+
+    std::vector<ResolvedBinding> bindings(_countof(ComLayout::kMembers));
+    int failed = 0;
+    for (size_t i = 0; i < bindings.size(); i++)
+        if (!ResolveBinding(libs, ComLayout::kMembers[i], bindings[i])) failed++;
+    for (ITypeLib* pLib : libs) pLib->Release();
+
+    if (failed)
+    {
+        std::wcerr << failed << L" binding(s) unresolved, " << outPath << L" not written" << std::endl;
+        return 1;
+    }
+    if (!WriteLayoutHeader(outPath, bindings)) return 1;
+
+    int undescribed = 0;
+    for (const ResolvedBinding& r : bindings)
+        if (r.b->kind == 0 && !r.described) undescribed++;
+    std::wcout << L"Wrote " << outPath << L": " << bindings.size() << L" binding(s)";
+    if (undescribed) std::wcout << L", " << undescribed << L" vtable slot(s) not described by the type libraries";
+    std::wcout << std::endl;
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
 {
     CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
 
+    if (argc >= 3 && wcscmp(argv[1], L"--header") == 0)
+    {
+        std::vector<const wchar_t*> paths(argv + 3, argv + argc);
+        if (paths.empty())
+        {
+            paths.push_back(L"C:\\Program Files (x86)\\Rockwell Software\\RSCommon\\RSTOP.DLL");
+            paths.push_back(L"C:\\Program Files (x86)\\Rockwell Software\\RSCommon\\RSWHO.OCX");
+            paths.push_back(L"C:\\Program Files (x86)\\Rockwell Software\\RSLinx\\LINXCOMM.DLL");
+        }
+        int rc = GenerateLayoutHeader(argv[2], paths);
+        CoUninitialize();
+        return rc;
+    }
+
     // Dump RSTOP.DLL TypeLib (Harmony Topology Services)
     DumpTypeLib(
         L"C:\\Program Files (x86)\\Rockwell Software\\RSCommon\\RSTOP.DLL",
@@ -10,6 +10,12 @@
  *               hot-load cycle, browse full topology (equivalent to --inject)
  *   --monitor:  Inject DLL and browse existing driver topology without
  *               creating or modifying drivers
+ *   --scan:     CIP ListIdentity sweep of an address range; no RSLinx needed
+ *   --prescan:  ListIdentity first; browse responsive IPs only, comms modules first
+ *   --watch:    Subscribe to query paths (W|) and stream their changes
+ *   --find:     Search the hook's cache by classname, name, IP, port or slot (F|)
+ *   --stream:   With inject/monitor: write device records (I|) as JSON Lines or CSV
+ *               as the hook identifies them
  *
  * REQUIREMENTS:
  * - Must compile for Win32 (x86) - RSLinx is 32-bit only
@@ -18,18 +24,24 @@
  */
 
 #include "DriverConfig.h"
+#include "IdentityScanner.h"
 #include "TopologyBrowser.h"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <map>
+#include <algorithm>
 #include <tlhelp32.h>
 #include <psapi.h>
+#include <io.h>
+#include <fcntl.h>
 #pragma comment(lib, "psapi.lib")
 
 // Per-driver specification from CLI
 struct DriverSpec {
     std::wstring name;
     std::vector<std::wstring> ips;
+    std::vector<std::wstring> skipIps;  // --prescan: offline hosts, sent as C|SKIP hints
 };
 
 // ============================================================
@@ -68,7 +80,8 @@ static void PipeSendLine(const std::string& line)
 
 static void PipeSendConfig(const std::vector<DriverSpec>& drivers,
     const std::vector<bool>& needsHotLoad,
-    const std::wstring& logDir, bool debugXml, bool monitorMode, bool probeDispids = false)
+    const std::wstring& logDir, bool debugXml, bool monitorMode, bool probeDispids = false,
+    bool stream = false)
 {
     PipeSendLine(monitorMode ? "C|MODE=monitor" : "C|MODE=inject");
     if (logDir != L"C:\\temp") {
@@ -78,6 +91,7 @@ static void PipeSendConfig(const std::vector<DriverSpec>& drivers,
     }
     if (debugXml) PipeSendLine("C|DEBUGXML=1");
     if (probeDispids) PipeSendLine("C|PROBE=1");
+    if (stream) PipeSendLine("C|STREAM=1");
 
     for (size_t di = 0; di < drivers.size(); di++) {
         char utf8[256];
@@ -90,6 +104,11 @@ static void PipeSendConfig(const std::vector<DriverSpec>& drivers,
             WideCharToMultiByte(CP_UTF8, 0, ip.c_str(), -1, ipUtf8, sizeof(ipUtf8), NULL, NULL);
             PipeSendLine(std::string("C|IP=") + ipUtf8);
         }
+        for (const auto& ip : drivers[di].skipIps) {
+            char ipUtf8[256];
+            WideCharToMultiByte(CP_UTF8, 0, ip.c_str(), -1, ipUtf8, sizeof(ipUtf8), NULL, NULL);
+            PipeSendLine(std::string("C|SKIP=") + ipUtf8);
+        }
     }
     PipeSendLine("C|END");
 }
@@ -109,16 +128,134 @@ static void PipeClose()
     }
 }
 
-// Read pipe messages until D|, capturing R| result into resultLine (if non-null).
-// Prints L| log lines to console. Returns true when D| received.
-static bool PipeReadUntilDone(DWORD timeoutMs, std::string* resultLine = nullptr)
+// ============================================================
+// Device Stream — C|STREAM=1 I| records, written as they arrive
+// ============================================================
+
+enum class StreamFormat { None, JsonLines, Csv };
+
+static StreamFormat g_streamFormat = StreamFormat::None;
+static FILE* g_streamOut = nullptr;     // stdout or the --out file
+static int g_streamRecords = 0;
+static DWORD g_streamStartTick = 0;
+
+static std::string JsonString(const std::string& s)
+{
+    std::string out = "\"";
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\') { out += '\\'; out += (char)ch; }
+        else if (ch < 0x20) { char esc[8]; snprintf(esc, sizeof(esc), "\\u%04x", ch); out += esc; }
+        else out += (char)ch;
+    }
+    return out + "\"";
+}
+
+static std::string CsvField(const std::string& s)
+{
+    if (s.find_first_of(",\"\r\n") == std::string::npos) return s;
+    std::string out = "\"";
+    for (char ch : s) {
+        if (ch == '"') out += '"';
+        out += ch;
+    }
+    return out + "\"";
+}
+
+/**
+ * Start the stream on outPath, or on stdout when it is empty or "-".
+ * On stdout the console text moves to stderr so the output stays
+ * machine-readable.
+ */
+static bool OpenDeviceStream(StreamFormat format, const std::wstring& outPath)
+{
+    if (outPath.empty() || outPath == L"-") {
+        _setmode(_fileno(stdout), _O_BINARY);
+        g_streamOut = stdout;
+        std::wcout.rdbuf(std::wcerr.rdbuf());
+    }
+    else {
+        g_streamOut = _wfopen(outPath.c_str(), L"wb");
+        if (!g_streamOut) {
+            std::wcerr << L"[FAIL] Cannot create stream file: " << outPath << std::endl;
+            return false;
+        }
+    }
+    g_streamFormat = format;
+    g_streamStartTick = GetTickCount();
+    if (format == StreamFormat::Csv) {
+        fputs("elapsed_ms,path,ip,port,slot,classname,name,stale\n", g_streamOut);
+        fflush(g_streamOut);
+    }
+    return true;
+}
+
+/**
+ * Write one I|ip|port|slot|classname|name[|STALE] record and flush it,
+ * so a downstream reader sees each device as soon as the hook sends it.
+ */
+static void WriteStreamRecord(const std::string& line)
+{
+    if (!g_streamOut) return;
+    std::string f[4];
+    size_t pos = 2;
+    for (int i = 0; i < 4; i++) {
+        size_t sep = line.find('|', pos);
+        if (sep == std::string::npos) return;
+        f[i] = line.substr(pos, sep - pos);
+        pos = sep + 1;
+    }
+    std::string name = line.substr(pos);
+    bool stale = name.size() >= 6 && name.compare(name.size() - 6, 6, "|STALE") == 0;
+    if (stale) name.erase(name.size() - 6);
+
+    const std::string& ip = f[0];
+    const std::string& port = f[1];
+    int slot = atoi(f[2].c_str());
+    std::string path = (slot < 0) ? ip : ip + "\\" + port + "\\" + f[2];
+    DWORD elapsedMs = GetTickCount() - g_streamStartTick;
+
+    std::string out;
+    if (g_streamFormat == StreamFormat::Csv) {
+        out = std::to_string(elapsedMs) + "," + CsvField(path) + "," + CsvField(ip) + "," +
+              CsvField(port) + "," + (slot < 0 ? "" : f[2]) + "," + CsvField(f[3]) + "," +
+              CsvField(name) + "," + (stale ? "1" : "0") + "\n";
+    }
+    else {
+        out = "{\"elapsed_ms\":" + std::to_string(elapsedMs) +
+              ",\"path\":" + JsonString(path) + ",\"ip\":" + JsonString(ip) +
+              ",\"port\":" + (slot < 0 ? std::string("null") : JsonString(port)) +
+              ",\"slot\":" + (slot < 0 ? std::string("null") : f[2]) +
+              ",\"classname\":" + JsonString(f[3]) + ",\"name\":" + JsonString(name) +
+              ",\"stale\":" + (stale ? "true" : "false") + "}\n";
+    }
+    fwrite(out.data(), 1, out.size(), g_streamOut);
+    fflush(g_streamOut);
+    g_streamRecords++;
+}
+
+static void CloseDeviceStream()
+{
+    if (!g_streamOut) return;
+    if (g_streamOut != stdout) fclose(g_streamOut);
+    g_streamOut = nullptr;
+    std::wcerr << L"[OK] " << g_streamRecords << L" device record(s) streamed" << std::endl;
+}
+
+// Read pipe messages until D| (or an H| ping answer), capturing R| result
+// (or the H| line) into resultLine (if non-null)
+// and every R| line into resultLines (QB| batches, if non-null).
+// Prints L| log lines to console and writes I| records to the device
+// stream. Returns true when D| received.
+static bool PipeReadUntilDone(DWORD timeoutMs, std::string* resultLine = nullptr,
+                              std::vector<std::string>* resultLines = nullptr)
 {
     // Use WriteConsoleW for Unicode-safe output (wcout breaks on em dashes etc.)
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    HANDLE hOut = GetStdHandle(g_streamOut == stdout ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
 
     std::string accumulated;
     char buf[4096];
     DWORD startTick = GetTickCount();
+    DWORD idleSleep = 1;
 
     while (true) {
         DWORD elapsed = GetTickCount() - startTick;
@@ -133,9 +270,12 @@ static bool PipeReadUntilDone(DWORD timeoutMs, std::string* resultLine = nullptr
         }
 
         if (bytesAvail == 0) {
-            Sleep(100);
+            // Short waits first: a resident hook's answer is usually a few ms away
+            Sleep(idleSleep);
+            if (idleSleep < 100) idleSleep *= 2;
             continue;
         }
+        idleSleep = 1;
 
         DWORD toRead = bytesAvail < (DWORD)(sizeof(buf) - 1) ? bytesAvail : (DWORD)(sizeof(buf) - 1);
         DWORD bytesRead = 0;
@@ -169,6 +309,14 @@ static bool PipeReadUntilDone(DWORD timeoutMs, std::string* resultLine = nullptr
             }
             else if (line.length() >= 2 && line[0] == 'R' && line[1] == '|') {
                 if (resultLine) *resultLine = line;
+                if (resultLines) resultLines->push_back(line);
+            }
+            else if (line.length() >= 2 && line[0] == 'I' && line[1] == '|') {
+                WriteStreamRecord(line);
+            }
+            else if (line.length() >= 2 && line[0] == 'H' && line[1] == '|') {
+                if (resultLine) *resultLine = line;
+                return true; // attach ping answered (no D| follows it)
             }
             else if (line.length() >= 2 && line[0] == 'D' && line[1] == '|') {
                 return true; // done
@@ -203,6 +351,10 @@ void PrintHeader(const std::wstring& title)
 // DLL Injection into rslinx.exe
 // ============================================================
 
+/**
+ * PID of the first process whose image name matches, ignoring case
+ * (one Toolhelp snapshot), or 0.
+ */
 static DWORD FindProcessByName(const wchar_t* processName)
 {
     HANDLE hSnap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
@@ -644,7 +796,10 @@ static int RunInjectMode(const std::vector<DriverSpec>& drivers, const std::wstr
     bool anyNeedsHotLoad = false;
     for (size_t di = 0; di < drivers.size(); di++)
     {
-        int createResult = CreateDriverRegistry(drivers[di].name, drivers[di].ips);
+        // Offline hosts stay in the Node Table; only the browse skips them
+        std::vector<std::wstring> nodeIPs = drivers[di].ips;
+        nodeIPs.insert(nodeIPs.end(), drivers[di].skipIps.begin(), drivers[di].skipIps.end());
+        int createResult = CreateDriverRegistry(drivers[di].name, nodeIPs);
         if (createResult == 0)
         {
             std::wcerr << L"[WARN] Could not create driver '" << drivers[di].name
@@ -661,8 +816,6 @@ static int RunInjectMode(const std::vector<DriverSpec>& drivers, const std::wstr
 
     // Step 1: Find rslinx.exe
     DWORD rslinxPid = FindProcessByName(L"RSLinx.exe");
-    if (rslinxPid == 0) rslinxPid = FindProcessByName(L"RSLINX.EXE");
-    if (rslinxPid == 0) rslinxPid = FindProcessByName(L"rslinx.exe");
     if (rslinxPid == 0)
     {
         std::wcerr << L"[FAIL] RSLinx.exe not found. Is it running?" << std::endl;
@@ -728,7 +881,8 @@ static int RunInjectMode(const std::vector<DriverSpec>& drivers, const std::wstr
         DeleteFileW(LogPath(logDir, L"hook_results.txt").c_str());
         DeleteFileW(LogPath(logDir, L"hook_log.txt").c_str());
     }
-    PipeSendConfig(drivers, driverNeedsHotLoad, logDir, debugXml, false, probeDispids);
+    PipeSendConfig(drivers, driverNeedsHotLoad, logDir, debugXml, false, probeDispids,
+                   g_streamFormat != StreamFormat::None);
     std::wcout << L"[OK] Config sent via pipe" << std::endl;
 
     // Step 8: Read pipe messages (log lines streamed to console in real-time)
@@ -753,6 +907,7 @@ static int RunInjectMode(const std::vector<DriverSpec>& drivers, const std::wstr
         std::wstring line;
         while (std::getline(resultFile, line))
         {
+            if (line.compare(0, 5, L"PERF:") == 0) continue;   // timing tables, for tooling
             std::wcout << L"  " << line << std::endl;
             if (line.find(L"DEVICES_IDENTIFIED:") != std::wstring::npos)
                 totalIdentified += _wtoi(line.substr(line.find(L':') + 1).c_str());
@@ -941,8 +1096,6 @@ static int RunMonitorMode(const std::vector<DriverSpec>& drivers, const std::wst
 
     // Step 1: Find RSLinx
     DWORD rslinxPid = FindProcessByName(L"RSLinx.exe");
-    if (rslinxPid == 0) rslinxPid = FindProcessByName(L"RSLINX.EXE");
-    if (rslinxPid == 0) rslinxPid = FindProcessByName(L"rslinx.exe");
     if (rslinxPid == 0)
     {
         std::wcerr << L"[FAIL] RSLinx.exe not found. Is it running?" << std::endl;
@@ -1003,7 +1156,8 @@ static int RunMonitorMode(const std::vector<DriverSpec>& drivers, const std::wst
         DeleteFileW(LogPath(logDir, L"hook_log.txt").c_str());
     }
     std::vector<bool> noHotLoad(drivers.size(), false);
-    PipeSendConfig(drivers, noHotLoad, logDir, debugXml, false, probeDispids);
+    PipeSendConfig(drivers, noHotLoad, logDir, debugXml, false, probeDispids,
+                   g_streamFormat != StreamFormat::None);
     std::wcout << L"[OK] Config sent via pipe" << std::endl;
 
     // Step 8: Read pipe messages (log lines streamed to console in real-time)
@@ -1072,56 +1226,75 @@ static int RunMonitorMode(const std::vector<DriverSpec>& drivers, const std::wst
 // Query Mode — connect to running hook, send Q|path, print R|
 // ============================================================
 
-static int RunQueryMode(const std::wstring& queryPath, const std::wstring& logDir)
+/**
+ * Attach for queries. A resident hook gets an H| ping, answered at once:
+ * READY makes this a query-only session with no browse and no initial
+ * D|. A cold hook, or one injected here, gets the config handshake and
+ * is waited for until its D|. Shared by the modes that only send queries.
+ */
+static bool ConnectForQueries(bool walk, bool swr = false)
 {
-    PrintHeader(L"RSLinx Hook Query Mode");
-
-    // Find RSLinxHook.dll path
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileNameW(NULL, exePath, MAX_PATH);
-    std::wstring dllPath(exePath);
-    size_t lastSlash = dllPath.rfind(L'\\');
-    if (lastSlash != std::wstring::npos) dllPath = dllPath.substr(0, lastSlash + 1);
-    dllPath += L"RSLinxHook.dll";
-
-    // Try to connect; inject if not already running
-    std::wcout << L"[INFO] Connecting to hook..." << std::endl;
+    // Connect to hook
     bool alreadyLoaded = TryConnectToPipe(500);
     if (!alreadyLoaded)
     {
+        // Find RSLinxHook.dll path
+        wchar_t exePath[MAX_PATH];
+        GetModuleFileNameW(NULL, exePath, MAX_PATH);
+        std::wstring dllPath(exePath);
+        size_t lastSlash = dllPath.rfind(L'\\');
+        if (lastSlash != std::wstring::npos) dllPath = dllPath.substr(0, lastSlash + 1);
+        dllPath += L"RSLinxHook.dll";
+
         DWORD rslinxPid = FindProcessByName(L"RSLinx.exe");
-        if (rslinxPid == 0) rslinxPid = FindProcessByName(L"RSLINX.EXE");
-        if (rslinxPid == 0) rslinxPid = FindProcessByName(L"rslinx.exe");
         if (rslinxPid == 0)
         {
             std::wcerr << L"[FAIL] RSLinx.exe not found" << std::endl;
-            return 1;
+            return false;
         }
         if (!InjectDLL(rslinxPid, dllPath))
         {
             std::wcerr << L"[FAIL] DLL injection failed" << std::endl;
-            return 1;
+            return false;
         }
         if (!TryConnectToPipe(10000))
         {
             std::wcerr << L"[FAIL] Hook pipe did not appear within 10s" << std::endl;
-            return 1;
+            return false;
         }
-        // Fresh inject: send minimal config so hook initialises but skips browse
-        PipeSendLine("C|MODE=inject");
-        PipeSendLine("C|DRIVER=Test");
-        PipeSendLine("C|END");
+    }
+    if (walk) PipeSendLine("C|WALK=1");
+    if (swr) PipeSendLine("C|SWR=1");
+
+    if (alreadyLoaded)
+    {
+        PipeSendLine("H|");
+        std::string hello;
+        if (PipeReadUntilDone(5000, &hello) && hello.compare(0, 2, "H|") == 0 &&
+            hello.find("|READY|") != std::string::npos)
+            return true;
+        // COLD: the hook is reading the rest of the config
     }
     else
     {
-        // Already running: still need to send C|END so HandleSession exits ReadConfigFromPipe
-        PipeSendLine("C|END");
+        // Fresh inject: minimal config so the hook initialises
+        PipeSendLine("C|MODE=inject");
+        PipeSendLine("C|DRIVER=Test");
     }
-    std::wcout << L"[OK] Connected" << std::endl;
+    PipeSendLine("C|END");
 
     // Wait for D| (end of initial browse or skip)
-    std::wcout << L"[INFO] Waiting for browse to complete..." << std::endl;
-    PipeReadUntilDone(300000);
+    return PipeReadUntilDone(300000);
+}
+
+static int RunQueryMode(const std::wstring& queryPath, const std::wstring& logDir, bool walk, bool swr)
+{
+    PrintHeader(L"RSLinx Hook Query Mode");
+
+    // Attach (injecting if not already running)
+    std::wcout << L"[INFO] Connecting to hook..." << std::endl;
+    if (!ConnectForQueries(walk, swr)) return 1;
+    std::wcout << L"[OK] Connected" << std::endl;
 
     // Send query command (convert wide path to UTF-8)
     char queryA[512] = {};
@@ -1160,16 +1333,18 @@ static int RunQueryMode(const std::wstring& queryPath, const std::wstring& logDi
     }
     else
     {
-        std::wcout << L"[NOTFOUND] " << queryPath << std::endl;
+        // C|SWR=1: the hook is browsing for it; the next query sees the result
+        bool pending = resultLine.size() >= 8 && resultLine.compare(resultLine.size() - 8, 8, "|PENDING") == 0;
+        std::wcout << L"[NOTFOUND] " << queryPath << (pending ? L" (refresh pending)" : L"") << std::endl;
         return 1;
     }
 }
 
 // ============================================================
-// Batch Query Mode — connect once, send multiple Q| commands, print all R| results
+// Batch Query Mode — connect once, send all paths as one QB| batch, print all R| results
 // ============================================================
 
-static int RunBatchQueryMode(const std::wstring& queryFile, const std::wstring& logDir)
+static int RunBatchQueryMode(const std::wstring& queryFile, const std::wstring& logDir, bool walk, bool swr)
 {
     // Read query paths from file (one per line)
     std::vector<std::wstring> queries;
@@ -1193,72 +1368,52 @@ static int RunBatchQueryMode(const std::wstring& queryFile, const std::wstring&
         return 1;
     }
 
-    // Find RSLinxHook.dll path
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileNameW(NULL, exePath, MAX_PATH);
-    std::wstring dllPath(exePath);
-    size_t lastSlash = dllPath.rfind(L'\\');
-    if (lastSlash != std::wstring::npos) dllPath = dllPath.substr(0, lastSlash + 1);
-    dllPath += L"RSLinxHook.dll";
+    // Attach (injecting if not already running)
+    if (!ConnectForQueries(walk, swr)) return 1;
 
-    // Connect to hook
-    bool alreadyLoaded = TryConnectToPipe(500);
-    if (!alreadyLoaded)
+    // Send every query as one QB| batch: the hook runs the browses the
+    // misses need once and answers with R|<id>|... lines, then one D|
+    std::string batch = "QB|BEGIN\n";
+    for (size_t qi = 0; qi < queries.size(); qi++)
     {
-        DWORD rslinxPid = FindProcessByName(L"RSLinx.exe");
-        if (rslinxPid == 0) rslinxPid = FindProcessByName(L"RSLINX.EXE");
-        if (rslinxPid == 0) rslinxPid = FindProcessByName(L"rslinx.exe");
-        if (rslinxPid == 0)
-        {
-            std::wcerr << L"[FAIL] RSLinx.exe not found" << std::endl;
-            return 1;
-        }
-        if (!InjectDLL(rslinxPid, dllPath))
-        {
-            std::wcerr << L"[FAIL] DLL injection failed" << std::endl;
-            return 1;
-        }
-        if (!TryConnectToPipe(10000))
-        {
-            std::wcerr << L"[FAIL] Hook pipe did not appear within 10s" << std::endl;
-            return 1;
-        }
-        PipeSendLine("C|MODE=inject");
-        PipeSendLine("C|DRIVER=Test");
-        PipeSendLine("C|END");
+        char queryA[512] = {};
+        WideCharToMultiByte(CP_UTF8, 0, queries[qi].c_str(), -1, queryA, sizeof(queryA), NULL, NULL);
+        batch += "QB|" + std::to_string(qi) + "|" + queryA + "\n";
     }
-    else
+    batch += "QB|END";
+    PipeSendLine(batch);
+
+    std::vector<std::string> resultLines;
+    PipeReadUntilDone(600000, nullptr, &resultLines);
+
+    // R|<id>|FOUND|classname|deviceName|ip|slot or R|<id>|NOTFOUND|path
+    std::vector<std::string> results(queries.size());
+    for (const auto& r : resultLines)
     {
-        PipeSendLine("C|END");
+        size_t sep = r.find('|', 2);
+        if (sep == std::string::npos) continue;
+        size_t id = (size_t)strtoul(r.c_str() + 2, nullptr, 10);
+        if (id < results.size()) results[id] = r.substr(sep + 1);
     }
 
-    // Wait for D| (end of initial browse or skip)
-    PipeReadUntilDone(300000);
-
-    // Send all queries and collect results
     int failures = 0;
-    for (const auto& qPath : queries)
+    for (size_t qi = 0; qi < queries.size(); qi++)
     {
-        char queryA[512] = {};
-        WideCharToMultiByte(CP_UTF8, 0, qPath.c_str(), -1, queryA, sizeof(queryA), NULL, NULL);
-        PipeSendLine(std::string("Q|") + queryA);
-
-        std::string resultLine;
-        PipeReadUntilDone(60000, &resultLine);
-
-        if (resultLine.length() > 2 && resultLine.substr(2, 5) == "FOUND")
+        if (results[qi].compare(0, 6, "FOUND|") == 0)
         {
-            int wlen = MultiByteToWideChar(CP_UTF8, 0, resultLine.c_str(), -1, NULL, 0);
+            int wlen = MultiByteToWideChar(CP_UTF8, 0, results[qi].c_str(), -1, NULL, 0);
             if (wlen > 0)
             {
                 std::wstring wline(wlen - 1, 0);
-                MultiByteToWideChar(CP_UTF8, 0, resultLine.c_str(), -1, &wline[0], wlen);
-                std::wcout << L"[FOUND] " << wline.substr(2) << std::endl;
+                MultiByteToWideChar(CP_UTF8, 0, results[qi].c_str(), -1, &wline[0], wlen);
+                std::wcout << L"[FOUND] " << wline << std::endl;
             }
         }
         else
         {
-            std::wcout << L"[NOTFOUND] " << qPath << std::endl;
+            const std::string& r = results[qi];
+            bool pending = r.size() >= 8 && r.compare(r.size() - 8, 8, "|PENDING") == 0;
+            std::wcout << L"[NOTFOUND] " << queries[qi] << (pending ? L" (refresh pending)" : L"") << std::endl;
             failures++;
         }
     }
@@ -1269,6 +1424,314 @@ static int RunBatchQueryMode(const std::wstring& queryFile, const std::wstring&
     return failures > 0 ? 1 : 0;
 }
 
+
+// ============================================================
+// Find Mode — one F| over the hook's cache indexes, print every match
+// ============================================================
+
+/**
+ * Send F|<expr> (class=, name=, ip=, port=, slot= terms joined by '|',
+ * '*' and '?' wildcards; a bare term is a classname) and print each
+ * R|FOUND line. Only what the hook has cached is searched. Exit code 0
+ * if anything matched.
+ */
+static int RunFindMode(const std::wstring& findExpr)
+{
+    if (!ConnectForQueries(false)) return 1;
+
+    char exprA[512] = {};
+    WideCharToMultiByte(CP_UTF8, 0, findExpr.c_str(), -1, exprA, sizeof(exprA), NULL, NULL);
+    PipeSendLine(std::string("F|") + exprA);
+
+    std::vector<std::string> resultLines;
+    PipeReadUntilDone(60000, nullptr, &resultLines);
+    PipeSendStop();
+    PipeClose();
+
+    int matches = 0;
+    for (const auto& r : resultLines)
+    {
+        if (r.compare(0, 8, "R|FOUND|") != 0) continue;
+        int wlen = MultiByteToWideChar(CP_UTF8, 0, r.c_str() + 8, -1, NULL, 0);
+        if (wlen <= 0) continue;
+        std::wstring wline(wlen - 1, 0);
+        MultiByteToWideChar(CP_UTF8, 0, r.c_str() + 8, -1, &wline[0], wlen);
+        std::wcout << L"[FOUND] " << wline << std::endl;
+        matches++;
+    }
+    std::wcout << matches << L" match(es) for " << findExpr << std::endl;
+    return matches > 0 ? 0 : 1;
+}
+
+// ============================================================
+// Watch Mode — connect once, W| every path, stream R| changes until Ctrl+C
+// ============================================================
+
+static volatile bool g_watchStop = false;
+
+static BOOL WINAPI WatchCtrlHandler(DWORD ctrlType)
+{
+    if (ctrlType != CTRL_C_EVENT && ctrlType != CTRL_BREAK_EVENT) return FALSE;
+    g_watchStop = true;
+    return TRUE;
+}
+
+/**
+ * Print one watch update: R|<id>|FOUND|classname|deviceName|ip|slot[|STALE]
+ * or R|<id>|NOTFOUND|path, prefixed with the local time.
+ */
+static void PrintWatchResult(const std::string& line, const std::vector<std::wstring>& paths)
+{
+    size_t sep = line.find('|', 2);
+    if (sep == std::string::npos) return;
+    size_t id = (size_t)strtoul(line.c_str() + 2, nullptr, 10);
+    if (id >= paths.size()) return;
+    std::string body = line.substr(sep + 1);
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    wchar_t stamp[16];
+    swprintf_s(stamp, L"%02u:%02u:%02u", st.wHour, st.wMinute, st.wSecond);
+
+    if (body.compare(0, 6, "FOUND|") == 0)
+    {
+        int wlen = MultiByteToWideChar(CP_UTF8, 0, body.c_str() + 6, -1, NULL, 0);
+        if (wlen <= 0) return;
+        std::wstring wbody(wlen - 1, 0);
+        MultiByteToWideChar(CP_UTF8, 0, body.c_str() + 6, -1, &wbody[0], wlen);
+        std::wcout << stamp << L" [FOUND] " << paths[id] << L" = " << wbody << std::endl;
+    }
+    else
+    {
+        std::wcout << stamp << L" [NOTFOUND] " << paths[id] << std::endl;
+    }
+}
+
+// W| lines per write while registering (see RunWatchMode)
+#define WATCH_SEND_CHUNK 64
+
+/**
+ * Read what the hook has sent (waiting up to 100 ms for it), print R|
+ * lines and skip the rest; L| lines are the hook's log. Returns the
+ * number of D| lines seen, or -1 once the pipe is gone.
+ */
+static int ReadWatchLines(std::string& accumulated, const std::vector<std::wstring>& paths)
+{
+    DWORD bytesAvail = 0;
+    if (!PeekNamedPipe(g_hPipeServer, NULL, 0, NULL, &bytesAvail, NULL)) return -1;
+    if (bytesAvail == 0)
+    {
+        Sleep(100);
+        return 0;
+    }
+    char buf[4096];
+    DWORD toRead = bytesAvail < (DWORD)sizeof(buf) ? bytesAvail : (DWORD)sizeof(buf);
+    DWORD bytesRead = 0;
+    if (!ReadFile(g_hPipeServer, buf, toRead, &bytesRead, NULL) || bytesRead == 0) return -1;
+    accumulated.append(buf, bytesRead);
+
+    int done = 0;
+    size_t pos;
+    while ((pos = accumulated.find('\n')) != std::string::npos)
+    {
+        std::string line = accumulated.substr(0, pos);
+        accumulated.erase(0, pos + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.length() >= 2 && line[0] == 'R' && line[1] == '|')
+            PrintWatchResult(line, paths);
+        else if (line.length() >= 2 && line[0] == 'D' && line[1] == '|')
+            done++;
+    }
+    return done;
+}
+
+/**
+ * Long-lived replacement for polling --query: every path in watchArg (a
+ * file of paths, one per line, or a single path) is sent as W|<id>|path.
+ * The hook answers each once and afterwards pushes an R| line only when
+ * a refresh changes that entry. Runs until Ctrl+C or the hook goes away.
+ */
+static int RunWatchMode(const std::wstring& watchArg, const std::wstring& logDir, bool walk)
+{
+    std::vector<std::wstring> paths;
+    std::wifstream wf(watchArg.c_str());
+    if (wf.is_open())
+    {
+        std::wstring line;
+        while (std::getline(wf, line))
+        {
+            if (!line.empty() && line.back() == L'\r') line.pop_back();
+            if (!line.empty()) paths.push_back(line);
+        }
+        wf.close();
+    }
+    else
+    {
+        paths.push_back(watchArg);
+    }
+    if (paths.empty())
+    {
+        std::wcerr << L"[FAIL] No paths to watch" << std::endl;
+        return 1;
+    }
+
+    if (!ConnectForQueries(walk)) return 1;
+
+    // W| lines go out a chunk at a time and each chunk's answers (R| and
+    // D| per path) are read before the next: the hook drops a client that
+    // leaves its replies unread for too long
+    SetConsoleCtrlHandler(WatchCtrlHandler, TRUE);
+    std::string accumulated;
+    bool connected = true;
+    for (size_t wi = 0; wi < paths.size() && connected && !g_watchStop; )
+    {
+        std::string chunk;
+        int sent = 0;
+        for (; wi < paths.size() && sent < WATCH_SEND_CHUNK; wi++, sent++)
+        {
+            char pathA[512] = {};
+            WideCharToMultiByte(CP_UTF8, 0, paths[wi].c_str(), -1, pathA, sizeof(pathA), NULL, NULL);
+            if (sent) chunk += "\n";
+            chunk += "W|" + std::to_string(wi) + "|" + pathA;
+        }
+        PipeSendLine(chunk);
+        for (int done = 0; done < sent && connected && !g_watchStop; )
+        {
+            int n = ReadWatchLines(accumulated, paths);
+            if (n < 0) connected = false;
+            else done += n;
+        }
+    }
+    if (connected && !g_watchStop)
+        std::wcout << L"[INFO] Watching " << paths.size() << L" path(s), Ctrl+C to stop" << std::endl;
+
+    // From here every R| line is a pushed change
+    while (connected && !g_watchStop)
+        connected = ReadWatchLines(accumulated, paths) >= 0;
+    if (!connected)
+        std::wcerr << L"[FAIL] Hook disconnected" << std::endl;
+    SetConsoleCtrlHandler(WatchCtrlHandler, FALSE);
+
+    PipeSendStop();
+    PipeClose();
+    return 0;
+}
+
+/**
+ * Browse order for a responsive host: communication modules (1756-EN2T and
+ * friends) first, then controllers, then everything else. These are the
+ * hosts with a backplane behind them, so their chassis browse starts early.
+ */
+static int BrowsePriority(const CIPDevice& dev)
+{
+    switch (dev.deviceType)
+    {
+    case 0x0C: return 0;  // Communications Adapter
+    case 0x0E: return 1;  // Programmable Logic Controller
+    default:   return 2;
+    }
+}
+
+/**
+ * ListIdentity pre-scan of every driver's IPs (--prescan). Responsive hosts
+ * stay in ips, reordered by BrowsePriority; hosts that never answer move to
+ * skipIps. Entries that are not IPv4 addresses are left alone. If nothing
+ * answers at all (UDP filtered, scan failed) the drivers are not touched.
+ */
+static void PrescanDrivers(std::vector<DriverSpec>& drivers, const ScanOptions& options)
+{
+    std::vector<DWORD> targets;
+    for (const auto& drv : drivers)
+        for (const auto& ip : drv.ips)
+        {
+            std::vector<DWORD> one;
+            std::wstring error;
+            if (IdentityScanner::ParseTargets(ip, one, error, 1))
+                targets.push_back(one[0]);
+        }
+    if (targets.empty()) return;
+
+    std::wcout << L"[INFO] Pre-scanning " << targets.size() << L" IP(s) with ListIdentity..." << std::endl;
+    IdentityScanner scanner;
+    std::vector<CIPDevice> found = scanner.Scan(targets, options);
+    if (found.empty())
+    {
+        std::wcerr << L"[WARN] Pre-scan: no device responded, browsing every IP" << std::endl;
+        return;
+    }
+
+    std::map<std::wstring, CIPDevice> byIP;
+    for (const auto& dev : found)
+        byIP[dev.ipAddress] = dev;
+
+    for (auto& drv : drivers)
+    {
+        std::vector<std::wstring> online, other;
+        for (const auto& ip : drv.ips)
+        {
+            std::vector<DWORD> one;
+            std::wstring error;
+            if (!IdentityScanner::ParseTargets(ip, one, error, 1))
+                other.push_back(ip);
+            else if (byIP.count(IdentityScanner::FormatIP(one[0])))
+                online.push_back(IdentityScanner::FormatIP(one[0]));
+            else
+                drv.skipIps.push_back(ip);
+        }
+        std::stable_sort(online.begin(), online.end(),
+            [&](const std::wstring& a, const std::wstring& b) {
+                return BrowsePriority(byIP[a]) < BrowsePriority(byIP[b]);
+            });
+        online.insert(online.end(), other.begin(), other.end());
+        drv.ips = online;
+
+        std::wcout << L"  [" << drv.name << L"] " << drv.ips.size() << L" online, "
+                   << drv.skipIps.size() << L" offline (skipped)" << std::endl;
+        for (const auto& ip : drv.ips)
+        {
+            auto it = byIP.find(ip);
+            if (it != byIP.end())
+                std::wcout << L"    " << ip << L" - " << it->second.productName << std::endl;
+        }
+    }
+    std::wcout << L"[OK] Pre-scan done in " << scanner.Stats().elapsedMs << L" ms" << std::endl;
+}
+
+/**
+ * Sweep a target spec with ListIdentity and list the devices that answer,
+ * each printed as its reply arrives. Does not touch RSLinx.
+ *
+ * @return 0 if any device responded
+ */
+static int RunScanMode(const std::wstring& spec, const ScanOptions& options)
+{
+    std::vector<DWORD> targets;
+    std::wstring error;
+    if (!IdentityScanner::ParseTargets(spec, targets, error))
+    {
+        std::wcerr << L"[FAIL] " << error << std::endl;
+        return 1;
+    }
+
+    std::wcout << L"Scanning " << targets.size() << L" hosts (" << options.ratePerSec
+               << L"/s, " << options.retries << L" retries)" << std::endl;
+
+    IdentityScanner scanner;
+    scanner.Scan(targets, options, [](const CIPDevice& dev) {
+        std::wcout << L"[ONLINE] " << std::left << std::setw(15) << dev.ipAddress << std::right
+                   << L"  " << std::fixed << std::setprecision(1) << std::setw(7) << dev.rttMs
+                   << L" ms  " << dev.productName << std::endl;
+    });
+
+    const ScanStats& stats = scanner.Stats();
+    std::wcout << L"Responded: " << stats.responded << L"/" << stats.targets
+               << L"  sent: " << stats.sent
+               << L"  unsolicited: " << stats.unsolicited
+               << L"  elapsed: " << stats.elapsedMs << L" ms" << std::endl;
+
+    return stats.responded > 0 ? 0 : 1;
+}
+
 int wmain(int argc, wchar_t* argv[])
 {
     SetConsoleOutputCP(CP_UTF8);
@@ -1278,8 +1741,17 @@ int wmain(int argc, wchar_t* argv[])
     std::wstring logDir = L"C:\\temp";
     bool debugXml = false;
     bool probeDispids = false;
+    bool walkTopology = false;
+    bool staleWhileRevalidate = false;
     std::wstring queryPath;
     std::wstring batchQueryFile;
+    std::wstring watchArg;
+    std::wstring findExpr;
+    std::wstring scanSpec;
+    ScanOptions scanOptions;
+    bool prescan = false;
+    std::wstring streamArg;
+    std::wstring streamOutPath;
 
     // Parse arguments — --driver pushes a new entry, --ip appends to the last driver
     int posArg = 0;
@@ -1297,6 +1769,42 @@ int wmain(int argc, wchar_t* argv[])
         {
             batchQueryFile = argv[++i];
         }
+        else if ((_wcsicmp(argv[i], L"--watch") == 0 || _wcsicmp(argv[i], L"-watch") == 0) && i + 1 < argc)
+        {
+            watchArg = argv[++i];
+        }
+        else if ((_wcsicmp(argv[i], L"--find") == 0 || _wcsicmp(argv[i], L"-find") == 0) && i + 1 < argc)
+        {
+            findExpr = argv[++i];
+        }
+        else if ((_wcsicmp(argv[i], L"--stream") == 0 || _wcsicmp(argv[i], L"-stream") == 0) && i + 1 < argc)
+        {
+            streamArg = argv[++i];
+        }
+        else if ((_wcsicmp(argv[i], L"--out") == 0 || _wcsicmp(argv[i], L"-out") == 0) && i + 1 < argc)
+        {
+            streamOutPath = argv[++i];
+        }
+        else if ((_wcsicmp(argv[i], L"--scan") == 0 || _wcsicmp(argv[i], L"-scan") == 0) && i + 1 < argc)
+        {
+            scanSpec = argv[++i];
+        }
+        else if (_wcsicmp(argv[i], L"--prescan") == 0 || _wcsicmp(argv[i], L"-prescan") == 0)
+        {
+            prescan = true;
+        }
+        else if ((_wcsicmp(argv[i], L"--scan-rate") == 0 || _wcsicmp(argv[i], L"-scan-rate") == 0) && i + 1 < argc)
+        {
+            scanOptions.ratePerSec = _wtoi(argv[++i]);
+        }
+        else if ((_wcsicmp(argv[i], L"--scan-retries") == 0 || _wcsicmp(argv[i], L"-scan-retries") == 0) && i + 1 < argc)
+        {
+            scanOptions.retries = _wtoi(argv[++i]);
+        }
+        else if ((_wcsicmp(argv[i], L"--scan-timeout") == 0 || _wcsicmp(argv[i], L"-scan-timeout") == 0) && i + 1 < argc)
+        {
+            scanOptions.replyTimeoutMs = (DWORD)_wtoi(argv[++i]);
+        }
         else if (_wcsicmp(argv[i], L"--monitor") == 0 || _wcsicmp(argv[i], L"-monitor") == 0)
         {
             monitorMode = true;
@@ -1309,6 +1817,14 @@ int wmain(int argc, wchar_t* argv[])
         {
             probeDispids = true;
         }
+        else if (_wcsicmp(argv[i], L"--walk") == 0 || _wcsicmp(argv[i], L"-walk") == 0)
+        {
+            walkTopology = true;
+        }
+        else if (_wcsicmp(argv[i], L"--swr") == 0 || _wcsicmp(argv[i], L"-swr") == 0)
+        {
+            staleWhileRevalidate = true;
+        }
         else if ((_wcsicmp(argv[i], L"--ip") == 0 || _wcsicmp(argv[i], L"-ip") == 0) && i + 1 < argc)
         {
             if (drivers.empty()) drivers.push_back({L"Test", {}});
@@ -1346,11 +1862,35 @@ int wmain(int argc, wchar_t* argv[])
     if (drivers.empty())
         drivers.push_back({L"Test", {}});
 
+    if (!scanSpec.empty())
+        return RunScanMode(scanSpec, scanOptions);
+
     if (!batchQueryFile.empty())
-        return RunBatchQueryMode(batchQueryFile, logDir);
+        return RunBatchQueryMode(batchQueryFile, logDir, walkTopology, staleWhileRevalidate);
+
+    if (!watchArg.empty())
+        return RunWatchMode(watchArg, logDir, walkTopology);
+
+    if (!findExpr.empty())
+        return RunFindMode(findExpr);
 
     if (!queryPath.empty())
-        return RunQueryMode(queryPath, logDir);
+        return RunQueryMode(queryPath, logDir, walkTopology, staleWhileRevalidate);
+
+    // --out alone streams JSON Lines
+    if (!streamArg.empty() || !streamOutPath.empty())
+    {
+        StreamFormat format = StreamFormat::JsonLines;
+        if (_wcsicmp(streamArg.c_str(), L"csv") == 0)
+            format = StreamFormat::Csv;
+        else if (!streamArg.empty() && _wcsicmp(streamArg.c_str(), L"jsonl") != 0)
+        {
+            std::wcerr << L"[FAIL] --stream takes jsonl or csv, not '" << streamArg << L"'" << std::endl;
+            return 1;
+        }
+        if (!OpenDeviceStream(format, streamOutPath))
+            return 1;
+    }
 
     PrintHeader(L"RSLinx Topology Browser - COM Automation");
 
@@ -1371,10 +1911,11 @@ int wmain(int argc, wchar_t* argv[])
     if (probeDispids)
         std::wcout << L"DISPID probing: enabled" << std::endl;
 
-    if (!queryPath.empty())
-        return RunQueryMode(queryPath, logDir);
-    else if (monitorMode)
-        return RunMonitorMode(drivers, logDir, debugXml, probeDispids);
-    else
-        return RunInjectMode(drivers, logDir, debugXml, probeDispids);
+    if (prescan)
+        PrescanDrivers(drivers, scanOptions);
+
+    int rc = monitorMode ? RunMonitorMode(drivers, logDir, debugXml, probeDispids)
+                         : RunInjectMode(drivers, logDir, debugXml, probeDispids);
+    CloseDeviceStream();
+    return rc;
 }
@@ -3,8 +3,12 @@
 #include "SEHHelpers.h"
 #include "EventSink.h"
 #include "DispatchHelpers.h"
+#include "ComLayout.h"
 #include "TopologyXML.h"
+#include "TopologySnapshot.h"
 #include "STAHook.h"
+#include "Perf.h"
+#include "QueryWatch.h"
 
 // ============================================================
 // BrowseOperations globals
@@ -17,6 +21,9 @@ IUnknown* g_pMainEnumUnk = nullptr;
 
 std::set<std::wstring> g_browsedDrivers;
 std::set<std::wstring> g_browsedBackplanes;
+std::vector<ConnectBatch> g_connectBatches;
+std::set<std::wstring> g_backplanePriorityIPs;
+BackplaneScheduleState g_backplaneSchedule;
 
 // ============================================================
 // Enumerator tracking
@@ -28,7 +35,8 @@ bool EnumeratorsCycledSince(int baseline)
     if ((int)g_enumerators.size() <= baseline) return true;
     for (int i = baseline; i < (int)g_enumerators.size(); i++)
     {
-        if (g_enumerators[i].pSink && !g_enumerators[i].pSink->m_cycleComplete)
+        if (g_enumerators[i].pSink && !g_enumerators[i].pSink->m_cycleComplete &&
+            !g_enumerators[i].stopped)
             return false;
     }
     return true;
@@ -42,11 +50,47 @@ void GetEnumeratorStatusSince(int baseline, int& completed, int& total)
     if (total < 0) total = 0;
     for (int i = baseline; i < (int)g_enumerators.size(); i++)
     {
-        if (g_enumerators[i].pSink && g_enumerators[i].pSink->m_cycleComplete)
+        if (g_enumerators[i].stopped ||
+            (g_enumerators[i].pSink && g_enumerators[i].pSink->m_cycleComplete))
             completed++;
     }
 }
 
+bool WaitEnumeratorsSince(int baseline, bool waitAll, DWORD timeoutMs)
+{
+    DWORD t0 = GetTickCount();
+    while (true)
+    {
+        int completed, total;
+        GetEnumeratorStatusSince(baseline, completed, total);
+        if (waitAll ? completed == total : (completed > 0 || total == 0))
+            return true;
+
+        DWORD elapsed = GetTickCount() - t0;
+        if (g_shouldStop || elapsed >= timeoutMs) return false;
+
+        HANDLE handles[2] = { g_hEnumeratorDone, g_hStopEvent };
+        DWORD nHandles = g_hStopEvent ? 2 : 1;
+        if (!g_hEnumeratorDone) { handles[0] = g_hStopEvent; nHandles = g_hStopEvent ? 1 : 0; }
+
+        // Cap each wait so a missed signal costs at most 250 ms
+        DWORD w = MsgWaitForMultipleObjects(nHandles, handles, FALSE,
+            std::min<DWORD>(timeoutMs - elapsed, 250), QS_ALLINPUT);
+        if (w == WAIT_OBJECT_0 + nHandles)
+        {
+            MSG msg;
+            while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+            { TranslateMessage(&msg); DispatchMessage(&msg); }
+        }
+    }
+}
+
+// A device the client's pre-scan reported offline (C|SKIP); see DeviceMatchesIP
+static bool IsSkippedDevice(const DriverEntry& drv, const std::wstring& devName)
+{
+    return DeviceMatchesIP(devName, drv.skipIPs);
+}
+
 // ============================================================
 // GetBusDispatch  - fresh bus IDispatch from COM objects on current STA
 // ============================================================
@@ -97,8 +141,7 @@ IDispatch* GetBusDispatch(const wchar_t* driverName)
             DISPPARAMS dp = { &argName, nullptr, 1, 0 };
             VARIANT varBus;
             VariantInit(&varBus);
-            hr = pWsDisp->Invoke(38, IID_NULL, LOCALE_USER_DEFAULT,
-                                  DISPATCH_PROPERTYGET, &dp, &varBus, nullptr, nullptr);
+            hr = ComLayout::Invoke(pWsDisp, ComLayout::ITopologyDevice_Dual::GetBusEx, &dp, &varBus);
             if (SUCCEEDED(hr) && (varBus.vt == VT_DISPATCH || varBus.vt == VT_UNKNOWN))
             {
                 IUnknown* pBusUnk = (varBus.vt == VT_DISPATCH)
@@ -119,12 +162,107 @@ IDispatch* GetBusDispatch(const wchar_t* driverName)
     return pBusDisp;
 }
 
+// ============================================================
+// ConnectNewDevice batch (Phase 1)
+// ============================================================
+
+static void FreeExcepInfo(EXCEPINFO& excep)
+{
+    if (excep.bstrDescription) SysFreeString(excep.bstrDescription);
+    if (excep.bstrSource) SysFreeString(excep.bstrSource);
+    if (excep.bstrHelpFile) SysFreeString(excep.bstrHelpFile);
+    excep = {};
+}
+
+void ConnectDevicesOnBus(IDispatch* pBus, ConnectBatch& batch)
+{
+    static const wchar_t* UNRECOGNIZED_DEVICE_GUID = L"{00000004-5D68-11CF-B4B9-C46F03C10000}";
+    bool logEach = batch.ips.size() <= CONNECT_LOG_EACH_MAX;
+
+    // Constant args allocated once; only the IP BSTR changes per call
+    VARIANT args[6];
+    for (int a = 0; a < 6; a++) VariantInit(&args[a]);
+    args[5].vt = VT_I4; args[5].lVal = 0;
+    args[4].vt = VT_BSTR; args[4].bstrVal = SysAllocString(UNRECOGNIZED_DEVICE_GUID);
+    args[2].vt = VT_BSTR; args[2].bstrVal = SysAllocString(L"Device");
+    args[1].vt = VT_BSTR; args[1].bstrVal = SysAllocString(L"A");
+    args[0].vt = VT_BSTR; args[0].bstrVal = nullptr;
+    DISPPARAMS dp = { args, nullptr, 6, 0 };
+
+    int failLogged = 0;
+    for (const auto& ip : batch.ips)
+    {
+        if (g_shouldStop) break;
+        if (!SysReAllocString(&args[0].bstrVal, ip.c_str()))
+        {
+            batch.failed++;
+            continue;
+        }
+
+        EXCEPINFO excep = {};
+        UINT argErr = 0;
+        VARIANT result;
+        VariantInit(&result);
+
+        HRESULT hr = ComLayout::Invoke(pBus, ComLayout::ITopologyBus::ConnectNewDevice,
+                                        &dp, &result, &excep, &argErr);
+        if (SUCCEEDED(hr))
+        {
+            if (logEach) Log(L"    [OK] %s added", ip.c_str());
+            batch.added++;
+        }
+        else if (hr == DISP_E_EXCEPTION)
+        {
+            if (logEach) Log(L"    [SKIP] %s already exists", ip.c_str());
+            batch.existing++;
+        }
+        else
+        {
+            if (logEach || failLogged < CONNECT_LOG_FAIL_MAX)
+                Log(L"    [FAIL] %s: hr=0x%08x", ip.c_str(), hr);
+            failLogged++;
+            batch.failed++;
+        }
+        FreeExcepInfo(excep);
+        VariantClear(&result);
+    }
+    if (!logEach && failLogged > CONNECT_LOG_FAIL_MAX)
+        Log(L"    ... %d more failures not shown", failLogged - CONNECT_LOG_FAIL_MAX);
+
+    for (int a = 0; a < 6; a++) VariantClear(&args[a]);
+    batch.done = true;
+}
+
+// Runs on MAIN STA: every pending Phase 1 batch in one work item, with
+// the bus acquired in this apartment so each Invoke is a direct call.
+HRESULT DoConnectNewDevices()
+{
+    PerfScope perf(PERF_CONNECT_NEW_DEVICES);
+    Log(L"[MAIN-STA] ConnectNewDevice: %d driver batch(es) on TID=%d",
+        (int)g_connectBatches.size(), GetCurrentThreadId());
+
+    for (auto& batch : g_connectBatches)
+    {
+        if (g_shouldStop) break;
+        IDispatch* pBus = GetBusDispatch(batch.driverName.c_str());
+        if (!pBus)
+        {
+            Log(L"[MAIN-STA]   [%s] Bus not found", batch.driverName.c_str());
+            continue;
+        }
+        ConnectDevicesOnBus(pBus, batch);
+        pBus->Release();
+    }
+    return S_OK;
+}
+
 // ============================================================
 // DoBusBrowse  - runs on MAIN STA thread
 // ============================================================
 
 HRESULT DoBusBrowse()
 {
+    PerfScope perf(PERF_BUS_BROWSE);
     Log(L"[BUS] DoBusBrowse starting on TID=%d", GetCurrentThreadId());
 
     if (!g_pSharedConfig)
@@ -150,7 +288,7 @@ HRESULT DoBusBrowse()
     }
     Log(L"[BUS] Bus OK: 0x%p", pBusDisp);
 
-    IDispatch* pDevices = DispatchGetCollection(pBusDisp, 50);
+    IDispatch* pDevices = DispatchGetCollection(pBusDisp, ComLayout::ITopologyBus::Devices.id);
     if (!pDevices)
     {
         Log(L"[BUS] FAIL: bus.Devices() returned null");
@@ -158,35 +296,35 @@ HRESULT DoBusBrowse()
         continue;
     }
 
-    int deviceCount = DispatchGetInt(pDevices, 1);
+    int deviceCount = DispatchGetInt(pDevices, ComLayout::ITopologyCollection::Count.id);
     Log(L"[BUS] Bus has %d devices", deviceCount);
 
-    std::vector<IDispatch*> devices = EnumerateCollection(pDevices);
-    Log(L"[BUS] Enumerated %d devices", (int)devices.size());
-
-    for (int i = 0; i < (int)devices.size(); i++)
+    // Devices are fetched in chunks and each is released once handled
+    CollectionEnumerator devices(pDevices);
+    IDispatch* pDevice = nullptr;
+    for (int i = 0; devices.Next(&pDevice); i++)
     {
-        IDispatch* pDevice = devices[i];
-        if (!pDevice) continue;
-
-        std::wstring devName = DispatchGetString(pDevice, 1);
+        TopologyObjectProps props;
+        DispatchGetObjectProps(pDevice, props, false);
+        const std::wstring& devName = props.name;
         Log(L"[BUS] Device %d: \"%s\"", i, devName.c_str());
 
-        {
-            std::wstring objectId = DispatchGetString(pDevice, 2);
-            Log(L"[BUS] Device %d: objectId='%s'", i, objectId.c_str());
-
-            DeviceInfo info;
-            info.productName = devName;
-            info.objectId = objectId;
-            if (!devName.empty())
-                g_deviceDetails[devName] = info;
-        }
+        bool skipped = IsSkippedDevice(drv, devName);
+
+        Log(L"[BUS] Device %d: objectId='%s'", i, props.objectId.c_str());
+        RefreshDeviceDetails(devName, props.objectId);
 
         // Store device name order for WalkTopologyTree (worker-thread-safe, no COM needed)
         if (!devName.empty())
             g_driverDeviceNames[drv.name].push_back(devName);
 
+        if (skipped)
+        {
+            Log(L"[BUS]   Offline per client pre-scan, skipping");
+            pDevice->Release();
+            continue;
+        }
+
         // Probe DISPIDs if requested (Phase A discovery)
         if (g_pSharedConfig->probeDispids)
         {
@@ -199,7 +337,7 @@ HRESULT DoBusBrowse()
         }
 
         IUnknown* pDevVtable = nullptr;
-        pDevice->QueryInterface(IID_IRSTopologyDevice, (void**)&pDevVtable);
+        CachedQueryInterface(pDevice, IID_IRSTopologyDevice, (void**)&pDevVtable);
         if (!pDevVtable)
         {
             Log(L"[BUS]   QI for IRSTopologyDevice FAILED, skipping");
@@ -208,7 +346,8 @@ HRESULT DoBusBrowse()
         }
 
         IUnknown* pBackplanePort = nullptr;
-        HRESULT hrBP = TryVtableGetObject(pDevVtable, 19, &pBackplanePort);
+        HRESULT hrBP = TryVtableGetObject(pDevVtable, ComLayout::IRSTopologyDevice::GetBackplanePort.slot,
+                                          &pBackplanePort);
         Log(L"[BUS]   GetBackplanePort[19]: hr=0x%08x port=0x%p", hrBP, pBackplanePort);
         pDevVtable->Release();
 
@@ -237,7 +376,7 @@ HRESULT DoBusBrowse()
         }
 
         IDispatch* pDevTopoObj = nullptr;
-        pDevice->QueryInterface(IID_ITopologyObject, (void**)&pDevTopoObj);
+        CachedQueryInterface(pDevice, IID_ITopologyObject, (void**)&pDevTopoObj);
         if (!pDevTopoObj)
             pDevice->QueryInterface(IID_IDispatch, (void**)&pDevTopoObj);
 
@@ -257,6 +396,7 @@ HRESULT DoBusBrowse()
         }
 
         DualEventSink* pSink = new DualEventSink(devName.c_str());
+        pSink->m_ownerDevice = devName;
         {
             IConnectionPointContainer* pDevCPC = nullptr;
             ((IUnknown*)pDevEnum)->QueryInterface(IID_IConnectionPointContainer, (void**)&pDevCPC);
@@ -286,7 +426,7 @@ HRESULT DoBusBrowse()
                         DWORD c = 0;
                         HRESULT hrAdv = pCP->Advise(static_cast<IRSTopologyOnlineNotify*>(pSink), &c);
                         if (SUCCEEDED(hrAdv))
-                            g_connectionPoints.push_back({pCP, c});
+                            g_connectionPoints.push_back({pCP, c, pSink});
                         else
                             pCP->Release();
                         cpIdx++;
@@ -300,7 +440,8 @@ HRESULT DoBusBrowse()
             }
         }
 
-        HRESULT hrStart = TryStartAtSlot(pDevEnum, pDevPath, 7);
+        HRESULT hrStart = TryStartAtSlot(pDevEnum, pDevPath,
+                                         ComLayout::IOnlineEnumeratorTypeLib::Start.slot);
         Log(L"[BUS]   Start(device path) via device enum: hr=0x%08x", hrStart);
         pSink->DumpDWords(L"after-start");
         pSink->CheckCanaries(L"after-start");
@@ -310,11 +451,14 @@ HRESULT DoBusBrowse()
             Log(L"[BUS]   >> Backplane browse started for \"%s\"", devName.c_str());
         }
 
-        g_enumerators.push_back({pDevEnum, pSink});
+        EnumeratorInfo ei = { pDevEnum, pSink };
+        if (!props.objectId.empty()) ei.target = L"dev:" + props.objectId;
+        g_enumerators.push_back(ei);
 
         SafeRelease(pDevPath, L"pDevPath");
         pDevice->Release();
     }
+    Log(L"[BUS] Enumerated %d devices", devices.Count());
 
     pDevices->Release();
     pBusDisp->Release();
@@ -325,12 +469,257 @@ HRESULT DoBusBrowse()
     return (startedCount > 0) ? S_OK : S_FALSE;
 }
 
+// ============================================================
+// Backplane browse scheduler (main STA) — see BrowseOperations.h
+// ============================================================
+
+struct BackplaneJob {
+    std::wstring deviceName;
+    std::wstring objectId;     // chassis device's objectid
+    std::wstring label;        // sink label: device/bus
+    IUnknown* pBus;            // backplane bus, owned by the job
+};
+
+static std::deque<BackplaneJob> s_backplaneQueue;
+// Chassis the last DoBackplaneBrowse found no backplane bus on: nothing
+// to enumerate, so they count as browsed (MarkBrowsedBackplanes)
+static std::set<std::wstring> s_noBackplaneDevices;
+
+static bool IsPriorityDevice(const std::wstring& devName)
+{
+    return DeviceMatchesIP(devName, g_backplanePriorityIPs);
+}
+
+// QI the job's bus for the enumerator, advise a sink and Start it at the
+// bus path. Releases the job's bus reference. False if nothing started.
+static bool StartBackplaneJob(BackplaneJob& job)
+{
+    IUnknown* pBackplaneBus = job.pBus;
+    job.pBus = nullptr;
+    Log(L"[BP] Starting \"%s\"", job.label.c_str());
+
+    void* pBPEnum = nullptr;
+    HRESULT hrEnum = pBackplaneBus->QueryInterface(IID_IOnlineEnumeratorTypeLib, &pBPEnum);
+    Log(L"[BP]   QI bus for enumerator: hr=0x%08x", hrEnum);
+
+    if (FAILED(hrEnum) || !pBPEnum)
+    {
+        Log(L"[BP]   Bus doesn't support enumerator");
+        pBackplaneBus->Release();
+        return false;
+    }
+
+    IDispatch* pBusDisp = nullptr;
+    pBackplaneBus->QueryInterface(IID_ITopologyBus, (void**)&pBusDisp);
+    if (!pBusDisp)
+        CachedQueryInterface(pBackplaneBus, IID_ITopologyObject, (void**)&pBusDisp);
+
+    IUnknown* pBPPath = nullptr;
+    if (pBusDisp)
+    {
+        pBPPath = DispatchGetPath(pBusDisp);
+        Log(L"[BP]   Bus path: 0x%p", pBPPath);
+        pBusDisp->Release();
+    }
+
+    if (!pBPPath)
+    {
+        Log(L"[BP]   Could not get bus path");
+        ((IUnknown*)pBPEnum)->Release();
+        pBackplaneBus->Release();
+        return false;
+    }
+
+    DualEventSink* pSink = new DualEventSink(job.label.c_str());
+    pSink->m_ownerDevice = job.deviceName;
+    int cpCount = 0;
+    {
+        IConnectionPointContainer* pCPC = nullptr;
+        pBackplaneBus->QueryInterface(IID_IConnectionPointContainer, (void**)&pCPC);
+        if (pCPC)
+        {
+            IConnectionPoint* pCP = nullptr;
+            if (SUCCEEDED(pCPC->FindConnectionPoint(IID_ITopologyBusEvents, &pCP)) && pCP)
+            {
+                DWORD cookie = 0;
+                HRESULT hrAdv = pCP->Advise(static_cast<ITopologyBusEvents*>(pSink), &cookie);
+                cpCount++;
+                if (SUCCEEDED(hrAdv))
+                    g_connectionPoints.push_back({pCP, cookie, pSink});
+                else
+                    pCP->Release();
+            }
+            pCPC->Release();
+        }
+    }
+    Log(L"[BP]   Connected %d CPs for \"%s\"", cpCount, job.label.c_str());
+    pSink->DumpDWords(L"after-advise");
+    pSink->CheckCanaries(L"after-advise");
+
+    HRESULT hrStart = TryStartAtSlot(pBPEnum, pBPPath, ComLayout::IOnlineEnumeratorTypeLib::Start.slot);
+    Log(L"[BP]   Start(bus path): hr=0x%08x", hrStart);
+    pSink->DumpDWords(L"after-start");
+    pSink->CheckCanaries(L"after-start");
+    if (SUCCEEDED(hrStart))
+        Log(L"[BP]   >> Backplane bus browse STARTED for \"%s\"", job.label.c_str());
+
+    // Kept for cleanup either way; one that did not start holds no slot
+    EnumeratorInfo ei = { pBPEnum, pSink };
+    ei.scheduled = true;
+    ei.stopped = FAILED(hrStart);
+    ei.startTick = GetTickCount();
+    if (!job.objectId.empty()) ei.target = L"bp:" + job.objectId;
+    g_enumerators.push_back(ei);
+
+    SafeRelease(pBPPath, L"pBPPath");
+    pBackplaneBus->Release();
+    return SUCCEEDED(hrStart);
+}
+
+static void StopScheduledEnumerator(EnumeratorInfo& ei, const wchar_t* why)
+{
+    HRESULT hr = TryVtableStop(ei.pEnumInterface, ComLayout::IOnlineEnumeratorTypeLib::Stop.slot);
+    ei.stopped = true;
+    Log(L"[BP] Stop \"%s\" (%s): hr=0x%08x",
+        ei.pSink ? ei.pSink->m_ownerDevice.c_str() : L"?", why, hr);
+}
+
+// Stop finished scheduler jobs, start queued ones into the free slots and
+// publish g_backplaneSchedule. Returns the number of jobs started.
+static int ScheduleBackplanes()
+{
+    int limit = g_pSharedConfig ? g_pSharedConfig->backplaneInFlight : 0;
+    DWORD now = GetTickCount();
+    BackplaneScheduleState state;
+
+    for (auto& ei : g_enumerators)
+    {
+        if (!ei.scheduled || ei.stopped) continue;
+        bool cycled = ei.pSink && ei.pSink->m_cycleComplete;
+        if (limit > 0)
+        {
+            if (cycled) { StopScheduledEnumerator(ei, L"cycled"); continue; }
+            if (now - ei.startTick >= BACKPLANE_JOB_TIMEOUT_MS)
+            {
+                StopScheduledEnumerator(ei, L"timed out");
+                continue;
+            }
+        }
+        if (cycled) continue;
+        state.inFlight++;
+        if (ei.pSink && IsPriorityDevice(ei.pSink->m_ownerDevice)) state.priorityPending++;
+    }
+
+    int started = 0;
+    while (!s_backplaneQueue.empty() && (limit <= 0 || state.inFlight < limit))
+    {
+        BackplaneJob job = s_backplaneQueue.front();
+        s_backplaneQueue.pop_front();
+        bool priority = IsPriorityDevice(job.deviceName);
+        if (!StartBackplaneJob(job)) continue;
+        started++;
+        state.inFlight++;
+        if (priority) state.priorityPending++;
+    }
+
+    state.queued = (int)s_backplaneQueue.size();
+    for (const auto& job : s_backplaneQueue)
+        if (IsPriorityDevice(job.deviceName)) state.priorityPending++;
+    g_backplaneSchedule = state;
+    return started;
+}
+
+HRESULT DoBackplaneSchedule()
+{
+    int started = ScheduleBackplanes();
+    if (started > 0)
+        Log(L"[BP] Scheduler: %d started, %d in flight, %d queued",
+            started, g_backplaneSchedule.inFlight, g_backplaneSchedule.queued);
+    return S_OK;
+}
+
+HRESULT DoBackplaneQueueClear()
+{
+    if (!s_backplaneQueue.empty())
+        Log(L"[BP] Dropping %d queued backplane job(s)", (int)s_backplaneQueue.size());
+    for (auto& job : s_backplaneQueue)
+        SafeRelease(job.pBus, L"queued-Bus");
+    s_backplaneQueue.clear();
+    g_backplaneSchedule.queued = 0;
+    return S_OK;
+}
+
+int MarkBrowsedBackplanes(const std::set<std::wstring>& ips)
+{
+    std::vector<std::wstring> finished(s_noBackplaneDevices.begin(), s_noBackplaneDevices.end());
+    for (const auto& ei : g_enumerators)
+        if (ei.scheduled && ei.pSink && ei.pSink->m_cycleComplete)
+            finished.push_back(ei.pSink->m_ownerDevice);
+
+    int marked = 0;
+    for (const auto& ip : ips)
+    {
+        std::set<std::wstring> one = { ip };
+        for (const auto& name : finished)
+        {
+            if (!DeviceMatchesIP(name, one)) continue;
+            g_browsedBackplanes.insert(ip);
+            marked++;
+            break;
+        }
+    }
+    if (marked < (int)ips.size())
+        Log(L"[BP] %d of %d chassis finished; the rest are browsed again when queried",
+            marked, (int)ips.size());
+    return marked;
+}
+
+bool RunBackplaneSchedule(int baseline, bool priorityOnly, DWORD timeoutMs)
+{
+    // Only meaningful if the browse found a priority chassis at all
+    bool priorityQueued = g_backplaneSchedule.priorityPending > 0;
+    DWORD t0 = GetTickCount();
+    while (true)
+    {
+        ExecuteOnMainSTA(DoBackplaneSchedule);
+        if (priorityOnly && priorityQueued && g_backplaneSchedule.priorityPending == 0)
+        {
+            ExecuteOnMainSTA(DoBackplaneQueueClear);
+            return true;
+        }
+        if (g_backplaneSchedule.queued == 0 && EnumeratorsCycledSince(baseline))
+            return true;
+
+        DWORD elapsed = GetTickCount() - t0;
+        if (g_shouldStop || elapsed >= timeoutMs)
+        {
+            ExecuteOnMainSTA(DoBackplaneQueueClear);
+            return false;
+        }
+
+        // Next completion (g_hEnumeratorDone), capped so job timeouts and a
+        // missed signal are noticed
+        HANDLE handles[2] = { g_hEnumeratorDone, g_hStopEvent };
+        DWORD nHandles = g_hStopEvent ? 2 : 1;
+        if (!g_hEnumeratorDone) { handles[0] = g_hStopEvent; nHandles = g_hStopEvent ? 1 : 0; }
+        DWORD w = MsgWaitForMultipleObjects(nHandles, handles, FALSE,
+            std::min<DWORD>(timeoutMs - elapsed, 250), QS_ALLINPUT);
+        if (w == WAIT_OBJECT_0 + nHandles)
+        {
+            MSG msg;
+            while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+            { TranslateMessage(&msg); DispatchMessage(&msg); }
+        }
+    }
+}
+
 // ============================================================
 // DoBackplaneBrowse  - runs on MAIN STA thread (Phase 4b)
 // ============================================================
 
 HRESULT DoBackplaneBrowse()
 {
+    PerfScope perf(PERF_BACKPLANE_BROWSE);
     Log(L"[BP] DoBackplaneBrowse starting on TID=%d", GetCurrentThreadId());
 
     if (!g_pSharedConfig)
@@ -339,7 +728,8 @@ HRESULT DoBackplaneBrowse()
         return E_INVALIDARG;
     }
 
-    int startedCount = 0;
+    int queuedCount = 0;
+    s_noBackplaneDevices.clear();
 
     for (auto& drv : g_pSharedConfig->drivers)
     {
@@ -351,31 +741,28 @@ HRESULT DoBackplaneBrowse()
         continue;
     }
 
-    IDispatch* pDevices = DispatchGetCollection(pEthBusDisp, 50);
+    IDispatch* pDevices = DispatchGetCollection(pEthBusDisp, ComLayout::ITopologyBus::Devices.id);
     if (!pDevices) { pEthBusDisp->Release(); continue; }
 
-    std::vector<IDispatch*> devices = EnumerateCollection(pDevices);
-    Log(L"[BP] Enumerated %d Ethernet devices", (int)devices.size());
-
-    for (int i = 0; i < (int)devices.size(); i++)
+    CollectionEnumerator devices(pDevices);
+    IDispatch* pDevice = nullptr;
+    for (int i = 0; devices.Next(&pDevice); i++)
     {
-        IDispatch* pDevice = devices[i];
-        if (!pDevice) continue;
-
-        std::wstring devName = DispatchGetString(pDevice, 1);
+        TopologyObjectProps props;
+        DispatchGetObjectProps(pDevice, props, false);
+        const std::wstring& devName = props.name;
         Log(L"[BP] Device %d: \"%s\"", i, devName.c_str());
 
+        if (IsSkippedDevice(drv, devName))
         {
-            std::wstring objectId = DispatchGetString(pDevice, 2);
-            Log(L"[BP] Device %d: objectId='%s'", i, objectId.c_str());
-
-            DeviceInfo info;
-            info.productName = devName;
-            info.objectId = objectId;
-            if (!devName.empty())
-                g_deviceDetails[devName] = info;
+            Log(L"[BP]   Offline per client pre-scan, skipping");
+            pDevice->Release();
+            continue;
         }
 
+        Log(L"[BP] Device %d: objectId='%s'", i, props.objectId.c_str());
+        RefreshDeviceDetails(devName, props.objectId);
+
         // Probe DISPIDs if requested (Phase A discovery)
         if (g_pSharedConfig->probeDispids)
         {
@@ -384,16 +771,23 @@ HRESULT DoBackplaneBrowse()
         }
 
         IUnknown* pDevVtable = nullptr;
-        pDevice->QueryInterface(IID_IRSTopologyDevice, (void**)&pDevVtable);
-        if (!pDevVtable) { pDevice->Release(); continue; }
+        CachedQueryInterface(pDevice, IID_IRSTopologyDevice, (void**)&pDevVtable);
+        if (!pDevVtable)
+        {
+            s_noBackplaneDevices.insert(devName);
+            pDevice->Release();
+            continue;
+        }
 
         IUnknown* pBackplanePort = nullptr;
-        HRESULT hrBP = TryVtableGetObject(pDevVtable, 19, &pBackplanePort);
+        HRESULT hrBP = TryVtableGetObject(pDevVtable, ComLayout::IRSTopologyDevice::GetBackplanePort.slot,
+                                          &pBackplanePort);
         pDevVtable->Release();
 
         if (FAILED(hrBP) || !pBackplanePort)
         {
             Log(L"[BP]   No backplane port");
+            s_noBackplaneDevices.insert(devName);
             pDevice->Release();
             continue;
         }
@@ -404,13 +798,14 @@ HRESULT DoBackplaneBrowse()
         std::wstring busLabel;
 
         IUnknown* pPortVtable = nullptr;
-        HRESULT hrPortQI = pBackplanePort->QueryInterface(IID_IRSTopologyPort, (void**)&pPortVtable);
+        HRESULT hrPortQI = CachedQueryInterface(pBackplanePort, IID_IRSTopologyPort, (void**)&pPortVtable);
         Log(L"[BP]   QI IRSTopologyPort: hr=0x%08x", hrPortQI);
 
         if (pPortVtable)
         {
             IUnknown* pBusRaw = nullptr;
-            HRESULT hrGetBus = TryVtableGetObject(pPortVtable, 10, &pBusRaw);
+            HRESULT hrGetBus = TryVtableGetObject(pPortVtable, ComLayout::IRSTopologyPort::GetBus.slot,
+                                                  &pBusRaw);
             Log(L"[BP]   GetBus[10]: hr=0x%08x bus=0x%p", hrGetBus, pBusRaw);
 
             if (SUCCEEDED(hrGetBus) && pBusRaw)
@@ -418,9 +813,9 @@ HRESULT DoBackplaneBrowse()
                 pBackplaneBus = pBusRaw;
 
                 IUnknown* pBusRSObj = nullptr;
-                if (SUCCEEDED(pBusRaw->QueryInterface(IID_IRSObject, (void**)&pBusRSObj)) && pBusRSObj)
+                if (SUCCEEDED(CachedQueryInterface(pBusRaw, IID_IRSObject, (void**)&pBusRSObj)) && pBusRSObj)
                 {
-                    TryVtableGetLabel(pBusRSObj, 7, busLabel);
+                    TryVtableGetLabel(pBusRSObj, ComLayout::IRSObject::GetName.slot, busLabel);
                     Log(L"[BP]   Bus IRSObject::GetName[7]: \"%s\"", busLabel.c_str());
                     pBusRSObj->Release();
                 }
@@ -449,8 +844,8 @@ HRESULT DoBackplaneBrowse()
                     DISPPARAMS dp = { &argName, nullptr, 1, 0 };
                     VARIANT varBus;
                     VariantInit(&varBus);
-                    HRESULT hr38 = pDevDualDisp->Invoke(38, IID_NULL, LOCALE_USER_DEFAULT,
-                        DISPATCH_PROPERTYGET, &dp, &varBus, nullptr, nullptr);
+                    HRESULT hr38 = ComLayout::Invoke(pDevDualDisp, ComLayout::ITopologyDevice_Dual::GetBusEx,
+                                                     &dp, &varBus);
 
                     bool found = false;
                     if (SUCCEEDED(hr38) && (varBus.vt == VT_DISPATCH || varBus.vt == VT_UNKNOWN) && varBus.punkVal)
@@ -477,6 +872,7 @@ HRESULT DoBackplaneBrowse()
         if (!pBackplaneBus)
         {
             Log(L"[BP]   Could not find backplane bus");
+            s_noBackplaneDevices.insert(devName);
             pDevice->Release();
             continue;
         }
@@ -485,88 +881,26 @@ HRESULT DoBackplaneBrowse()
         if (!busLabel.empty())
             sinkLabel += L"/" + busLabel;
 
-        void* pBPEnum = nullptr;
-        HRESULT hrEnum = pBackplaneBus->QueryInterface(IID_IOnlineEnumeratorTypeLib, &pBPEnum);
-        Log(L"[BP]   QI bus for enumerator: hr=0x%08x", hrEnum);
-
-        if (FAILED(hrEnum) || !pBPEnum)
-        {
-            Log(L"[BP]   Bus doesn't support enumerator");
-            pBackplaneBus->Release();
-            pDevice->Release();
-            continue;
-        }
-
-        IDispatch* pBusDisp = nullptr;
-        pBackplaneBus->QueryInterface(IID_ITopologyBus, (void**)&pBusDisp);
-        if (!pBusDisp)
-            pBackplaneBus->QueryInterface(IID_ITopologyObject, (void**)&pBusDisp);
-
-        IUnknown* pBPPath = nullptr;
-        if (pBusDisp)
-        {
-            pBPPath = DispatchGetPath(pBusDisp);
-            Log(L"[BP]   Bus path: 0x%p", pBPPath);
-            pBusDisp->Release();
-        }
-
-        if (!pBPPath)
-        {
-            Log(L"[BP]   Could not get bus path");
-            pBackplaneBus->Release();
-            pDevice->Release();
-            continue;
-        }
-
-        DualEventSink* pSink = new DualEventSink(sinkLabel.c_str());
-        int cpCount = 0;
-        {
-            IConnectionPointContainer* pCPC = nullptr;
-            pBackplaneBus->QueryInterface(IID_IConnectionPointContainer, (void**)&pCPC);
-            if (pCPC)
-            {
-                IConnectionPoint* pCP = nullptr;
-                if (SUCCEEDED(pCPC->FindConnectionPoint(IID_ITopologyBusEvents, &pCP)) && pCP)
-                {
-                    DWORD cookie = 0;
-                    HRESULT hrAdv = pCP->Advise(static_cast<ITopologyBusEvents*>(pSink), &cookie);
-                    cpCount++;
-                    if (SUCCEEDED(hrAdv))
-                        g_connectionPoints.push_back({pCP, cookie});
-                    else
-                        pCP->Release();
-                }
-                pCPC->Release();
-            }
-        }
-        Log(L"[BP]   Connected %d CPs for \"%s\"", cpCount, sinkLabel.c_str());
-        pSink->DumpDWords(L"after-advise");
-        pSink->CheckCanaries(L"after-advise");
-
-        HRESULT hrStart = TryStartAtSlot(pBPEnum, pBPPath, 7);
-        Log(L"[BP]   Start(bus path): hr=0x%08x", hrStart);
-        pSink->DumpDWords(L"after-start");
-        pSink->CheckCanaries(L"after-start");
-        if (SUCCEEDED(hrStart))
-        {
-            startedCount++;
-            Log(L"[BP]   >> Backplane bus browse STARTED for \"%s\"", sinkLabel.c_str());
-        }
-
-        g_enumerators.push_back({pBPEnum, pSink});
-
-        SafeRelease(pBPPath, L"pBPPath");
-        pBackplaneBus->Release();
+        // The queue owns the bus reference until the job starts
+        s_backplaneQueue.push_back({devName, props.objectId, sinkLabel, pBackplaneBus});
+        queuedCount++;
         pDevice->Release();
     }
+    Log(L"[BP] Enumerated %d Ethernet devices", devices.Count());
 
     pDevices->Release();
     pEthBusDisp->Release();
     } // end per-driver loop
 
-    Log(L"[BP] DoBackplaneBrowse done: %d started across %d drivers",
-        startedCount, (int)g_pSharedConfig->drivers.size());
-    return (startedCount > 0) ? S_OK : S_FALSE;
+    // Chassis pending queries first; otherwise in browse order
+    std::stable_partition(s_backplaneQueue.begin(), s_backplaneQueue.end(),
+        [](const BackplaneJob& job) { return IsPriorityDevice(job.deviceName); });
+    int startedCount = ScheduleBackplanes();
+
+    Log(L"[BP] DoBackplaneBrowse done: %d queued across %d drivers, %d started, %d waiting (in-flight limit %d)",
+        queuedCount, (int)g_pSharedConfig->drivers.size(), startedCount,
+        g_backplaneSchedule.queued, g_pSharedConfig->backplaneInFlight);
+    return (startedCount > 0 || g_backplaneSchedule.queued > 0) ? S_OK : S_FALSE;
 }
 
 // ============================================================
@@ -575,44 +909,40 @@ HRESULT DoBackplaneBrowse()
 
 HRESULT DoCleanupOnMainSTA()
 {
+    PerfScope perf(PERF_CLEANUP);
     Log(L"[CLEANUP] DoCleanupOnMainSTA starting on TID=%d", GetCurrentThreadId());
 
-    // 1. Stop all enumerators via vtable[8]
+    // 1. Stop all enumerators via vtable[8] (the scheduler's stopped ones
+    //    already are)
     int stopCount = 0;
     for (auto& ei : g_enumerators)
     {
-        if (!ei.pEnumInterface) continue;
-        __try
+        if (!ei.pEnumInterface || ei.stopped) continue;
+        HRESULT hr = TryVtableStop(ei.pEnumInterface, ComLayout::IOnlineEnumeratorTypeLib::Stop.slot);
+        if (hr == E_UNEXPECTED)
+            Log(L"[CLEANUP] Stop enumerator 0x%p: SEH exception (ignored)", ei.pEnumInterface);
+        else
         {
-            typedef HRESULT (__stdcall *StopFunc)(void* pThis);
-            void** vtable = *(void***)ei.pEnumInterface;
-            StopFunc pfn = (StopFunc)vtable[8];
-            HRESULT hr = pfn(ei.pEnumInterface);
             Log(L"[CLEANUP] Stop enumerator 0x%p: hr=0x%08x", ei.pEnumInterface, hr);
             stopCount++;
         }
-        __except (EXCEPTION_EXECUTE_HANDLER)
-        {
-            Log(L"[CLEANUP] Stop enumerator 0x%p: SEH exception (ignored)", ei.pEnumInterface);
-        }
     }
     Log(L"[CLEANUP] Stopped %d enumerators", stopCount);
+    DoBackplaneQueueClear();
 
     // 2. Unadvise all connection points
     int unadviseCount = 0;
     for (auto& cpi : g_connectionPoints)
     {
         if (!cpi.pCP) continue;
-        __try
+        HRESULT hr = TryUnadvise(cpi.pCP, cpi.cookie);
+        if (hr == E_UNEXPECTED)
+            Log(L"[CLEANUP] Unadvise CP 0x%p: SEH exception (ignored)", cpi.pCP);
+        else
         {
-            HRESULT hr = cpi.pCP->Unadvise(cpi.cookie);
             Log(L"[CLEANUP] Unadvise CP 0x%p cookie=%d: hr=0x%08x", cpi.pCP, cpi.cookie, hr);
             unadviseCount++;
         }
-        __except (EXCEPTION_EXECUTE_HANDLER)
-        {
-            Log(L"[CLEANUP] Unadvise CP 0x%p: SEH exception (ignored)", cpi.pCP);
-        }
     }
     Log(L"[CLEANUP] Unadvised %d connection points", unadviseCount);
 
@@ -648,17 +978,82 @@ HRESULT DoCleanupOnMainSTA()
     // 6. Clear global persistent pointers
     g_pMainSink = nullptr;
     g_pMainEnumUnk = nullptr;
+    ResetDispatchCaches();
 
     Log(L"[CLEANUP] DoCleanupOnMainSTA complete");
     return S_OK;
 }
 
+// ============================================================
+// DoCompactEnumerators  - runs on MAIN STA thread
+// ============================================================
+
+HRESULT DoCompactEnumerators()
+{
+    // Keyed on the browsed object, not the sink label: two chassis with
+    // the same catalog name have the same label
+    std::map<std::wstring, size_t> newest;
+    for (size_t i = 0; i < g_enumerators.size(); i++)
+        if (g_enumerators[i].pSink && !g_enumerators[i].target.empty())
+            newest[g_enumerators[i].target] = i;
+
+    std::set<DualEventSink*> dropped;
+    std::vector<EnumeratorInfo> kept;
+    for (size_t i = 0; i < g_enumerators.size(); i++)
+    {
+        EnumeratorInfo& ei = g_enumerators[i];
+        bool superseded = ei.pSink && !ei.target.empty() && newest[ei.target] != i;
+        // Scheduler jobs that never started or timed out; ones stopped
+        // after their cycle keep their bus CP for port events
+        bool dead = ei.scheduled && ei.stopped && !(ei.pSink && ei.pSink->m_cycleComplete);
+        if (!superseded && !dead)
+        {
+            kept.push_back(ei);
+            continue;
+        }
+        if (ei.pEnumInterface)
+        {
+            if (!ei.stopped)
+                TryVtableStop(ei.pEnumInterface, ComLayout::IOnlineEnumeratorTypeLib::Stop.slot);
+            SafeRelease((IUnknown*)ei.pEnumInterface, L"compact-Enum");
+        }
+        if (ei.pSink) dropped.insert(ei.pSink);
+    }
+
+    int cpDropped = 0;
+    std::vector<ConnectionPointInfo> cpKept;
+    for (auto& cpi : g_connectionPoints)
+    {
+        if (!cpi.pSink || !dropped.count(cpi.pSink))
+        {
+            cpKept.push_back(cpi);
+            continue;
+        }
+        if (cpi.pCP)
+        {
+            TryUnadvise(cpi.pCP, cpi.cookie);
+            SafeRelease(cpi.pCP, L"compact-CP");
+        }
+        cpDropped++;
+    }
+    for (auto* pSink : dropped) pSink->Release();
+
+    int enumDropped = (int)(g_enumerators.size() - kept.size());
+    g_enumerators.swap(kept);
+    g_connectionPoints.swap(cpKept);
+    if (enumDropped > 0)
+        Log(L"[COMPACT] Released %d enumerator(s) and %d connection point(s); %d / %d remain",
+            enumDropped, cpDropped, (int)g_enumerators.size(), (int)g_connectionPoints.size());
+    return S_OK;
+}
+
 // ============================================================
 // DoMainSTABrowse  - runs on the MAIN STA thread
 // ============================================================
 
 HRESULT DoMainSTABrowse()
 {
+    PerfScope perf(PERF_MAIN_STA_BROWSE);
     Log(L"[MAIN-STA] DoMainSTABrowse starting on TID=%d", GetCurrentThreadId());
 
     if (!g_pSharedConfig)
@@ -748,8 +1143,7 @@ HRESULT DoMainSTABrowse()
             DISPPARAMS dp = { &argName, nullptr, 1, 0 };
             VARIANT varBus;
             VariantInit(&varBus);
-            hr = pWsDisp->Invoke(38, IID_NULL, LOCALE_USER_DEFAULT,
-                                  DISPATCH_PROPERTYGET, &dp, &varBus, nullptr, nullptr);
+            hr = ComLayout::Invoke(pWsDisp, ComLayout::ITopologyDevice_Dual::GetBusEx, &dp, &varBus);
             Log(L"[MAIN-STA] Bus(\"%s\"): hr=0x%08x vt=%d",
                 drv.name.c_str(), hr, varBus.vt);
             if (SUCCEEDED(hr) && (varBus.vt == VT_DISPATCH || varBus.vt == VT_UNKNOWN))
@@ -788,7 +1182,7 @@ HRESULT DoMainSTABrowse()
                 hr = pCP->Advise(static_cast<IRSTopologyOnlineNotify*>(pSink), &cookie);
                 Log(L"[MAIN-STA] Bus CP Advise: hr=0x%08x cookie=%d", hr, cookie);
                 if (SUCCEEDED(hr))
-                    g_connectionPoints.push_back({pCP, cookie});
+                    g_connectionPoints.push_back({pCP, cookie, pSink});
                 else
                     pCP->Release();
             }
@@ -866,7 +1260,7 @@ HRESULT DoMainSTABrowse()
                     hr = pCP->Advise(static_cast<IRSTopologyOnlineNotify*>(pSink), &enumCookie);
                     if (SUCCEEDED(hr))
                     {
-                        g_connectionPoints.push_back({pCP, enumCookie});
+                        g_connectionPoints.push_back({pCP, enumCookie, pSink});
                         cpConnected++;
                     }
                     else
@@ -891,8 +1285,7 @@ HRESULT DoMainSTABrowse()
         DISPPARAMS dpPath = { &argFlags, nullptr, 1, 0 };
         VARIANT varPath;
         VariantInit(&varPath);
-        hr = pBusDisp->Invoke(4, IID_NULL, LOCALE_USER_DEFAULT,
-                                DISPATCH_PROPERTYGET, &dpPath, &varPath, nullptr, nullptr);
+        hr = ComLayout::Invoke(pBusDisp, ComLayout::ITopologyBus::path, &dpPath, &varPath);
         Log(L"[MAIN-STA] bus.path(flags=0): hr=0x%08x vt=%d", hr, varPath.vt);
         if (SUCCEEDED(hr) && (varPath.vt == VT_DISPATCH || varPath.vt == VT_UNKNOWN))
         {
@@ -915,7 +1308,8 @@ HRESULT DoMainSTABrowse()
     if (enumFromBus)
     {
         pSink->DumpCounters(L"main-before-start");
-        hrDrvStart = TryStartAtSlot(pBusEnum, pPathObject, 7);
+        hrDrvStart = TryStartAtSlot(pBusEnum, pPathObject,
+                                    ComLayout::IOnlineEnumeratorTypeLib::Start.slot);
         Log(L"[MAIN-STA] Start(bus.path) via bus-QI enum: hr=0x%08x", hrDrvStart);
         pSink->DumpCounters(L"main-after-start");
         pSink->DumpDWords(L"after-start");
@@ -935,7 +1329,8 @@ HRESULT DoMainSTABrowse()
         if (SUCCEEDED(hr) && pRealEnum)
         {
             pSink->DumpCounters(L"main-before-start");
-            hrDrvStart = TryStartAtSlot(pRealEnum, pPathObject, 7);
+            hrDrvStart = TryStartAtSlot(pRealEnum, pPathObject,
+                                        ComLayout::IOnlineEnumeratorTypeLib::Start.slot);
             Log(L"[MAIN-STA] Start(bus.path) via standalone: hr=0x%08x", hrDrvStart);
             pSink->DumpCounters(L"main-after-start");
             pSink->DumpDWords(L"after-start");
@@ -953,7 +1348,9 @@ HRESULT DoMainSTABrowse()
 
     SafeRelease(pPathObject, L"pPathObject");
 
-    g_enumerators.push_back({(void*)pEnumUnk, pSink});
+    EnumeratorInfo drvEi = { (void*)pEnumUnk, pSink };
+    drvEi.target = L"drv:" + drv.name;
+    g_enumerators.push_back(drvEi);
 
     SafeRelease(pBusDisp, L"pBusDisp");
     SafeRelease(pBusUnk, L"pBusUnk");
@@ -980,7 +1377,8 @@ HRESULT DoMainSTABrowse()
 // RunMonitorLoop  - continuous browse mode
 // ============================================================
 
-void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, const std::vector<BusInfo>& buses)
+void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, const std::vector<BusInfo>& buses,
+                    MonitorServiceFunc service, HANDLE hServiceEvent)
 {
     Log(L"");
     Log(L"=== Monitor Mode: Continuous browse ===");
@@ -988,9 +1386,22 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
     bool busBrowseDone = false;
     bool backplaneBrowseDone = false;
     int snapshotNum = 0;
-    int lastIdentified = 0;
     DWORD startTick = GetTickCount();
 
+    // Event-driven: sinks signal g_hTopologyChanged, the loop debounces and
+    // snapshots. monitorMaxStaleMs bounds how long a quiet network goes
+    // without one. The first snapshot is treated as a pending change.
+    if (!g_hTopologyChanged)
+        g_hTopologyChanged = CreateEventW(NULL, FALSE, FALSE, NULL);
+    LONG seenChanges = g_topologyChanges;
+    bool changePending = true;
+    DWORD firstChangeTick = startTick;
+    DWORD lastChangeTick = startTick;
+    DWORD lastSnapTick = startTick;
+    DWORD lastCompactTick = startTick;
+    Log(L"[MONITOR] Event-driven snapshots (debounce %d ms, max staleness %d s)",
+        MONITOR_DEBOUNCE_MS, (int)(config.monitorMaxStaleMs / 1000));
+
     while (true)
     {
         if (g_shouldStop)
@@ -998,9 +1409,9 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
             Log(L"[MONITOR] DLL unload stop signal received");
             break;
         }
-        if (g_pipeConnected) {
-            if (PipeCheckStop()) {
-                Log(L"[PIPE] Stop signal received");
+        if (service) {
+            if (!service()) {
+                Log(L"[PIPE] Stop signal received (no monitor clients left)");
                 break;
             }
         } else {
@@ -1016,11 +1427,56 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
         while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
         { TranslateMessage(&msg); DispatchMessage(&msg); }
 
-        Sleep(100);
+        DWORD now = GetTickCount();
+        if (now - lastCompactTick >= MONITOR_COMPACT_MS)
+        {
+            ExecuteOnMainSTA(DoCompactEnumerators);
+            lastCompactTick = now;
+        }
+
+        LONG changes = g_topologyChanges;
+        if (changes != seenChanges)
+        {
+            seenChanges = changes;
+            if (!changePending) { changePending = true; firstChangeTick = now; }
+            lastChangeTick = now;
+        }
+
+        const wchar_t* reason = nullptr;
+        DWORD waitMs = MONITOR_STOP_POLL_MS;
+        if (changePending)
+        {
+            DWORD quiet = now - lastChangeTick;
+            DWORD burst = now - firstChangeTick;
+            if (quiet >= MONITOR_DEBOUNCE_MS || burst >= MONITOR_DEBOUNCE_MAX_MS)
+                reason = L"change";
+            else
+                waitMs = std::min<DWORD>(waitMs, std::min<DWORD>(MONITOR_DEBOUNCE_MS - quiet, MONITOR_DEBOUNCE_MAX_MS - burst));
+        }
+        if (!reason && config.monitorMaxStaleMs > 0)
+        {
+            DWORD age = now - lastSnapTick;
+            if (age >= config.monitorMaxStaleMs)
+                reason = L"stale";
+            else
+                waitMs = std::min<DWORD>(waitMs, config.monitorMaxStaleMs - age);
+        }
+
+        if (!reason)
+        {
+            // Sleep until a sink event, client work, a window message, or the next deadline
+            HANDLE handles[2];
+            DWORD count = 0;
+            if (g_hTopologyChanged) handles[count++] = g_hTopologyChanged;
+            if (hServiceEvent) handles[count++] = hServiceEvent;
+            MsgWaitForMultipleObjects(count, handles, FALSE, waitMs, QS_ALLINPUT);
+            continue;
+        }
 
-        DWORD elapsed = GetTickCount() - startTick;
+        changePending = false;
+        lastSnapTick = now;
+        DWORD elapsed = now - startTick;
 
-        if (elapsed > 0 && elapsed % 10000 < 100)
         {
             snapshotNum++;
             std::wstring snapFile;
@@ -1028,16 +1484,21 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
                 wchar_t fname[64];
                 swprintf(fname, 64, L"hook_topo_monitor_%d.xml", snapshotNum);
                 snapFile = LogPath(config.logDir, fname);
-            } else {
-                snapFile = LogPath(config.logDir, L"hook_topo_poll.xml");
             }
-            if (SaveTopologyXML(pGlobals, snapFile.c_str()))
+            // Take the dirty state before saving so events that land during
+            // the capture are kept for the next round
+            std::set<std::wstring> dirtyDevices;
+            bool ethernetDirty = TakeDirtyDevices(dirtyDevices);
+            bool fullRefresh = (snapshotNum == 1) || (wcscmp(reason, L"stale") == 0);
+
+            TopologySnapshot snap;
+            if (CaptureTopologySnapshot(pGlobals, config.debugXml ? snapFile.c_str() : nullptr, snap, false))
             {
-                TopologyCounts c = CountDevicesInXML(snapFile.c_str());
-                PipeSendStatus(c.totalDevices, c.identifiedDevices, (int)g_discoveredDevices.size());
-                Log(L"[MONITOR] Snapshot %d @ %ds: %d devices, %d identified, %d events",
-                    snapshotNum, elapsed / 1000, c.totalDevices, c.identifiedDevices,
-                    (int)g_discoveredDevices.size());
+                TopologyCounts c = CountDevicesInXML(snap);
+                PipeSendStatus(c.totalDevices, c.identifiedDevices, g_discoveredDevices.Count());
+                Log(L"[MONITOR] Snapshot %d @ %ds (%s): %d devices, %d identified, %d events",
+                    snapshotNum, elapsed / 1000, reason, c.totalDevices, c.identifiedDevices,
+                    g_discoveredDevices.Count());
 
                 if (!busBrowseDone && c.identifiedDevices > 0)
                 {
@@ -1047,6 +1508,7 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
                     HRESULT hrBus = ExecuteOnMainSTA(DoBusBrowse);
                     Log(L"[MONITOR] Bus browse: hr=0x%08x", hrBus);
                     busBrowseDone = true;
+                    fullRefresh = true;   // DoBusBrowse may have added devices to g_deviceDetails
                 }
 
                 if (busBrowseDone && !backplaneBrowseDone && !g_capturedBuses.empty())
@@ -1056,36 +1518,32 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
                     HRESULT hrBP = ExecuteOnMainSTA(DoBackplaneBrowse);
                     Log(L"[MONITOR] Backplane browse: hr=0x%08x", hrBP);
                     backplaneBrowseDone = true;
+                    fullRefresh = true;
                 }
 
-                // Update caches before tree walk so WalkTopologyTree has fresh IP/classname data
-                UpdateDeviceIPsFromXML(snapFile.c_str());
-                PopulateQueryCache(snapFile.c_str());
+                // Update caches before tree walk so WalkTopologyTree has fresh IP/classname data.
+                // Between full refreshes only the chassis the sinks marked dirty are rebuilt.
+                int refreshed = 0;
+                if (!fullRefresh && ethernetDirty)
+                    UpdateDeviceIPsFromXML(snap);
+                if (!fullRefresh && RefreshQueryCache(snap, ethernetDirty, dirtyDevices, refreshed))
+                {
+                    Log(L"[MONITOR] Incremental refresh: %d dirty chassis, ethernet %s, %d subtrees rebuilt",
+                        (int)dirtyDevices.size(), ethernetDirty ? L"dirty" : L"clean", refreshed);
+                }
+                else
+                {
+                    // Once the backplanes are browsed a full rebuild is a complete picture
+                    UpdateDeviceIPsFromXML(snap);
+                    PopulateQueryCache(snap, backplaneBrowseDone);
+                    if (backplaneBrowseDone) SaveWarmCache();
+                }
+                NotifyCacheSubscribers();
                 WalkTopologyTree(pGlobals);
                 if (config.debugXml)
                     PipeSendTopology(snapFile.c_str());
-
-                std::wstring resultsPath = LogPath(config.logDir, L"hook_results.txt");
-                FILE* rf = _wfopen(resultsPath.c_str(), L"w, ccs=UTF-8");
-                if (rf)
-                {
-                    fwprintf(rf, L"MODE: monitor\n");
-                    fwprintf(rf, L"SNAPSHOT: %d\n", snapshotNum);
-                    fwprintf(rf, L"DEVICES_IDENTIFIED: %d\n", c.identifiedDevices);
-                    fwprintf(rf, L"DEVICES_TOTAL: %d\n", c.totalDevices);
-                    fwprintf(rf, L"EVENTS: %d\n", (int)g_discoveredDevices.size());
-                    fwprintf(rf, L"ELAPSED: %d\n", elapsed / 1000);
-                    for (const auto& kv : g_deviceDetails)
-                    {
-                        const DeviceInfo& d = kv.second;
-                        fwprintf(rf, L"DEVICE: %s | %s\n",
-                            d.ip.empty() ? L"(no IP)" : d.ip.c_str(),
-                            d.productName.c_str());
-                    }
-                    fclose(rf);
-                }
-
-                lastIdentified = c.identifiedDevices;
+                // hook_results.txt is written once, when the loop ends: live
+                // results go to C|STREAM=1 clients as I| records
             }
         }
     }
@@ -1098,10 +1556,11 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
 
     DWORD totalElapsed = GetTickCount() - startTick;
     {
-        std::wstring finalSnap = LogPath(config.logDir, config.debugXml ? L"hook_topo_monitor_final.xml" : L"hook_topo_poll.xml");
-        SaveTopologyXML(pGlobals, finalSnap.c_str());
-        TopologyCounts fc = CountDevicesInXML(finalSnap.c_str());
-        UpdateDeviceIPsFromXML(finalSnap.c_str());
+        std::wstring finalSnap = LogPath(config.logDir, L"hook_topo_monitor_final.xml");
+        TopologySnapshot snap;
+        CaptureTopologySnapshot(pGlobals, config.debugXml ? finalSnap.c_str() : nullptr, snap, false);
+        TopologyCounts fc = CountDevicesInXML(snap);
+        UpdateDeviceIPsFromXML(snap);
 
         std::wstring resultsPath = LogPath(config.logDir, L"hook_results.txt");
         FILE* rf = _wfopen(resultsPath.c_str(), L"w, ccs=UTF-8");
@@ -1111,7 +1570,10 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
             fwprintf(rf, L"SNAPSHOT: %d (final)\n", snapshotNum);
             fwprintf(rf, L"DEVICES_IDENTIFIED: %d\n", fc.identifiedDevices);
             fwprintf(rf, L"DEVICES_TOTAL: %d\n", fc.totalDevices);
-            fwprintf(rf, L"EVENTS: %d\n", (int)g_discoveredDevices.size());
+            fwprintf(rf, L"EVENTS: %d\n", g_discoveredDevices.Count());
+            fwprintf(rf, L"EVENTS_DISTINCT: %d\n", g_discoveredDevices.Distinct());
+            for (const auto& addr : g_discoveredDevices.Recent())
+                fwprintf(rf, L"RECENT_EVENT: %s\n", addr.c_str());
             fwprintf(rf, L"ELAPSED: %d\n", totalElapsed / 1000);
             for (const auto& kv : g_deviceDetails)
             {
@@ -1124,13 +1586,7 @@ void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, cons
         }
 
         Log(L"[MONITOR] Final: %d devices, %d identified, %d events, %ds elapsed",
-            fc.totalDevices, fc.identifiedDevices, (int)g_discoveredDevices.size(), totalElapsed / 1000);
-    }
-
-    if (!config.debugXml)
-    {
-        std::wstring pollPath = LogPath(config.logDir, L"hook_topo_poll.xml");
-        DeleteFileW(pollPath.c_str());
+            fc.totalDevices, fc.identifiedDevices, g_discoveredDevices.Count(), totalElapsed / 1000);
     }
 
     Log(L"[MONITOR] Monitor loop complete");
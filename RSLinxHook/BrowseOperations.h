@@ -8,8 +8,18 @@
 // Globals defined in BrowseOperations.cpp
 // ============================================================
 
-struct ConnectionPointInfo { IConnectionPoint* pCP; DWORD cookie; };
-struct EnumeratorInfo { void* pEnumInterface; DualEventSink* pSink; };
+struct ConnectionPointInfo { IConnectionPoint* pCP; DWORD cookie; DualEventSink* pSink; };
+struct EnumeratorInfo {
+    void* pEnumInterface;
+    DualEventSink* pSink;
+    bool scheduled = false;    // started by the backplane scheduler
+    bool stopped = false;      // stopped via vtable[8] by the scheduler, or never started
+    DWORD startTick = 0;       // scheduled jobs only
+    // What it browses: driver name, or device objectid for device and
+    // backplane enumerators. An older enumerator with the same target is
+    // superseded (DoCompactEnumerators); empty is never superseded.
+    std::wstring target;
+};
 
 extern std::vector<ConnectionPointInfo> g_connectionPoints;
 extern std::vector<EnumeratorInfo> g_enumerators;
@@ -18,14 +28,116 @@ extern IUnknown* g_pMainEnumUnk;
 
 // Browse-state tracking: which driver names / IPs have completed each phase
 extern std::set<std::wstring> g_browsedDrivers;    // driver names with Phase 2+3 complete
-extern std::set<std::wstring> g_browsedBackplanes; // IPs with Phase 4+4b complete
+extern std::set<std::wstring> g_browsedBackplanes; // IPs whose backplane browse finished
 
+// A stopped enumerator counts as cycled
 bool EnumeratorsCycledSince(int baseline);
 void GetEnumeratorStatusSince(int baseline, int& completed, int& total);
 
+// Wait for the enumerators added since baseline to complete a cycle: all of
+// them (waitAll) or at least one. Wakes on g_hEnumeratorDone rather than
+// polling, pumping worker messages meanwhile. Returns true if the condition
+// was met, false on timeout or STOP. Capture baseline BEFORE the
+// ExecuteOnMainSTA call that starts the enumerators.
+bool WaitEnumeratorsSince(int baseline, bool waitAll, DWORD timeoutMs);
+
+// Per-bus-type limits for the enumerator waits, shared by the inject
+// phases and query browses. A driver or device bus enumerator cycles once
+// it has polled its Node Table or ports (Phase 5). Backplane enumerators
+// start in waves of C|BPINFLIGHT and each polls every slot of a chassis,
+// so Phase 5b allows twice as long.
+#define ENUM_WAIT_DRIVER_MS     30000
+#define ENUM_WAIT_BUS_MS        30000
+#define ENUM_WAIT_BACKPLANE_MS  60000
+
 IDispatch* GetBusDispatch(const wchar_t* driverName);
+
+// ============================================================
+// Backplane browse scheduler
+// DoBackplaneBrowse queues one job per chassis backplane bus rather than
+// starting them all at once; at most HookConfig::backplaneInFlight
+// (C|BPINFLIGHT=N, 0 = no limit) run at a time across all drivers.
+// Chassis whose IP is in g_backplanePriorityIPs — the ones pending Q|
+// queries want — are started first. DoBackplaneSchedule stops every
+// scheduled enumerator that has cycled (vtable[8] Stop, as cleanup does)
+// or run past BACKPLANE_JOB_TIMEOUT_MS, then starts queued jobs into the
+// freed slots. The worker calls it each time an enumerator completes
+// (RunBackplaneSchedule, or the Phase 5b poll).
+// With no limit every job starts at once and nothing is stopped early.
+// ============================================================
+
+#define BACKPLANE_JOB_TIMEOUT_MS  15000
+
+// Written by the worker before DoBackplaneBrowse
+extern std::set<std::wstring> g_backplanePriorityIPs;
+
+// Written on the main STA by the scheduler functions, read by the worker
+// after ExecuteOnMainSTA returns
+struct BackplaneScheduleState {
+    int queued = 0;            // jobs not started yet
+    int inFlight = 0;          // started, not cycled or stopped
+    int priorityPending = 0;   // priority jobs queued or in flight
+};
+extern BackplaneScheduleState g_backplaneSchedule;
+
+HRESULT DoBackplaneSchedule();
+// Release every queued job without starting it
+HRESULT DoBackplaneQueueClear();
+
+// Worker: step the scheduler until every job since baseline has finished
+// (or, with priorityOnly, every priority job; the rest of the queue is
+// then dropped). False on timeout or STOP.
+bool RunBackplaneSchedule(int baseline, bool priorityOnly, DWORD timeoutMs);
+
+// Worker, after the scheduler has run: add each of ips whose chassis is
+// finished to g_browsedBackplanes — its backplane job cycled, or the last
+// DoBackplaneBrowse found no backplane bus on it. A job that was dropped,
+// timed out or never started leaves its IP to be browsed on the next
+// query. Returns the number marked.
+int MarkBrowsedBackplanes(const std::set<std::wstring>& ips);
+
+// Phase 1 work: IPs to add to one driver (already de-duplicated against the
+// topology). Filled by the worker, processed by DoConnectNewDevices on the
+// main STA, counts written back for the summary.
+struct ConnectBatch {
+    std::wstring driverName;
+    std::vector<std::wstring> ips;
+    bool done = false;          // false: bus not reachable from the main STA
+    int added = 0, existing = 0, failed = 0;
+};
+extern std::vector<ConnectBatch> g_connectBatches;
+
+// Batches above this size log failures only (plus the per-driver summary)
+#define CONNECT_LOG_EACH_MAX  20
+#define CONNECT_LOG_FAIL_MAX  10
+
+// Invoke DISPID 54 (ConnectNewDevice) for every IP in batch on pBus
+void ConnectDevicesOnBus(IDispatch* pBus, ConnectBatch& batch);
+HRESULT DoConnectNewDevices();
 HRESULT DoMainSTABrowse();
 HRESULT DoBusBrowse();
 HRESULT DoBackplaneBrowse();
 HRESULT DoCleanupOnMainSTA();
-void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, const std::vector<BusInfo>& buses);
+
+// Drop enumerators a later browse superseded (same target, newer
+// entry) and scheduler jobs that never started or timed out: Stop,
+// unadvise their connection points, release enumerator and sink. Query
+// browses add a fresh set each time, so without this g_enumerators /
+// g_connectionPoints only grow until cleanup. Shifts g_enumerators
+// indices: never call while a baseline taken before it is still in use.
+HRESULT DoCompactEnumerators();
+// Monitor loop timing: a snapshot runs MONITOR_DEBOUNCE_MS after the last sink
+// event, or MONITOR_DEBOUNCE_MAX_MS after the first one while events keep
+// arriving; otherwise the loop sleeps, checking for stop every MONITOR_STOP_POLL_MS.
+#define MONITOR_DEBOUNCE_MS      500
+#define MONITOR_DEBOUNCE_MAX_MS  3000
+#define MONITOR_STOP_POLL_MS     250
+#define MONITOR_COMPACT_MS       600000   // DoCompactEnumerators interval
+
+// Called on every monitor pass to serve pipe clients; false ends the loop.
+// hServiceEvent (may be NULL) wakes the loop when there is work for it.
+// Without a service function the loop stops on <logDir>\hook_stop.txt.
+typedef bool (*MonitorServiceFunc)();
+
+void RunMonitorLoop(const HookConfig& config, IRSTopologyGlobals* pGlobals, const std::vector<BusInfo>& buses,
+                    MonitorServiceFunc service = nullptr, HANDLE hServiceEvent = NULL);
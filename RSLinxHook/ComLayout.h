@@ -0,0 +1,126 @@
+#pragma once
+// ============================================================
+// ComLayout.h - seeded by hand from the DISPIDs and slots the hook
+// already called; not yet generated. Replace it by running, against the
+// installed type libraries (and again after an RSLinx upgrade):
+//   TypeLibDump.exe --header ..\RSLinxHook\ComLayout.h
+// TypeLibDump is compiled against this file and takes its member list
+// from kMembers, so a binding added here by hand is kept when it runs.
+// DISPIDs are looked up by member name. Vtable slots are the ones the
+// hook calls, checked for their parameter count where a library
+// describes the interface. VerifyComLayout repeats both checks at hook
+// startup.
+// ============================================================
+
+#include <windows.h>
+#include <oleauto.h>
+
+namespace ComLayout {
+
+template <DISPID Id, WORD Kind>
+struct DispMember {
+    static constexpr DISPID id = Id;
+    static constexpr WORD kind = Kind;
+};
+
+template <int Slot>
+struct VtblSlot {
+    static constexpr int slot = Slot;
+};
+
+// pDisp->Invoke with the member's DISPID and invoke kind
+template <DISPID Id, WORD Kind>
+inline HRESULT Invoke(IDispatch* pDisp, DispMember<Id, Kind>, DISPPARAMS* dp, VARIANT* result,
+                      EXCEPINFO* excep = nullptr, UINT* argErr = nullptr)
+{
+    return pDisp->Invoke(Id, IID_NULL, LOCALE_USER_DEFAULT, Kind, dp, result, excep, argErr);
+}
+
+// One bound member, as VerifyComLayout checks it. An all-zero iid means
+// the member is searched for in every interface of the libraries.
+struct Member {
+    const wchar_t* iface;
+    GUID iid;
+    const wchar_t* name;
+    WORD kind;      // DISPATCH_METHOD / DISPATCH_PROPERTYGET; 0 = vtable slot
+    DISPID dispid;  // kind != 0
+    int slot;       // kind == 0
+    int params;     // kind == 0: parameter count at that slot
+};
+
+namespace ITopologyObject {    // {BB55A38E-8502-11D0-AD54-00C04FD915B9}
+    constexpr DispMember<1, DISPATCH_PROPERTYGET> Name{};
+    constexpr DispMember<2, DISPATCH_PROPERTYGET> objectid{};
+}
+
+namespace ITopologyCollection {    // {2D76DE6C-94A0-11D0-AD56-00C04FD915B9}
+    constexpr DispMember<1, DISPATCH_PROPERTYGET> Count{};
+}
+
+namespace ITopologyBus {    // {25C81D16-F7BA-11D0-AD73-00C04FD915B9}
+    constexpr DispMember<4, DISPATCH_PROPERTYGET> path{};
+    constexpr DispMember<50, DISPATCH_PROPERTYGET> Devices{};
+    constexpr DispMember<54, DISPATCH_METHOD> ConnectNewDevice{};
+}
+
+namespace ITopologyDevice_Dual {    // {B2A20A5E-F7B9-11D0-AD73-00C04FD915B9}
+    constexpr DispMember<38, DISPATCH_PROPERTYGET> GetBusEx{};
+    constexpr DispMember<51, DISPATCH_PROPERTYGET> Busses{};
+}
+
+namespace RSTopologyGlobals {    // any interface
+    constexpr DispMember<0x60020000, DISPATCH_METHOD> SaveTopologyXML{};
+}
+
+namespace IRSTopologyDevice {    // {DCEAD8E1-2E7A-11CF-B4B5-C46F03C10000}
+    constexpr VtblSlot<14> AddPort{};
+    constexpr VtblSlot<19> GetBackplanePort{};
+}
+
+namespace IRSTopologyPort {    // {98E549B2-B27E-11D0-AD5E-00C04FD915B9}
+    constexpr VtblSlot<10> GetBus{};
+}
+
+namespace IRSObject {    // {94CB2140-450F-11CF-B4B5-C46F03C10000}
+    constexpr VtblSlot<7> GetName{};
+}
+
+namespace IOnlineEnumeratorTypeLib {    // {FC357A88-0A98-11D1-AD78-00C04FD915B9}
+    constexpr VtblSlot<7> Start{};
+    constexpr VtblSlot<8> Stop{};
+}
+
+constexpr Member kMembers[] = {
+    { L"ITopologyObject", { 0xBB55A38E, 0x8502, 0x11D0, { 0xAD, 0x54, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"Name", DISPATCH_PROPERTYGET, 1, -1, -1 },
+    { L"ITopologyObject", { 0xBB55A38E, 0x8502, 0x11D0, { 0xAD, 0x54, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"objectid", DISPATCH_PROPERTYGET, 2, -1, -1 },
+    { L"ITopologyCollection", { 0x2D76DE6C, 0x94A0, 0x11D0, { 0xAD, 0x56, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"Count", DISPATCH_PROPERTYGET, 1, -1, -1 },
+    { L"ITopologyBus", { 0x25C81D16, 0xF7BA, 0x11D0, { 0xAD, 0x73, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"path", DISPATCH_PROPERTYGET, 4, -1, -1 },
+    { L"ITopologyBus", { 0x25C81D16, 0xF7BA, 0x11D0, { 0xAD, 0x73, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"Devices", DISPATCH_PROPERTYGET, 50, -1, -1 },
+    { L"ITopologyBus", { 0x25C81D16, 0xF7BA, 0x11D0, { 0xAD, 0x73, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"ConnectNewDevice", DISPATCH_METHOD, 54, -1, -1 },
+    { L"ITopologyDevice_Dual", { 0xB2A20A5E, 0xF7B9, 0x11D0, { 0xAD, 0x73, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"GetBusEx", DISPATCH_PROPERTYGET, 38, -1, -1 },
+    { L"ITopologyDevice_Dual", { 0xB2A20A5E, 0xF7B9, 0x11D0, { 0xAD, 0x73, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"Busses", DISPATCH_PROPERTYGET, 51, -1, -1 },
+    { L"RSTopologyGlobals", { 0x00000000, 0x0000, 0x0000, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+      L"SaveTopologyXML", DISPATCH_METHOD, 0x60020000, -1, -1 },
+    { L"IRSTopologyDevice", { 0xDCEAD8E1, 0x2E7A, 0x11CF, { 0xB4, 0xB5, 0xC4, 0x6F, 0x03, 0xC1, 0x00, 0x00 } },
+      L"AddPort", 0, DISPID_UNKNOWN, 14, 6 },
+    { L"IRSTopologyDevice", { 0xDCEAD8E1, 0x2E7A, 0x11CF, { 0xB4, 0xB5, 0xC4, 0x6F, 0x03, 0xC1, 0x00, 0x00 } },
+      L"GetBackplanePort", 0, DISPID_UNKNOWN, 19, 1 },
+    { L"IRSTopologyPort", { 0x98E549B2, 0xB27E, 0x11D0, { 0xAD, 0x5E, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"GetBus", 0, DISPID_UNKNOWN, 10, 1 },
+    { L"IRSObject", { 0x94CB2140, 0x450F, 0x11CF, { 0xB4, 0xB5, 0xC4, 0x6F, 0x03, 0xC1, 0x00, 0x00 } },
+      L"GetName", 0, DISPID_UNKNOWN, 7, 2 },
+    { L"IOnlineEnumeratorTypeLib", { 0xFC357A88, 0x0A98, 0x11D1, { 0xAD, 0x78, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"Start", 0, DISPID_UNKNOWN, 7, 1 },
+    { L"IOnlineEnumeratorTypeLib", { 0xFC357A88, 0x0A98, 0x11D1, { 0xAD, 0x78, 0x00, 0xC0, 0x4F, 0xD9, 0x15, 0xB9 } },
+      L"Stop", 0, DISPID_UNKNOWN, 8, 0 },
+};
+
+} // namespace ComLayout
@@ -0,0 +1,84 @@
+#include "ComLayoutCheck.h"
+#include "ComLayout.h"
+#include "TypeInfoLookup.h"
+#include "Logging.h"
+
+bool g_comLayoutMismatch = false;
+
+enum class LayoutOutcome { Ok, Mismatch, Skipped };
+
+// ============================================================
+// One binding (lookups shared with TypeLibDump --header)
+// ============================================================
+
+static LayoutOutcome CheckDispMember(ITypeLib* const* libs, int count,
+                                     const ComLayout::Member& m, DISPID& actual)
+{
+    bool described;
+    actual = TypeInfoLookup::LookupDispMember(libs, count, m.iid, m.name, m.kind, described);
+    if (!described) return LayoutOutcome::Skipped;
+    return (actual == m.dispid) ? LayoutOutcome::Ok : LayoutOutcome::Mismatch;
+}
+
+static LayoutOutcome CheckVtblSlot(ITypeLib* const* libs, int count,
+                                   const ComLayout::Member& m, int& actual)
+{
+    bool described;
+    actual = TypeInfoLookup::LookupSlotParams(libs, count, m.iid, m.slot, described);
+    if (!described) return LayoutOutcome::Skipped;   // no library, or dispatch-only
+    return (actual == m.params) ? LayoutOutcome::Ok : LayoutOutcome::Mismatch;
+}
+
+// ============================================================
+// VerifyComLayout
+// ============================================================
+
+int VerifyComLayout(ITypeLib* const* libs, int count)
+{
+    int ok = 0, mismatched = 0, skipped = 0;
+    for (const ComLayout::Member& m : ComLayout::kMembers)
+    {
+        LayoutOutcome outcome;
+        if (m.kind != 0)
+        {
+            DISPID actual;
+            outcome = CheckDispMember(libs, count, m, actual);
+            if (outcome == LayoutOutcome::Mismatch)
+            {
+                if (actual == DISPID_UNKNOWN)
+                    Log(L"[LAYOUT] FAIL %s::%s: DISPID %d expected, member not found",
+                        m.iface, m.name, m.dispid);
+                else
+                    Log(L"[LAYOUT] FAIL %s::%s: DISPID %d expected, type library has %d",
+                        m.iface, m.name, m.dispid, actual);
+            }
+        }
+        else
+        {
+            int actual;
+            outcome = CheckVtblSlot(libs, count, m, actual);
+            if (outcome == LayoutOutcome::Mismatch)
+            {
+                if (actual < 0)
+                    Log(L"[LAYOUT] FAIL %s::%s: no function at vtable slot %d",
+                        m.iface, m.name, m.slot);
+                else
+                    Log(L"[LAYOUT] FAIL %s::%s: slot %d takes %d parameter(s), expected %d",
+                        m.iface, m.name, m.slot, actual, m.params);
+            }
+        }
+        if (outcome == LayoutOutcome::Skipped)
+            Log(L"[LAYOUT] WARN %s::%s: not described by the type libraries, unchecked",
+                m.iface, m.name);
+
+        if (outcome == LayoutOutcome::Ok) ok++;
+        else if (outcome == LayoutOutcome::Mismatch) mismatched++;
+        else skipped++;
+    }
+
+    g_comLayoutMismatch = mismatched > 0;
+    Log(L"[LAYOUT] %d binding(s) checked: %d ok, %d mismatched, %d unchecked%s",
+        ok + mismatched + skipped, ok, mismatched, skipped,
+        mismatched ? L" - commands will be refused" : L"");
+    return mismatched;
+}
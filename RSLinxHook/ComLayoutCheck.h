@@ -0,0 +1,20 @@
+#pragma once
+#include "RSLinxHook_fwd.h"
+
+// ============================================================
+// Startup check of ComLayout.h against the loaded type libraries
+// Each ComLayout::kMembers entry is resolved in libs: a DISPID binding
+// by member name and invoke kind (base interfaces included), a vtable
+// binding by its slot, which must hold a function taking the recorded
+// number of parameters. An interface no library describes is skipped.
+// One [LAYOUT] line per mismatch or skip, then a summary.
+// ============================================================
+
+// Worker, before the pipe server starts. libs may hold nulls (a library
+// that failed to load). Returns the number of mismatches and sets
+// g_comLayoutMismatch when there is any.
+int VerifyComLayout(ITypeLib* const* libs, int count);
+
+// Set once at startup: browse and query commands are refused, since a
+// call through a moved DISPID or slot reaches the wrong member
+extern bool g_comLayoutMismatch;
@@ -15,35 +15,50 @@ std::wstring Utf8ToWide(const char* utf8)
     return result;
 }
 
-bool ReadConfigFromPipe(HookConfig& config)
+bool ReadConfigFromPipe(PipeSession* session, HookConfig& config)
 {
-    if (!g_pipeConnected) return false;
+    if (!session->connected) return false;
     char buf[4096];
-    std::string accumulated;
     while (true) {
-        DWORD bytesRead = 0;
-        if (!ReadFile(g_hPipe, buf, sizeof(buf) - 1, &bytesRead, NULL) || bytesRead == 0)
-            return false;
-        buf[bytesRead] = '\0';
-        accumulated += buf;
-        // Process complete lines
-        size_t pos;
-        while ((pos = accumulated.find('\n')) != std::string::npos) {
-            std::string line = accumulated.substr(0, pos);
-            accumulated.erase(0, pos + 1);
-            if (!line.empty() && line.back() == '\r') line.pop_back();
-            if (line == "C|END") return true;
-            if (line.length() >= 2 && line[0] == 'C' && line[1] == '|') {
-                std::wstring wval = Utf8ToWide(line.c_str() + 2);
-                if (wval == L"MODE=inject") config.mode = HookMode::Inject;
-                else if (wval == L"MODE=monitor") config.mode = HookMode::Monitor;
-                else if (wval.length() >= 7 && wval.substr(0, 7) == L"LOGDIR=") config.logDir = wval.substr(7);
-                else if (wval == L"DEBUGXML=1") config.debugXml = true;
-                else if (wval == L"PROBE=1") config.probeDispids = true;
-                else if (wval.length() >= 7 && wval.substr(0, 7) == L"DRIVER=") config.drivers.push_back({wval.substr(7), {}, false});
-                else if (wval == L"NEWDRIVER=1" && !config.drivers.empty()) config.drivers.back().newDriver = true;
-                else if (wval.length() >= 3 && wval.substr(0, 3) == L"IP=" && !config.drivers.empty()) config.drivers.back().ipAddresses.push_back(wval.substr(3));
+        // Buffered reader: anything sent right after C|END stays queued
+        // for the session's command loop
+        if (!PipeReadLine(session, buf, sizeof(buf))) return false;
+        std::string line(buf);
+        if (line == "C|END") return true;
+        if (line.length() >= 2 && line[0] == 'H' && line[1] == '|') {
+            // Attach ping: the caller answers it, and reads the rest of
+            // the config only if the hook turns out to be cold
+            config.hello = true;
+            config.helloDrivers.clear();
+            std::wstring list = Utf8ToWide(line.c_str() + 2);
+            size_t start = 0;
+            while (start < list.size()) {
+                size_t comma = list.find(L',', start);
+                if (comma == std::wstring::npos) comma = list.size();
+                if (comma > start) config.helloDrivers.push_back(list.substr(start, comma - start));
+                start = comma + 1;
             }
+            return true;
+        }
+        if (line.length() >= 2 && line[0] == 'C' && line[1] == '|') {
+            std::wstring wval = Utf8ToWide(line.c_str() + 2);
+            if (wval == L"MODE=inject") config.mode = HookMode::Inject;
+            else if (wval == L"MODE=monitor") config.mode = HookMode::Monitor;
+            else if (wval.length() >= 7 && wval.substr(0, 7) == L"LOGDIR=") config.logDir = wval.substr(7);
+            else if (wval == L"DEBUGXML=1") config.debugXml = true;
+            else if (wval == L"PROBE=1") config.probeDispids = true;
+            else if (wval == L"DELTA=1") config.deltaTopology = true;
+            else if (wval == L"BINARY=1") config.binaryProtocol = true;
+            else if (wval == L"WALK=1") config.walkTopology = true;
+            else if (wval == L"SWR=1") config.staleWhileRevalidate = true;
+            else if (wval == L"STREAM=1") config.streamDevices = true;
+            else if (wval.length() >= 11 && wval.substr(0, 11) == L"BPINFLIGHT=") config.backplaneInFlight = _wtoi(wval.c_str() + 11);
+            else if (wval.length() >= 9 && wval.substr(0, 9) == L"MAXSTALE=") config.monitorMaxStaleMs = (DWORD)_wtoi(wval.c_str() + 9) * 1000;
+            else if (wval.length() >= 9 && wval.substr(0, 9) == L"LOGLEVEL=") config.logLevel = ParseLogLevel(wval.substr(9));
+            else if (wval.length() >= 7 && wval.substr(0, 7) == L"DRIVER=") config.drivers.push_back({wval.substr(7), {}, false});
+            else if (wval == L"NEWDRIVER=1" && !config.drivers.empty()) config.drivers.back().newDriver = true;
+            else if (wval.length() >= 3 && wval.substr(0, 3) == L"IP=" && !config.drivers.empty()) config.drivers.back().ipAddresses.push_back(wval.substr(3));
+            else if (wval.length() >= 5 && wval.substr(0, 5) == L"SKIP=" && !config.drivers.empty()) config.drivers.back().skipIPs.push_back(wval.substr(5));
         }
     }
 }
@@ -7,10 +7,19 @@
 
 enum class HookMode { Inject, Monitor };
 
+// H| attach ping: the hook answers H|<version>|READY|<caps> or
+// H|<version>|COLD|<caps> (see ReadConfigFromPipe)
+#define HOOK_HELLO_VERSION 1
+#define HOOK_CAPABILITIES "Q,QB,F,W,B,P,WALK,SWR,STREAM,BINARY,DELTA"
+
 struct DriverEntry {
     std::wstring name;
     std::vector<std::wstring> ipAddresses;
     bool newDriver = false;
+    // C|SKIP=<ip>: Node Table hosts the client found offline (ListIdentity
+    // pre-scan). Not connected and given no backplane enumerator, so the
+    // Phase 5/5b enumerator waits do not sit on hosts that never answer.
+    std::vector<std::wstring> skipIPs;
 };
 
 struct HookConfig
@@ -20,6 +29,16 @@ struct HookConfig
     std::wstring logDir = L"C:\\temp";
     bool debugXml = false;
     bool probeDispids = false;
+    bool deltaTopology = false;   // C|DELTA=1: client applies N|DELTA blocks
+    DWORD monitorMaxStaleMs = 30000; // C|MAXSTALE=<s>: monitor snapshots at least this often (0 = events only)
+    int logLevel = -1;            // C|LOGLEVEL=info|debug|...: see Logging.h (-1 = default)
+    bool binaryProtocol = false;  // C|BINARY=1: framed hook -> client output (see PipeBinary.h)
+    bool walkTopology = false;    // C|WALK=1: Q| misses read the chassis from COM (TopologyWalker.h)
+    int backplaneInFlight = 8;    // C|BPINFLIGHT=N: backplane enumerators running at once (0 = no limit)
+    bool staleWhileRevalidate = false; // C|SWR=1: Q|/QB| misses answered at once, PENDING (this client only)
+    bool streamDevices = false;   // C|STREAM=1: I| record per identified device (this client only, see QueryWatch.h)
+    bool hello = false;           // config ended with H| instead of C|END (query-only attach)
+    std::vector<std::wstring> helloDrivers;   // H|<driver>,<driver>: drivers the client needs the hook to hold
 
     // Backward compat helpers
     const std::wstring& driverName() const { return drivers[0].name; }
@@ -45,4 +64,6 @@ struct BusInfo {
 };
 
 std::wstring Utf8ToWide(const char* utf8);
-bool ReadConfigFromPipe(HookConfig& config);
+// C| lines up to C|END from one client (its session thread), or up to
+// an H| ping (config.hello set); a cold hook calls again for the rest
+bool ReadConfigFromPipe(PipeSession* session, HookConfig& config);
@@ -0,0 +1,260 @@
+#include "DeviceStore.h"
+#include <cwctype>
+
+// ============================================================
+// DeviceStore implementation
+// ============================================================
+
+static const std::wstring s_emptyName;
+
+void DeviceStore::Clear()
+{
+    // Port ids stay valid across refreshes, only the devices go
+    m_devices.clear();
+    m_byClass.clear();
+    m_byName.clear();
+    m_byPort.clear();
+}
+
+const DeviceRecord* DeviceStore::FindDevice(const std::wstring& ip) const
+{
+    auto it = m_devices.find(ip);
+    return (it != m_devices.end()) ? &it->second : nullptr;
+}
+
+DeviceRecord* DeviceStore::FindDevice(const std::wstring& ip)
+{
+    auto it = m_devices.find(ip);
+    return (it != m_devices.end()) ? &it->second : nullptr;
+}
+
+DeviceRecord& DeviceStore::UpsertDevice(const std::wstring& ip)
+{
+    DeviceRecord& dev = m_devices[ip];
+    if (dev.ip.empty()) dev.ip = ip;
+    return dev;
+}
+
+void DeviceStore::ClearSlots(const std::wstring& ip)
+{
+    DeviceRecord* dev = FindDevice(ip);
+    if (dev) dev->ports.clear();
+}
+
+void DeviceStore::ClearPort(DeviceRecord& dev, int portId)
+{
+    for (size_t i = 0; i < dev.ports.size(); i++)
+        if (dev.ports[i].portId == portId)
+        {
+            dev.ports.erase(dev.ports.begin() + i);
+            return;
+        }
+}
+
+void DeviceStore::SetSlot(DeviceRecord& dev, int portId, int slot,
+                          const std::wstring& classname, const std::wstring& deviceName)
+{
+    if (portId < 0 || slot < 0 || slot > DEVICE_STORE_MAX_SLOT) return;
+
+    SlotTable* table = nullptr;
+    for (auto& t : dev.ports)
+        if (t.portId == portId) { table = &t; break; }
+    if (!table)
+    {
+        dev.ports.emplace_back();
+        table = &dev.ports.back();
+        table->portId = portId;
+    }
+
+    if ((int)table->slots.size() <= slot)
+        table->slots.resize(slot + 1);
+    SlotEntry& e = table->slots[slot];
+    e.present = true;
+    e.classname = classname;
+    e.deviceName = deviceName;
+}
+
+bool DeviceStore::Lookup(const std::wstring& ip, const std::wstring& portName, int slot,
+                         QueryResult& out) const
+{
+    out = QueryResult();
+    const DeviceRecord* dev = FindDevice(ip);
+    if (!dev) return false;
+
+    if (portName.empty())
+    {
+        out.found = true;
+        out.ip = dev->ip;
+        out.classname = dev->classname;
+        out.deviceName = dev->deviceName;
+        return true;
+    }
+
+    int portId = FindPort(portName);
+    if (portId < 0 || slot < 0) return false;
+    for (const auto& t : dev->ports)
+    {
+        if (t.portId != portId) continue;
+        if (slot >= (int)t.slots.size() || !t.slots[slot].present) return false;
+        out.found = true;
+        out.ip = dev->ip;
+        out.portName = m_portNames[portId];
+        out.slot = slot;
+        out.classname = t.slots[slot].classname;
+        out.deviceName = t.slots[slot].deviceName;
+        return true;
+    }
+    return false;
+}
+
+// ============================================================
+// Secondary indexes and F| matching
+// ============================================================
+
+static std::wstring FoldCase(const std::wstring& s)
+{
+    std::wstring out(s);
+    for (auto& ch : out) ch = (wchar_t)towupper(ch);
+    return out;
+}
+
+// Characters before the first wildcard
+static size_t LiteralPrefix(const std::wstring& pattern)
+{
+    size_t n = pattern.find_first_of(L"*?");
+    return (n == std::wstring::npos) ? pattern.size() : n;
+}
+
+// pattern is case-folded; text is folded on the fly
+static bool WildcardMatch(const wchar_t* pattern, const wchar_t* text)
+{
+    const wchar_t* star = nullptr;
+    const wchar_t* resume = nullptr;
+    while (*text)
+    {
+        if (*pattern == L'*') { star = pattern++; resume = text; continue; }
+        if (*pattern == L'?' || *pattern == (wchar_t)towupper(*text)) { pattern++; text++; continue; }
+        if (!star) return false;
+        pattern = star + 1;
+        text = ++resume;
+    }
+    while (*pattern == L'*') pattern++;
+    return *pattern == L'\0';
+}
+
+static bool PatternMatches(const std::wstring& folded, const std::wstring& text)
+{
+    return folded.empty() || WildcardMatch(folded.c_str(), text.c_str());
+}
+
+void DeviceStore::BuildIndexes()
+{
+    m_byClass.clear();
+    m_byName.clear();
+    m_byPort.assign(m_portNames.size(), std::vector<StoreEntryRef>());
+    for (const auto& kv : m_devices)
+    {
+        const DeviceRecord& dev = kv.second;
+        StoreEntryRef ref = { &dev, nullptr, -1, -1 };
+        m_byClass[FoldCase(dev.classname)].push_back(ref);
+        m_byName[FoldCase(dev.deviceName)].push_back(ref);
+        for (const auto& t : dev.ports)
+        {
+            for (int s = 0; s < (int)t.slots.size(); s++)
+            {
+                const SlotEntry& e = t.slots[s];
+                if (!e.present) continue;
+                ref = { &dev, &e, t.portId, s };
+                m_byClass[FoldCase(e.classname)].push_back(ref);
+                m_byName[FoldCase(e.deviceName)].push_back(ref);
+                m_byPort[t.portId].push_back(ref);
+            }
+        }
+    }
+}
+
+bool DeviceStore::Find(const FindQuery& q, std::vector<QueryResult>& out, size_t max) const
+{
+    const std::wstring cls = FoldCase(q.classname), name = FoldCase(q.deviceName);
+    const std::wstring ip = FoldCase(q.ip), port = FoldCase(q.portName);
+    const bool slotsOnly = q.slot >= 0 || !port.empty();
+    size_t taken = 0;
+    bool more = false;
+
+    // false once max is reached and one more entry matched
+    auto consider = [&](const StoreEntryRef& r) -> bool {
+        if (slotsOnly && !r.slotEntry) return true;
+        if (q.slot >= 0 && r.slot != q.slot) return true;
+        const std::wstring& c = r.slotEntry ? r.slotEntry->classname : r.dev->classname;
+        const std::wstring& n = r.slotEntry ? r.slotEntry->deviceName : r.dev->deviceName;
+        if (!PatternMatches(cls, c) || !PatternMatches(name, n) || !PatternMatches(ip, r.dev->ip))
+            return true;
+        if (!port.empty() && !PatternMatches(port, PortName(r.portId))) return true;
+        if (taken == max) { more = true; return false; }
+        QueryResult res;
+        res.found = true;
+        res.classname = c;
+        res.deviceName = n;
+        res.ip = r.dev->ip;
+        res.portName = PortName(r.portId);
+        res.slot = r.slot;
+        out.push_back(res);
+        taken++;
+        return true;
+    };
+    // Every entry of an index whose key starts with prefix
+    auto scanPrefix = [&](const std::map<std::wstring, std::vector<StoreEntryRef>>& index,
+                          const std::wstring& prefix) {
+        for (auto it = index.lower_bound(prefix);
+             it != index.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+            for (const auto& r : it->second)
+                if (!consider(r)) return;
+    };
+
+    size_t clsLit = LiteralPrefix(cls), nameLit = LiteralPrefix(name);
+    if (clsLit > 0)
+        scanPrefix(m_byClass, cls.substr(0, clsLit));
+    else if (nameLit > 0)
+        scanPrefix(m_byName, name.substr(0, nameLit));
+    else if (slotsOnly)
+    {
+        for (size_t id = 0; id < m_byPort.size() && !more; id++)
+        {
+            if (!PatternMatches(port, m_portNames[id])) continue;
+            for (const auto& r : m_byPort[id])
+                if (!consider(r)) break;
+        }
+    }
+    else
+        scanPrefix(m_byClass, L"");
+    return more;
+}
+
+int DeviceStore::InternPort(const std::wstring& name)
+{
+    auto it = m_portIds.find(name);
+    if (it != m_portIds.end()) return it->second;
+    int id = (int)m_portNames.size();
+    m_portNames.push_back(name);
+    m_portIds.emplace(name, id);
+    return id;
+}
+
+int DeviceStore::FindPort(const std::wstring& name) const
+{
+    auto it = m_portIds.find(name);
+    return (it != m_portIds.end()) ? it->second : -1;
+}
+
+const std::wstring& DeviceStore::PortName(int portId) const
+{
+    if (portId < 0 || portId >= (int)m_portNames.size()) return s_emptyName;
+    return m_portNames[portId];
+}
+
+bool IsIdentifiedClassname(const std::wstring& classname)
+{
+    return !classname.empty() &&
+           classname != L"Unrecognized Device" &&
+           classname != L"Workstation";
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+
+// ============================================================
+// DeviceStore — in-memory topology cache behind Q| queries and N| walks
+// Pure C++ (no COM), filled from TopologySnapshot by PopulateQueryCache.
+//
+//   devices     IP -> DeviceRecord (hash map)
+//   DeviceRecord.ports  one SlotTable per backplane-style port, slot-indexed
+//   port names  interned once; records and lookups carry the small id
+//   indexes     classname, device name (case-folded, sorted) and port id
+//               -> entries, for F| finds; rebuilt by BuildIndexes
+// ============================================================
+
+// Path query result: ip-only (portName="", slot=-1) or backplane slot
+struct QueryResult {
+    bool found = false;
+    std::wstring classname;
+    std::wstring deviceName;
+    std::wstring ip;
+    std::wstring portName;
+    int slot = -1;
+    bool stale = false;     // served from the warm-start file, no browse has confirmed it yet
+};
+
+// Ethernet device details by topology device name (g_deviceDetails)
+struct DeviceInfo {
+    std::wstring ip;           // "10.39.31.200" (from topology XML address mapping)
+    std::wstring productName;  // DISPID 1 = Name (e.g. "5069-L310ER LOGIX310ER")
+    std::wstring objectId;     // DISPID 2 = topology objectid GUID
+};
+
+// Slot numbers come from <address type="Short">; anything outside this
+// range is not a chassis slot and is not stored.
+#define DEVICE_STORE_MAX_SLOT 1023
+
+struct SlotEntry {
+    bool present = false;
+    std::wstring classname;
+    std::wstring deviceName;
+};
+
+struct SlotTable {
+    int portId = -1;                 // interned port name
+    std::vector<SlotEntry> slots;    // index = slot number
+};
+
+struct DeviceRecord {
+    std::wstring ip;
+    std::wstring classname;
+    std::wstring deviceName;
+    std::vector<SlotTable> ports;    // usually one (Backplane)
+};
+
+// One cached path: an IP-level device (slotEntry null, portId and slot -1)
+// or one slot of it. Valid until the store next changes.
+struct StoreEntryRef {
+    const DeviceRecord* dev;
+    const SlotEntry* slotEntry;
+    int portId;
+    int slot;
+};
+
+// F| criteria: every non-empty pattern must match (case-insensitive,
+// '*' any run, '?' one character). A port or slot criterion limits the
+// find to slots; otherwise IP-level devices match too.
+struct FindQuery {
+    std::wstring classname;
+    std::wstring deviceName;
+    std::wstring ip;
+    std::wstring portName;
+    int slot = -1;                   // -1: any
+};
+
+class DeviceStore
+{
+public:
+    DeviceStore() = default;
+    DeviceStore(DeviceStore&&) = default;
+    DeviceStore& operator=(DeviceStore&&) = default;
+
+    void Clear();
+
+    // Ethernet device by IP, or nullptr (O(1))
+    const DeviceRecord* FindDevice(const std::wstring& ip) const;
+    DeviceRecord* FindDevice(const std::wstring& ip);
+    // Create or fetch; a new record has no slots
+    DeviceRecord& UpsertDevice(const std::wstring& ip);
+    // Drop every slot of one device (before rebuilding its chassis)
+    void ClearSlots(const std::wstring& ip);
+    // Drop one port's slots, leaving the device's other ports
+    void ClearPort(DeviceRecord& dev, int portId);
+
+    void SetSlot(DeviceRecord& dev, int portId, int slot,
+                 const std::wstring& classname, const std::wstring& deviceName);
+
+    // Q| lookup: portName empty -> the IP-level device
+    bool Lookup(const std::wstring& ip, const std::wstring& portName, int slot,
+                QueryResult& out) const;
+
+    // The indexes are not maintained by the calls above (callers also edit
+    // records in place): a writer rebuilds them once it is done, before it
+    // releases g_deviceStoreLock. O(entries).
+    void BuildIndexes();
+    // F| lookup through the narrowest index the query allows: a literal
+    // classname prefix, else a literal name prefix, else the matching
+    // ports' slots, else everything. Appends at most max results; returns
+    // true if more matched.
+    bool Find(const FindQuery& q, std::vector<QueryResult>& out, size_t max) const;
+
+    int InternPort(const std::wstring& name);
+    int FindPort(const std::wstring& name) const;   // -1 if never seen
+    const std::wstring& PortName(int portId) const;
+
+    size_t DeviceCount() const { return m_devices.size(); }
+    size_t PortCount() const { return m_portNames.size(); }
+    const std::unordered_map<std::wstring, DeviceRecord>& Devices() const { return m_devices; }
+
+private:
+    // The indexes point into m_devices
+    DeviceStore(const DeviceStore&) = delete;
+    DeviceStore& operator=(const DeviceStore&) = delete;
+
+    std::unordered_map<std::wstring, DeviceRecord> m_devices;
+    std::vector<std::wstring> m_portNames;
+    std::unordered_map<std::wstring, int> m_portIds;
+
+    std::map<std::wstring, std::vector<StoreEntryRef>> m_byClass;   // every entry
+    std::map<std::wstring, std::vector<StoreEntryRef>> m_byName;
+    std::vector<std::vector<StoreEntryRef>> m_byPort;              // index = port id
+};
+
+// True if a device with this classname counts as identified
+bool IsIdentifiedClassname(const std::wstring& classname);
@@ -1,11 +1,91 @@
 #include "DispatchHelpers.h"
 #include "Logging.h"
 #include "ComInterfaces.h"
+#include "ComLayout.h"
+#include "Perf.h"
+#include "STAHook.h"
+#include <unordered_map>
+
+// ============================================================
+// Capability cache — see DispatchHelpers.h
+// ============================================================
+
+struct ClassCaps {
+    int enumIface = -1;              // index into s_enumIIDs that QI accepted
+    std::vector<IID> noInterface;    // QI refused
+    std::vector<DISPID> noMember;    // Invoke returned DISP_E_MEMBERNOTFOUND
+    // DispatchFindName answers, keyed by the caller's names array
+    struct FoundName { const wchar_t* const* names; DISPID dispid; int which; };
+    std::vector<FoundName> foundNames;
+};
+
+static std::unordered_map<void*, ClassCaps> s_classCaps;
+
+// Class key of pObj, nullptr off the main STA (cache bypassed)
+static void* ClassKey(IUnknown* pObj)
+{
+    if (!pObj || GetCurrentThreadId() != g_mainThreadId) return nullptr;
+    return *(void**)pObj;
+}
+
+HRESULT CachedQueryInterface(IUnknown* pObj, REFIID riid, void** ppv)
+{
+    *ppv = nullptr;
+    if (!pObj) return E_POINTER;
+    void* key = ClassKey(pObj);
+    if (key)
+    {
+        auto it = s_classCaps.find(key);
+        if (it != s_classCaps.end())
+            for (const IID& iid : it->second.noInterface)
+                if (IsEqualIID(iid, riid))
+                {
+                    PerfAdd(PERF_CTR_QI_SKIPPED, 1);
+                    return E_NOINTERFACE;
+                }
+    }
+    HRESULT hr = pObj->QueryInterface(riid, ppv);
+    if (key && hr == E_NOINTERFACE)
+        s_classCaps[key].noInterface.push_back(riid);
+    return hr;
+}
+
+void ResetDispatchCaches()
+{
+    if (!s_classCaps.empty())
+        Log(L"[DISP] Capability cache: %d class(es) dropped", (int)s_classCaps.size());
+    s_classCaps.clear();
+}
 
 // ============================================================
 // IDispatch helper implementations
 // ============================================================
 
+// Property get, timed as PERF_INVOKE. A DISPID the object's class does
+// not have is remembered and not invoked again.
+static HRESULT InvokeGet(IDispatch* pDisp, DISPID dispid, DISPPARAMS* dp, VARIANT* result)
+{
+    void* key = ClassKey(pDisp);
+    if (key)
+    {
+        auto it = s_classCaps.find(key);
+        if (it != s_classCaps.end() &&
+            std::find(it->second.noMember.begin(), it->second.noMember.end(), dispid) != it->second.noMember.end())
+        {
+            PerfAdd(PERF_CTR_INVOKE_SKIPPED, 1);
+            return DISP_E_MEMBERNOTFOUND;
+        }
+    }
+
+    PerfScope perf(PERF_INVOKE);
+    HRESULT hr = pDisp->Invoke(dispid, IID_NULL, LOCALE_USER_DEFAULT,
+                               DISPATCH_PROPERTYGET, dp, result, nullptr, nullptr);
+    if (FAILED(hr)) PerfAdd(PERF_CTR_INVOKE_FAILED, 1);
+    if (key && hr == DISP_E_MEMBERNOTFOUND)
+        s_classCaps[key].noMember.push_back(dispid);
+    return hr;
+}
+
 // Get int property via DISPID (no args)
 int DispatchGetInt(IDispatch* pDisp, DISPID dispid)
 {
@@ -13,8 +93,7 @@ int DispatchGetInt(IDispatch* pDisp, DISPID dispid)
     DISPPARAMS dp = { nullptr, nullptr, 0, 0 };
     VARIANT result;
     VariantInit(&result);
-    HRESULT hr = pDisp->Invoke(dispid, IID_NULL, LOCALE_USER_DEFAULT,
-                                DISPATCH_PROPERTYGET, &dp, &result, nullptr, nullptr);
+    HRESULT hr = InvokeGet(pDisp, dispid, &dp, &result);
     if (FAILED(hr))
     {
         Log(L"[DISP] GetInt(DISPID %d): FAILED hr=0x%08x", dispid, hr);
@@ -35,8 +114,7 @@ std::wstring DispatchGetString(IDispatch* pDisp, DISPID dispid)
     DISPPARAMS dp = { nullptr, nullptr, 0, 0 };
     VARIANT result;
     VariantInit(&result);
-    HRESULT hr = pDisp->Invoke(dispid, IID_NULL, LOCALE_USER_DEFAULT,
-                                DISPATCH_PROPERTYGET, &dp, &result, nullptr, nullptr);
+    HRESULT hr = InvokeGet(pDisp, dispid, &dp, &result);
     if (FAILED(hr)) { VariantClear(&result); return L""; }
     std::wstring s;
     if (result.vt == VT_BSTR && result.bstrVal)
@@ -45,6 +123,58 @@ std::wstring DispatchGetString(IDispatch* pDisp, DISPID dispid)
     return s;
 }
 
+// Get any scalar property via DISPID (no args), converted to text
+std::wstring DispatchGetText(IDispatch* pDisp, DISPID dispid)
+{
+    if (!pDisp || dispid == DISPID_UNKNOWN) return L"";
+    DISPPARAMS dp = { nullptr, nullptr, 0, 0 };
+    VARIANT result;
+    VariantInit(&result);
+    HRESULT hr = InvokeGet(pDisp, dispid, &dp, &result);
+    std::wstring s;
+    if (SUCCEEDED(hr) && result.vt != VT_DISPATCH && result.vt != VT_UNKNOWN &&
+        SUCCEEDED(VariantChangeType(&result, &result, 0, VT_BSTR)) && result.bstrVal)
+        s = result.bstrVal;
+    VariantClear(&result);
+    return s;
+}
+
+DISPID DispatchFindName(IDispatch* pDisp, const wchar_t* const* names, int count, int* which)
+{
+    if (which) *which = -1;
+    if (!pDisp) return DISPID_UNKNOWN;
+    void* key = ClassKey(pDisp);
+    if (key)
+    {
+        auto it = s_classCaps.find(key);
+        if (it != s_classCaps.end())
+            for (const ClassCaps::FoundName& f : it->second.foundNames)
+                if (f.names == names)
+                {
+                    if (which) *which = f.which;
+                    return f.dispid;
+                }
+    }
+
+    // Only a name the class does not have (DISP_E_UNKNOWNNAME) is a
+    // settled miss; any other failure is asked again next time
+    DISPID found = DISPID_UNKNOWN;
+    int index = -1;
+    bool settled = true;
+    for (int i = 0; i < count && index < 0; i++)
+    {
+        LPOLESTR name = const_cast<LPOLESTR>(names[i]);
+        DISPID dispid = DISPID_UNKNOWN;
+        HRESULT hr = pDisp->GetIDsOfNames(IID_NULL, &name, 1, LOCALE_USER_DEFAULT, &dispid);
+        if (SUCCEEDED(hr)) { found = dispid; index = i; }
+        else if (hr != DISP_E_UNKNOWNNAME) settled = false;
+    }
+    if (key && (index >= 0 || settled))
+        s_classCaps[key].foundNames.push_back({ names, found, index });
+    if (which) *which = index;
+    return found;
+}
+
 // Get collection property via DISPID (no args) — returns IDispatch*
 // Tries to QI returned object for ITopologyCollection dispatch to get correct DISPIDs
 IDispatch* DispatchGetCollection(IDispatch* pDisp, DISPID dispid)
@@ -53,8 +183,7 @@ IDispatch* DispatchGetCollection(IDispatch* pDisp, DISPID dispid)
     DISPPARAMS dp = { nullptr, nullptr, 0, 0 };
     VARIANT result;
     VariantInit(&result);
-    HRESULT hr = pDisp->Invoke(dispid, IID_NULL, LOCALE_USER_DEFAULT,
-                                DISPATCH_PROPERTYGET, &dp, &result, nullptr, nullptr);
+    HRESULT hr = InvokeGet(pDisp, dispid, &dp, &result);
     if (FAILED(hr))
     {
         Log(L"[DISP] GetCollection(DISPID %d): FAILED hr=0x%08x", dispid, hr);
@@ -91,76 +220,139 @@ IDispatch* DispatchGetCollection(IDispatch* pDisp, DISPID dispid)
     return pResult;
 }
 
-// Enumerate collection using _NewEnum → IEnumVARIANT
-// Returns all items as a vector of IDispatch* (caller must Release each)
-std::vector<IDispatch*> EnumerateCollection(IDispatch* pCollection)
+// EnumerateCollection's QI chain, in order. IID_IDispatch is last and
+// always succeeds.
+static const IID s_enumIIDs[] = {
+    IID_ITopologyObject, IID_ITopologyBus, IID_ITopologyChassis, IID_IDispatch,
+};
+
+// Item VARIANT -> IDispatch* via s_enumIIDs: ITopologyObject dispatch
+// (correct DISPIDs: 1=Name, 4=path), then bus/chassis dispatch, then the
+// default IDispatch. The interface that worked for the class is tried first.
+static IDispatch* ItemDispatch(VARIANT& item)
 {
-    std::vector<IDispatch*> items;
-    if (!pCollection) return items;
+    IUnknown* pUnk = nullptr;
+    if (item.vt == VT_DISPATCH && item.pdispVal)
+        item.pdispVal->QueryInterface(IID_IUnknown, (void**)&pUnk);
+    else if (item.vt == VT_UNKNOWN && item.punkVal)
+        item.punkVal->QueryInterface(IID_IUnknown, (void**)&pUnk);
+    VariantClear(&item);
+    if (!pUnk) return nullptr;
+
+    IDispatch* pDisp = nullptr;
+    void* key = ClassKey(pUnk);
+    int cached = -1;
+    if (key)
+    {
+        auto it = s_classCaps.find(key);
+        if (it != s_classCaps.end()) cached = it->second.enumIface;
+    }
+    if (cached >= 0)
+    {
+        if (SUCCEEDED(pUnk->QueryInterface(s_enumIIDs[cached], (void**)&pDisp)) && pDisp)
+            PerfAdd(PERF_CTR_QI_SKIPPED, cached);
+        else
+            pDisp = nullptr;
+    }
+    for (int k = 0; !pDisp && k < (int)_countof(s_enumIIDs); k++)
+    {
+        if (k == cached) continue;
+        if (FAILED(pUnk->QueryInterface(s_enumIIDs[k], (void**)&pDisp)))
+            pDisp = nullptr;
+        else if (key && pDisp)
+            s_classCaps[key].enumIface = k;
+    }
+    pUnk->Release();
+    return pDisp;
+}
+
+CollectionEnumerator::CollectionEnumerator(IDispatch* pCollection, ULONG chunk)
+{
+    if (!pCollection) return;
 
     // Get _NewEnum (DISPID -4)
     DISPPARAMS dp = { nullptr, nullptr, 0, 0 };
     VARIANT result;
     VariantInit(&result);
-    HRESULT hr = pCollection->Invoke(-4, IID_NULL, LOCALE_USER_DEFAULT,
-                                      DISPATCH_PROPERTYGET, &dp, &result, nullptr, nullptr);
+    HRESULT hr = InvokeGet(pCollection, -4, &dp, &result);
     if (FAILED(hr))
     {
         Log(L"[DISP] _NewEnum (DISPID -4): FAILED hr=0x%08x", hr);
-        return items;
+        return;
     }
 
-    IEnumVARIANT* pEnum = nullptr;
-    if (result.vt == VT_UNKNOWN && result.punkVal)
-    {
-        result.punkVal->QueryInterface(IID_IEnumVARIANT, (void**)&pEnum);
-    }
-    else if (result.vt == VT_DISPATCH && result.pdispVal)
-    {
-        result.pdispVal->QueryInterface(IID_IEnumVARIANT, (void**)&pEnum);
-    }
+    VARTYPE vt = result.vt;
+    if (vt == VT_UNKNOWN && result.punkVal)
+        result.punkVal->QueryInterface(IID_IEnumVARIANT, (void**)&m_pEnum);
+    else if (vt == VT_DISPATCH && result.pdispVal)
+        result.pdispVal->QueryInterface(IID_IEnumVARIANT, (void**)&m_pEnum);
     VariantClear(&result);
 
-    if (!pEnum)
+    if (!m_pEnum)
     {
-        Log(L"[DISP] _NewEnum: could not get IEnumVARIANT (vt was %d)", result.vt);
-        return items;
+        Log(L"[DISP] _NewEnum: could not get IEnumVARIANT (vt was %d)", vt);
+        return;
     }
+    m_batch.resize(chunk ? chunk : 1);
+    for (auto& v : m_batch) VariantInit(&v);
+}
 
-    // Iterate
-    VARIANT item;
-    ULONG fetched = 0;
-    while (pEnum->Next(1, &item, &fetched) == S_OK && fetched > 0)
+CollectionEnumerator::~CollectionEnumerator()
+{
+    for (ULONG i = m_pos; i < m_fetched; i++)
+        VariantClear(&m_batch[i]);
+    if (m_pEnum) m_pEnum->Release();
+}
+
+bool CollectionEnumerator::Next(IDispatch** ppItem)
+{
+    *ppItem = nullptr;
+    if (!m_pEnum) return false;
+
+    for (;;)
     {
-        IUnknown* pUnk = nullptr;
-        if (item.vt == VT_DISPATCH && item.pdispVal)
-            item.pdispVal->QueryInterface(IID_IUnknown, (void**)&pUnk);
-        else if (item.vt == VT_UNKNOWN && item.punkVal)
-            item.punkVal->QueryInterface(IID_IUnknown, (void**)&pUnk);
-        VariantClear(&item);
-
-        if (pUnk)
+        if (m_pos == m_fetched)
+        {
+            if (m_last) return false;
+            m_pos = m_fetched = 0;
+            HRESULT hr = m_pEnum->Next((ULONG)m_batch.size(), m_batch.data(), &m_fetched);
+            if (FAILED(hr) && m_batch.size() > 1 && m_count == 0)
+            {
+                // Enumerator that only serves one item per call
+                Log(L"[DISP] IEnumVARIANT::Next(%d) FAILED hr=0x%08x, fetching one at a time",
+                    (int)m_batch.size(), hr);
+                m_batch.resize(1);
+                m_fetched = 0;
+                hr = m_pEnum->Next(1, m_batch.data(), &m_fetched);
+            }
+            // S_FALSE: fewer than asked for, the enumerator is exhausted
+            if (hr != S_OK) m_last = true;
+            if (FAILED(hr)) m_fetched = 0;
+            if (m_fetched > (ULONG)m_batch.size()) m_fetched = (ULONG)m_batch.size();
+            if (m_fetched == 0) return false;
+        }
+
+        IDispatch* pDisp = ItemDispatch(m_batch[m_pos++]);
+        if (pDisp)
         {
-            // QI for ITopologyObject dispatch (correct DISPIDs: 1=Name, 4=path)
-            // Then try bus/chassis dispatch, fallback to default IDispatch
-            IDispatch* pDisp = nullptr;
-            HRESULT hrQI = pUnk->QueryInterface(IID_ITopologyObject, (void**)&pDisp);
-            if (FAILED(hrQI))
-                hrQI = pUnk->QueryInterface(IID_ITopologyBus, (void**)&pDisp);
-            if (FAILED(hrQI))
-                hrQI = pUnk->QueryInterface(IID_ITopologyChassis, (void**)&pDisp);
-            if (FAILED(hrQI))
-                pUnk->QueryInterface(IID_IDispatch, (void**)&pDisp);
-            pUnk->Release();
-
-            if (pDisp)
-                items.push_back(pDisp);
+            *ppItem = pDisp;
+            m_count++;
+            return true;
         }
-        fetched = 0;
     }
-    pEnum->Release();
+}
 
-    Log(L"[DISP] _NewEnum: enumerated %d items", (int)items.size());
+// Enumerate collection using _NewEnum → IEnumVARIANT
+// Returns all items as a vector of IDispatch* (caller must Release each)
+std::vector<IDispatch*> EnumerateCollection(IDispatch* pCollection)
+{
+    std::vector<IDispatch*> items;
+    CollectionEnumerator it(pCollection);
+    IDispatch* pItem = nullptr;
+    while (it.Next(&pItem))
+        items.push_back(pItem);
+    if (it.Opened())
+        Log(L"[DISP] _NewEnum: enumerated %d items", (int)items.size());
     return items;
 }
 
@@ -317,7 +509,7 @@ void ProbeBusDISPIDs(IDispatch* pDisp, const wchar_t* label)
     pUnk->Release();
 }
 
-// Get path object from topology object (DISPID 4, flags=0)
+// Get path object from topology object (path, flags=0)
 IUnknown* DispatchGetPath(IDispatch* pDisp)
 {
     if (!pDisp) return nullptr;
@@ -328,8 +520,7 @@ IUnknown* DispatchGetPath(IDispatch* pDisp)
     DISPPARAMS dp = { &argFlags, nullptr, 1, 0 };
     VARIANT result;
     VariantInit(&result);
-    HRESULT hr = pDisp->Invoke(4, IID_NULL, LOCALE_USER_DEFAULT,
-                                DISPATCH_PROPERTYGET, &dp, &result, nullptr, nullptr);
+    HRESULT hr = InvokeGet(pDisp, ComLayout::ITopologyBus::path.id, &dp, &result);
     if (FAILED(hr)) { VariantClear(&result); return nullptr; }
     IUnknown* pResult = nullptr;
     if (result.vt == VT_DISPATCH && result.pdispVal)
@@ -345,3 +536,40 @@ IUnknown* DispatchGetPath(IDispatch* pDisp)
     VariantClear(&result);
     return pResult;
 }
+
+// Name, objectid and optionally path in one pass; see header
+void DispatchGetObjectProps(IDispatch* pDisp, TopologyObjectProps& props, bool withPath)
+{
+    props.name.clear();
+    props.objectId.clear();
+    props.pPath = nullptr;
+    if (!pDisp) return;
+
+    DISPPARAMS noArgs = { nullptr, nullptr, 0, 0 };
+    VARIANT result;
+    VariantInit(&result);
+
+    if (SUCCEEDED(InvokeGet(pDisp, ComLayout::ITopologyObject::Name.id, &noArgs, &result)) &&
+        result.vt == VT_BSTR && result.bstrVal)
+        props.name = result.bstrVal;
+    VariantClear(&result);
+
+    if (SUCCEEDED(InvokeGet(pDisp, ComLayout::ITopologyObject::objectid.id, &noArgs, &result)) &&
+        result.vt == VT_BSTR && result.bstrVal)
+        props.objectId = result.bstrVal;
+    VariantClear(&result);
+
+    if (!withPath) return;
+    VARIANT argFlags;
+    VariantInit(&argFlags);
+    argFlags.vt = VT_I4;
+    argFlags.lVal = 0;
+    DISPPARAMS pathArgs = { &argFlags, nullptr, 1, 0 };
+    if (SUCCEEDED(InvokeGet(pDisp, ComLayout::ITopologyBus::path.id, &pathArgs, &result)) &&
+        (result.vt == VT_DISPATCH || result.vt == VT_UNKNOWN) && result.punkVal)
+    {
+        props.pPath = result.punkVal;
+        props.pPath->AddRef();
+    }
+    VariantClear(&result);
+}
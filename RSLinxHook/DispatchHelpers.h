@@ -7,10 +7,91 @@
 
 int DispatchGetInt(IDispatch* pDisp, DISPID dispid);
 std::wstring DispatchGetString(IDispatch* pDisp, DISPID dispid);
+// Any scalar property as text (VT_BSTR, integers, ...); empty on failure
+std::wstring DispatchGetText(IDispatch* pDisp, DISPID dispid);
+// First of names that GetIDsOfNames resolves on pDisp, DISPID_UNKNOWN if
+// none. names must be a static array: the answer is remembered per class
+// (see the capability cache below) under its address.
+DISPID DispatchFindName(IDispatch* pDisp, const wchar_t* const* names, int count, int* which = nullptr);
 IDispatch* DispatchGetCollection(IDispatch* pDisp, DISPID dispid);
+// Every item of a collection (caller releases each); see CollectionEnumerator
 std::vector<IDispatch*> EnumerateCollection(IDispatch* pCollection);
 IUnknown* DispatchGetPath(IDispatch* pDisp);
 
+// ============================================================
+// CollectionEnumerator — lazy walk over a collection's _NewEnum
+// IEnumVARIANT::Next is asked for up to `chunk` items per call. Each item
+// gets EnumerateCollection's QI chain only when Next hands it out, and
+// the destructor releases whatever was fetched but not handed out, so a
+// loop that breaks early neither QIs nor holds the rest:
+//
+//   CollectionEnumerator items(pCollection);
+//   IDispatch* pItem = nullptr;
+//   while (items.Next(&pItem)) { ...; pItem->Release(); }
+// ============================================================
+
+static const ULONG ENUM_CHUNK_SIZE = 64;
+
+class CollectionEnumerator
+{
+public:
+    explicit CollectionEnumerator(IDispatch* pCollection, ULONG chunk = ENUM_CHUNK_SIZE);
+    ~CollectionEnumerator();
+    CollectionEnumerator(const CollectionEnumerator&) = delete;
+    CollectionEnumerator& operator=(const CollectionEnumerator&) = delete;
+
+    // Next item as IDispatch* (caller releases); false at the end
+    bool Next(IDispatch** ppItem);
+    bool Opened() const { return m_pEnum != nullptr; }
+    int Count() const { return m_count; }   // items handed out so far
+
+private:
+    IEnumVARIANT* m_pEnum = nullptr;
+    std::vector<VARIANT> m_batch;
+    ULONG m_fetched = 0;       // valid entries in m_batch
+    ULONG m_pos = 0;           // next entry to hand out
+    bool m_last = false;       // enumerator reported the end
+    int m_count = 0;
+};
+
+// Name (DISPID 1), objectid (2) and, with withPath, path (4, flags=0) of
+// one topology object: back-to-back calls sharing one result VARIANT.
+// IDispatch has no multi-property get, so this is as close to one
+// round-trip per object as the interface allows.
+struct TopologyObjectProps {
+    std::wstring name;
+    std::wstring objectId;
+    IUnknown* pPath = nullptr;     // caller releases
+};
+void DispatchGetObjectProps(IDispatch* pDisp, TopologyObjectProps& props, bool withPath);
+
+// ============================================================
+// Capability cache (main STA only)
+// On the main STA every topology object is the in-proc object itself, so
+// objects of one class share their interface vtables and the vtable
+// pointer identifies the class. Per class the helpers remember the
+// interface EnumerateCollection's QI chain settles on, the IIDs a QI
+// refused (E_NOINTERFACE only), the DISPIDs that are not members
+// (DISP_E_MEMBERNOTFOUND) and what DispatchFindName resolved, and skip
+// those calls for every later object of that class. Other threads may
+// hold proxies, whose vtable is shared by every object behind one
+// interface, so they bypass the cache. P| counts skipped calls as
+// QISkipped / InvokeSkipped.
+//
+// A vtable pointer names a class only while its DLL stays loaded. A
+// driver hot-load can unload one and map another at the same address, so
+// the cache is dropped after every hot-load and at cleanup. (The objects
+// expose no CLSID, and their type info costs a call per object, which is
+// what the cache saves.)
+// ============================================================
+
+// Forget every class (main STA)
+void ResetDispatchCaches();
+
+// QueryInterface, answered E_NOINTERFACE without a call when the object's
+// class already refused riid
+HRESULT CachedQueryInterface(IUnknown* pObj, REFIID riid, void** ppv);
+
 // DISPID discovery — probe device/bus objects for available properties
 void ProbeDeviceDISPIDs(IDispatch* pDisp, const wchar_t* label);
 void ProbeBusDISPIDs(IDispatch* pDisp, const wchar_t* label);
@@ -1,14 +1,21 @@
 ﻿#include "RSLinxHook_fwd.h"
 #include "Logging.h"
+#include "PipeBinary.h"
 #include "ComInterfaces.h"
+#include "ComLayout.h"
+#include "ComLayoutCheck.h"
 #include "Config.h"
 #include "SEHHelpers.h"
 #include "EventSink.h"
 #include "DispatchHelpers.h"
 #include "TopologyXML.h"
+#include "TopologySnapshot.h"
 #include "EngineHotLoad.h"
 #include "STAHook.h"
 #include "BrowseOperations.h"
+#include "TopologyWalker.h"
+#include "Perf.h"
+#include "QueryWatch.h"
 
 // ============================================================
 // Globals owned by DllMain.cpp
@@ -18,6 +25,235 @@ HANDLE g_hWorkerThread = NULL;
 volatile bool g_shouldStop = false;
 static IHarmonyConnector* g_pHarmony = nullptr;
 
+// ============================================================
+// Client commands
+// Pipe clients run on their own session threads (see Logging.h) and
+// hand anything that needs COM — a new client's config, a re-browse,
+// a query the cache cannot answer — to the worker as a ClientCommand.
+// The session thread waits for it unless it is detached: a monitor
+// client's session command lasts as long as the monitor loop.
+// ============================================================
+
+enum class ClientCommandType { Session, Query, QueryBatch, Watch, Refresh, Browse, Revalidate, Closed };
+
+// One Q| or W| path, or one entry of a QB| batch
+struct QueryItem {
+    int tag = -1;              // QB| or W| request id; -1 for a plain Q|
+    std::string path;
+    std::wstring ip, portName;
+    int slot = -1;
+};
+
+// A client's C|SKIP= hosts by driver name. Each command's browses skip
+// its own client's hosts, not those of whichever client came last.
+typedef std::vector<std::pair<std::wstring, std::vector<std::wstring>>> SkipLists;
+
+struct ClientCommand {
+    ClientCommandType type;
+    PipeSession* session;      // referenced until the command is released
+    HookConfig config;         // Session
+    std::string path;          // Query
+    std::vector<QueryItem> batch;  // QueryBatch, Refresh: the cache misses; Watch: the paths
+    HANDLE hDone = NULL;       // signaled by the worker; NULL when detached
+    volatile LONG refs = 1;
+    bool keepSession = true;   // false: the worker ends the client (browse crashed)
+    bool walkTopology = false; // the client's C|WALK=1 (Query, QueryBatch, Watch, Refresh)
+    SkipLists skipIPs;         // the client's C|SKIP= entries
+};
+
+static CRITICAL_SECTION s_commandCS;
+static std::deque<ClientCommand*> s_commands;
+static HANDLE s_hCommandEvent = NULL;     // auto-reset, set on every submit
+static bool s_inMonitorLoop = false;      // worker thread only
+// Cache misses waiting for the monitor loop (ParkForMonitor); worker only
+struct ParkedCommand { ClientCommand* cmd; DWORD tick; };
+static std::vector<ParkedCommand> s_parked;
+#define MONITOR_QUERY_WAIT_MS 30000
+// C|SWR=1 misses by path: the clients a queued or running refresh
+// answers (AddRef'd sessions), and when a refresh last found nothing
+struct RefreshWaiter { PipeSession* session; QueryItem item; };
+static std::map<std::string, std::vector<RefreshWaiter>> s_refreshWaiters;   // under s_commandCS
+static std::map<std::string, DWORD> s_refreshMisses;                         // under s_commandCS
+#define REFRESH_MISS_TTL_MS 60000
+// Drivers the worker holds a bus for, published for H| answers
+static std::vector<std::wstring> s_residentDrivers;   // under s_commandCS
+
+// Worker state the command handlers share (WorkerThread's locals)
+struct WorkerContext {
+    HookConfig* config;
+    IRSTopologyGlobals** ppGlobals;
+    std::vector<BusInfo>* buses;
+};
+static WorkerContext s_worker = {};
+
+static ClientCommand* NewCommand(ClientCommandType type, PipeSession* session)
+{
+    ClientCommand* cmd = new ClientCommand();
+    cmd->type = type;
+    cmd->session = session;
+    PipeSessionAddRef(session);
+    return cmd;
+}
+
+static SkipLists SessionSkipLists(const HookConfig& cfg)
+{
+    SkipLists lists;
+    for (const auto& drv : cfg.drivers)
+        if (!drv.skipIPs.empty()) lists.emplace_back(drv.name, drv.skipIPs);
+    return lists;
+}
+
+// A command carrying the options of the client that sent it
+static ClientCommand* NewClientCommand(ClientCommandType type, PipeSession* session,
+                                       const HookConfig& cfg)
+{
+    ClientCommand* cmd = NewCommand(type, session);
+    cmd->walkTopology = cfg.walkTopology;
+    cmd->skipIPs = SessionSkipLists(cfg);
+    return cmd;
+}
+
+// Give each driver of config the skip list lists has for it, none if absent
+static void ApplySkipLists(HookConfig& config, const SkipLists& lists)
+{
+    for (auto& drv : config.drivers)
+    {
+        drv.skipIPs.clear();
+        for (const auto& l : lists)
+            if (_wcsicmp(l.first.c_str(), drv.name.c_str()) == 0) { drv.skipIPs = l.second; break; }
+    }
+}
+
+static void ReleaseCommand(ClientCommand* cmd)
+{
+    if (InterlockedDecrement(&cmd->refs) != 0) return;
+    if (cmd->hDone) CloseHandle(cmd->hDone);
+    PipeSessionRelease(cmd->session);
+    delete cmd;
+}
+
+// Queue a command for the worker. With wait, block until it has run and
+// return its keepSession (false as well if the hook stops first).
+static bool SubmitCommand(ClientCommand* cmd, bool wait)
+{
+    if (wait)
+    {
+        cmd->hDone = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (!cmd->hDone) { ReleaseCommand(cmd); return false; }
+        cmd->refs = 2;   // the worker's and ours
+    }
+    EnterCriticalSection(&s_commandCS);
+    s_commands.push_back(cmd);
+    LeaveCriticalSection(&s_commandCS);
+    SetEvent(s_hCommandEvent);
+    if (!wait) return true;
+
+    HANDLE handles[2] = { cmd->hDone, g_hStopEvent };
+    bool done = WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0;
+    bool keep = done && cmd->keepSession;
+    ReleaseCommand(cmd);
+    return keep;
+}
+
+// Queue the background browse of C|SWR=1 misses. A path a queued or
+// running refresh already covers only adds this client to its waiters;
+// one a refresh found nothing for within REFRESH_MISS_TTL_MS is answered
+// not-found at once. The rest join the session's refresh still in the
+// queue, so a burst of queries costs one browse pass.
+static void SubmitRefresh(PipeSession* session, std::vector<QueryItem>& items, const HookConfig& cfg)
+{
+    std::vector<QueryItem> recent, fresh;
+    DWORD now = GetTickCount();
+    EnterCriticalSection(&s_commandCS);
+    for (auto& item : items)
+    {
+        auto miss = s_refreshMisses.find(item.path);
+        if (miss != s_refreshMisses.end())
+        {
+            if (now - miss->second < REFRESH_MISS_TTL_MS)
+            {
+                recent.push_back(std::move(item));
+                continue;
+            }
+            s_refreshMisses.erase(miss);
+        }
+        auto& waiters = s_refreshWaiters[item.path];
+        bool covered = !waiters.empty();
+        PipeSessionAddRef(session);
+        waiters.push_back({session, item});
+        if (!covered) fresh.push_back(std::move(item));
+    }
+    bool merged = false;
+    if (!fresh.empty() && !s_commands.empty() &&
+        s_commands.back()->type == ClientCommandType::Refresh && s_commands.back()->session == session)
+    {
+        auto& batch = s_commands.back()->batch;
+        batch.insert(batch.end(), std::make_move_iterator(fresh.begin()),
+                     std::make_move_iterator(fresh.end()));
+        merged = true;
+    }
+    LeaveCriticalSection(&s_commandCS);
+
+    if (!recent.empty())
+    {
+        PipeBeginReply(session);
+        for (const auto& item : recent)
+            PipeSendResult(false, nullptr, nullptr, nullptr, 0, item.path.c_str(), item.tag);
+        PipeEndReply();
+    }
+    if (fresh.empty() || merged) return;
+    ClientCommand* cmd = NewClientCommand(ClientCommandType::Refresh, session, cfg);
+    cmd->batch = std::move(fresh);
+    SubmitCommand(cmd, false);
+}
+
+// Every client waiting on path; the caller releases their sessions
+static std::vector<RefreshWaiter> TakeRefreshWaiters(const std::string& path)
+{
+    std::vector<RefreshWaiter> waiters;
+    EnterCriticalSection(&s_commandCS);
+    auto it = s_refreshWaiters.find(path);
+    if (it != s_refreshWaiters.end())
+    {
+        waiters = std::move(it->second);
+        s_refreshWaiters.erase(it);
+    }
+    LeaveCriticalSection(&s_commandCS);
+    return waiters;
+}
+
+// A command the worker will not run: the client ends, and a refresh's
+// waiters are let go unanswered
+static void FailCommand(ClientCommand* cmd)
+{
+    cmd->keepSession = false;
+    if (cmd->type != ClientCommandType::Refresh) return;
+    for (const auto& item : cmd->batch)
+        for (auto& w : TakeRefreshWaiters(item.path))
+            PipeSessionRelease(w.session);
+}
+
+static ClientCommand* TakeCommand()
+{
+    ClientCommand* cmd = nullptr;
+    EnterCriticalSection(&s_commandCS);
+    if (!s_commands.empty())
+    {
+        cmd = s_commands.front();
+        s_commands.pop_front();
+    }
+    LeaveCriticalSection(&s_commandCS);
+    return cmd;
+}
+
+static void CompleteCommand(ClientCommand* cmd)
+{
+    if (cmd->hDone) SetEvent(cmd->hDone);
+    ReleaseCommand(cmd);
+}
+
+static bool ServiceClientsFromMonitor();
+
 // ============================================================
 // AcquireNewBuses
 // Acquire ITopologyBus objects for any driver in config that
@@ -43,17 +279,21 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
     HRESULT hr = pGlobals->GetThisWorkstationObject(pProject, &pWorkstation);
     if (FAILED(hr)) { pProject->Release(); Log(L"[FAIL] GetWorkstation: 0x%08x", hr); return; }
 
-    // Per-driver engine hot-load for new drivers
+    // Engine hot-load of all new drivers in one main-STA item
+    g_engineDriverNames.clear();
     for (auto& drv : config.drivers)
     {
         if (drv.newDriver)
         {
-            g_engineDriverName = drv.name;
+            g_engineDriverNames.push_back(drv.name);
             Log(L"[ENGINE] Hot-loading driver '%s'...", drv.name.c_str());
-            HRESULT hrEngine = ExecuteOnMainSTA(DoEngineHotLoadOnMainSTA);
-            Log(L"[ENGINE] Hot-load '%s': 0x%08x", drv.name.c_str(), hrEngine);
         }
     }
+    if (!g_engineDriverNames.empty())
+    {
+        HRESULT hrEngine = ExecuteOnMainSTA(DoEngineHotLoadOnMainSTA);
+        Log(L"[ENGINE] Hot-load of %d driver(s): 0x%08x", (int)g_engineDriverNames.size(), hrEngine);
+    }
 
     // Re-acquire workstation after any hot-loads
     if (config.newDriver())
@@ -93,7 +333,7 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
         {
             if (attempt == 1 && !drv.newDriver)
             {
-                g_engineDriverName = drv.name;
+                g_engineDriverNames.assign(1, drv.name);
                 Log(L"[ENGINE] Fallback hot-load for '%s'...", drv.name.c_str());
                 ExecuteOnMainSTA(DoEngineHotLoadOnMainSTA);
                 pWorkstation->Release();
@@ -113,8 +353,8 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
                     DISPPARAMS dp = { &argName, nullptr, 1, 0 };
                     VARIANT varBus; VariantInit(&varBus);
                     EXCEPINFO excep = {};
-                    hr = pWsDisp->Invoke(38, IID_NULL, LOCALE_USER_DEFAULT,
-                                          DISPATCH_PROPERTYGET, &dp, &varBus, &excep, nullptr);
+                    hr = ComLayout::Invoke(pWsDisp, ComLayout::ITopologyDevice_Dual::GetBusEx,
+                                           &dp, &varBus, &excep);
                     if (SUCCEEDED(hr) && (varBus.vt == VT_DISPATCH || varBus.vt == VT_UNKNOWN))
                     {
                         pBusUnk = (varBus.vt == VT_DISPATCH)
@@ -143,17 +383,18 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
                 pWorkstation->QueryInterface(IID_ITopologyDevice_Dual, (void**)&pWsDisp);
                 if (pWsDisp)
                 {
-                    IDispatch* pBusColl = DispatchGetCollection(pWsDisp, 51);
+                    IDispatch* pBusColl = DispatchGetCollection(pWsDisp, ComLayout::ITopologyDevice_Dual::Busses.id);
                     if (pBusColl)
                     {
-                        auto busList = EnumerateCollection(pBusColl);
-                        for (size_t i = 0; i < busList.size(); i++)
+                        CollectionEnumerator busList(pBusColl);
+                        IDispatch* pItem = nullptr;
+                        while (!pBusDisp && busList.Next(&pItem))
                         {
-                            std::wstring name = DispatchGetString(busList[i], 1);
+                            std::wstring name = DispatchGetString(pItem, ComLayout::ITopologyObject::Name.id);
                             if (_wcsicmp(name.c_str(), drv.name.c_str()) == 0)
                             {
                                 IUnknown* pUnk = nullptr;
-                                busList[i]->QueryInterface(IID_IUnknown, (void**)&pUnk);
+                                pItem->QueryInterface(IID_IUnknown, (void**)&pUnk);
                                 if (pUnk)
                                 {
                                     pUnk->QueryInterface(IID_ITopologyBus, (void**)&pBusDisp);
@@ -161,8 +402,8 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
                                 }
                                 Log(L"[OK] Got bus via Busses() enumeration: \"%s\"", name.c_str());
                             }
+                            pItem->Release();
                         }
-                        for (auto* p : busList) p->Release();
                         pBusColl->Release();
                     }
                     pWsDisp->Release();
@@ -207,8 +448,8 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
                     {
                         IUnknown* pNewObj = nullptr;
                         IID iidUnk = IID_IUnknown;
-                        hr = TryVtableAddPort(pDevVtable, 14, &clsids[ci].clsid,
-                                               drv.name.c_str(), &iidUnk, &pNewObj);
+                        hr = TryVtableAddPort(pDevVtable, ComLayout::IRSTopologyDevice::AddPort.slot,
+                                               &clsids[ci].clsid, drv.name.c_str(), &iidUnk, &pNewObj);
                         Log(L"[BUS] AddPort[14] with %s: hr=0x%08x obj=0x%p",
                             clsids[ci].name, hr, pNewObj);
 
@@ -229,7 +470,8 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
                             if (pPortVtable)
                             {
                                 IUnknown* pBusRaw = nullptr;
-                                HRESULT hrGB = TryVtableGetObject(pPortVtable, 10, &pBusRaw);
+                                HRESULT hrGB = TryVtableGetObject(pPortVtable,
+                                    ComLayout::IRSTopologyPort::GetBus.slot, &pBusRaw);
                                 Log(L"[BUS]   GetBus[10]: hr=0x%08x bus=0x%p", hrGB, pBusRaw);
                                 if (SUCCEEDED(hrGB) && pBusRaw)
                                 {
@@ -246,7 +488,7 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
                             hrQI = pNewObj->QueryInterface(IID_IDispatch, (void**)&pDisp);
                             if (pDisp)
                             {
-                                std::wstring name = DispatchGetString(pDisp, 1);
+                                std::wstring name = DispatchGetString(pDisp, ComLayout::ITopologyObject::Name.id);
                                 Log(L"[BUS]   Object Name (DISPID 1): \"%s\"", name.c_str());
                                 pDisp->Release();
                             }
@@ -293,6 +535,15 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
         Log(L"[OK] Have %d bus(es) total", (int)buses.size());
 }
 
+// Poll snapshot of a running browse: with a device stream open, fold it
+// into the query cache now so the stream does not wait for Final Results
+static void StreamPollSnapshot(const TopologySnapshot& snap)
+{
+    if (!HasDeviceStreams()) return;
+    PopulateQueryCache(snap);
+    NotifyCacheSubscribers();
+}
+
 // ============================================================
 // RunBrowsePhases
 // Execute phases 1-4b on the current config/buses and write
@@ -303,18 +554,31 @@ static void AcquireNewBuses(HookConfig& config, IRSTopologyGlobals* pGlobals,
 static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
                              std::vector<BusInfo>& buses)
 {
-    g_discoveredDevices.clear();
+    g_discoveredDevices.Clear();
 
     // =============================================================
     // Phase 1: ConnectNewDevice
     // =============================================================
     {
         Log(L"");
-        Log(L"=== Phase 1: ConnectNewDevice (smart, %d drivers) ===", (int)buses.size());
-
-        static const wchar_t* UNRECOGNIZED_DEVICE_GUID = L"{00000004-5D68-11CF-B4B9-C46F03C10000}";
-        int totalAdded = 0, totalExisting = 0, totalFailed = 0;
+        Log(L"=== Phase 1: ConnectNewDevice (batched, %d drivers) ===", (int)buses.size());
+
+        // Skip IPs the topology already has without a COM call each
+        std::map<std::wstring, std::set<std::wstring>> known;
+        bool anyIPs = false;
+        for (auto& d : config.drivers)
+            if (!d.ipAddresses.empty()) anyIPs = true;
+        if (anyIPs)
+        {
+            TopologySnapshot snap;
+            if (CaptureTopologySnapshot(pGlobals, nullptr, snap, false))
+                CollectDriverAddresses(snap, known);
+            else
+                Log(L"  Snapshot for de-dup failed  - every IP goes to ConnectNewDevice");
+        }
 
+        g_connectBatches.clear();
+        int allKnown = 0;   // existing count of drivers with nothing left to add
         for (auto& bus : buses)
         {
             const DriverEntry* pDrv = nullptr;
@@ -326,64 +590,50 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
                 continue;
             }
 
-            Log(L"  [%s] Adding %d IPs...", bus.driverName.c_str(), (int)pDrv->ipAddresses.size());
-            int addedCount = 0, existingCount = 0, failedCount = 0;
+            ConnectBatch batch;
+            batch.driverName = bus.driverName;
+            auto kit = known.find(bus.driverName);
+            std::set<std::wstring> queued;
+            for (auto& ip : pDrv->ipAddresses)
+            {
+                if (kit != known.end() && kit->second.count(ip)) { batch.existing++; continue; }
+                if (queued.insert(ip).second) batch.ips.push_back(ip);
+            }
+            Log(L"  [%s] %d IPs: %d already in topology, %d to add",
+                bus.driverName.c_str(), (int)pDrv->ipAddresses.size(),
+                batch.existing, (int)batch.ips.size());
+            if (!batch.ips.empty()) g_connectBatches.push_back(batch);
+            else allKnown += batch.existing;
+        }
+
+        if (!g_connectBatches.empty())
+        {
+            HRESULT hrAdd = ExecuteOnMainSTA(DoConnectNewDevices);
+            if (FAILED(hrAdd)) Log(L"  Main-STA ConnectNewDevice failed: 0x%08x", hrAdd);
+        }
 
-            for (size_t i = 0; i < pDrv->ipAddresses.size(); i++)
+        int totalAdded = 0, totalExisting = allKnown, totalFailed = 0;
+        for (auto& batch : g_connectBatches)
+        {
+            // Bus not reachable from the main STA: use the worker's bus pointer
+            if (!batch.done && !g_shouldStop)
             {
-                VARIANT args[6];
-                VariantInit(&args[5]); args[5].vt = VT_I4; args[5].lVal = 0;
-                VariantInit(&args[4]); args[4].vt = VT_BSTR;
-                args[4].bstrVal = SysAllocString(UNRECOGNIZED_DEVICE_GUID);
-                VariantInit(&args[3]);
-                VariantInit(&args[2]); args[2].vt = VT_BSTR;
-                args[2].bstrVal = SysAllocString(L"Device");
-                VariantInit(&args[1]); args[1].vt = VT_BSTR;
-                args[1].bstrVal = SysAllocString(L"A");
-                VariantInit(&args[0]); args[0].vt = VT_BSTR;
-                args[0].bstrVal = SysAllocString(pDrv->ipAddresses[i].c_str());
-
-                DISPPARAMS dp = { args, nullptr, 6, 0 };
-                EXCEPINFO excep = {};
-                UINT argErr = 0;
-                VARIANT result;
-                VariantInit(&result);
-
-                HRESULT hr = bus.pBusDisp->Invoke(54, IID_NULL, LOCALE_USER_DEFAULT,
-                                                   DISPATCH_METHOD, &dp, &result, &excep, &argErr);
-
-                if (SUCCEEDED(hr))
-                {
-                    Log(L"    [OK] %s added", pDrv->ipAddresses[i].c_str());
-                    addedCount++;
-                }
-                else if (hr == DISP_E_EXCEPTION)
-                {
-                    Log(L"    [SKIP] %s already exists", pDrv->ipAddresses[i].c_str());
-                    existingCount++;
-                    if (excep.bstrDescription) SysFreeString(excep.bstrDescription);
-                    if (excep.bstrSource) SysFreeString(excep.bstrSource);
-                    if (excep.bstrHelpFile) SysFreeString(excep.bstrHelpFile);
-                }
-                else
+                for (auto& bus : buses)
                 {
-                    Log(L"    [FAIL] %s: hr=0x%08x", pDrv->ipAddresses[i].c_str(), hr);
-                    failedCount++;
-                    if (excep.bstrDescription) SysFreeString(excep.bstrDescription);
-                    if (excep.bstrSource) SysFreeString(excep.bstrSource);
-                    if (excep.bstrHelpFile) SysFreeString(excep.bstrHelpFile);
+                    if (bus.driverName != batch.driverName) continue;
+                    Log(L"  [%s] Adding %d IPs from the worker STA...",
+                        batch.driverName.c_str(), (int)batch.ips.size());
+                    ConnectDevicesOnBus(bus.pBusDisp, batch);
+                    break;
                 }
-
-                for (int a = 0; a < 6; a++) VariantClear(&args[a]);
-                VariantClear(&result);
             }
-
             Log(L"  [%s] Added: %d, Existing: %d, Failed: %d",
-                bus.driverName.c_str(), addedCount, existingCount, failedCount);
-            totalAdded += addedCount;
-            totalExisting += existingCount;
-            totalFailed += failedCount;
+                batch.driverName.c_str(), batch.added, batch.existing, batch.failed);
+            totalAdded += batch.added;
+            totalExisting += batch.existing;
+            totalFailed += batch.failed;
         }
+        g_connectBatches.clear();
 
         Log(L"  Total: Added: %d, Existing: %d, Failed: %d", totalAdded, totalExisting, totalFailed);
     }
@@ -391,22 +641,23 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
     // Initial topology snapshot
     Log(L"");
     {
-        std::wstring beforePath = LogPath(config.logDir, config.debugXml ? L"hook_topo_before.xml" : L"hook_topo_poll.xml");
-        SaveTopologyXML(pGlobals, beforePath.c_str());
-        TopologyCounts before = CountDevicesInXML(beforePath.c_str());
-        PipeSendTopology(beforePath.c_str());
-        PipeSendStatus(before.totalDevices, before.identifiedDevices, (int)g_discoveredDevices.size());
+        std::wstring beforePath = LogPath(config.logDir, L"hook_topo_before.xml");
+        TopologySnapshot snap;
+        CaptureTopologySnapshot(pGlobals, config.debugXml ? beforePath.c_str() : nullptr, snap, true);
+        TopologyCounts before = CountDevicesInXML(snap);
+        PipeSendStatus(before.totalDevices, before.identifiedDevices, g_discoveredDevices.Count());
         Log(L"Topology BEFORE browse: %d devices, %d identified",
             before.totalDevices, before.identifiedDevices);
     }
 
-    // Helper: SaveTopologyXML with retry + message pump on failure
+    // Helper: CaptureTopologySnapshot with retry + message pump on failure
     // If all retries fail, attempt to re-acquire pGlobals once from HarmonyServices
     bool reacquireAttempted = false;
-    auto SaveTopologyWithRetry = [&](const wchar_t* path, int maxRetries = 3) -> bool {
+    auto CaptureWithRetry = [&](const wchar_t* keepPath, TopologySnapshot& snap,
+                                bool sendXml, int maxRetries = 3) -> bool {
         for (int attempt = 0; attempt < maxRetries; attempt++)
         {
-            if (SaveTopologyXML(pGlobals, path)) return true;
+            if (CaptureTopologySnapshot(pGlobals, keepPath, snap, sendXml)) return true;
             if (attempt < maxRetries - 1 && !g_shouldStop)
             {
                 for (int w = 0; w < 20 && !g_shouldStop; w++)
@@ -435,7 +686,7 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
                     pGlobals->Release();
                     pGlobals = pNewGlobals;
                     Log(L"  >> TopologyGlobals re-acquired, retrying save...");
-                    if (SaveTopologyXML(pGlobals, path)) return true;
+                    if (CaptureTopologySnapshot(pGlobals, keepPath, snap, sendXml)) return true;
                     Log(L"  >> Save still failed after re-acquire");
                 }
             }
@@ -464,11 +715,15 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
             Log(L"[WARN] Main-STA browse failed  - identification may not trigger");
     }
 
-    // Monitor mode: enter continuous loop then return
-    if (config.mode == HookMode::Monitor)
+    // Monitor mode: enter continuous loop then return. The loop keeps
+    // serving client commands; a client arriving while it runs is not
+    // browsed for (MonitorOwnsSinks) and shares the loop's stream.
+    if (config.mode == HookMode::Monitor && !s_inMonitorLoop)
     {
         Log(L"=== Entering Monitor Mode ===");
-        RunMonitorLoop(config, pGlobals, buses);
+        s_inMonitorLoop = true;
+        RunMonitorLoop(config, pGlobals, buses, ServiceClientsFromMonitor, s_hCommandEvent);
+        s_inMonitorLoop = false;
         return;
     }
 
@@ -496,23 +751,22 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
                     wchar_t fname[64];
                     swprintf(fname, 64, L"hook_topo_%ds.xml", elapsed / 1000);
                     pollFile = LogPath(config.logDir, fname);
-                } else {
-                    pollFile = LogPath(config.logDir, L"hook_topo_poll.xml");
                 }
                 TopologyCounts c = { 0, 0 };
-                bool xmlOk = SaveTopologyWithRetry(pollFile.c_str());
+                TopologySnapshot snap;
+                bool xmlOk = CaptureWithRetry(config.debugXml ? pollFile.c_str() : nullptr, snap, true);
                 if (xmlOk)
                 {
-                    c = CountDevicesInXML(pollFile.c_str());
-                    PipeSendTopology(pollFile.c_str());
-                    PipeSendStatus(c.totalDevices, c.identifiedDevices, (int)g_discoveredDevices.size());
+                    c = CountDevicesInXML(snap);
+                    PipeSendStatus(c.totalDevices, c.identifiedDevices, g_discoveredDevices.Count());
+                    StreamPollSnapshot(snap);
 
                     targetsFound = !allIPs.empty() ?
-                        CountTargetsIdentifiedInXML(pollFile.c_str(), allIPs) : 0;
+                        CountTargetsIdentifiedInXML(snap, allIPs) : 0;
                     Log(L"  [%ds] %d devices, %d identified, %d/%d targets, %d events",
                         elapsed / 1000, c.totalDevices, c.identifiedDevices,
                         targetsFound, totalTargets,
-                        (int)g_discoveredDevices.size());
+                        g_discoveredDevices.Count());
                 }
                 else
                 {
@@ -580,11 +834,12 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
     // Phase 4: Bus browse + Phase 5 + Phase 4b + Phase 5b
     // =============================================================
     {
-        std::wstring midPath = LogPath(config.logDir, config.debugXml ? L"hook_topo_mid.xml" : L"hook_topo_poll.xml");
+        std::wstring midPath = LogPath(config.logDir, L"hook_topo_mid.xml");
         TopologyCounts pre = { 0, 0 };
-        if (SaveTopologyWithRetry(midPath.c_str()))
+        TopologySnapshot midSnap;
+        if (CaptureWithRetry(config.debugXml ? midPath.c_str() : nullptr, midSnap, false))
         {
-            pre = CountDevicesInXML(midPath.c_str());
+            pre = CountDevicesInXML(midSnap);
         }
         else
         {
@@ -610,10 +865,10 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
             if (SUCCEEDED(hrBus))
             {
                 Log(L"");
-                Log(L"=== Phase 5: Bus browse polling (event-driven, max 30s) ===");
+                Log(L"=== Phase 5: Bus browse polling (event-driven, max %ds) ===", ENUM_WAIT_BUS_MS / 1000);
 
                 DWORD busStart = GetTickCount();
-                while (!g_shouldStop && GetTickCount() - busStart < 30000)
+                while (!g_shouldStop && GetTickCount() - busStart < ENUM_WAIT_BUS_MS)
                 {
                     DWORD elapsed = GetTickCount() - busStart;
 
@@ -630,19 +885,18 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
                             wchar_t fname[64];
                             swprintf(fname, 64, L"hook_topo_bus_%ds.xml", elapsed / 1000);
                             pollFile = LogPath(config.logDir, fname);
-                        } else {
-                            pollFile = LogPath(config.logDir, L"hook_topo_poll.xml");
                         }
-                        if (SaveTopologyXML(pGlobals, pollFile.c_str()))
+                        TopologySnapshot snap;
+                        if (CaptureTopologySnapshot(pGlobals, config.debugXml ? pollFile.c_str() : nullptr, snap, true))
                         {
-                            TopologyCounts c = CountDevicesInXML(pollFile.c_str());
-                            PipeSendTopology(pollFile.c_str());
-                            PipeSendStatus(c.totalDevices, c.identifiedDevices, (int)g_discoveredDevices.size());
+                            TopologyCounts c = CountDevicesInXML(snap);
+                            PipeSendStatus(c.totalDevices, c.identifiedDevices, g_discoveredDevices.Count());
+                            StreamPollSnapshot(snap);
                             int cycled, total;
                             GetEnumeratorStatusSince(phase4Baseline, cycled, total);
                             Log(L"  [%ds] %d devices, %d identified, %d events, %d/%d enumerators cycled",
                                 elapsed / 1000, c.totalDevices, c.identifiedDevices,
-                                (int)g_discoveredDevices.size(), cycled, total);
+                                g_discoveredDevices.Count(), cycled, total);
                         }
                     }
 
@@ -662,6 +916,7 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
             Log(L"");
             Log(L"=== Phase 4b: Backplane bus browse ===");
             Log(L"Captured %d backplane buses from events", (int)g_capturedBuses.size());
+            g_backplanePriorityIPs.clear();
             int phase4bBaseline = (int)g_enumerators.size();
             HRESULT hrBP = ExecuteOnMainSTA(DoBackplaneBrowse);
             Log(L"Phase 4b result: 0x%08x", hrBP);
@@ -669,15 +924,21 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
             if (SUCCEEDED(hrBP))
             {
                 Log(L"");
-                Log(L"=== Phase 5b: Backplane module polling (stabilization, 2s interval, max 60s) ===");
+                Log(L"=== Phase 5b: Backplane module polling (stabilization, 2s interval, max %ds) ===",
+                    ENUM_WAIT_BACKPLANE_MS / 1000);
 
                 int lastDeviceCount = 0;
                 DWORD lastProgressTick = GetTickCount();
                 DWORD bpStart = GetTickCount();
-                while (!g_shouldStop && GetTickCount() - bpStart < 60000)
+                while (!g_shouldStop && GetTickCount() - bpStart < ENUM_WAIT_BACKPLANE_MS)
                 {
                     DWORD elapsed = GetTickCount() - bpStart;
 
+                    // Backplane scheduler: replace cycled enumerators with queued ones
+                    if (g_backplaneSchedule.queued > 0 ||
+                        (config.backplaneInFlight > 0 && g_backplaneSchedule.inFlight > 0))
+                        ExecuteOnMainSTA(DoBackplaneSchedule);
+
                     if (elapsed > 0 && elapsed % 2000 < 100)
                     {
                         std::wstring pollFile;
@@ -685,19 +946,18 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
                             wchar_t fname[64];
                             swprintf(fname, 64, L"hook_topo_bp_%ds.xml", elapsed / 1000);
                             pollFile = LogPath(config.logDir, fname);
-                        } else {
-                            pollFile = LogPath(config.logDir, L"hook_topo_poll.xml");
                         }
-                        if (SaveTopologyWithRetry(pollFile.c_str()))
+                        TopologySnapshot snap;
+                        if (CaptureWithRetry(config.debugXml ? pollFile.c_str() : nullptr, snap, true))
                         {
-                            TopologyCounts c = CountDevicesInXML(pollFile.c_str());
-                            PipeSendTopology(pollFile.c_str());
-                            PipeSendStatus(c.totalDevices, c.identifiedDevices, (int)g_discoveredDevices.size());
+                            TopologyCounts c = CountDevicesInXML(snap);
+                            PipeSendStatus(c.totalDevices, c.identifiedDevices, g_discoveredDevices.Count());
+                            StreamPollSnapshot(snap);
                             int cycled, total;
                             GetEnumeratorStatusSince(phase4bBaseline, cycled, total);
                             Log(L"  [%ds] %d devices, %d identified, %d events, %d/%d enumerators cycled",
                                 elapsed / 1000, c.totalDevices, c.identifiedDevices,
-                                (int)g_discoveredDevices.size(), cycled, total);
+                                g_discoveredDevices.Count(), cycled, total);
 
                             // Track progress: did device count increase?
                             if (c.totalDevices > lastDeviceCount)
@@ -716,6 +976,7 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
 
                             // Stabilization exit: no new devices for 10s, minimum 8s elapsed
                             if (elapsed >= 8000 && lastDeviceCount > 0 &&
+                                g_backplaneSchedule.queued == 0 &&
                                 GetTickCount() - lastProgressTick >= 10000)
                             {
                                 Log(L"  >> Backplane topology stable for 10s at %ds (%d devices, %d identified) - advancing",
@@ -733,10 +994,13 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
                 }
             }
 
-            // Mark Phase 4+4b complete for all IPs
+            ExecuteOnMainSTA(DoBackplaneQueueClear);
+
+            // Mark Phase 4+4b complete for the chassis that finished
+            std::set<std::wstring> configIPs;
             for (auto& drv : config.drivers)
-                for (auto& ip : drv.ipAddresses)
-                    g_browsedBackplanes.insert(ip);
+                configIPs.insert(drv.ipAddresses.begin(), drv.ipAddresses.end());
+            MarkBrowsedBackplanes(configIPs);
         }
         else
         {
@@ -750,24 +1014,27 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
     Log(L"=== Final Results ===");
 
     {
-        std::wstring afterPath = LogPath(config.logDir, config.debugXml ? L"hook_topo_after.xml" : L"hook_topo_poll.xml");
-        SaveTopologyXML(pGlobals, afterPath.c_str());
+        std::wstring afterPath = LogPath(config.logDir, L"hook_topo_after.xml");
+        TopologySnapshot snap;
+        bool captured = CaptureTopologySnapshot(pGlobals, config.debugXml ? afterPath.c_str() : nullptr, snap, false);
 
-        TopologyCounts fc = CountDevicesInXML(afterPath.c_str());
+        TopologyCounts fc = CountDevicesInXML(snap);
         // Populate caches before tree walk so WalkTopologyTree has fresh IP/classname/slot data
-        UpdateDeviceIPsFromXML(afterPath.c_str());
-        PopulateQueryCache(afterPath.c_str());
+        UpdateDeviceIPsFromXML(snap);
+        PopulateQueryCache(snap, captured);
+        if (captured) SaveWarmCache();
+        NotifyCacheSubscribers();
         WalkTopologyTree(pGlobals);
         if (config.debugXml)
             PipeSendTopology(afterPath.c_str());
-        PipeSendStatus(fc.totalDevices, fc.identifiedDevices, (int)g_discoveredDevices.size());
+        PipeSendStatus(fc.totalDevices, fc.identifiedDevices, g_discoveredDevices.Count());
         std::vector<std::wstring> allIPs = config.allIPs();
-        bool targetFound = !allIPs.empty() && IsTargetIdentifiedInXML(afterPath.c_str(), allIPs);
+        bool targetFound = !allIPs.empty() && IsTargetIdentifiedInXML(snap, allIPs);
         Log(L"Final topology: %d devices, %d identified",
             fc.totalDevices, fc.identifiedDevices);
         if (!allIPs.empty())
             Log(L"Target IPs identified: %s", targetFound ? L"YES" : L"NO");
-        Log(L"Events received: %d", (int)g_discoveredDevices.size());
+        Log(L"Events received: %d", g_discoveredDevices.Count());
 
         std::wstring resultsPath = LogPath(config.logDir, L"hook_results.txt");
         FILE* resultFile = _wfopen(resultsPath.c_str(), L"w, ccs=UTF-8");
@@ -776,10 +1043,14 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
             fwprintf(resultFile, L"DRIVERS: %d\n", (int)config.drivers.size());
             fwprintf(resultFile, L"DEVICES_IDENTIFIED: %d\n", fc.identifiedDevices);
             fwprintf(resultFile, L"DEVICES_TOTAL: %d\n", fc.totalDevices);
-            fwprintf(resultFile, L"EVENTS: %d\n", (int)g_discoveredDevices.size());
+            fwprintf(resultFile, L"EVENTS: %d\n", g_discoveredDevices.Count());
             if (!allIPs.empty())
                 fwprintf(resultFile, L"TARGET: %s\n", allIPs[0].c_str());
             fwprintf(resultFile, L"TARGET_STATUS: %s\n", targetFound ? L"IDENTIFIED" : L"NOT_FOUND");
+            std::vector<std::string> perf;
+            PerfFormat(perf);
+            for (const auto& p : perf)
+                fwprintf(resultFile, L"PERF: %hs\n", p.c_str());
             for (const auto& kv : g_deviceDetails)
             {
                 const DeviceInfo& d = kv.second;
@@ -790,9 +1061,6 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
             fclose(resultFile);
         }
         Log(L"[OK] Results file written");
-
-        if (!config.debugXml)
-            DeleteFileW(afterPath.c_str());
     }
 }
 
@@ -800,40 +1068,23 @@ static void RunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobals,
 // HandleQuery
 // Respond to a Q|path command: look up the device in topology
 // XML, triggering browse if the path hasn't been browsed yet.
+// Cache hits are answered on the client's session thread
+// (AnswerQueryFromCache); the worker only sees the misses.
+// HandleBatchQuery does the same for the misses of a QB| batch
+// with one browse pass and one cache refresh for all of them.
 // ============================================================
 
-// Build the cache key used in g_queryCache
-static std::wstring MakeCacheKey(const std::wstring& ip, const std::wstring& portName, int slot)
-{
-    if (portName.empty()) return ip;
-    wchar_t buf[512];
-    swprintf(buf, 512, L"%s\\%s\\%d", ip.c_str(), portName.c_str(), slot);
-    return buf;
-}
+// Entries per QB| batch; later entries are answered NOTFOUND
+#define QUERY_BATCH_MAX 10000
 
-// Wait for enumerators added since 'baseline' to complete (max 30s)
-static void WaitForEnumerators(int baseline)
+// Q| path: ip[\portName[\slot]]
+static void ParseQueryPath(const char* path, std::wstring& ip, std::wstring& portName, int& slot)
 {
-    DWORD t0 = GetTickCount();
-    while (!g_shouldStop && GetTickCount() - t0 < 30000)
-    {
-        if (GetTickCount() - t0 >= 2000 && EnumeratorsCycledSince(baseline)) break;
-        MSG msg;
-        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
-        { TranslateMessage(&msg); DispatchMessage(&msg); }
-        Sleep(100);
-    }
-}
-
-static void HandleQuery(const char* path, IRSTopologyGlobals* pGlobals,
-                        HookConfig& config, std::vector<BusInfo>& buses)
-{
-    // Parse path: ip[\portName[\slot]]
     std::string pathStr(path);
     if (!pathStr.empty() && pathStr.back() == '\r') pathStr.pop_back();
 
     std::string ipA, portNameA;
-    int slot = -1;
+    slot = -1;
 
     size_t first = pathStr.find('\\');
     if (first == std::string::npos)
@@ -856,86 +1107,431 @@ static void HandleQuery(const char* path, IRSTopologyGlobals* pGlobals,
         }
     }
 
-    std::wstring ip = Utf8ToWide(ipA.c_str());
-    std::wstring portName = Utf8ToWide(portNameA.c_str());
-    std::wstring cacheKey = MakeCacheKey(ip, portName, slot);
+    ip = Utf8ToWide(ipA.c_str());
+    portName = Utf8ToWide(portNameA.c_str());
+}
 
-    Log(L"[QUERY] path='%hs' ip='%s' portName='%s' slot=%d",
-        path, ip.c_str(), portName.c_str(), slot);
+static bool LookupQueryItem(const QueryItem& item, QueryResult& hit, bool cacheLock)
+{
+    bool found = cacheLock ? LookupCachedPath(item.ip, item.portName, item.slot, hit)
+                           : g_deviceStore.Lookup(item.ip, item.portName, item.slot, hit);
+    if (!cacheLock) hit.stale = g_cacheStale;
+    return found && hit.classname != L"Unrecognized Device";
+}
 
-    // --- Cache-first lookup (no file I/O) ---
-    auto it = g_queryCache.find(cacheKey);
-    bool cacheHit = (it != g_queryCache.end() &&
-                     it->second.found &&
-                     it->second.classname != L"Unrecognized Device");
+// One R| line; callers add D| and wrap it in PipeBeginReply
+static void SendQueryResult(const QueryItem& item, bool found, const QueryResult& hit)
+{
+    if (found)
+    {
+        char classA[128] = {}, nameA[256] = {}, ipABuf[64] = {};
+        WideCharToMultiByte(CP_UTF8, 0, hit.classname.c_str(), -1, classA, sizeof(classA), NULL, NULL);
+        WideCharToMultiByte(CP_UTF8, 0, hit.deviceName.c_str(), -1, nameA, sizeof(nameA), NULL, NULL);
+        WideCharToMultiByte(CP_UTF8, 0, item.ip.c_str(), -1, ipABuf, sizeof(ipABuf), NULL, NULL);
+        if (item.tag < 0)
+            Log(L"[QUERY] R|FOUND|%hs|%hs|%hs|%d%s", classA, nameA, ipABuf, item.slot,
+                hit.stale ? L" (stale)" : L"");
+        PipeSendResult(true, classA, nameA, ipABuf, item.slot, item.path.c_str(), item.tag, hit.stale);
+    }
+    else
+    {
+        if (item.tag < 0)
+            Log(L"[QUERY] Not found: %hs", item.path.c_str());
+        PipeSendResult(false, nullptr, nullptr, nullptr, 0, item.path.c_str(), item.tag);
+    }
+}
 
-    if (!cacheHit)
+// C|SWR=1 answer to a miss, inside a reply frame: whatever the cache
+// holds for the path (an Unrecognized Device entry included), PENDING
+static void SendProvisionalResult(const QueryItem& item)
+{
+    QueryResult hit;
+    if (!LookupCachedPath(item.ip, item.portName, item.slot, hit))
     {
-        // Determine what browse is needed
-        bool needsDriverBrowse = (g_browsedDrivers.find(ip) == g_browsedDrivers.end());
-        bool needsBackplane = !portName.empty() &&
-                              (g_browsedBackplanes.find(ip) == g_browsedBackplanes.end());
+        PipeSendResult(false, nullptr, nullptr, nullptr, 0, item.path.c_str(), item.tag, false, true);
+        return;
+    }
+    char classA[128] = {}, nameA[256] = {}, ipABuf[64] = {};
+    WideCharToMultiByte(CP_UTF8, 0, hit.classname.c_str(), -1, classA, sizeof(classA), NULL, NULL);
+    WideCharToMultiByte(CP_UTF8, 0, hit.deviceName.c_str(), -1, nameA, sizeof(nameA), NULL, NULL);
+    WideCharToMultiByte(CP_UTF8, 0, item.ip.c_str(), -1, ipABuf, sizeof(ipABuf), NULL, NULL);
+    PipeSendResult(true, classA, nameA, ipABuf, item.slot, item.path.c_str(), item.tag, hit.stale, true);
+}
+
+// Session thread: answer from g_deviceStore, or false to queue for the worker
+static bool AnswerQueryFromCache(PipeSession* session, const char* path)
+{
+    PerfScope perf(PERF_QUERY_CACHE);
+    QueryItem item;
+    item.path = path;
+    ParseQueryPath(path, item.ip, item.portName, item.slot);
+
+    QueryResult hit;
+    if (!LookupQueryItem(item, hit, true)) return false;
+    Log(L"[QUERY] Client %d: cache hit for '%hs'", session->id, path);
+    PipeBeginReply(session);
+    SendQueryResult(item, true, hit);
+    PipeSendDone();
+    PipeEndReply();
+    return true;
+}
+
+// ============================================================
+// F| find: every cached entry matching the criteria, from the device
+// store's indexes on the session thread. Never browses: only what is
+// already cached is found.
+//   F|class=1756-L8*            F|name=*LOGIX*|ip=10.39.*
+//   F|port=Backplane|slot=0     F|1756-EN2T*   (bare term: classname)
+// One R|FOUND line per match, R|NOTFOUND|<expr> if none, then D|.
+// ============================================================
+
+// Matches per F| reply; the rest are counted in the log
+#define FIND_MAX_RESULTS 10000
 
-        if (needsDriverBrowse)
+static bool ParseFindQuery(const char* expr, FindQuery& q)
+{
+    std::string rest(expr);
+    size_t start = 0;
+    while (start <= rest.size())
+    {
+        size_t end = rest.find('|', start);
+        if (end == std::string::npos) end = rest.size();
+        std::string term = rest.substr(start, end - start);
+        start = end + 1;
+        if (term.empty()) continue;
+
+        size_t eq = term.find('=');
+        std::string key = (eq == std::string::npos) ? "class" : term.substr(0, eq);
+        std::wstring value = Utf8ToWide(term.substr(eq == std::string::npos ? 0 : eq + 1).c_str());
+        if (key == "class") q.classname = value;
+        else if (key == "name") q.deviceName = value;
+        else if (key == "ip") q.ip = value;
+        else if (key == "port") q.portName = value;
+        else if (key == "slot") q.slot = _wtoi(value.c_str());
+        else return false;
+    }
+    return true;
+}
+
+static void AnswerFind(PipeSession* session, const char* expr)
+{
+    PerfScope perf(PERF_FIND_QUERY);
+    FindQuery q;
+    std::vector<QueryResult> matches;
+    bool parsed = ParseFindQuery(expr, q);
+    bool more = parsed && FindCachedPaths(q, matches, FIND_MAX_RESULTS);
+
+    PipeBeginReply(session);
+    for (const auto& m : matches)
+    {
+        char classA[128] = {}, nameA[256] = {}, ipA[64] = {};
+        WideCharToMultiByte(CP_UTF8, 0, m.classname.c_str(), -1, classA, sizeof(classA), NULL, NULL);
+        WideCharToMultiByte(CP_UTF8, 0, m.deviceName.c_str(), -1, nameA, sizeof(nameA), NULL, NULL);
+        WideCharToMultiByte(CP_UTF8, 0, m.ip.c_str(), -1, ipA, sizeof(ipA), NULL, NULL);
+        PipeSendResult(true, classA, nameA, ipA, m.slot, nullptr, -1, m.stale);
+    }
+    if (matches.empty())
+        PipeSendResult(false, nullptr, nullptr, nullptr, 0, expr);
+    PipeSendDone();
+    PipeEndReply();
+
+    if (!parsed)
+        Log(L"[FIND] Client %d: bad criteria '%hs' (keys: class, name, ip, port, slot)", session->id, expr);
+    else
+        Log(L"[FIND] Client %d: '%hs' -> %d match(es)%s", session->id, expr, (int)matches.size(),
+            more ? L" (limit reached, more matched)" : L"");
+}
+
+// Run the browses the given cache misses need — driver browse at most
+// once, one bus + backplane pass for every unbrowsed chassis — then
+// refresh the cache once: with walk (the client's C|WALK=1) by walking
+// just the queried chassis over COM, from a full snapshot if that walk
+// is incomplete. Returns false if nothing needed browsing, or the
+// monitor loop runs.
+static bool BrowseForQueries(const std::vector<QueryItem>& items, IRSTopologyGlobals* pGlobals,
+                             HookConfig& config, bool walk)
+{
+    // The monitor loop browses on its own; misses run once it has the
+    // paths or they time out (ParkForMonitor), and are answered from the cache
+    if (s_inMonitorLoop) return false;
+
+    bool needsDriverBrowse = false;
+    std::set<std::wstring> backplaneIPs;
+    for (const auto& item : items)
+    {
+        if (g_browsedDrivers.find(item.ip) == g_browsedDrivers.end())
+            needsDriverBrowse = true;
+        if (!item.portName.empty() && g_browsedBackplanes.find(item.ip) == g_browsedBackplanes.end())
+            backplaneIPs.insert(item.ip);
+    }
+
+    if (needsDriverBrowse)
+    {
+        Log(L"[QUERY] Running Phase 2+3 for %d path(s)", (int)items.size());
+        int baseline = (int)g_enumerators.size();
+        ExecuteOnMainSTA(DoMainSTABrowse);
+        if (!WaitEnumeratorsSince(baseline, true, ENUM_WAIT_DRIVER_MS))
+            Log(L"[QUERY] Driver enumerators did not all cycle");
+        for (auto& drv : config.drivers) g_browsedDrivers.insert(drv.name);
+    }
+
+    if (!backplaneIPs.empty())
+    {
+        Log(L"[QUERY] Running Phase 4+4b for %d chassis", (int)backplaneIPs.size());
+        // Priority goes by the IP the last snapshot recorded per chassis;
+        // record one first if a queried IP has no device name yet
+        size_t known = 0;
+        for (const auto& ip : backplaneIPs)
+            for (const auto& d : g_deviceDetails)
+                if (d.second.ip == ip) { known++; break; }
+        if (known < backplaneIPs.size())
         {
-            Log(L"[QUERY] Running Phase 2+3 for %s", ip.c_str());
-            ExecuteOnMainSTA(DoMainSTABrowse);
-            WaitForEnumerators((int)g_enumerators.size());
-            for (auto& drv : config.drivers) g_browsedDrivers.insert(drv.name);
+            TopologySnapshot ipSnap;
+            if (CaptureTopologySnapshot(pGlobals, nullptr, ipSnap, false))
+                UpdateDeviceIPsFromXML(ipSnap);
         }
-
-        if (needsBackplane)
+        g_capturedBuses.clear();
+        g_captureBuses = true;
+        int busBaseline = (int)g_enumerators.size();
+        HRESULT hrBus = ExecuteOnMainSTA(DoBusBrowse);
+        if (SUCCEEDED(hrBus))
         {
-            Log(L"[QUERY] Running Phase 4+4b for %s", ip.c_str());
-            g_capturedBuses.clear();
-            g_captureBuses = true;
-            HRESULT hrBus = ExecuteOnMainSTA(DoBusBrowse);
-            if (SUCCEEDED(hrBus))
-            {
-                WaitForEnumerators((int)g_enumerators.size());
-                g_captureBuses = false;
-                HRESULT hrBP = ExecuteOnMainSTA(DoBackplaneBrowse);
-                if (SUCCEEDED(hrBP))
-                    WaitForEnumerators((int)g_enumerators.size());
-            }
+            WaitEnumeratorsSince(busBaseline, true, ENUM_WAIT_BUS_MS);
             g_captureBuses = false;
-            g_browsedBackplanes.insert(ip);
+            // The queried chassis start first; once they have cycled the
+            // rest of the queue is dropped (browsed when queried)
+            g_backplanePriorityIPs = backplaneIPs;
+            int bpBaseline = (int)g_enumerators.size();
+            HRESULT hrBP = ExecuteOnMainSTA(DoBackplaneBrowse);
+            if (SUCCEEDED(hrBP) &&
+                !RunBackplaneSchedule(bpBaseline, true, ENUM_WAIT_BACKPLANE_MS))
+                Log(L"[QUERY] Backplane enumerators did not all cycle");
+            g_backplanePriorityIPs.clear();
+        }
+        g_captureBuses = false;
+        MarkBrowsedBackplanes(backplaneIPs);
+    }
+
+    if (!needsDriverBrowse && backplaneIPs.empty()) return false;
+    // Every baseline above is done with; drop what these browses superseded
+    ExecuteOnMainSTA(DoCompactEnumerators);
+
+    if (walk)
+    {
+        g_walkRequest.ips.clear();
+        g_walkRequest.slots = false;
+        for (const auto& item : items)
+        {
+            g_walkRequest.ips.insert(item.ip);
+            if (!item.portName.empty()) g_walkRequest.slots = true;
+        }
+        if (SUCCEEDED(ExecuteOnMainSTA(DoTopologyWalk)) && g_walkResult.complete)
+        {
+            ApplyTopologyWalk(g_walkResult);
+            SaveWarmCache();
+            NotifyCacheSubscribers();
+            return true;
         }
+        Log(L"[QUERY] Topology walk incomplete, falling back to a snapshot");
+    }
+
+    // Refresh cache from topology  - ONE XML write, only when browse ran
+    std::wstring xmlFile = LogPath(config.logDir, L"hook_topo_live.xml");
+    TopologySnapshot snap;
+    if (CaptureTopologySnapshot(pGlobals, config.debugXml ? xmlFile.c_str() : nullptr, snap, false))
+    {
+        UpdateDeviceIPsFromXML(snap);
+        PopulateQueryCache(snap);
+        SaveWarmCache();
+        NotifyCacheSubscribers();
+    }
+    return true;
+}
 
-        if (needsDriverBrowse || needsBackplane)
+static void HandleQuery(const char* path, PipeSession* session, IRSTopologyGlobals* pGlobals,
+                        HookConfig& config, bool walk)
+{
+    std::vector<QueryItem> items(1);
+    QueryItem& item = items[0];
+    item.path = path;
+    ParseQueryPath(path, item.ip, item.portName, item.slot);
+
+    Log(L"[QUERY] path='%hs' ip='%s' portName='%s' slot=%d",
+        path, item.ip.c_str(), item.portName.c_str(), item.slot);
+
+    // --- Cache-first lookup (no file I/O) ---
+    QueryResult hit;
+    bool cacheHit = LookupQueryItem(item, hit, false);
+    if (!cacheHit && BrowseForQueries(items, pGlobals, config, walk))
+        cacheHit = LookupQueryItem(item, hit, false);
+
+    PipeBeginReply(session);
+    SendQueryResult(item, cacheHit, hit);
+    PipeSendDone();
+    PipeEndReply();
+}
+
+// W| paths in the order the client sent them, the first one a cache
+// miss: one browse as for Q| for every miss, then each watch is
+// registered and answered with whatever the refresh found
+static void HandleWatch(const std::vector<QueryItem>& items, PipeSession* session,
+                        IRSTopologyGlobals* pGlobals, HookConfig& config, bool walk)
+{
+    std::vector<QueryItem> misses;
+    for (const auto& item : items)
+    {
+        QueryResult hit;
+        if (!LookupQueryItem(item, hit, false)) misses.push_back(item);
+    }
+    if (!misses.empty()) BrowseForQueries(misses, pGlobals, config, walk);
+    for (const auto& item : items)
+        AddQueryWatch(session, item.path.c_str(), item.tag, item.ip, item.portName, item.slot, false);
+}
+
+// W|path or W|<id>|path into item
+static void ParseWatchLine(const char* arg, QueryItem& item)
+{
+    // A path never starts with digits followed by '|' (IPs have dots)
+    const char* p = arg;
+    while (*p >= '0' && *p <= '9') p++;
+    if (p > arg && *p == '|')
+    {
+        item.tag = atoi(arg);
+        arg = p + 1;
+    }
+    item.path = arg;
+    ParseQueryPath(arg, item.ip, item.portName, item.slot);
+}
+
+// Session thread: answered and registered here when cached; otherwise
+// the path is left in item for the worker.
+static bool WatchFromCache(PipeSession* session, const char* arg, QueryItem& item)
+{
+    ParseWatchLine(arg, item);
+    return AddQueryWatch(session, item.path.c_str(), item.tag, item.ip, item.portName, item.slot, true);
+}
+
+// Background half of a C|SWR=1 miss: the client already has a PENDING
+// answer. Browse as for Q|, then push the final R| for each path (no D|).
+// Later queries for these paths are cache hits.
+static void HandleRefresh(const std::vector<QueryItem>& items, PipeSession* session,
+                          IRSTopologyGlobals* pGlobals, HookConfig& config, bool walk)
+{
+    DWORD t0 = GetTickCount();
+    bool browsed = BrowseForQueries(items, pGlobals, config, walk);
+    int found = 0, answered = 0;
+    for (const auto& item : items)
+    {
+        QueryResult hit;
+        bool ok = LookupQueryItem(item, hit, false);
+        if (ok) found++;
+        EnterCriticalSection(&s_commandCS);
+        if (ok) s_refreshMisses.erase(item.path);
+        else s_refreshMisses[item.path] = GetTickCount();
+        LeaveCriticalSection(&s_commandCS);
+
+        for (auto& w : TakeRefreshWaiters(item.path))
         {
-            // Refresh cache from topology  - ONE XML write, only when browse ran
-            std::wstring xmlFile = LogPath(config.logDir, L"hook_topo_live.xml");
-            if (SaveTopologyXML(pGlobals, xmlFile.c_str()))
+            if (w.session->connected)
             {
-                UpdateDeviceIPsFromXML(xmlFile.c_str());
-                PopulateQueryCache(xmlFile.c_str());
-                if (!config.debugXml) DeleteFileW(xmlFile.c_str());
+                PipeBeginReply(w.session);
+                SendQueryResult(w.item, ok, hit);
+                PipeEndReply();
+                answered++;
             }
-            it = g_queryCache.find(cacheKey);
-            cacheHit = (it != g_queryCache.end() &&
-                        it->second.found &&
-                        it->second.classname != L"Unrecognized Device");
+            PipeSessionRelease(w.session);
         }
     }
+    Log(L"[QUERY] Refresh for client %d: %d of %d pending path(s) resolved, %d answer(s) pushed (%s, %lu ms)",
+        session->id, found, (int)items.size(), answered, browsed ? L"browsed" : L"nothing to browse",
+        GetTickCount() - t0);
+}
+
+// The misses of a QB| batch (the session thread answered the hits)
+static void HandleBatchQuery(const std::vector<QueryItem>& items, PipeSession* session,
+                             IRSTopologyGlobals* pGlobals, HookConfig& config, bool walk)
+{
+    DWORD t0 = GetTickCount();
+    bool browsed = BrowseForQueries(items, pGlobals, config, walk);
 
-    char resBuf[512];
-    if (cacheHit)
+    int found = 0;
+    PipeBeginReply(session);
+    for (const auto& item : items)
     {
-        char classA[128] = {}, nameA[256] = {}, ipABuf[64] = {};
-        WideCharToMultiByte(CP_UTF8, 0, it->second.classname.c_str(), -1, classA, sizeof(classA), NULL, NULL);
-        WideCharToMultiByte(CP_UTF8, 0, it->second.deviceName.c_str(), -1, nameA, sizeof(nameA), NULL, NULL);
-        WideCharToMultiByte(CP_UTF8, 0, ip.c_str(), -1, ipABuf, sizeof(ipABuf), NULL, NULL);
-        snprintf(resBuf, sizeof(resBuf), "R|FOUND|%s|%s|%s|%d", classA, nameA, ipABuf, slot);
-        Log(L"[QUERY] %hs", resBuf);
+        QueryResult hit;
+        bool ok = LookupQueryItem(item, hit, false);
+        if (ok) found++;
+        SendQueryResult(item, ok, hit);
     }
-    else
+    PipeSendDone();
+    PipeEndReply();
+    Log(L"[QUERY] Batch: %d of %d cache misses resolved (%s, %lu ms)",
+        found, (int)items.size(), browsed ? L"browsed" : L"nothing to browse",
+        GetTickCount() - t0);
+}
+
+// Session thread: read QB|<id>|<path> lines up to QB|END, answer the
+// cache hits at once and hand the misses to the worker as one command.
+// Entries past QUERY_BATCH_MAX are answered NOTFOUND as they are read.
+// With provisional (C|SWR=1) the misses are answered PENDING too, and
+// the reply ends here. Returns false if the session should end.
+static bool ReadQueryBatch(PipeSession* session, std::vector<QueryItem>& misses, bool provisional)
+{
+    std::vector<QueryItem> items;
+    char line[512];
+    int overflow = 0;
+    while (true)
+    {
+        if (!PipeReadLine(session, line, sizeof(line))) return false;
+        if (strcmp(line, "QB|END") == 0) break;
+        if (strncmp(line, "QB|", 3) != 0) continue;
+
+        const char* sep = strchr(line + 3, '|');
+        if (!sep || line[3] < '0' || line[3] > '9') continue;
+        QueryItem item;
+        item.tag = atoi(line + 3);
+        item.path = sep + 1;
+        if (items.size() >= QUERY_BATCH_MAX)
+        {
+            overflow++;
+            PipeBeginReply(session);
+            SendQueryResult(item, false, QueryResult());
+            PipeEndReply();
+            continue;
+        }
+        ParseQueryPath(item.path.c_str(), item.ip, item.portName, item.slot);
+        items.push_back(std::move(item));
+    }
+
+    PipeBeginReply(session);
+    for (size_t i = 0; i < items.size(); i++)
     {
-        snprintf(resBuf, sizeof(resBuf), "R|NOTFOUND|%s", path);
-        Log(L"[QUERY] Not found: %hs", path);
+        QueryResult hit;
+        if (LookupQueryItem(items[i], hit, true)) SendQueryResult(items[i], true, hit);
+        else
+        {
+            if (provisional) SendProvisionalResult(items[i]);
+            misses.push_back(std::move(items[i]));
+        }
     }
-    PipeSendLine(resBuf);
-    PipeSend("D|\n", 3);
+    if (misses.empty() || provisional) PipeSendDone();
+    PipeEndReply();
+
+    Log(L"[QUERY] Client %d: batch of %d path(s), %d cache miss(es)",
+        session->id, (int)items.size() + overflow, (int)misses.size());
+    if (overflow)
+        Log(L"[QUERY] Client %d: %d path(s) over the %d-entry batch limit", session->id, overflow, QUERY_BATCH_MAX);
+    return true;
+}
+
+// A running monitor loop's sinks feed every monitor client's stream, and
+// a browse starts with DoCleanupOnMainSTA, which would tear them down.
+// True (and logged) when what the client asked for is refused for that.
+static bool MonitorOwnsSinks(PipeSession* session, const wchar_t* what)
+{
+    if (!s_inMonitorLoop) return false;
+    Log(L"[PIPE] Client %d: %s refused - the monitor loop owns the sinks", session->id, what);
+    return true;
 }
 
 // ============================================================
@@ -961,24 +1557,15 @@ static bool SafeRunBrowsePhases(HookConfig& config, IRSTopologyGlobals*& pGlobal
 
 // ============================================================
 // HandleSession
-// Manage one connected CLI client: read config, acquire buses,
-// run browse if needed, enter command loop.
+// Worker side of a new client: merge its config, acquire buses,
+// run browse if needed or replay the cached topology to it.
 // ============================================================
 
-static void HandleSession(HookConfig& config, IRSTopologyGlobals*& pGlobals,
-                          std::vector<BusInfo>& buses)
+static void HandleSession(PipeSession* session, const HookConfig& newConfig, HookConfig& config,
+                          IRSTopologyGlobals*& pGlobals, std::vector<BusInfo>& buses)
 {
     static bool logDirSet = false;
 
-    // Read config from pipe
-    HookConfig newConfig;
-    if (!ReadConfigFromPipe(newConfig))
-    {
-        Log(L"[FAIL] Cannot read config from pipe");
-        return;
-    }
-    Log(L"[PIPE] Config received via pipe");
-
     // First session: switch log to config logDir
     if (!logDirSet && newConfig.logDir != L"C:\\temp")
     {
@@ -987,8 +1574,7 @@ static void HandleSession(HookConfig& config, IRSTopologyGlobals*& pGlobals,
         FILE* newLog = _wfopen(newLogPath.c_str(), L"w, ccs=UTF-8");
         if (newLog)
         {
-            fclose(g_logFile);
-            g_logFile = newLog;
+            LogSwitchFile(newLog);
             logDirSet = true;
             Log(L"=== RSLinxHook v7 Worker Thread (logdir: %s) ===", newConfig.logDir.c_str());
         }
@@ -999,6 +1585,8 @@ static void HandleSession(HookConfig& config, IRSTopologyGlobals*& pGlobals,
     config.mode = newConfig.mode;
     config.debugXml = newConfig.debugXml;
     config.probeDispids = newConfig.probeDispids;
+    config.backplaneInFlight = newConfig.backplaneInFlight;
+    config.monitorMaxStaleMs = newConfig.monitorMaxStaleMs;
     if (!newConfig.logDir.empty()) config.logDir = newConfig.logDir;
 
     for (auto& newDrv : newConfig.drivers)
@@ -1024,8 +1612,12 @@ static void HandleSession(HookConfig& config, IRSTopologyGlobals*& pGlobals,
     }
 
     g_pSharedConfig = &config;
+    // From here on the client receives broadcast L|/S|/N|/X| output
+    PipeSessionReady(session, newConfig.deltaTopology, newConfig.mode == HookMode::Monitor,
+                     newConfig.logLevel);
 
-    Log(L"Drivers: %d, Mode: %s, LogDir: %s, NewWork: %s",
+    Log(L"Client %d - Drivers: %d, Mode: %s, LogDir: %s, NewWork: %s",
+        session->id,
         (int)config.drivers.size(),
         config.mode == HookMode::Monitor ? L"monitor" : L"inject",
         config.logDir.c_str(),
@@ -1036,10 +1628,32 @@ static void HandleSession(HookConfig& config, IRSTopologyGlobals*& pGlobals,
     {
         AcquireNewBuses(config, pGlobals, buses);
     }
-
-    // Run browse phases if this is the first session or there's new work
+    EnterCriticalSection(&s_commandCS);
+    s_residentDrivers.clear();
+    for (const auto& bus : buses)
+        s_residentDrivers.push_back(bus.driverName);
+    LeaveCriticalSection(&s_commandCS);
+
+    // Run browse phases if this is the first session or there's new work.
+    // With warm-start data loaded (and nothing browsed yet) an inject
+    // client gets that data now, flagged stale, and the browse runs
+    // right after as a background revalidation.
     bool shouldBrowse = buses.empty() ? false : (hasNewWork || g_browsedDrivers.empty());
-    if (shouldBrowse)
+    if (shouldBrowse && MonitorOwnsSinks(session, L"browse"))
+        shouldBrowse = false;   // replayed below; the loop's snapshots cover the rest
+    bool revalidate = shouldBrowse && g_cacheStale && g_browsedDrivers.empty() &&
+                      config.mode == HookMode::Inject;
+    if (revalidate)
+    {
+        Log(L"[CACHE] Serving warm-start topology to client %d, revalidating in background", session->id);
+        TopologyCounts cached = CountDevicesFromCache();
+        PipeBeginReply(session);
+        WalkTopologyTree(pGlobals);
+        PipeSendStatus(cached.totalDevices, cached.identifiedDevices, g_discoveredDevices.Count());
+        PipeEndReply();
+        SubmitCommand(NewClientCommand(ClientCommandType::Revalidate, session, newConfig), false);
+    }
+    else if (shouldBrowse)
     {
         // Always unadvise stale sinks before registering new ones.
         // Handles the case where the hook is reused across viewer sessions
@@ -1053,53 +1667,387 @@ static void HandleSession(HookConfig& config, IRSTopologyGlobals*& pGlobals,
     }
     else
     {
-        Log(L"[INFO] Already browsed  - replaying cached topology to new client");
-        std::wstring pollFile = LogPath(config.logDir, L"hook_topo_poll.xml");
+        Log(L"[INFO] Already browsed  - replaying cached topology to client %d", session->id);
+        // Snapshots are only kept on disk in debugXml mode (hook_topo_after.xml);
+        // otherwise they never leave memory and the query cache is the source.
+        // The replay goes to this client only; the others already hold the tree.
+        std::wstring pollFile = LogPath(config.logDir, L"hook_topo_after.xml");
         DWORD attr = GetFileAttributesW(pollFile.c_str());
         if (attr != INVALID_FILE_ATTRIBUTES && !(attr & FILE_ATTRIBUTE_DIRECTORY))
         {
             TopologyCounts cached = CountDevicesInXML(pollFile.c_str());
+            PipeBeginReply(session);
             WalkTopologyTree(pGlobals);
             if (config.debugXml)
                 PipeSendTopology(pollFile.c_str());
-            PipeSendStatus(cached.totalDevices, cached.identifiedDevices, (int)g_discoveredDevices.size());
+            PipeSendStatus(cached.totalDevices, cached.identifiedDevices, g_discoveredDevices.Count());
+            PipeEndReply();
             Log(L"[INFO] Replayed cached topology: %d devices, %d identified",
                 cached.totalDevices, cached.identifiedDevices);
         }
         else
         {
-            // XML file missing — use in-memory cache instead
-            Log(L"[WARN] No cached XML — replaying from in-memory cache");
+            // No debug XML on disk — use in-memory cache instead
+            Log(L"[INFO] Replaying from in-memory cache");
             TopologyCounts cached = CountDevicesFromCache();
+            PipeBeginReply(session);
             WalkTopologyTree(pGlobals);
-            PipeSendStatus(cached.totalDevices, cached.identifiedDevices, (int)g_discoveredDevices.size());
+            PipeSendStatus(cached.totalDevices, cached.identifiedDevices, g_discoveredDevices.Count());
+            PipeEndReply();
             Log(L"[INFO] Replayed from cache: %d devices, %d identified",
                 cached.totalDevices, cached.identifiedDevices);
         }
     }
 
-    // Signal end of initial browse to CLI
-    PipeSend("D|\n", 3);
+    // Signal end of initial browse to CLI (after the log lines that led to it)
+    LogFlush(500);
+    PipeBeginReply(session);
+    PipeSendDone();
+    PipeEndReply();
+}
+
+// ============================================================
+// Client command dispatch (worker thread)
+// ============================================================
+
+static void RunClientCommand(ClientCommand* cmd)
+{
+    HookConfig& config = *s_worker.config;
+    IRSTopologyGlobals*& pGlobals = *s_worker.ppGlobals;
+    std::vector<BusInfo>& buses = *s_worker.buses;
+    PipeSession* session = cmd->session;
+
+    // This client's skip lists for the command's browses; a command run
+    // inside the monitor loop hands the loop's own back afterwards
+    SkipLists outer = SessionSkipLists(config);
+    ApplySkipLists(config, cmd->skipIPs);
+
+    switch (cmd->type)
+    {
+    case ClientCommandType::Session:
+        HandleSession(session, cmd->config, config, pGlobals, buses);
+        break;
+
+    case ClientCommandType::Query:
+        HandleQuery(cmd->path.c_str(), session, pGlobals, config, cmd->walkTopology);
+        break;
+
+    case ClientCommandType::QueryBatch:
+        HandleBatchQuery(cmd->batch, session, pGlobals, config, cmd->walkTopology);
+        break;
+
+    case ClientCommandType::Watch:
+        HandleWatch(cmd->batch, session, pGlobals, config, cmd->walkTopology);
+        break;
+
+    case ClientCommandType::Refresh:
+        HandleRefresh(cmd->batch, session, pGlobals, config, cmd->walkTopology);
+        break;
+
+    case ClientCommandType::Revalidate:
+    {
+        if (!g_cacheStale) break;   // a browse already replaced the warm-start data
+        if (MonitorOwnsSinks(session, L"revalidation")) break;   // the loop's snapshots do it
+        Log(L"[CACHE] Revalidating warm-start topology");
+        HookMode mode = config.mode;
+        config.mode = HookMode::Inject;
+        ExecuteOnMainSTA(DoCleanupOnMainSTA);
+        if (!SafeRunBrowsePhases(config, pGlobals, buses))
+            Log(L"[FAIL] Revalidation browse crashed (SEH exception)");
+        config.mode = mode;
+        break;
+    }
+
+    case ClientCommandType::Browse:
+    {
+        Log(L"[PIPE] Re-browse requested by client %d", session->id);
+        if (MonitorOwnsSinks(session, L"re-browse"))
+        {
+            PipeBeginReply(session);
+            PipeSendDone();
+            PipeEndReply();
+            break;
+        }
+        // A re-browse never starts a monitor loop of its own
+        HookMode mode = config.mode;
+        config.mode = HookMode::Inject;
+        ExecuteOnMainSTA(DoCleanupOnMainSTA); // unadvise stale sinks before re-registering
+        bool ok = SafeRunBrowsePhases(config, pGlobals, buses);
+        config.mode = mode;
+        PipeBeginReply(session);
+        PipeSendDone();
+        PipeEndReply();
+        cmd->keepSession = ok;   // COM state likely corrupt — disconnect client
+        break;
+    }
+
+    case ClientCommandType::Closed:
+        ResetTopologyDiff(session->id);
+        break;
+    }
+    ApplySkipLists(config, outer);
+}
+
+// Every path of a Q|, QB| or refresh command is in the cache
+static bool CommandCached(const ClientCommand* cmd)
+{
+    QueryResult hit;
+    if (cmd->type == ClientCommandType::Query)
+    {
+        QueryItem item;
+        ParseQueryPath(cmd->path.c_str(), item.ip, item.portName, item.slot);
+        return LookupQueryItem(item, hit, false);
+    }
+    for (const auto& item : cmd->batch)
+        if (!LookupQueryItem(item, hit, false)) return false;
+    return true;
+}
+
+// A cache miss while the monitor loop runs: a browse for it would hold
+// up the loop, and with it every client's S| stream, while the loop's
+// own browse is finding the same devices. It waits here instead. A W|
+// miss is not parked: it registers at once, and the watch pushes the
+// path when the loop caches it.
+static bool ParkForMonitor(ClientCommand* cmd)
+{
+    if (!s_inMonitorLoop) return false;
+    if (cmd->type != ClientCommandType::Query && cmd->type != ClientCommandType::QueryBatch &&
+        cmd->type != ClientCommandType::Refresh)
+        return false;
+    if (CommandCached(cmd)) return false;
+    s_parked.push_back({cmd, GetTickCount()});
+    Log(L"[QUERY] Client %d: cache miss waits for the monitor loop (up to %d s)",
+        cmd->session->id, MONITOR_QUERY_WAIT_MS / 1000);
+    return true;
+}
+
+// Run the parked commands the cache now answers or that have waited
+// MONITOR_QUERY_WAIT_MS; once the loop has ended, all of them (browsing
+// as usual)
+static void ServiceParkedCommands()
+{
+    DWORD now = GetTickCount();
+    for (size_t i = 0; i < s_parked.size();)
+    {
+        ClientCommand* cmd = s_parked[i].cmd;
+        bool fail = g_shouldStop || !s_worker.config;
+        if (!fail && s_inMonitorLoop && cmd->session->connected &&
+            now - s_parked[i].tick < MONITOR_QUERY_WAIT_MS && !CommandCached(cmd))
+        {
+            i++;
+            continue;
+        }
+        s_parked.erase(s_parked.begin() + i);
+        // A refresh also answers the other clients waiting on its paths
+        if (fail) FailCommand(cmd);
+        else if (cmd->session->connected || cmd->type == ClientCommandType::Refresh)
+            RunClientCommand(cmd);
+        CompleteCommand(cmd);
+    }
+}
+
+static void ServiceClientCommands()
+{
+    while (ClientCommand* cmd = TakeCommand())
+    {
+        if (g_shouldStop || !s_worker.config)
+            FailCommand(cmd);
+        else if (g_comLayoutMismatch && cmd->type != ClientCommandType::Closed)
+        {
+            Log(L"[FAIL] Client %d: command refused - COM layout mismatch (see [LAYOUT] lines)",
+                cmd->session->id);
+            // A session that never got ready sees no Log lines; tell it why
+            // it is dropped before the disconnect
+            if (!cmd->session->ready)
+            {
+                PipeBeginReply(cmd->session);
+                PipeSendLogLine(L"[FAIL] command refused - COM layout mismatch, see the hook log");
+                PipeEndReply();
+            }
+            FailCommand(cmd);
+        }
+        else if (ParkForMonitor(cmd))
+            continue;
+        else
+            RunClientCommand(cmd);
+        CompleteCommand(cmd);
+    }
+    ServiceParkedCommands();
+}
+
+// MonitorServiceFunc: serve other clients between monitor passes, and keep
+// monitoring while any monitor client is attached
+static bool ServiceClientsFromMonitor()
+{
+    ServiceClientCommands();
+    return !g_shouldStop && PipeMonitorSessions() > 0;
+}
+
+// ============================================================
+// AnswerHello  - H| attach ping (session thread)
+// READY when an earlier session left the worker holding a bus for every
+// driver the client named (for any driver, if it named none): the
+// session is then query-only and never reaches the worker's
+// HandleSession — no driver merge, browse decision, topology replay or
+// initial D|. COLD: the client sends the rest of its config as usual.
+// The reply is one text line, sent before any binary switch.
+// ============================================================
+
+static bool AnswerHello(PipeSession* session, const std::vector<std::wstring>& drivers)
+{
+    EnterCriticalSection(&s_commandCS);
+    bool ready = !s_residentDrivers.empty();
+    for (const auto& drv : drivers)
+    {
+        bool held = false;
+        for (const auto& resident : s_residentDrivers)
+            if (_wcsicmp(resident.c_str(), drv.c_str()) == 0) { held = true; break; }
+        if (!held) { ready = false; break; }
+    }
+    LeaveCriticalSection(&s_commandCS);
+
+    char line[128];
+    int n = snprintf(line, sizeof(line), "H|%d|%s|%s\n", HOOK_HELLO_VERSION,
+                     ready ? "READY" : "COLD", HOOK_CAPABILITIES);
+    PipeBeginReply(session);
+    PipeSessionSend(session, line, n);
+    PipeEndReply();
+    Log(L"[PIPE] Client %d: attach ping, hook %s", session->id, ready ? L"ready" : L"cold");
+    return ready;
+}
+
+// ============================================================
+// RunClientSession
+// Session thread of one pipe client (PipeSessionFunc): read its
+// config, hand it to the worker (unless an H| ping made it a query
+// session), then serve Q|, QB|, F|, W|, B|, P| and STOP.
+// Cache hits are answered here, so a query never waits behind
+// another client's browse or monitor pass.
+// ============================================================
+
+static void RunClientSession(PipeSession* session)
+{
+    HookConfig cfg;
+    if (!ReadConfigFromPipe(session, cfg))
+    {
+        Log(L"[FAIL] Client %d: cannot read config from pipe", session->id);
+        return;
+    }
+    bool querySession = cfg.hello && AnswerHello(session, cfg.helloDrivers);
+    if (cfg.hello && !querySession && !ReadConfigFromPipe(session, cfg))
+    {
+        Log(L"[FAIL] Client %d: cannot read config from pipe", session->id);
+        return;
+    }
+    Log(L"[PIPE] Client %d: %s", session->id,
+        querySession ? L"query session attached" : L"config received via pipe");
+    if (cfg.binaryProtocol)
+    {
+        PipeEnableBinary(session);
+        Log(L"[PIPE] Client %d: binary framing enabled (v%d)", session->id, PIPE_BINARY_VERSION);
+    }
+
+    // A monitor client's session command runs as long as the monitor loop,
+    // so it is not waited for: this thread must stay free to read STOP
+    bool monitor = (cfg.mode == HookMode::Monitor);
+    // Streamed before the worker starts this session's browse, so the
+    // cached devices go first and none of the browse's records are missed
+    if (cfg.streamDevices)
+        AddDeviceStream(session);
+    ClientCommand* cmd = nullptr;
+    bool keep = true;
+    if (!querySession)
+    {
+        cmd = NewClientCommand(ClientCommandType::Session, session, cfg);
+        cmd->config = cfg;
+        keep = SubmitCommand(cmd, !monitor);
+    }
 
-    // Command loop: handle Q| queries, B| re-browse, and STOP
     char line[512];
-    while (g_pipeConnected && !g_shouldStop)
+    while (keep && session->connected && !g_shouldStop)
     {
-        if (!PipeReadLine(line, sizeof(line))) break;
+        if (!PipeReadLine(session, line, sizeof(line))) break;
         if (strcmp(line, "STOP") == 0) break;
         if (line[0] == 'Q' && line[1] == '|')
         {
-            HandleQuery(line + 2, pGlobals, config, buses);
+            if (AnswerQueryFromCache(session, line + 2)) continue;
+            if (cfg.staleWhileRevalidate)
+            {
+                // Answer now; the browse runs behind it and pushes the result
+                QueryItem item;
+                item.path = line + 2;
+                ParseQueryPath(item.path.c_str(), item.ip, item.portName, item.slot);
+                PipeBeginReply(session);
+                SendProvisionalResult(item);
+                PipeSendDone();
+                PipeEndReply();
+                std::vector<QueryItem> items(1, item);
+                SubmitRefresh(session, items, cfg);
+                continue;
+            }
+            cmd = NewClientCommand(ClientCommandType::Query, session, cfg);
+            cmd->path = line + 2;
+            keep = SubmitCommand(cmd, true);
+        }
+        else if (strcmp(line, "QB|BEGIN") == 0)
+        {
+            std::vector<QueryItem> misses;
+            keep = ReadQueryBatch(session, misses, cfg.staleWhileRevalidate);
+            if (!keep || misses.empty()) continue;
+            if (cfg.staleWhileRevalidate)
+            {
+                SubmitRefresh(session, misses, cfg);
+                continue;
+            }
+            cmd = NewClientCommand(ClientCommandType::QueryBatch, session, cfg);
+            cmd->batch = std::move(misses);
+            keep = SubmitCommand(cmd, true);
+        }
+        else if (line[0] == 'F' && line[1] == '|')
+        {
+            AnswerFind(session, line + 2);
+        }
+        else if (line[0] == 'W' && line[1] == '|')
+        {
+            QueryItem item;
+            if (WatchFromCache(session, line + 2, item)) continue;
+            cmd = NewClientCommand(ClientCommandType::Watch, session, cfg);
+            cmd->batch.push_back(std::move(item));
+            // W| lines the client has already sent share the miss's browse;
+            // cached ones wait with it so the answers stay in order
+            while (cmd->batch.size() < QUERY_BATCH_MAX && PipeLineBuffered(session, "W|") &&
+                   PipeReadLine(session, line, sizeof(line)))
+            {
+                QueryItem next;
+                ParseWatchLine(line + 2, next);
+                cmd->batch.push_back(std::move(next));
+            }
+            keep = SubmitCommand(cmd, true);
         }
         else if (strcmp(line, "B|") == 0)
         {
-            Log(L"[PIPE] Re-browse requested by client");
-            ExecuteOnMainSTA(DoCleanupOnMainSTA); // unadvise stale sinks before re-registering
-            bool ok = SafeRunBrowsePhases(config, pGlobals, buses);
-            PipeSend("D|\n", 3);
-            if (!ok) break; // COM state likely corrupt — disconnect client
+            keep = SubmitCommand(NewClientCommand(ClientCommandType::Browse, session, cfg), true);
+        }
+        else if (strcmp(line, "P|") == 0 || strcmp(line, "P|RESET") == 0)
+        {
+            // Interlocked tables: no need to wait for the worker
+            std::vector<std::string> stats;
+            PerfFormat(stats);
+            if (line[2] == 'R') PerfReset();
+            PipeBeginReply(session);
+            PipeSendPerf(stats);
+            PipeSendDone();
+            PipeEndReply();
         }
     }
+
+    // Stop broadcasting to this client before the worker forgets its
+    // topology state, so nothing recreates it
+    LogFlush(1000);
+    PipeSessionDrain(session, 1000);
+    PipeSessionDrop(session);
+    DropCacheSubscriptions(session);
+    SubmitCommand(NewCommand(ClientCommandType::Closed, session), false);
 }
 
 // ============================================================
@@ -1109,7 +2057,12 @@ static void HandleSession(HookConfig& config, IRSTopologyGlobals*& pGlobals,
 static DWORD WINAPI WorkerThread(LPVOID lpParam)
 {
     InitializeCriticalSection(&g_logCS);
+    InitializeCriticalSection(&g_dirtyCS);
+    InitializeCriticalSection(&s_commandCS);
+    g_hEnumeratorDone = CreateEventW(NULL, FALSE, FALSE, NULL);
+    s_hCommandEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
     g_logFile = _wfopen(L"C:\\temp\\hook_log.txt", L"w, ccs=UTF-8");
+    LogStartWriter();
     Log(L"=== RSLinxHook v7 Worker Thread Started ===");
     Log(L"PID: %d, TID: %d", GetCurrentProcessId(), GetCurrentThreadId());
 
@@ -1118,7 +2071,12 @@ static DWORD WINAPI WorkerThread(LPVOID lpParam)
     if (FAILED(hr) && hr != RPC_E_CHANGED_MODE && hr != S_FALSE)
     {
         Log(L"[FAIL] CoInitializeEx failed: 0x%08x", hr);
+        LogStopWriter();
         if (g_logFile) fclose(g_logFile);
+        if (g_hEnumeratorDone) { CloseHandle(g_hEnumeratorDone); g_hEnumeratorDone = NULL; }
+        if (s_hCommandEvent) { CloseHandle(s_hCommandEvent); s_hCommandEvent = NULL; }
+        DeleteCriticalSection(&s_commandCS);
+        DeleteCriticalSection(&g_dirtyCS);
         DeleteCriticalSection(&g_logCS);
         return 1;
     }
@@ -1149,50 +2107,45 @@ static DWORD WINAPI WorkerThread(LPVOID lpParam)
             L"C:\\Program Files (x86)\\Rockwell Software\\RSLinx\\LINXCOMM.DLL",
             L"C:\\Program Files (x86)\\Rockwell Software\\RSCommon\\RSWHO.OCX",
         };
+        ITypeLib* libs[3] = {};
         for (int i = 0; i < 3; i++)
-        {
-            ITypeLib* pTL = nullptr;
-            hr = LoadTypeLibEx(tlbPaths[i], REGKIND_REGISTER, &pTL);
-            if (pTL) pTL->Release();
-        }
+            hr = LoadTypeLibEx(tlbPaths[i], REGKIND_REGISTER, &libs[i]);
+        // ComLayout.h against what this RSLinx install describes
+        VerifyComLayout(libs, 3);
+        for (int i = 0; i < 3; i++)
+            if (libs[i]) libs[i]->Release();
     }
 
-    // Create named pipe server and enter accept loop
-    if (!PipeCreateServer())
+    // Topology from before the last RSLinx restart, if any (served stale)
+    LoadWarmCache();
+
+    // ENGINE.DLL exports for driver hot-load, resolved once
+    BindEngine();
+
+    // Start the pipe server; client sessions hand their work to this thread
+    if (!PipeStartServer(RunClientSession))
     {
-        Log(L"[FAIL] PipeCreateServer: %d", GetLastError());
+        Log(L"[FAIL] PipeStartServer: %d", GetLastError());
         goto cleanup;
     }
-    Log(L"[PIPE] Server created, waiting for clients...");
+    Log(L"[PIPE] Server started (up to %d clients), waiting for clients...", PIPE_MAX_CLIENTS);
 
     {
         HookConfig config;
         std::vector<BusInfo> buses;
+        s_worker = { &config, &pGlobals, &buses };
 
         while (!g_shouldStop)
         {
-            Log(L"[PIPE] Waiting for client connection...");
-            if (!PipeAcceptClient())
-            {
-                if (g_shouldStop) break;
-                Log(L"[PIPE] AcceptClient failed: %d -- recreating pipe", GetLastError());
-                PipeDestroyServer();
-                Sleep(500);
-                if (!PipeCreateServer())
-                {
-                    Log(L"[PIPE] Recreate failed: %d -- exiting", GetLastError());
-                    break;
-                }
-                continue;
-            }
-            Log(L"[PIPE] Client connected");
-
-            HandleSession(config, pGlobals, buses);
-
-            PipeDisconnectClient();
-            Log(L"[PIPE] Client disconnected, looping");
+            HANDLE handles[2] = { s_hCommandEvent, g_hStopEvent };
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) break;
+            ServiceClientCommands();
         }
 
+        // Fail whatever is still queued; waiting session threads see g_hStopEvent
+        s_worker = {};
+        ServiceClientCommands();
+
         // Release buses accumulated across sessions
         for (auto& bus : buses)
         {
@@ -1212,6 +2165,7 @@ static DWORD WINAPI WorkerThread(LPVOID lpParam)
     }
 
 cleanup:
+    ShutdownMainSTAQueue();
     if (pGlobals) pGlobals->Release();
     if (pHarmony) pHarmony->Release();
 
@@ -1220,10 +2174,16 @@ cleanup:
     g_pSharedConfig = nullptr;
     Log(L"=== RSLinxHook v7 Worker Thread Done ===");
 
-    PipeDestroyServer();
+    PipeStopServer();
+    ServiceClientCommands();   // detached commands of the last sessions
+    LogStopWriter();
 
     if (g_logFile) fclose(g_logFile);
     g_logFile = nullptr;
+    if (g_hEnumeratorDone) { CloseHandle(g_hEnumeratorDone); g_hEnumeratorDone = NULL; }
+    if (s_hCommandEvent) { CloseHandle(s_hCommandEvent); s_hCommandEvent = NULL; }
+    DeleteCriticalSection(&s_commandCS);
+    DeleteCriticalSection(&g_dirtyCS);
     DeleteCriticalSection(&g_logCS);
 
     return 0;
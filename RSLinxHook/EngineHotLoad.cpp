@@ -1,16 +1,59 @@
 #include "EngineHotLoad.h"
 #include "Logging.h"
+#include "DispatchHelpers.h"
+#include "Perf.h"
 
 // ============================================================
 // EngineHotLoad globals
 // ============================================================
 
-std::wstring g_engineDriverName;
+EngineBinding g_engine;
+std::vector<std::wstring> g_engineDriverNames;
 
 // ============================================================
 // EngineHotLoad implementations
 // ============================================================
 
+bool BindEngine()
+{
+    if (g_engine.hEngine) return g_engine.usable();
+
+    // Module names compare case-insensitively
+    HMODULE hEngine = GetModuleHandleA("ENGINE.DLL");
+    if (!hEngine)
+    {
+        Log(L"[ENGINE] ENGINE.DLL not found in process");
+        return false;
+    }
+
+    // Mangled C++ names
+    EngineBinding b;
+    b.hEngine = hEngine;
+    b.findDriverByName = (void* (__cdecl*)(const char*))GetProcAddress(hEngine,
+        "?Engine_FindCDriver@@YAPAVCDriver@@PBD@Z");
+    b.findDriverByID = (void* (__cdecl*)(int))GetProcAddress(hEngine,
+        "?Engine_FindCDriver@@YAPAVCDriver@@H@Z");
+    b.refreshPorts = (void (__cdecl*)())GetProcAddress(hEngine,
+        "?Engine_RefreshWorkstationPorts@@YAXXZ");
+    b.refreshDevices = (void (__cdecl*)())GetProcAddress(hEngine,
+        "?Engine_RefreshDeviceList@@YAXXZ");
+    b.getDriverCount = (int (__cdecl*)())GetProcAddress(hEngine,
+        "?Engine_GetDriverCount@@YAHXZ");
+    b.addDevice = (long (__cdecl*)(void*))GetProcAddress(hEngine,
+        "?Engine_AddDevice@@YAJPAVCDevice@@@Z");
+    g_engine = b;
+
+    Log(L"[ENGINE] ENGINE.DLL at 0x%p: FindByName=0x%p FindByID=0x%p RefreshDevices=0x%p "
+        L"RefreshPorts=0x%p AddDevice=0x%p DriverCount=0x%p",
+        hEngine, b.findDriverByName, b.findDriverByID, b.refreshDevices,
+        b.refreshPorts, b.addDevice, b.getDriverCount);
+    if (!b.usable())
+        Log(L"[ENGINE] No Engine_FindCDriver export - hot-load disabled");
+    else if (!b.refreshDevices || !b.refreshPorts)
+        Log(L"[ENGINE] Refresh export(s) missing - hot-loaded drivers may not reach the topology");
+    return b.usable();
+}
+
 // DriverID → DRV filename mapping (from Ghidra analysis of ENGINE.DLL static table)
 const char* GetDrvFileForDriverID(DWORD driverID)
 {
@@ -42,25 +85,98 @@ const char* GetDrvFileForDriverID(DWORD driverID)
     return nullptr;
 }
 
-// Find the driver type key name and DRV filename for a given driver Name
-bool FindDriverTypeAndDrv(const char* driverName, char* outDriverType, size_t typeLen,
-                           char* outDrvFile, size_t drvLen)
+// ============================================================
+// Driver type cache — rebuilt on the main STA when a registry change
+// notification fired since the last build
+// ============================================================
+
+#define RSLINX_DRIVERS_KEY  "SOFTWARE\\WOW6432Node\\Rockwell Software\\RSLinx\\Drivers"
+#define RSLINX_LOADABLE_KEY "SOFTWARE\\WOW6432Node\\Rockwell Software\\RSLinx\\Loadable Drivers"
+
+#ifndef REG_NOTIFY_THREAD_AGNOSTIC
+#define REG_NOTIFY_THREAD_AGNOSTIC 0x10000000L
+#endif
+
+struct DriverTypeEntry {
+    std::string type;        // key under Drivers
+    DWORD driverID = 0;      // Loadable Drivers\<type>\DriverID
+    const char* drvFile = nullptr;
+};
+
+struct RegistryWatch {
+    HKEY hKey = nullptr;
+    HANDLE hChanged = nullptr;   // manual-reset; set by the notification
+};
+
+static std::map<std::string, DriverTypeEntry> s_driverTypes;   // lower-case Name -> type
+static RegistryWatch s_watchDrivers, s_watchLoadable;
+static bool s_driverTypesBuilt = false;
+
+static std::string LowerName(const char* s)
 {
-    outDriverType[0] = '\0';
-    outDrvFile[0] = '\0';
+    std::string out(s);
+    for (auto& ch : out) ch = (char)tolower((unsigned char)ch);
+    return out;
+}
+
+// One-shot notification: armed again by every rebuild. Without the key or
+// the notification the cache counts as dirty on every lookup.
+static void ArmRegistryWatch(RegistryWatch& w, const char* path)
+{
+    if (!w.hKey && RegOpenKeyExA(HKEY_LOCAL_MACHINE, path, 0, KEY_READ | KEY_NOTIFY, &w.hKey) != ERROR_SUCCESS)
+        w.hKey = nullptr;
+    if (!w.hChanged) w.hChanged = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!w.hKey || !w.hChanged) return;
+
+    ResetEvent(w.hChanged);
+    LONG rc = RegNotifyChangeKeyValue(w.hKey, TRUE,
+        REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET | REG_NOTIFY_THREAD_AGNOSTIC,
+        w.hChanged, TRUE);
+    if (rc != ERROR_SUCCESS)
+    {
+        Log(L"[ENGINE] RegNotifyChangeKeyValue(%S): %ld", path, rc);
+        SetEvent(w.hChanged);
+    }
+}
+
+static bool RegistryWatchFired(const RegistryWatch& w)
+{
+    return !w.hKey || !w.hChanged || WaitForSingleObject(w.hChanged, 0) == WAIT_OBJECT_0;
+}
+
+static DWORD ReadDriverID(HKEY hLoadableRoot, const char* typeName)
+{
+    DWORD driverID = 0;
+    HKEY hLoadable;
+    if (hLoadableRoot && RegOpenKeyExA(hLoadableRoot, typeName, 0, KEY_READ, &hLoadable) == ERROR_SUCCESS)
+    {
+        DWORD idSize = sizeof(driverID);
+        if (RegQueryValueExA(hLoadable, "DriverID", NULL, NULL, (BYTE*)&driverID, &idSize) != ERROR_SUCCESS)
+            driverID = 0;
+        RegCloseKey(hLoadable);
+    }
+    return driverID;
+}
+
+// Every instance Name under Drivers\<type>\<instance>
+static void RebuildDriverTypes()
+{
+    // Armed before the walk, so a change during it is not missed
+    ArmRegistryWatch(s_watchDrivers, RSLINX_DRIVERS_KEY);
+    ArmRegistryWatch(s_watchLoadable, RSLINX_LOADABLE_KEY);
+    s_driverTypes.clear();
+    s_driverTypesBuilt = true;
 
-    // Enumerate all driver type keys under Drivers
     HKEY hDriversKey;
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE,
-        "SOFTWARE\\WOW6432Node\\Rockwell Software\\RSLinx\\Drivers",
-        0, KEY_READ, &hDriversKey) != ERROR_SUCCESS)
-        return false;
+    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, RSLINX_DRIVERS_KEY, 0, KEY_READ, &hDriversKey) != ERROR_SUCCESS)
+        return;
+    HKEY hLoadableRoot = nullptr;
+    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, RSLINX_LOADABLE_KEY, 0, KEY_READ, &hLoadableRoot) != ERROR_SUCCESS)
+        hLoadableRoot = nullptr;
 
     char typeName[128];
     DWORD typeNameLen;
-    bool found = false;
-
-    for (DWORD typeIdx = 0; !found; typeIdx++)
+    for (DWORD typeIdx = 0; ; typeIdx++)
     {
         typeNameLen = sizeof(typeName);
         if (RegEnumKeyExA(hDriversKey, typeIdx, typeName, &typeNameLen,
@@ -70,10 +186,15 @@ bool FindDriverTypeAndDrv(const char* driverName, char* outDriverType, size_t ty
         if (RegOpenKeyExA(hDriversKey, typeName, 0, KEY_READ, &hTypeKey) != ERROR_SUCCESS)
             continue;
 
+        DriverTypeEntry entry;
+        entry.type = typeName;
+        entry.driverID = ReadDriverID(hLoadableRoot, typeName);
+        entry.drvFile = entry.driverID ? GetDrvFileForDriverID(entry.driverID) : nullptr;
+
         // Enumerate instances
         char instName[128];
         DWORD instNameLen;
-        for (DWORD instIdx = 0; !found; instIdx++)
+        for (DWORD instIdx = 0; ; instIdx++)
         {
             instNameLen = sizeof(instName);
             if (RegEnumKeyExA(hTypeKey, instIdx, instName, &instNameLen,
@@ -84,126 +205,76 @@ bool FindDriverTypeAndDrv(const char* driverName, char* outDriverType, size_t ty
                 continue;
 
             char nameVal[256] = {};
-            DWORD nameValLen = sizeof(nameVal);
+            DWORD nameValLen = sizeof(nameVal) - 1;
             DWORD nameType;
             if (RegQueryValueExA(hInstKey, "Name", NULL, &nameType,
-                (BYTE*)nameVal, &nameValLen) == ERROR_SUCCESS
-                && nameType == REG_SZ && _stricmp(nameVal, driverName) == 0)
+                (BYTE*)nameVal, &nameValLen) == ERROR_SUCCESS && nameType == REG_SZ)
             {
-                strcpy_s(outDriverType, typeLen, typeName);
-
-                // Look up DriverID from Loadable Drivers key
-                char loadablePath[256];
-                sprintf_s(loadablePath, "SOFTWARE\\WOW6432Node\\Rockwell Software\\RSLinx\\Loadable Drivers\\%s", typeName);
-                HKEY hLoadable;
-                if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, loadablePath, 0, KEY_READ, &hLoadable) == ERROR_SUCCESS)
-                {
-                    DWORD driverID = 0;
-                    DWORD idSize = sizeof(driverID);
-                    if (RegQueryValueExA(hLoadable, "DriverID", NULL, NULL,
-                        (BYTE*)&driverID, &idSize) == ERROR_SUCCESS)
-                    {
-                        const char* drv = GetDrvFileForDriverID(driverID);
-                        if (drv)
-                            strcpy_s(outDrvFile, drvLen, drv);
-                    }
-                    RegCloseKey(hLoadable);
-                }
-                found = true;
+                // First type wins, as the enumeration order did before
+                s_driverTypes.emplace(LowerName(nameVal), entry);
             }
             RegCloseKey(hInstKey);
         }
         RegCloseKey(hTypeKey);
     }
+    if (hLoadableRoot) RegCloseKey(hLoadableRoot);
     RegCloseKey(hDriversKey);
-    return found;
+    Log(L"[ENGINE] Driver type cache: %d driver name(s)", (int)s_driverTypes.size());
 }
 
-void TryEngineHotLoad(const wchar_t* driverNameW)
+// Find the driver type key name and DRV filename for a given driver Name
+bool FindDriverTypeAndDrv(const char* driverName, char* outDriverType, size_t typeLen,
+                           char* outDrvFile, size_t drvLen, DWORD* outDriverID)
 {
-    HMODULE hEngine = GetModuleHandleA("ENGINE.DLL");
-    if (!hEngine) hEngine = GetModuleHandleA("engine.dll");
-    if (!hEngine) hEngine = GetModuleHandleA("Engine.dll");
-    if (!hEngine)
-    {
-        Log(L"[ENGINE] ENGINE.DLL not found in process");
-        return;
-    }
-    Log(L"[ENGINE] ENGINE.DLL found at 0x%p", hEngine);
-
-    // Resolve ENGINE.DLL exports (mangled C++ names)
-    typedef void* (__cdecl *pfnFindCDriverByName)(const char*);
-    pfnFindCDriverByName pFindDriverByName = (pfnFindCDriverByName)GetProcAddress(hEngine,
-        "?Engine_FindCDriver@@YAPAVCDriver@@PBD@Z");
-
-    typedef void* (__cdecl *pfnFindCDriverByID)(int);
-    pfnFindCDriverByID pFindDriverByID = (pfnFindCDriverByID)GetProcAddress(hEngine,
-        "?Engine_FindCDriver@@YAPAVCDriver@@H@Z");
-
-    typedef void (__cdecl *pfnRefreshPorts)();
-    pfnRefreshPorts pRefreshPorts = (pfnRefreshPorts)GetProcAddress(hEngine,
-        "?Engine_RefreshWorkstationPorts@@YAXXZ");
-
-    typedef void (__cdecl *pfnRefreshDevices)();
-    pfnRefreshDevices pRefreshDevices = (pfnRefreshDevices)GetProcAddress(hEngine,
-        "?Engine_RefreshDeviceList@@YAXXZ");
-
-    typedef int (__cdecl *pfnGetDriverCount)();
-    pfnGetDriverCount pGetDriverCount = (pfnGetDriverCount)GetProcAddress(hEngine,
-        "?Engine_GetDriverCount@@YAHXZ");
-
-    typedef long (__cdecl *pfnAddDevice)(void*);
-    pfnAddDevice pAddDevice = (pfnAddDevice)GetProcAddress(hEngine,
-        "?Engine_AddDevice@@YAJPAVCDevice@@@Z");
+    outDriverType[0] = '\0';
+    outDrvFile[0] = '\0';
+    if (outDriverID) *outDriverID = 0;
 
-    Log(L"[ENGINE] FindByName=0x%p RefreshDevices=0x%p RefreshPorts=0x%p AddDevice=0x%p DriverCount=0x%p",
-        pFindDriverByName, pRefreshDevices, pRefreshPorts, pAddDevice, pGetDriverCount);
+    if (!s_driverTypesBuilt || RegistryWatchFired(s_watchDrivers) || RegistryWatchFired(s_watchLoadable))
+        RebuildDriverTypes();
 
-    // Convert driver name to narrow
-    char narrowName[256] = {};
-    WideCharToMultiByte(CP_ACP, 0, driverNameW, -1, narrowName, sizeof(narrowName), NULL, NULL);
+    std::string key = LowerName(driverName);
+    auto it = s_driverTypes.find(key);
+    if (it == s_driverTypes.end())
+    {
+        // Written a moment ago: the notification may not have landed yet
+        RebuildDriverTypes();
+        it = s_driverTypes.find(key);
+        if (it == s_driverTypes.end()) return false;
+    }
 
-    // Find driver type and DRV filename from registry
-    char driverType[128] = {};
-    char drvFile[128] = {};
-    FindDriverTypeAndDrv(narrowName, driverType, sizeof(driverType), drvFile, sizeof(drvFile));
-    Log(L"[ENGINE] Driver \"%S\" -> type=\"%S\" drv=\"%S\"", narrowName, driverType, drvFile);
+    const DriverTypeEntry& e = it->second;
+    strcpy_s(outDriverType, typeLen, e.type.c_str());
+    if (e.drvFile) strcpy_s(outDrvFile, drvLen, e.drvFile);
+    if (outDriverID) *outDriverID = e.driverID;
+    return true;
+}
 
-    // === PHASE 1: Find existing CDriver for this driver type ===
+// Engine_FindCDriver by type name, else by DriverID
+static void* FindCDriver(const char* driverType, DWORD driverID)
+{
     void* pCDriver = nullptr;
 
-    if (pFindDriverByName && driverType[0])
+    if (g_engine.findDriverByName && driverType[0])
     {
-        __try { pCDriver = pFindDriverByName(driverType); }
+        __try { pCDriver = g_engine.findDriverByName(driverType); }
         __except(EXCEPTION_EXECUTE_HANDLER) { pCDriver = nullptr; }
         Log(L"[ENGINE] FindCDriver(\"%S\") = 0x%p", driverType, pCDriver);
     }
 
-    if (!pCDriver && pFindDriverByID)
+    if (!pCDriver && g_engine.findDriverByID && driverID)
     {
-        char loadablePath[256];
-        sprintf_s(loadablePath, "SOFTWARE\\WOW6432Node\\Rockwell Software\\RSLinx\\Loadable Drivers\\%s", driverType);
-        HKEY hLoadable;
-        DWORD driverID = 0;
-        if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, loadablePath, 0, KEY_READ, &hLoadable) == ERROR_SUCCESS)
-        {
-            DWORD idSize = sizeof(driverID);
-            RegQueryValueExA(hLoadable, "DriverID", NULL, NULL, (BYTE*)&driverID, &idSize);
-            RegCloseKey(hLoadable);
-        }
-        if (driverID)
-        {
-            __try { pCDriver = pFindDriverByID((int)driverID); }
-            __except(EXCEPTION_EXECUTE_HANDLER) { pCDriver = nullptr; }
-            Log(L"[ENGINE] FindCDriver(DriverID=0x%X) = 0x%p", driverID, pCDriver);
-        }
+        __try { pCDriver = g_engine.findDriverByID((int)driverID); }
+        __except(EXCEPTION_EXECUTE_HANDLER) { pCDriver = nullptr; }
+        Log(L"[ENGINE] FindCDriver(DriverID=0x%X) = 0x%p", driverID, pCDriver);
     }
+    return pCDriver;
+}
 
-    if (!pCDriver)
-    {
-        Log(L"[ENGINE] No existing CDriver found");
-        return;
-    }
+// Stop + Start one CDriver and register its devices with the ENGINE topology
+static void CycleCDriver(void* pCDriver)
+{
+    long (__cdecl *pAddDevice)(void*) = g_engine.addDevice;
 
     // === PHASE 2: Check device count and determine if Stop/Start needed ===
     typedef void  (__thiscall *pfnDriverMethod)(void* thisPtr);
@@ -255,7 +326,7 @@ void TryEngineHotLoad(const wchar_t* driverNameW)
         Log(L"[ENGINE] CDriver GetDeviceCount() after Start = %d (was %d)", countAfterStart, deviceCountBefore);
     }
 
-    // === PHASE 4: Register all devices with ENGINE topology and refresh ===
+    // === PHASE 4: Register all devices with ENGINE topology (refreshed once per hot-load) ===
     {
         pfnGetDeviceCount fnGetCount = (pfnGetDeviceCount)vtable[7];
         pfnGetDevice fnGetDevice = (pfnGetDevice)vtable[8];
@@ -280,31 +351,72 @@ void TryEngineHotLoad(const wchar_t* driverNameW)
             }
         }
     }
+}
 
-    if (pRefreshDevices)
+// Engine_RefreshDeviceList and Engine_RefreshWorkstationPorts, once per hot-load
+static void RefreshEngineLists()
+{
+    if (g_engine.refreshDevices)
     {
         Log(L"[ENGINE] Calling Engine_RefreshDeviceList...");
-        __try { pRefreshDevices(); }
+        __try { g_engine.refreshDevices(); }
         __except(EXCEPTION_EXECUTE_HANDLER) { Log(L"[ENGINE] RefreshDeviceList CRASHED"); }
         Log(L"[ENGINE] RefreshDeviceList done");
     }
 
-    if (pRefreshPorts)
+    if (g_engine.refreshPorts)
     {
         Log(L"[ENGINE] Calling Engine_RefreshWorkstationPorts...");
-        __try { pRefreshPorts(); }
+        __try { g_engine.refreshPorts(); }
         __except(EXCEPTION_EXECUTE_HANDLER) { Log(L"[ENGINE] RefreshWorkstationPorts CRASHED"); }
         Log(L"[ENGINE] RefreshWorkstationPorts done");
     }
+}
+
+void TryEngineHotLoad(const std::vector<std::wstring>& driverNames)
+{
+    if (!BindEngine()) return;
+
+    // === PHASE 1: Find the existing CDriver of each driver's type ===
+    std::vector<void*> cdrivers;
+    for (const auto& name : driverNames)
+    {
+        char narrowName[256] = {};
+        WideCharToMultiByte(CP_ACP, 0, name.c_str(), -1, narrowName, sizeof(narrowName), NULL, NULL);
+
+        char driverType[128] = {};
+        char drvFile[128] = {};
+        DWORD driverID = 0;
+        FindDriverTypeAndDrv(narrowName, driverType, sizeof(driverType), drvFile, sizeof(drvFile), &driverID);
+        Log(L"[ENGINE] Driver \"%S\" -> type=\"%S\" drv=\"%S\"", narrowName, driverType, drvFile);
+
+        void* pCDriver = FindCDriver(driverType, driverID);
+        if (!pCDriver)
+            Log(L"[ENGINE] No existing CDriver found for \"%S\"", narrowName);
+        else if (std::find(cdrivers.begin(), cdrivers.end(), pCDriver) == cdrivers.end())
+            cdrivers.push_back(pCDriver);
+    }
+    if (cdrivers.empty()) return;
+
+    // === PHASES 2-4, once per CDriver ===
+    for (void* pCDriver : cdrivers)
+        CycleCDriver(pCDriver);
+
+    RefreshEngineLists();
 
-    Log(L"[ENGINE] Hot-load complete, waiting for topology propagation...");
+    Log(L"[ENGINE] Hot-load of %d driver(s) (%d CDriver(s)) complete, waiting for topology propagation...",
+        (int)driverNames.size(), (int)cdrivers.size());
     Sleep(5000);
 }
 
 // Wrapper to call TryEngineHotLoad on the main STA thread
 HRESULT DoEngineHotLoadOnMainSTA()
 {
-    Log(L"[ENGINE-STA] Running TryEngineHotLoad on main STA thread (TID=%d)", GetCurrentThreadId());
-    TryEngineHotLoad(g_engineDriverName.c_str());
+    PerfScope perf(PERF_ENGINE_HOTLOAD);
+    Log(L"[ENGINE-STA] Running TryEngineHotLoad for %d driver(s) on main STA thread (TID=%d)",
+        (int)g_engineDriverNames.size(), GetCurrentThreadId());
+    TryEngineHotLoad(g_engineDriverNames);
+    // Driver DLLs may have moved; their classes' vtables with them
+    ResetDispatchCaches();
     return S_OK;
 }
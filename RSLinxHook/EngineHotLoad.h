@@ -6,10 +6,36 @@
 // Globals defined in EngineHotLoad.cpp
 // ============================================================
 
-extern std::wstring g_engineDriverName;
+// ENGINE.DLL exports a hot-load calls, resolved once by BindEngine
+struct EngineBinding {
+    HMODULE hEngine = nullptr;
+    void* (__cdecl *findDriverByName)(const char*) = nullptr;
+    void* (__cdecl *findDriverByID)(int) = nullptr;
+    void (__cdecl *refreshPorts)() = nullptr;
+    void (__cdecl *refreshDevices)() = nullptr;
+    int (__cdecl *getDriverCount)() = nullptr;
+    long (__cdecl *addDevice)(void*) = nullptr;
+    // A CDriver can be found by name or ID: hot-load is possible
+    bool usable() const { return findDriverByName || findDriverByID; }
+};
+
+extern EngineBinding g_engine;
+
+// Drivers the next DoEngineHotLoadOnMainSTA hot-loads, in one main-STA item
+extern std::vector<std::wstring> g_engineDriverNames;
+
+// Worker, at hook load. Resolves and logs the exports; a later hot-load
+// binds again only if ENGINE.DLL was not loaded yet.
+bool BindEngine();
 
 const char* GetDrvFileForDriverID(DWORD driverID);
+// Driver Name -> type key, DriverID and DRV file, from a cache of the
+// Drivers and Loadable Drivers keys. RegNotifyChangeKeyValue marks the
+// cache dirty on any change under either key; a name the cache does not
+// know rebuilds it once. Main STA only.
 bool FindDriverTypeAndDrv(const char* driverName, char* outDriverType, size_t typeLen,
-                           char* outDrvFile, size_t drvLen);
-void TryEngineHotLoad(const wchar_t* driverNameW);
+                           char* outDrvFile, size_t drvLen, DWORD* outDriverID = nullptr);
+// Drivers of one type share a CDriver: it is cycled once, and the engine's
+// device and port lists are refreshed once for the whole set
+void TryEngineHotLoad(const std::vector<std::wstring>& driverNames);
 HRESULT DoEngineHotLoadOnMainSTA();
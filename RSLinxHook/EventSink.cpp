@@ -1,14 +1,116 @@
 #include "EventSink.h"
 #include "Logging.h"
 #include "SEHHelpers.h"
+#include <unordered_set>
 
 // ============================================================
 // EventSink globals
 // ============================================================
 
-std::vector<std::wstring> g_discoveredDevices;
+DiscoveryEvents g_discoveredDevices;
 std::vector<IUnknown*> g_capturedBuses;
 volatile bool g_captureBuses = false;
+HANDLE g_hTopologyChanged = NULL;
+volatile LONG g_topologyChanges = 0;
+CRITICAL_SECTION g_dirtyCS;
+HANDLE g_hEnumeratorDone = NULL;
+
+static std::set<std::wstring> s_dirtyDevices;
+static bool s_dirtyEthernet = false;
+
+// ============================================================
+// Address pool and event record
+// ============================================================
+
+static SRWLOCK s_addressLock = SRWLOCK_INIT;
+static std::unordered_set<std::wstring> s_addresses;   // node-based: element addresses are stable
+static volatile LONG s_liveSinks = 0;
+
+const std::wstring* InternAddress(const wchar_t* addr)
+{
+    AcquireSRWLockExclusive(&s_addressLock);
+    const std::wstring* p = &*s_addresses.insert(addr).first;
+    ReleaseSRWLockExclusive(&s_addressLock);
+    return p;
+}
+
+void DiscoveryEvents::Record(const std::wstring* addr)
+{
+    AcquireSRWLockExclusive(&m_lock);
+    m_ring[m_count % DISCOVERY_RING_SIZE] = addr;
+    m_count++;
+    m_distinct.insert(addr);
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+void DiscoveryEvents::Clear()
+{
+    AcquireSRWLockExclusive(&m_lock);
+    m_count = 0;
+    m_distinct.clear();
+    for (auto& p : m_ring) p = nullptr;
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+int DiscoveryEvents::Count() const
+{
+    AcquireSRWLockShared(&m_lock);
+    int n = m_count;
+    ReleaseSRWLockShared(&m_lock);
+    return n;
+}
+
+int DiscoveryEvents::Distinct() const
+{
+    AcquireSRWLockShared(&m_lock);
+    int n = (int)m_distinct.size();
+    ReleaseSRWLockShared(&m_lock);
+    return n;
+}
+
+std::vector<std::wstring> DiscoveryEvents::Recent() const
+{
+    std::vector<std::wstring> out;
+    AcquireSRWLockShared(&m_lock);
+    int kept = (m_count < DISCOVERY_RING_SIZE) ? m_count : DISCOVERY_RING_SIZE;
+    for (int i = m_count - kept; i < m_count; i++)
+        out.push_back(*m_ring[i % DISCOVERY_RING_SIZE]);
+    ReleaseSRWLockShared(&m_lock);
+    return out;
+}
+
+void GetHookMemoryStats(HookMemoryStats& stats)
+{
+    MEMORYSTATUSEX ms = { sizeof(ms) };
+    if (GlobalMemoryStatusEx(&ms))
+        stats.addressSpaceKB = (unsigned)((ms.ullTotalVirtual - ms.ullAvailVirtual) / 1024);
+    stats.sinks = (int)s_liveSinks;
+    AcquireSRWLockShared(&s_addressLock);
+    stats.addresses = (int)s_addresses.size();
+    ReleaseSRWLockShared(&s_addressLock);
+}
+
+void SignalTopologyChange(const std::wstring& ownerDevice)
+{
+    EnterCriticalSection(&g_dirtyCS);
+    if (ownerDevice.empty()) s_dirtyEthernet = true;
+    else s_dirtyDevices.insert(ownerDevice);
+    LeaveCriticalSection(&g_dirtyCS);
+
+    InterlockedIncrement(&g_topologyChanges);
+    if (g_hTopologyChanged) SetEvent(g_hTopologyChanged);
+}
+
+bool TakeDirtyDevices(std::set<std::wstring>& devices)
+{
+    devices.clear();
+    EnterCriticalSection(&g_dirtyCS);
+    devices.swap(s_dirtyDevices);
+    bool ethernet = s_dirtyEthernet;
+    s_dirtyEthernet = false;
+    LeaveCriticalSection(&g_dirtyCS);
+    return ethernet;
+}
 
 // ============================================================
 // DualEventSink implementation
@@ -17,7 +119,8 @@ volatile bool g_captureBuses = false;
 DualEventSink::DualEventSink(const wchar_t* label)
     : m_refCount(1), m_pFTM(nullptr),
       m_magic(0xDEADBEEF), m_label(label ? label : L""),
-      m_cycleComplete(false), m_browseEnded(false), m_addressCount(0)
+      m_cycleComplete(false),
+      m_browseEnded(false), m_addressCount(0)
 {
     memset(m_pad, 0, sizeof(m_pad));
     // +8 must be non-zero for Start to succeed
@@ -33,6 +136,7 @@ DualEventSink::DualEventSink(const wchar_t* label)
     ((DWORD*)(m_pad + 2044))[0] = 0xCAFEBABE;   // near end of pad — overflow guard
 
     InitializeCriticalSection(&m_cs);
+    InterlockedIncrement(&s_liveSinks);
 
     // Create Free Threaded Marshaler for cross-apartment calls
     HRESULT hr = CoCreateFreeThreadedMarshaler(
@@ -44,9 +148,17 @@ DualEventSink::DualEventSink(const wchar_t* label)
 DualEventSink::~DualEventSink()
 {
     DeleteCriticalSection(&m_cs);
+    InterlockedDecrement(&s_liveSinks);
     if (m_pFTM) m_pFTM->Release();
 }
 
+void DualEventSink::MarkCycleComplete()
+{
+    if (m_cycleComplete) return;
+    m_cycleComplete = true;
+    if (g_hEnumeratorDone) SetEvent(g_hEnumeratorDone);
+}
+
 void DualEventSink::DumpCounters(const wchar_t* label)
 {
     DWORD* pDW = (DWORD*)m_pad;
@@ -158,16 +270,18 @@ STDMETHODIMP DualEventSink::BrowseStarted(IUnknown* pBus)
 
 STDMETHODIMP DualEventSink::BrowseCycled(IUnknown* pBus)
 {
-    m_cycleComplete = true;
+    MarkCycleComplete();
     Log(L"[ENUM:%s] BrowseCycled (explicit)", m_label.c_str());
+    SignalTopologyChange(m_ownerDevice);
     return S_OK;
 }
 
 STDMETHODIMP DualEventSink::BrowseEnded(IUnknown* pBus)
 {
-    m_cycleComplete = true;
     m_browseEnded = true;
+    MarkCycleComplete();
     Log(L"[ENUM:%s] BrowseEnded (%d addresses seen)", m_label.c_str(), m_addressCount);
+    SignalTopologyChange(m_ownerDevice);
     return S_OK;
 }
 
@@ -176,26 +290,32 @@ STDMETHODIMP DualEventSink::Found(IUnknown* pBus, VARIANT addr)
     wchar_t addrBuf[256] = L"<unknown>";
     SafeVariantToString(&addr, addrBuf, 256);
     if (addr.vt == VT_I2 || addr.vt == VT_I4)
-        Log(L"[ENUM:%s] Slot %s found", m_label.c_str(), addrBuf);
+        LogDebug(L"[ENUM:%s] Slot %s found", m_label.c_str(), addrBuf);
     else
-        Log(L"[ENUM:%s] Address %s found", m_label.c_str(), addrBuf);
+        LogDebug(L"[ENUM:%s] Address %s found", m_label.c_str(), addrBuf);
 
+    const std::wstring* addrKey = InternAddress(addrBuf);
+    bool isNew = false;
     EnterCriticalSection(&m_cs);
     m_addressCount++;
-    if (m_seenAddresses.count(addrBuf) > 0)
+    if (m_seenAddresses.count(addrKey) > 0)
     {
         if (!m_cycleComplete)
         {
-            m_cycleComplete = true;
+            MarkCycleComplete();
             Log(L"[ENUM:%s] Cycle complete -- repeat address %s (after %d addresses)",
                 m_label.c_str(), addrBuf, m_addressCount);
         }
     }
     else
-        m_seenAddresses.insert(addrBuf);
+    {
+        m_seenAddresses.insert(addrKey);
+        isNew = true;
+    }
     LeaveCriticalSection(&m_cs);
 
-    g_discoveredDevices.push_back(addrBuf);
+    g_discoveredDevices.Record(addrKey);
+    if (isNew) SignalTopologyChange(m_ownerDevice);
     return S_OK;
 }
 
@@ -203,15 +323,21 @@ STDMETHODIMP DualEventSink::NothingAtAddress(IUnknown* pBus, VARIANT addr)
 {
     wchar_t addrBuf[256] = L"<unknown>";
     SafeVariantToString(&addr, addrBuf, 256);
-    Log(L"[ENUM:%s] Nothing at %s", m_label.c_str(), addrBuf);
+    LogDebug(L"[ENUM:%s] Nothing at %s", m_label.c_str(), addrBuf);
+
+    // A previously found address going quiet is a removal
+    EnterCriticalSection(&m_cs);
+    bool wasSeen = m_seenAddresses.erase(InternAddress(addrBuf)) > 0;
+    LeaveCriticalSection(&m_cs);
+    if (wasSeen) SignalTopologyChange(m_ownerDevice);
     return S_OK;
 }
 
 // --- ITopologyBusEvents methods ---
 
-STDMETHODIMP DualEventSink::OnPortConnect(IUnknown*, IUnknown*, VARIANT) { return S_OK; }
-STDMETHODIMP DualEventSink::OnPortDisconnect(IUnknown*, IUnknown*, VARIANT) { return S_OK; }
-STDMETHODIMP DualEventSink::OnPortChangeAddress(IUnknown*, IUnknown*, VARIANT, VARIANT) { return S_OK; }
+STDMETHODIMP DualEventSink::OnPortConnect(IUnknown*, IUnknown*, VARIANT) { SignalTopologyChange(m_ownerDevice); return S_OK; }
+STDMETHODIMP DualEventSink::OnPortDisconnect(IUnknown*, IUnknown*, VARIANT) { SignalTopologyChange(m_ownerDevice); return S_OK; }
+STDMETHODIMP DualEventSink::OnPortChangeAddress(IUnknown*, IUnknown*, VARIANT, VARIANT) { SignalTopologyChange(m_ownerDevice); return S_OK; }
 STDMETHODIMP DualEventSink::OnPortChangeState(IUnknown*, long) { return S_OK; }
 
 STDMETHODIMP DualEventSink::OnBrowseStarted(IUnknown* pBus)
@@ -222,16 +348,18 @@ STDMETHODIMP DualEventSink::OnBrowseStarted(IUnknown* pBus)
 
 STDMETHODIMP DualEventSink::OnBrowseCycled(IUnknown*)
 {
-    m_cycleComplete = true;
+    MarkCycleComplete();
     Log(L"[BUS:%s] OnBrowseCycled (explicit)", m_label.c_str());
+    SignalTopologyChange(m_ownerDevice);
     return S_OK;
 }
 
 STDMETHODIMP DualEventSink::OnBrowseEnded(IUnknown*)
 {
-    m_cycleComplete = true;
     m_browseEnded = true;
+    MarkCycleComplete();
     Log(L"[BUS:%s] BrowseEnded (%d addresses seen)", m_label.c_str(), m_addressCount);
+    SignalTopologyChange(m_ownerDevice);
     return S_OK;
 }
 
@@ -240,26 +368,32 @@ STDMETHODIMP DualEventSink::OnBrowseAddressFound(IUnknown*, VARIANT addr)
     wchar_t addrBuf[256] = L"<unknown>";
     SafeVariantToString(&addr, addrBuf, 256);
     if (addr.vt == VT_I2 || addr.vt == VT_I4)
-        Log(L"[BUS:%s] Slot %s found", m_label.c_str(), addrBuf);
+        LogDebug(L"[BUS:%s] Slot %s found", m_label.c_str(), addrBuf);
     else
-        Log(L"[BUS:%s] Address %s found", m_label.c_str(), addrBuf);
+        LogDebug(L"[BUS:%s] Address %s found", m_label.c_str(), addrBuf);
 
+    const std::wstring* addrKey = InternAddress(addrBuf);
+    bool isNew = false;
     EnterCriticalSection(&m_cs);
     m_addressCount++;
-    if (m_seenAddresses.count(addrBuf) > 0)
+    if (m_seenAddresses.count(addrKey) > 0)
     {
         if (!m_cycleComplete)
         {
-            m_cycleComplete = true;
+            MarkCycleComplete();
             Log(L"[BUS:%s] Cycle complete -- repeat address %s (after %d addresses)",
                 m_label.c_str(), addrBuf, m_addressCount);
         }
     }
     else
-        m_seenAddresses.insert(addrBuf);
+    {
+        m_seenAddresses.insert(addrKey);
+        isNew = true;
+    }
     LeaveCriticalSection(&m_cs);
 
-    g_discoveredDevices.push_back(addrBuf);
+    g_discoveredDevices.Record(addrKey);
+    if (isNew) SignalTopologyChange(m_ownerDevice);
     return S_OK;
 }
 
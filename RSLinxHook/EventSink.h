@@ -7,10 +7,72 @@
 // Globals defined in EventSink.cpp
 // ============================================================
 
-extern std::vector<std::wstring> g_discoveredDevices;
+// ============================================================
+// Browse event record
+// Every Found / OnBrowseAddressFound is counted, but only the last
+// DISCOVERY_RING_SIZE addresses are kept, so a monitor session that runs
+// for weeks holds a fixed amount however many browse cycles it sees.
+// Addresses are interned: the ring and every sink's seen set share one
+// copy of each distinct string (the pool is bounded by the addresses that
+// exist on the network, not by the number of events).
+// ============================================================
+
+#define DISCOVERY_RING_SIZE 256
+
+// Shared copy of addr, valid for the DLL's lifetime. Thread-safe.
+const std::wstring* InternAddress(const wchar_t* addr);
+
+class DiscoveryEvents
+{
+public:
+    void Record(const std::wstring* addr);
+    void Clear();                        // start of a browse
+    int Count() const;                   // events since Clear
+    int Distinct() const;                // distinct addresses since Clear
+    std::vector<std::wstring> Recent() const;   // ring contents, oldest first
+
+private:
+    mutable SRWLOCK m_lock = SRWLOCK_INIT;
+    int m_count = 0;
+    std::set<const std::wstring*> m_distinct;
+    const std::wstring* m_ring[DISCOVERY_RING_SIZE] = {};
+};
+
+extern DiscoveryEvents g_discoveredDevices;
+
+// Memory figures for S|: the process's used address space (the 2 GB a
+// 32-bit rslinx.exe has), live event sinks and interned addresses
+struct HookMemoryStats {
+    unsigned addressSpaceKB = 0;
+    int sinks = 0;
+    int addresses = 0;
+};
+void GetHookMemoryStats(HookMemoryStats& stats);
+
 extern std::vector<IUnknown*> g_capturedBuses;
 extern volatile bool g_captureBuses;
 
+// Monitor wake-up. Sinks bump g_topologyChanges and set g_hTopologyChanged
+// (auto-reset, created by RunMonitorLoop) whenever the topology may have
+// changed: new address, address gone, cycle/end of browse, port events.
+// ownerDevice names the chassis whose backplane changed; empty (a driver's
+// Ethernet sink) marks the Ethernet layer dirty. g_dirtyCS guards the dirty
+// state and is initialized by the worker thread.
+extern HANDLE g_hTopologyChanged;
+extern volatile LONG g_topologyChanges;
+extern CRITICAL_SECTION g_dirtyCS;
+void SignalTopologyChange(const std::wstring& ownerDevice);
+
+// Enumerator completion. Each sink sets g_hEnumeratorDone (auto-reset,
+// created by the worker thread) the first time its cycle completes, so
+// one waiter can watch any number of sinks; it then rescans
+// m_cycleComplete (see WaitEnumeratorsSince).
+extern HANDLE g_hEnumeratorDone;
+
+// Swap out the dirty chassis set and clear it. Returns true if the Ethernet
+// layer (device list / IPs) was dirty as well.
+bool TakeDirtyDevices(std::set<std::wstring>& devices);
+
 // ============================================================
 // Dual-interface event sink with FTM + padding.
 //
@@ -43,10 +105,11 @@ public:
     IUnknown* m_pFTM;           // +2060: Free Threaded Marshaler
     DWORD m_magic;              // +2064:
     std::wstring m_label;       // identity for log messages (e.g., "Test/Ethernet", "5069-L320ER/Backplane")
+    std::wstring m_ownerDevice; // chassis device whose backplane this sink browses (empty = driver bus)
 
     // Cycle detection: track seen addresses to detect when browse repeats
     CRITICAL_SECTION m_cs;
-    std::set<std::wstring> m_seenAddresses;
+    std::set<const std::wstring*> m_seenAddresses;   // interned (InternAddress)
     volatile bool m_cycleComplete;  // true when repeat address, BrowseCycled, or BrowseEnded
     volatile bool m_browseEnded;    // true when BrowseEnded fires
     int m_addressCount;             // total Found() calls
@@ -58,6 +121,9 @@ public:
     void DumpDWords(const wchar_t* label, int count = 134);  // 134 DWORDs = 536 bytes, covers observed write max (~+528 from object start)
     void CheckCanaries(const wchar_t* label);  // verifies sentinel values placed after observed write zone
 
+    // Set m_cycleComplete and signal the completion events (first call only)
+    void MarkCycleComplete();
+
     // --- IUnknown ---
     STDMETHODIMP QueryInterface(REFIID riid, void** ppv) override;
     STDMETHODIMP_(ULONG) AddRef() override;
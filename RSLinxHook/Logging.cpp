@@ -1,4 +1,6 @@
 #include "Logging.h"
+#include "Perf.h"
+#include "EventSink.h"
 
 // ============================================================
 // Logging globals
@@ -6,79 +8,702 @@
 
 FILE* g_logFile = nullptr;
 CRITICAL_SECTION g_logCS;
-HANDLE g_hPipe = INVALID_HANDLE_VALUE;
 HANDLE g_hStopEvent = NULL;
 bool g_pipeConnected = false;
 
 // ============================================================
-// Logging functions
+// Pipe transport
+// Each session has one OVERLAPPED event for reads and one for writes,
+// reused for every call. Outgoing bytes collect in the session's
+// writeBuf; PipeSessionSend flushes at once unless a frame is open, in
+// which case the buffer goes out when it fills, when
+// PIPE_FLUSH_DEADLINE_MS has passed since its first unsent byte, or at
+// PipeEndFrame. A flush appends to the session's sendQueue, which its
+// writer thread writes to the pipe outside g_logCS. A write that does
+// not complete within PIPE_WRITE_TIMEOUT_MS, or a queue past
+// PIPE_SEND_QUEUE_MAX, drops that client; the others never wait on it.
+// Incoming bytes are read PIPE_READ_CHUNK at a time into the session's
+// readBuf and split into lines from there.
 // ============================================================
 
-void PipeSend(const char* data, int len)
+static std::vector<PipeSession*> s_sessions;   // connected sessions
+static int s_frameDepth = 0;                   // owned by the g_logCS holder
+static PipeSession* s_replyTarget = nullptr;   // owned by the g_logCS holder
+static int s_replyDepth = 0;
+
+// LOG, STATUS, XML and DONE frames carry no interned strings, so one
+// encoding serves every binary client. Used with g_logCS held.
+static BinaryEncoder s_frameEncoder;
+static std::string s_textScratch, s_binScratch;
+
+// Bit k: a ready session takes L| lines up to level k. Written under
+// g_logCS; Log() reads it without the lock to skip unwanted lines.
+static volatile unsigned s_sessionLevels = 0;
+
+static void UpdatePipeConnected()
 {
-    if (!g_pipeConnected) return;
-    OVERLAPPED ov = {};
-    ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-    if (!ov.hEvent) { g_pipeConnected = false; return; }
-    DWORD written;
-    BOOL ok = WriteFile(g_hPipe, data, len, &written, &ov);
-    if (!ok)
+    unsigned levels = 0;
+    for (PipeSession* s : s_sessions)
+        if (s->ready && s->connected) levels |= 1u << s->logLevel;
+    s_sessionLevels = levels;
+    g_pipeConnected = levels != 0;
+}
+
+// Mark the session gone and fail its pending read. Call with g_logCS held.
+static void MarkDisconnected(PipeSession* s)
+{
+    if (!s->connected) return;
+    s->connected = false;
+    CancelIoEx(s->hPipe, NULL);
+    UpdatePipeConnected();
+}
+
+static void DropFromWriter(PipeSession* s)
+{
+    EnterCriticalSection(&g_logCS);
+    MarkDisconnected(s);
+    LeaveCriticalSection(&g_logCS);
+}
+
+// Blocking overlapped write of the whole buffer. Writer thread only.
+static void PipeWriteRaw(PipeSession* s, const char* data, int len)
+{
+    PerfScope perf(PERF_PIPE_WRITE);
+    PerfAdd(PERF_CTR_PIPE_BYTES, len);
+    while (len > 0 && s->connected)
+    {
+        OVERLAPPED ov = {};
+        ov.hEvent = s->hWriteEvent;
+        DWORD written = 0;
+        BOOL ok = WriteFile(s->hPipe, data, len, &written, &ov);
+        if (!ok)
+        {
+            if (GetLastError() != ERROR_IO_PENDING) { DropFromWriter(s); return; }
+            if (WaitForSingleObject(s->hWriteEvent, PIPE_WRITE_TIMEOUT_MS) != WAIT_OBJECT_0)
+            {
+                // Client stopped reading: drop it
+                CancelIoEx(s->hPipe, &ov);
+                GetOverlappedResult(s->hPipe, &ov, &written, TRUE);
+                DropFromWriter(s);
+                return;
+            }
+            if (!GetOverlappedResult(s->hPipe, &ov, &written, FALSE)) { DropFromWriter(s); return; }
+        }
+        if (written == 0) { DropFromWriter(s); return; }
+        data += written;
+        len -= (int)written;
+    }
+}
+
+// Writes the session's queue until writerStop is set and the queue is empty
+static DWORD WINAPI SessionWriterThread(LPVOID param)
+{
+    PipeSession* s = (PipeSession*)param;
+    std::string batch;
+    while (true)
+    {
+        EnterCriticalSection(&s->sendCS);
+        batch.swap(s->sendQueue);
+        s->sendInFlight = batch.size();
+        bool stop = s->writerStop;
+        LeaveCriticalSection(&s->sendCS);
+
+        if (!batch.empty())
+        {
+            PipeWriteRaw(s, batch.data(), (int)batch.size());
+            batch.clear();
+            EnterCriticalSection(&s->sendCS);
+            s->sendInFlight = 0;
+            LeaveCriticalSection(&s->sendCS);
+            continue;
+        }
+        if (stop) break;
+        WaitForSingleObject(s->hSendEvent, INFINITE);
+    }
+    return 0;
+}
+
+// Hand bytes to the writer thread. Call with g_logCS held.
+static void QueueWrite(PipeSession* s, const char* data, int len)
+{
+    if (!s->connected) return;
+    EnterCriticalSection(&s->sendCS);
+    bool full = s->sendQueue.size() + len > PIPE_SEND_QUEUE_MAX;
+    if (!full) s->sendQueue.append(data, len);
+    LeaveCriticalSection(&s->sendCS);
+    if (full) MarkDisconnected(s);   // too far behind to catch up
+    else SetEvent(s->hSendEvent);
+}
+
+static void FlushWriteBuffer(PipeSession* s)
+{
+    if (s->writeLen > 0) QueueWrite(s, s->writeBuf, s->writeLen);
+    s->writeLen = 0;
+}
+
+void PipeSessionSend(PipeSession* s, const char* data, int len)
+{
+    if (!s || !s->connected || len <= 0) return;
+    // The log writer thread sends too; g_logCS keeps messages whole
+    EnterCriticalSection(&g_logCS);
+    if (s->writeLen + len > PIPE_WRITE_BUFFER)
+    {
+        FlushWriteBuffer(s);
+        if (len > PIPE_WRITE_BUFFER)
+        {
+            QueueWrite(s, data, len);   // larger than a frame: send as is
+            len = 0;
+        }
+    }
+    if (len > 0)
+    {
+        if (s->writeLen == 0) s->writeFirstTick = GetTickCount();
+        memcpy(s->writeBuf + s->writeLen, data, len);
+        s->writeLen += len;
+    }
+    if (s_frameDepth == 0 || GetTickCount() - s->writeFirstTick >= PIPE_FLUSH_DEADLINE_MS)
+        FlushWriteBuffer(s);
+    LeaveCriticalSection(&g_logCS);
+}
+
+void PipeBeginFrame()
+{
+    EnterCriticalSection(&g_logCS);
+    s_frameDepth++;
+}
+
+void PipeEndFrame()
+{
+    if (--s_frameDepth == 0)
+        for (PipeSession* s : s_sessions) FlushWriteBuffer(s);
+    LeaveCriticalSection(&g_logCS);
+}
+
+int PipeTargets(PipeSession** out, int max)
+{
+    int n = 0;
+    if (s_replyTarget)
+    {
+        if (s_replyTarget->connected && max > 0) out[n++] = s_replyTarget;
+        return n;
+    }
+    for (PipeSession* s : s_sessions)
+        if (s->ready && s->connected && n < max) out[n++] = s;
+    return n;
+}
+
+void PipeBeginReply(PipeSession* session)
+{
+    PipeBeginFrame();
+    s_replyTarget = session;
+    s_replyDepth++;
+}
+
+void PipeEndReply()
+{
+    if (--s_replyDepth == 0) s_replyTarget = nullptr;
+    PipeEndFrame();
+}
+
+// One message, prepared in both encodings, to every target of the frame
+static void SendToTargets(const std::string& text, const std::string& bin)
+{
+    PipeSession* targets[PIPE_MAX_CLIENTS];
+    int n = PipeTargets(targets, PIPE_MAX_CLIENTS);
+    for (int i = 0; i < n; i++)
+    {
+        const std::string& msg = targets[i]->binary ? bin : text;
+        PipeSessionSend(targets[i], msg.data(), (int)msg.size());
+    }
+}
+
+void PipeEnableBinary(PipeSession* session)
+{
+    EnterCriticalSection(&g_logCS);
+    if (!session->binary)
+    {
+        char line[32];
+        int n = snprintf(line, sizeof(line), "V|BINARY|%d\n", PIPE_BINARY_VERSION);
+        PipeSessionSend(session, line, n);
+        session->encoder.Reset();
+        session->binary = true;
+    }
+    LeaveCriticalSection(&g_logCS);
+}
+
+// A batch of log lines in each encoding, one buffer per client log
+// level: buffer k holds the records at level k and below
+struct LogBatch {
+    std::string text[LOG_LEVEL_DEBUG + 1];
+    std::string bin[LOG_LEVEL_DEBUG + 1];
+
+    void Clear()
+    {
+        for (int k = 0; k <= LOG_LEVEL_DEBUG; k++) { text[k].clear(); bin[k].clear(); }
+    }
+};
+
+// L| line and FRAME_LOG for one log record, appended to the buffers of
+// the levels some ready session uses. Call with g_logCS held.
+static void AppendLogMessage(LogBatch& batch, int level, const wchar_t* msg, int len)
+{
+    if (len <= 0) return;
+    char utf8[LOG_RECORD_CHARS * 3];
+    int n = WideCharToMultiByte(CP_UTF8, 0, msg, len, utf8, (int)sizeof(utf8), NULL, NULL);
+    if (n <= 0) return;
+    for (int k = level; k <= LOG_LEVEL_DEBUG; k++)
+    {
+        if (!(s_sessionLevels & (1u << k))) continue;
+        batch.text[k] += "L|";
+        batch.text[k].append(utf8, n);
+        batch.text[k] += '\n';
+        s_frameEncoder.Log(batch.bin[k], utf8, n);
+    }
+}
+
+// Log lines go to every ready session, even inside a reply to one of them
+static void SendLogMessages(const LogBatch& batch)
+{
+    for (PipeSession* s : s_sessions)
+    {
+        if (!s->ready || !s->connected) continue;
+        const std::string& msg = s->binary ? batch.bin[s->logLevel] : batch.text[s->logLevel];
+        if (!msg.empty()) PipeSessionSend(s, msg.data(), (int)msg.size());
+    }
+}
+
+void PipeSendDone()
+{
+    PipeBeginFrame();
+    s_textScratch = "D|\n";
+    s_binScratch.clear();
+    s_frameEncoder.Empty(s_binScratch, FRAME_DONE);
+    SendToTargets(s_textScratch, s_binScratch);
+    PipeEndFrame();
+}
+
+void PipeSendLogLine(const wchar_t* text)
+{
+    char utf8[LOG_RECORD_CHARS * 3];
+    int n = WideCharToMultiByte(CP_UTF8, 0, text, (int)wcslen(text), utf8, (int)sizeof(utf8), NULL, NULL);
+    if (n <= 0) return;
+    PipeBeginFrame();
+    s_textScratch = "L|";
+    s_textScratch.append(utf8, n);
+    s_textScratch += '\n';
+    s_binScratch.clear();
+    s_frameEncoder.Log(s_binScratch, utf8, n);
+    SendToTargets(s_textScratch, s_binScratch);
+    PipeEndFrame();
+}
+
+void PipeSendResult(bool found, const char* classname, const char* deviceName,
+                    const char* ip, int slot, const char* path, int tag, bool stale,
+                    bool pending)
+{
+    PipeBeginFrame();
+    PipeSession* targets[PIPE_MAX_CLIENTS];
+    int count = PipeTargets(targets, PIPE_MAX_CLIENTS);
+    char buf[768];
+    char prefix[16] = "R|";
+    if (tag >= 0) snprintf(prefix, sizeof(prefix), "R|%d|", tag);
+    const char* freshness = pending ? "|PENDING" : (stale && found) ? "|STALE" : "";
+    int n = found
+        ? snprintf(buf, sizeof(buf), "%sFOUND|%s|%s|%s|%d%s\n", prefix, classname, deviceName, ip, slot,
+                   freshness)
+        : snprintf(buf, sizeof(buf), "%sNOTFOUND|%s%s\n", prefix, path, freshness);
+    if (n > (int)sizeof(buf) - 1) { n = (int)sizeof(buf) - 1; buf[n - 1] = '\n'; }
+    for (int i = 0; i < count; i++)
+    {
+        PipeSession* s = targets[i];
+        if (!s->binary)
+        {
+            if (n > 0) PipeSessionSend(s, buf, n);
+            continue;
+        }
+        s_binScratch.clear();
+        if (found) s->encoder.Result(s_binScratch, classname, deviceName, ip, slot, tag, stale, pending);
+        else s->encoder.ResultNotFound(s_binScratch, path, tag, pending);
+        PipeSessionSend(s, s_binScratch.data(), (int)s_binScratch.size());
+    }
+    PipeEndFrame();
+}
+
+void PipeSendDevice(const char* ip, const char* portName, int slot,
+                    const char* classname, const char* deviceName, bool stale)
+{
+    PipeBeginFrame();
+    PipeSession* targets[PIPE_MAX_CLIENTS];
+    int count = PipeTargets(targets, PIPE_MAX_CLIENTS);
+    char buf[768];
+    int n = snprintf(buf, sizeof(buf), "I|%s|%s|%d|%s|%s%s\n", ip, portName, slot,
+                     classname, deviceName, stale ? "|STALE" : "");
+    if (n > (int)sizeof(buf) - 1) { n = (int)sizeof(buf) - 1; buf[n - 1] = '\n'; }
+    for (int i = 0; i < count; i++)
+    {
+        PipeSession* s = targets[i];
+        if (!s->binary)
+        {
+            if (n > 0) PipeSessionSend(s, buf, n);
+            continue;
+        }
+        s_binScratch.clear();
+        s->encoder.Device(s_binScratch, ip, portName, slot, classname, deviceName, stale);
+        PipeSessionSend(s, s_binScratch.data(), (int)s_binScratch.size());
+    }
+    PipeEndFrame();
+}
+
+void PipeSendPerf(const std::vector<std::string>& lines)
+{
+    PipeBeginFrame();
+    s_textScratch.clear();
+    s_binScratch.clear();
+    for (const auto& line : lines)
+    {
+        s_textScratch += "P|";
+        s_textScratch += line;
+        s_textScratch += '\n';
+        s_frameEncoder.Bytes(s_binScratch, FRAME_PERF, line.data(), line.size());
+    }
+    SendToTargets(s_textScratch, s_binScratch);
+    PipeEndFrame();
+}
+
+void PipeXmlBegin(PipeSession* session)
+{
+    if (session->binary)
+    {
+        s_binScratch.clear();
+        s_frameEncoder.Empty(s_binScratch, FRAME_XML_BEGIN);
+        PipeSessionSend(session, s_binScratch.data(), (int)s_binScratch.size());
+    }
+    else
+    {
+        PipeSessionSend(session, "X|BEGIN\n", 8);
+    }
+}
+
+void PipeXmlData(PipeSession* session, const char* data, int len)
+{
+    if (len <= 0) return;
+    if (session->binary)
+    {
+        s_binScratch.clear();
+        s_frameEncoder.Bytes(s_binScratch, FRAME_XML_DATA, data, len);
+        PipeSessionSend(session, s_binScratch.data(), (int)s_binScratch.size());
+    }
+    else
+    {
+        PipeSessionSend(session, data, len);
+    }
+}
+
+void PipeXmlEnd(PipeSession* session, char lastByte)
+{
+    if (session->binary)
+    {
+        s_binScratch.clear();
+        s_frameEncoder.Empty(s_binScratch, FRAME_XML_END);
+        PipeSessionSend(session, s_binScratch.data(), (int)s_binScratch.size());
+        return;
+    }
+    if (lastByte != '\n') PipeSessionSend(session, "\n", 1);
+    PipeSessionSend(session, "X|END\n", 6);
+}
+
+// ============================================================
+// Log ring (bounded MPSC; per-slot sequence numbers)
+// Slot i is free for the producer claiming position p when
+// seq == p, and ready for the writer when seq == p + 1.
+// ============================================================
+
+volatile LONG g_logLevel = LOG_LEVEL_DEFAULT;
+
+struct LogRecord {
+    volatile LONG seq;
+    int level;
+    int len;
+    wchar_t text[LOG_RECORD_CHARS];
+};
+
+static LogRecord* s_logRing = nullptr;
+static volatile LONG s_enqueuePos = 0;
+static LONG s_dequeuePos = 0;              // writer thread only
+static volatile LONG s_writtenPos = 0;     // records fully written (for LogFlush)
+static volatile LONG s_dropped = 0;
+static volatile LONG s_writerIdle = 0;     // writer is (about to be) waiting
+static volatile bool s_writerStop = false;
+static HANDLE s_hLogEvent = NULL;
+static HANDLE s_hLogThread = NULL;
+
+// Synchronous path: before the writer starts and after it stops
+static void WriteLogLineDirect(int level, const wchar_t* text, int len)
+{
+    EnterCriticalSection(&g_logCS);
+    if (g_logFile && level <= g_logLevel) {
+        fputws(text, g_logFile);
+        fputwc(L'\n', g_logFile);
+        fflush(g_logFile);
+    }
+    if (g_pipeConnected) {
+        LogBatch batch;
+        AppendLogMessage(batch, level, text, len);
+        SendLogMessages(batch);
+    }
+    LeaveCriticalSection(&g_logCS);
+}
+
+static bool EnqueueLog(int level, const wchar_t* fmt, va_list args)
+{
+    LONG pos = s_enqueuePos;
+    LogRecord* rec;
+    while (true)
     {
-        if (GetLastError() == ERROR_IO_PENDING)
-            GetOverlappedResult(g_hPipe, &ov, &written, TRUE);
+        rec = &s_logRing[pos & (LOG_RING_SLOTS - 1)];
+        LONG dif = rec->seq - pos;
+        if (dif == 0)
+        {
+            LONG prev = InterlockedCompareExchange(&s_enqueuePos, pos + 1, pos);
+            if (prev == pos) break;
+            pos = prev;
+        }
+        else if (dif < 0)
+        {
+            InterlockedIncrement(&s_dropped);   // ring full
+            return false;
+        }
         else
-            g_pipeConnected = false;
+        {
+            pos = s_enqueuePos;
+        }
+    }
+
+    int len = _vsnwprintf(rec->text, LOG_RECORD_CHARS - 1, fmt, args);
+    if (len < 0) len = LOG_RECORD_CHARS - 1;     // truncated
+    rec->text[len] = L'\0';
+    rec->level = level;
+    rec->len = len;
+    InterlockedExchange(&rec->seq, pos + 1);     // publish
+
+    if (InterlockedCompareExchange(&s_writerIdle, 0, 1) == 1)
+        SetEvent(s_hLogEvent);
+    return true;
+}
+
+static void LogV(int level, const wchar_t* fmt, va_list args)
+{
+    if (s_hLogThread && !s_writerStop)
+    {
+        EnqueueLog(level, fmt, args);
+        return;
     }
-    CloseHandle(ov.hEvent);
+    wchar_t buf[LOG_RECORD_CHARS];
+    int len = _vsnwprintf(buf, LOG_RECORD_CHARS - 1, fmt, args);
+    if (len < 0) len = LOG_RECORD_CHARS - 1;
+    buf[len] = L'\0';
+    WriteLogLineDirect(level, buf, len);
+}
+
+// True if the log file or some ready client takes lines at level
+static bool LevelWanted(int level)
+{
+    return level <= g_logLevel || (s_sessionLevels >> level) != 0;
+}
+
+// Level of a Log() line from the markers in its format (see Logging.h)
+static int TaggedLevel(const wchar_t* fmt)
+{
+    int level = LOG_LEVEL_INFO;
+    for (const wchar_t* p = fmt; *p; p++)
+    {
+        if (*p < L'A' || *p > L'Z') continue;
+        if (p > fmt && ((p[-1] >= L'A' && p[-1] <= L'Z') || (p[-1] >= L'a' && p[-1] <= L'z'))) continue;
+        if (wcsncmp(p, L"FAIL", 4) == 0 || wcsncmp(p, L"ERROR", 5) == 0) return LOG_LEVEL_ERROR;
+        if (wcsncmp(p, L"WARN", 4) == 0) level = LOG_LEVEL_WARN;
+    }
+    return level;
 }
 
 void Log(const wchar_t* fmt, ...)
 {
-    EnterCriticalSection(&g_logCS);
+    int level = TaggedLevel(fmt);
+    if (!LevelWanted(level)) return;
+    va_list args;
+    va_start(args, fmt);
+    LogV(level, fmt, args);
+    va_end(args);
+}
 
-    // Write to log file
+void LogAt(int level, const wchar_t* fmt, ...)
+{
+    if (!LevelWanted(level)) return;
     va_list args;
     va_start(args, fmt);
-    if (g_logFile) {
-        vfwprintf(g_logFile, fmt, args);
-        fwprintf(g_logFile, L"\n");
-        fflush(g_logFile);
-    }
+    LogV(level, fmt, args);
     va_end(args);
+}
 
-    // Stream to TUI pipe as L|<text>\n
-    if (g_pipeConnected) {
-        wchar_t buf[2048];
-        va_start(args, fmt);
-        int len = _vsnwprintf(buf, 2046, fmt, args);
-        va_end(args);
-        if (len > 0) {
-            char utf8[4096];
-            utf8[0] = 'L'; utf8[1] = '|';
-            int n = WideCharToMultiByte(CP_UTF8, 0, buf, len, utf8 + 2, 4090, NULL, NULL);
-            if (n > 0) {
-                utf8[n + 2] = '\n';
-                PipeSend(utf8, n + 3);
-            }
+int ParseLogLevel(const std::wstring& name)
+{
+    if (name.size() == 1 && name[0] >= L'0' && name[0] <= L'0' + LOG_LEVEL_DEBUG)
+        return name[0] - L'0';
+    if (_wcsicmp(name.c_str(), L"error") == 0) return LOG_LEVEL_ERROR;
+    if (_wcsicmp(name.c_str(), L"warn") == 0) return LOG_LEVEL_WARN;
+    if (_wcsicmp(name.c_str(), L"info") == 0) return LOG_LEVEL_INFO;
+    if (_wcsicmp(name.c_str(), L"debug") == 0) return LOG_LEVEL_DEBUG;
+    return -1;
+}
+
+// Write up to LOG_BATCH_MAX ready records: one fflush and one pipe write
+// per client. Returns the number written.
+static int WriteLogBatch(LogBatch& batch)
+{
+    int count = 0;
+    batch.Clear();
+
+    EnterCriticalSection(&g_logCS);
+    LONG dropped = InterlockedExchange(&s_dropped, 0);
+    while (count < LOG_BATCH_MAX)
+    {
+        LogRecord* rec = &s_logRing[s_dequeuePos & (LOG_RING_SLOTS - 1)];
+        if (rec->seq != s_dequeuePos + 1) break;    // not published yet
+
+        if (g_logFile && rec->level <= g_logLevel) {
+            fputws(rec->text, g_logFile);
+            fputwc(L'\n', g_logFile);
         }
+        if (g_pipeConnected)
+            AppendLogMessage(batch, rec->level, rec->text, rec->len);
+
+        InterlockedExchange(&rec->seq, s_dequeuePos + LOG_RING_SLOTS);   // free the slot
+        s_dequeuePos++;
+        count++;
+    }
+    if (dropped > 0) {
+        wchar_t note[96];
+        int len = swprintf(note, 96, L"[LOG] %d line(s) dropped (log ring full)", (int)dropped);
+        if (g_logFile) { fputws(note, g_logFile); fputwc(L'\n', g_logFile); }
+        if (g_pipeConnected)
+            AppendLogMessage(batch, LOG_LEVEL_WARN, note, len);
+    }
+    if (g_logFile && (count > 0 || dropped > 0)) fflush(g_logFile);
+    if (g_pipeConnected) SendLogMessages(batch);
+    LeaveCriticalSection(&g_logCS);
+
+    InterlockedExchange(&s_writtenPos, s_dequeuePos);
+    return count;
+}
+
+static DWORD WINAPI LogWriterThread(LPVOID)
+{
+    LogBatch batch;
+    batch.text[LOG_LEVEL_DEFAULT].reserve(64 * 1024);
+    batch.bin[LOG_LEVEL_DEFAULT].reserve(64 * 1024);
+    while (true)
+    {
+        if (WriteLogBatch(batch) > 0) continue;
+        if (s_writerStop) break;
+
+        // Announce the wait, then re-check so a record published in
+        // between is not left sitting until the timeout
+        InterlockedExchange(&s_writerIdle, 1);
+        if (s_logRing[s_dequeuePos & (LOG_RING_SLOTS - 1)].seq == s_dequeuePos + 1)
+        {
+            InterlockedExchange(&s_writerIdle, 0);
+            continue;
+        }
+        WaitForSingleObject(s_hLogEvent, 100);
+        InterlockedExchange(&s_writerIdle, 0);
+    }
+    WriteLogBatch(batch);
+    return 0;
+}
+
+bool LogStartWriter()
+{
+    if (s_hLogThread) return true;
+    if (!s_logRing)
+    {
+        s_logRing = (LogRecord*)VirtualAlloc(NULL, sizeof(LogRecord) * LOG_RING_SLOTS,
+                                             MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!s_logRing) return false;
+        for (LONG i = 0; i < LOG_RING_SLOTS; i++) s_logRing[i].seq = i;
+        s_enqueuePos = 0;
+        s_dequeuePos = 0;
+        s_writtenPos = 0;
+    }
+    s_hLogEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!s_hLogEvent) return false;
+    s_writerStop = false;
+    s_hLogThread = CreateThread(NULL, 0, LogWriterThread, NULL, 0, NULL);
+    if (!s_hLogThread)
+    {
+        CloseHandle(s_hLogEvent);
+        s_hLogEvent = NULL;
+        return false;
+    }
+    return true;
+}
+
+void LogStopWriter()
+{
+    if (!s_hLogThread) return;
+    // Shutdown only: a line claimed after the final batch is lost, later
+    // ones take the synchronous path
+    s_writerStop = true;
+    SetEvent(s_hLogEvent);
+    WaitForSingleObject(s_hLogThread, 5000);
+    CloseHandle(s_hLogThread);
+    s_hLogThread = NULL;
+    CloseHandle(s_hLogEvent);
+    s_hLogEvent = NULL;
+}
+
+bool LogFlush(DWORD timeoutMs)
+{
+    if (!s_hLogThread) return true;
+    LONG target = s_enqueuePos;
+    DWORD t0 = GetTickCount();
+    while (s_writtenPos - target < 0)
+    {
+        if (GetTickCount() - t0 >= timeoutMs) return false;
+        if (InterlockedCompareExchange(&s_writerIdle, 0, 1) == 1)
+            SetEvent(s_hLogEvent);
+        Sleep(1);
     }
+    return true;
+}
 
+void LogSwitchFile(FILE* newLog)
+{
+    LogFlush(1000);
+    EnterCriticalSection(&g_logCS);
+    if (g_logFile) fclose(g_logFile);
+    g_logFile = newLog;
     LeaveCriticalSection(&g_logCS);
 }
 
 void PipeSendTopology(const wchar_t* xmlPath)
 {
     if (!g_pipeConnected) return;
-    FILE* f = _wfopen(xmlPath, L"r");
+    FILE* f = _wfopen(xmlPath, L"rb");
     if (!f) return;
 
-    EnterCriticalSection(&g_logCS);
-    PipeSend("X|BEGIN\n", 8);
-    char line[4096];
-    while (fgets(line, sizeof(line), f))
-        PipeSend(line, (int)strlen(line));
-    PipeSend("X|END\n", 6);
-    LeaveCriticalSection(&g_logCS);
+    PipeBeginFrame();
+    PipeSession* targets[PIPE_MAX_CLIENTS];
+    int count = PipeTargets(targets, PIPE_MAX_CLIENTS);
+    for (int i = 0; i < count; i++) PipeXmlBegin(targets[i]);
+    char chunk[PIPE_READ_CHUNK];
+    size_t n;
+    char lastByte = '\n';
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    {
+        for (int i = 0; i < count; i++) PipeXmlData(targets[i], chunk, (int)n);
+        lastByte = chunk[n - 1];
+    }
+    for (int i = 0; i < count; i++) PipeXmlEnd(targets[i], lastByte);
+    PipeEndFrame();
 
     fclose(f);
 }
@@ -86,172 +711,360 @@ void PipeSendTopology(const wchar_t* xmlPath)
 void PipeSendStatus(int total, int identified, int events)
 {
     if (!g_pipeConnected) return;
+    HookMemoryStats mem;
+    GetHookMemoryStats(mem);
+    PipeBeginFrame();
     char buf[128];
-    int n = snprintf(buf, sizeof(buf), "S|%d|%d|%d\n", total, identified, events);
-    EnterCriticalSection(&g_logCS);
-    PipeSend(buf, n);
-    LeaveCriticalSection(&g_logCS);
+    int n = snprintf(buf, sizeof(buf), "S|%d|%d|%d|%u|%d|%d\n", total, identified, events,
+                     mem.addressSpaceKB, mem.sinks, mem.addresses);
+    s_textScratch.assign(buf, n > 0 ? n : 0);
+    s_binScratch.clear();
+    s_frameEncoder.Status(s_binScratch, total, identified, events,
+                          mem.addressSpaceKB, mem.sinks, mem.addresses);
+    SendToTargets(s_textScratch, s_binScratch);
+    PipeEndFrame();
 }
 
-bool PipeCheckStop()
+// One overlapped ReadFile into the free tail of the session's readBuf.
+// Returns false on disconnect, g_hStopEvent, or a full buffer.
+static bool FillReadBuffer(PipeSession* s)
 {
-    if (!g_pipeConnected) return false;
-    DWORD bytesAvail = 0;
-    if (PeekNamedPipe(g_hPipe, NULL, 0, NULL, &bytesAvail, NULL) && bytesAvail > 0) {
-        char stopBuf[64];
-        DWORD bytesRead = 0;
-        DWORD toRead = bytesAvail < 63 ? bytesAvail : 63;
-        OVERLAPPED ov = {};
-        ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-        if (!ov.hEvent) return false;
-        BOOL ok = ReadFile(g_hPipe, stopBuf, toRead, &bytesRead, &ov);
-        if (!ok && GetLastError() == ERROR_IO_PENDING)
-            GetOverlappedResult(g_hPipe, &ov, &bytesRead, TRUE);
-        CloseHandle(ov.hEvent);
-        if (bytesRead > 0) {
-            stopBuf[bytesRead] = '\0';
-            if (strstr(stopBuf, "STOP")) {
+    if (s->readPos > 0)
+    {
+        memmove(s->readBuf, s->readBuf + s->readPos, s->readLen - s->readPos);
+        s->readLen -= s->readPos;
+        s->readPos = 0;
+    }
+    DWORD toRead = (DWORD)(sizeof(s->readBuf) - s->readLen);
+    if (toRead == 0) return false;
+
+    OVERLAPPED ov = {};
+    ov.hEvent = s->hReadEvent;
+    DWORD bytesRead = 0;
+    BOOL ok = ReadFile(s->hPipe, s->readBuf + s->readLen, toRead, &bytesRead, &ov);
+    if (!ok)
+    {
+        if (GetLastError() != ERROR_IO_PENDING) { PipeSessionDrop(s); return false; }
+        HANDLE handles[2] = { s->hReadEvent, g_hStopEvent };
+        DWORD w = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        if (w != WAIT_OBJECT_0)
+        {
+            CancelIoEx(s->hPipe, &ov);
+            GetOverlappedResult(s->hPipe, &ov, &bytesRead, TRUE);
+            return false;
+        }
+        if (!GetOverlappedResult(s->hPipe, &ov, &bytesRead, FALSE)) bytesRead = 0;
+    }
+    if (bytesRead == 0) { PipeSessionDrop(s); return false; }
+    s->readLen += (int)bytesRead;
+    return true;
+}
+
+// Take one complete line out of the read buffer (CR/LF stripped). False if none buffered.
+static bool TakeBufferedLine(PipeSession* s, char* buf, int maxLen)
+{
+    for (int i = s->readPos; i < s->readLen; i++)
+    {
+        if (s->readBuf[i] != '\n') continue;
+        int n = 0;
+        for (int j = s->readPos; j < i && n < maxLen - 1; j++)
+            if (s->readBuf[j] != '\r') buf[n++] = s->readBuf[j];
+        buf[n] = '\0';
+        s->readPos = i + 1;
+        return true;
+    }
+    return false;
+}
+
+bool PipeReadLine(PipeSession* s, char* buf, int maxLen)
+{
+    buf[0] = '\0';
+    while (!g_shouldStop)
+    {
+        if (TakeBufferedLine(s, buf, maxLen)) return true;
+        if (!s->connected) return false;
+        if (!FillReadBuffer(s))
+        {
+            // Over-long line filling the whole buffer: deliver it truncated
+            if (s->connected && !g_shouldStop && s->readPos == 0 && s->readLen == (int)sizeof(s->readBuf))
+            {
+                int n = (s->readLen < maxLen - 1) ? s->readLen : maxLen - 1;
+                memcpy(buf, s->readBuf, n);
+                buf[n] = '\0';
+                s->readPos = s->readLen;
                 return true;
             }
+            return false;
         }
     }
     return false;
 }
 
+bool PipeLineBuffered(PipeSession* s, const char* prefix)
+{
+    size_t len = strlen(prefix);
+    const char* line = s->readBuf + s->readPos;
+    int avail = s->readLen - s->readPos;
+    return avail > (int)len && memchr(line, '\n', avail) != nullptr &&
+           memcmp(line, prefix, len) == 0;
+}
+
 // ============================================================
-// Pipe server functions (hook becomes the named pipe server)
+// Pipe server (hook is the named pipe server)
+// The listener owns s_sessionThreads until PipeStopServer joins it.
+// A session starts with one reference for s_sessions; its thread,
+// and any worker command naming it, hold their own.
 // ============================================================
 
-bool PipeCreateServer()
+static PipeSessionFunc s_sessionFunc = nullptr;
+static HANDLE s_hListenerThread = NULL;
+static HANDLE s_hSlotFree = NULL;              // auto-reset: a session closed
+static std::vector<HANDLE> s_sessionThreads;
+static LONG s_nextSessionId = 0;
+
+void PipeSessionAddRef(PipeSession* session)
 {
-    g_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-    g_hPipe = CreateNamedPipeW(
-        L"\\\\.\\pipe\\RSLinxHook",
-        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
-        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
-        1, 4096, 4096, 0, NULL);
-    return g_hPipe != INVALID_HANDLE_VALUE;
+    InterlockedIncrement(&session->refs);
 }
 
-bool PipeAcceptClient()
+void PipeSessionRelease(PipeSession* session)
 {
-    if (g_hPipe == INVALID_HANDLE_VALUE) return false;
+    if (InterlockedDecrement(&session->refs) != 0) return;
+    if (session->hPipe != INVALID_HANDLE_VALUE) CloseHandle(session->hPipe);
+    if (session->hReadEvent) CloseHandle(session->hReadEvent);
+    if (session->hWriteEvent) CloseHandle(session->hWriteEvent);
+    if (session->hSendEvent) CloseHandle(session->hSendEvent);
+    if (session->hWriterThread) CloseHandle(session->hWriterThread);
+    DeleteCriticalSection(&session->sendCS);
+    delete session;
+}
 
-    OVERLAPPED ov = {};
-    ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-    if (!ov.hEvent) return false;
+void PipeSessionReady(PipeSession* session, bool delta, bool monitor, int logLevel)
+{
+    EnterCriticalSection(&g_logCS);
+    session->delta = delta;
+    session->monitor = monitor;
+    session->logLevel = (logLevel >= 0 && logLevel <= LOG_LEVEL_DEBUG) ? logLevel : LOG_LEVEL_DEFAULT;
+    session->ready = true;
+    UpdatePipeConnected();
+    LeaveCriticalSection(&g_logCS);
+}
 
-    BOOL ok = ConnectNamedPipe(g_hPipe, &ov);
-    if (!ok)
+void PipeSessionDrop(PipeSession* session)
+{
+    EnterCriticalSection(&g_logCS);
+    MarkDisconnected(session);
+    LeaveCriticalSection(&g_logCS);
+}
+
+bool PipeSessionDrain(PipeSession* session, DWORD timeoutMs)
+{
+    DWORD t0 = GetTickCount();
+    while (session->connected)
     {
-        DWORD err = GetLastError();
-        if (err == ERROR_PIPE_CONNECTED)
-        {
-            CloseHandle(ov.hEvent);
-            g_pipeConnected = true;
-            return true;
-        }
-        if (err == ERROR_IO_PENDING)
-        {
-            // Wait for either a client connection or the stop event
-            HANDLE handles[2] = { ov.hEvent, g_hStopEvent };
-            DWORD waitResult = WaitForMultipleObjects(g_hStopEvent ? 2 : 1, handles, FALSE, INFINITE);
-            if (waitResult == WAIT_OBJECT_0)
-            {
-                // Client connected
-                DWORD dummy;
-                GetOverlappedResult(g_hPipe, &ov, &dummy, FALSE);
-                CloseHandle(ov.hEvent);
-                g_pipeConnected = true;
-                return true;
-            }
-            else
-            {
-                // Stop event signaled or error — cancel the pending I/O
-                CancelIoEx(g_hPipe, &ov);
-                CloseHandle(ov.hEvent);
-                return false;
-            }
-        }
-        // Other error
-        CloseHandle(ov.hEvent);
-        return false;
+        EnterCriticalSection(&session->sendCS);
+        bool empty = session->sendQueue.empty() && session->sendInFlight == 0;
+        LeaveCriticalSection(&session->sendCS);
+        if (empty) return true;
+        if (GetTickCount() - t0 >= timeoutMs) return false;
+        Sleep(1);
     }
-
-    // ConnectNamedPipe returned TRUE (rare but possible)
-    CloseHandle(ov.hEvent);
-    g_pipeConnected = true;
     return true;
 }
 
-void PipeDisconnectClient()
+int PipeMonitorSessions()
 {
-    DisconnectNamedPipe(g_hPipe);
-    g_pipeConnected = false;
+    int n = 0;
+    EnterCriticalSection(&g_logCS);
+    for (PipeSession* s : s_sessions)
+        if (s->ready && s->monitor && s->connected) n++;
+    LeaveCriticalSection(&g_logCS);
+    return n;
 }
 
-void PipeDestroyServer()
+// Flush, disconnect and unlist a session its thread is finished with
+static void CloseSession(PipeSession* s)
 {
-    if (g_hPipe != INVALID_HANDLE_VALUE)
-    {
-        CloseHandle(g_hPipe);
-        g_hPipe = INVALID_HANDLE_VALUE;
-    }
-    if (g_hStopEvent != NULL)
+    LogFlush(1000);   // let queued L| lines reach the client first
+    EnterCriticalSection(&g_logCS);
+    FlushWriteBuffer(s);
+    s_sessions.erase(std::remove(s_sessions.begin(), s_sessions.end(), s), s_sessions.end());
+    UpdatePipeConnected();
+    LeaveCriticalSection(&g_logCS);
+
+    // The writer sends what is queued (each write bounded by
+    // PIPE_WRITE_TIMEOUT_MS), then exits
+    if (s->hWriterThread)
     {
-        CloseHandle(g_hStopEvent);
-        g_hStopEvent = NULL;
+        EnterCriticalSection(&s->sendCS);
+        s->writerStop = true;
+        LeaveCriticalSection(&s->sendCS);
+        SetEvent(s->hSendEvent);
+        WaitForSingleObject(s->hWriterThread, INFINITE);
     }
+
+    EnterCriticalSection(&g_logCS);
+    s->connected = false;
+    DisconnectNamedPipe(s->hPipe);
+    LeaveCriticalSection(&g_logCS);
+    SetEvent(s_hSlotFree);
+    PipeSessionRelease(s);   // the list's reference
 }
 
-// Read one newline-terminated line. Returns false on disconnect or g_shouldStop.
-bool PipeReadLine(char* buf, int maxLen)
+static DWORD WINAPI SessionThread(LPVOID param)
 {
-    if (!g_pipeConnected || g_hPipe == INVALID_HANDLE_VALUE) return false;
-    int i = 0;
-    while (i < maxLen - 1 && !g_shouldStop)
+    PipeSession* s = (PipeSession*)param;
+    s_sessionFunc(s);
+    CloseSession(s);
+    Log(L"[PIPE] Client %d disconnected", s->id);
+    PipeSessionRelease(s);
+    return 0;
+}
+
+static bool StopRequested()
+{
+    return g_shouldStop || WaitForSingleObject(g_hStopEvent, 0) == WAIT_OBJECT_0;
+}
+
+// Wait for a client on a fresh instance; false on g_hStopEvent or error
+static bool WaitForClient(HANDLE hPipe, HANDLE hEvent)
+{
+    OVERLAPPED ov = {};
+    ov.hEvent = hEvent;
+    ResetEvent(hEvent);
+    if (ConnectNamedPipe(hPipe, &ov)) return true;   // rare but possible
+
+    DWORD err = GetLastError();
+    if (err == ERROR_PIPE_CONNECTED) return true;
+    if (err != ERROR_IO_PENDING) return false;
+
+    DWORD dummy;
+    HANDLE handles[2] = { hEvent, g_hStopEvent };
+    if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0)
+        return GetOverlappedResult(hPipe, &ov, &dummy, FALSE) != FALSE;
+
+    // Stop event signaled — cancel the pending connect
+    CancelIoEx(hPipe, &ov);
+    GetOverlappedResult(hPipe, &ov, &dummy, TRUE);
+    return false;
+}
+
+// Keeps one instance waiting for the next client while the others are in use
+static DWORD WINAPI PipeListenerThread(LPVOID)
+{
+    HANDLE hConnectEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!hConnectEvent) return 1;
+
+    while (!StopRequested())
     {
-        OVERLAPPED ov = {};
-        ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-        if (!ov.hEvent) { buf[i] = '\0'; return false; }
+        // Reap the threads of sessions that have ended
+        for (size_t i = 0; i < s_sessionThreads.size();)
+        {
+            if (WaitForSingleObject(s_sessionThreads[i], 0) != WAIT_OBJECT_0) { i++; continue; }
+            CloseHandle(s_sessionThreads[i]);
+            s_sessionThreads.erase(s_sessionThreads.begin() + i);
+        }
 
-        DWORD bytesRead = 0;
-        BOOL ok = ReadFile(g_hPipe, buf + i, 1, &bytesRead, &ov);
-        if (!ok && GetLastError() == ERROR_IO_PENDING)
+        HANDLE hPipe = CreateNamedPipeW(
+            L"\\\\.\\pipe\\RSLinxHook",
+            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+            PIPE_MAX_CLIENTS, PIPE_WRITE_BUFFER, PIPE_READ_CHUNK, 0, NULL);
+        if (hPipe == INVALID_HANDLE_VALUE)
         {
-            HANDLE handles[2] = { ov.hEvent, g_hStopEvent };
-            DWORD wait = WaitForMultipleObjects(g_hStopEvent ? 2 : 1, handles, FALSE, INFINITE);
-            if (wait == WAIT_OBJECT_0)
-            {
-                GetOverlappedResult(g_hPipe, &ov, &bytesRead, FALSE);
-            }
-            else
-            {
-                CancelIoEx(g_hPipe, &ov);
-                CloseHandle(ov.hEvent);
-                buf[i] = '\0';
-                return false;
-            }
+            // ERROR_PIPE_BUSY: every instance has a client — wait for one to leave
+            DWORD err = GetLastError();
+            if (err != ERROR_PIPE_BUSY)
+                Log(L"[PIPE] CreateNamedPipe failed: %d -- retrying", err);
+            HANDLE handles[2] = { s_hSlotFree, g_hStopEvent };
+            WaitForMultipleObjects(2, handles, FALSE, err == ERROR_PIPE_BUSY ? INFINITE : 500);
+            continue;
         }
-        CloseHandle(ov.hEvent);
 
-        if (bytesRead == 0)
+        if (!WaitForClient(hPipe, hConnectEvent))
         {
-            g_pipeConnected = false;
-            buf[i] = '\0';
-            return false;
+            CloseHandle(hPipe);
+            continue;
         }
-        if (buf[i] == '\n') { buf[i] = '\0'; return true; }
-        if (buf[i] != '\r') i++;  // skip \r if present
+
+        PipeSession* s = new PipeSession();
+        s->id = InterlockedIncrement(&s_nextSessionId);
+        s->hPipe = hPipe;
+        s->hReadEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        s->hWriteEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        s->hSendEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+        InitializeCriticalSection(&s->sendCS);
+        if (s->hReadEvent && s->hWriteEvent && s->hSendEvent)
+            s->hWriterThread = CreateThread(NULL, 0, SessionWriterThread, s, 0, NULL);
+        if (!s->hWriterThread)
+        {
+            DisconnectNamedPipe(hPipe);
+            PipeSessionRelease(s);
+            continue;
+        }
+
+        EnterCriticalSection(&g_logCS);
+        s_sessions.push_back(s);
+        int active = (int)s_sessions.size();
+        LeaveCriticalSection(&g_logCS);
+
+        PipeSessionAddRef(s);   // the session thread's reference
+        HANDLE hThread = CreateThread(NULL, 0, SessionThread, s, 0, NULL);
+        if (!hThread)
+        {
+            Log(L"[PIPE] Session thread for client %d failed: %d", s->id, GetLastError());
+            CloseSession(s);
+            PipeSessionRelease(s);
+            continue;
+        }
+        s_sessionThreads.push_back(hThread);
+        Log(L"[PIPE] Client %d connected (%d active)", s->id, active);
     }
-    buf[i] = '\0';
-    return false;
+
+    CloseHandle(hConnectEvent);
+    return 0;
 }
 
-void PipeSendLine(const char* line)
+bool PipeStartServer(PipeSessionFunc sessionFunc)
 {
-    PipeSend(line, (int)strlen(line));
-    PipeSend("\n", 1);
+    s_sessionFunc = sessionFunc;
+    if (!g_hStopEvent) g_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!s_hSlotFree) s_hSlotFree = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!g_hStopEvent || !s_hSlotFree) return false;
+    s_hListenerThread = CreateThread(NULL, 0, PipeListenerThread, NULL, 0, NULL);
+    return s_hListenerThread != NULL;
+}
+
+void PipeStopServer()
+{
+    if (g_hStopEvent) SetEvent(g_hStopEvent);
+    if (s_hListenerThread)
+    {
+        WaitForSingleObject(s_hListenerThread, INFINITE);
+        CloseHandle(s_hListenerThread);
+        s_hListenerThread = NULL;
+    }
+
+    // Fail every pending read so the session threads return. Each joins
+    // its writer before exiting (writes are bounded by
+    // PIPE_WRITE_TIMEOUT_MS), so once they are joined nothing is left
+    // waiting on g_hStopEvent or s_hSlotFree.
+    EnterCriticalSection(&g_logCS);
+    for (PipeSession* s : s_sessions) MarkDisconnected(s);
+    LeaveCriticalSection(&g_logCS);
+    for (HANDLE h : s_sessionThreads)
+    {
+        WaitForSingleObject(h, INFINITE);
+        CloseHandle(h);
+    }
+    s_sessionThreads.clear();
+
+    if (g_hStopEvent != NULL)
+    {
+        CloseHandle(g_hStopEvent);
+        g_hStopEvent = NULL;
+    }
+    if (s_hSlotFree) { CloseHandle(s_hSlotFree); s_hSlotFree = NULL; }
 }
 
 std::wstring LogPath(const std::wstring& logDir, const wchar_t* filename)
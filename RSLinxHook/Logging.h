@@ -1,5 +1,6 @@
 #pragma once
 #include "RSLinxHook_fwd.h"
+#include "PipeBinary.h"
 
 // ============================================================
 // Logging and pipe communication
@@ -8,21 +9,195 @@
 
 extern FILE* g_logFile;
 extern CRITICAL_SECTION g_logCS;
-extern HANDLE g_hPipe;
 extern HANDLE g_hStopEvent;   // signaled to unblock overlapped pipe operations
-extern bool g_pipeConnected;
+extern bool g_pipeConnected;  // at least one ready pipe session (see below)
+
+// ============================================================
+// Log levels. Log() is LOG_LEVEL_INFO, or ERROR / WARN when its format
+// carries an upper-case FAIL or ERROR / WARN marker ("[FAIL] ...",
+// "[BP] ERROR: ..."). LogDebug is for hot-path lines (per-address
+// events) and compiles to nothing when LOG_MAX_LEVEL is lower.
+// g_logLevel is the log file's threshold; each ready client receives
+// L| lines up to its own C|LOGLEVEL. A line neither wants is discarded
+// before formatting.
+// ============================================================
+
+#define LOG_LEVEL_ERROR   0
+#define LOG_LEVEL_WARN    1
+#define LOG_LEVEL_INFO    2
+#define LOG_LEVEL_DEBUG   3
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_DEBUG
+
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+extern volatile LONG g_logLevel;
 
-void PipeSend(const char* data, int len);
 void Log(const wchar_t* fmt, ...);
+void LogAt(int level, const wchar_t* fmt, ...);
+
+#if LOG_MAX_LEVEL >= LOG_LEVEL_DEBUG
+#define LogDebug(...) LogAt(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LogDebug(...) ((void)0)
+#endif
+
+// "error" / "warn" / "info" / "debug" or a digit; -1 if not recognized
+int ParseLogLevel(const std::wstring& name);
+
+// ============================================================
+// Asynchronous log writer
+// Log() formats into a lock-free ring (LOG_RING_SLOTS records) and
+// returns; a background thread writes batches to g_logFile and as
+// L| lines to the pipe. A full ring drops lines (counted, reported
+// once the writer catches up) rather than blocking the caller —
+// Log() runs on RSLinx's main STA inside event-sink callbacks.
+// g_logCS serializes output: the writer holds it per batch, and
+// multi-line pipe blocks (X|, N|) hold it so log lines cannot
+// interleave with them.
+// Before LogStartWriter / after LogStopWriter, Log() writes in place.
+// ============================================================
+
+#define LOG_RING_SLOTS    1024     // power of two
+#define LOG_RECORD_CHARS  1024     // longer lines are truncated
+#define LOG_BATCH_MAX     256      // records per writer pass
+
+bool LogStartWriter();
+void LogStopWriter();              // drains everything queued first
+// Wait until every line logged before the call has been written
+bool LogFlush(DWORD timeoutMs);
+// Replace g_logFile (closing the old one) after flushing pending lines
+void LogSwitchFile(FILE* newLog);
 void PipeSendTopology(const wchar_t* xmlPath);
 void PipeSendStatus(int total, int identified, int events);
-bool PipeCheckStop();
 std::wstring LogPath(const std::wstring& logDir, const wchar_t* filename);
 
-// Pipe server functions (hook is server; CLI connects as client)
-bool PipeCreateServer();
-bool PipeAcceptClient();
-void PipeDisconnectClient();
-void PipeDestroyServer();
-bool PipeReadLine(char* buf, int maxLen);
-void PipeSendLine(const char* line);
+// Pipe transport buffers. Session output is coalesced inside a frame
+// (PipeBeginFrame/PipeEndFrame, nestable, holds g_logCS): a session's
+// buffer is flushed when PIPE_WRITE_BUFFER fills, PIPE_FLUSH_DEADLINE_MS
+// after its first unsent byte, or at PipeEndFrame. Outside a frame
+// PipeSessionSend flushes immediately. A flush only moves the bytes to
+// the session's send queue; its writer thread does the pipe write,
+// without g_logCS, so a client that stops reading stalls only itself.
+// Reads go through a PIPE_READ_CHUNK line buffer per session.
+#define PIPE_WRITE_BUFFER       65536
+#define PIPE_READ_CHUNK         4096
+#define PIPE_FLUSH_DEADLINE_MS  20
+#define PIPE_SEND_QUEUE_MAX     (8 * 1024 * 1024)   // unsent bytes before a client is dropped
+
+void PipeBeginFrame();
+void PipeEndFrame();
+
+// ============================================================
+// Pipe sessions
+// The server keeps up to PIPE_MAX_CLIENTS instances of
+// \\.\pipe\RSLinxHook. A listener thread accepts clients and runs the
+// PipeSessionFunc on a thread per client; COM work stays on the worker
+// thread, which session threads hand commands to (DllMain.cpp).
+// A session is ready once the worker has taken its config: from then
+// on it receives the broadcast output (L|, S|, N|, X|). Replies (R|,
+// D|, the replay for a new client) go to one session inside
+// PipeBeginReply/PipeEndReply.
+// The session list and every field below the handles belong to the
+// g_logCS holder, the send queue to sendCS; the read buffer belongs to
+// the session thread.
+// ============================================================
+
+#define PIPE_MAX_CLIENTS        8
+#define PIPE_WRITE_TIMEOUT_MS   5000    // one write this slow drops the client
+
+struct PipeSession {
+    int id = 0;                          // unique per connection
+    HANDLE hPipe = INVALID_HANDLE_VALUE;
+    HANDLE hReadEvent = NULL;
+    HANDLE hWriteEvent = NULL;
+    HANDLE hSendEvent = NULL;            // auto-reset: send queue grew, or writer stop
+    HANDLE hWriterThread = NULL;
+    volatile LONG refs = 1;
+    volatile bool connected = true;
+
+    bool ready = false;
+    bool binary = false;                 // C|BINARY=1 acknowledged
+    bool delta = false;                  // C|DELTA=1: applies N|DELTA blocks
+    bool monitor = false;                // keeps the monitor loop running
+    int logLevel = LOG_LEVEL_DEFAULT;    // C|LOGLEVEL: L| lines above it are not sent
+    BinaryEncoder encoder;               // this client's string table
+    char writeBuf[PIPE_WRITE_BUFFER];
+    int writeLen = 0;
+    DWORD writeFirstTick = 0;            // GetTickCount of the oldest unsent byte
+
+    CRITICAL_SECTION sendCS;
+    std::string sendQueue;               // flushed bytes the writer has not taken
+    size_t sendInFlight = 0;             // taken, write not finished
+    bool writerStop = false;
+
+    char readBuf[PIPE_READ_CHUNK];
+    int readPos = 0, readLen = 0;
+};
+
+typedef void (*PipeSessionFunc)(PipeSession* session);
+
+// Create g_hStopEvent and start the listener. sessionFunc runs on the
+// client's thread; the session is disconnected when it returns.
+bool PipeStartServer(PipeSessionFunc sessionFunc);
+// After g_hStopEvent: stop accepting, drop every client, join their threads
+void PipeStopServer();
+
+void PipeSessionAddRef(PipeSession* session);
+void PipeSessionRelease(PipeSession* session);
+// Start broadcasts to the session (worker, after taking its config)
+void PipeSessionReady(PipeSession* session, bool delta, bool monitor, int logLevel);
+// Disconnect from another thread; the session thread's next read fails
+void PipeSessionDrop(PipeSession* session);
+// Wait until the writer thread has sent everything flushed to the
+// session so far. False on timeout.
+bool PipeSessionDrain(PipeSession* session, DWORD timeoutMs);
+// Ready monitor-mode sessions still connected
+int PipeMonitorSessions();
+
+// Read one newline-terminated line (session thread). Returns false on
+// disconnect or g_hStopEvent.
+bool PipeReadLine(PipeSession* session, char* buf, int maxLen);
+// The next line is already buffered and starts with prefix, so
+// PipeReadLine returns it without waiting (session thread)
+bool PipeLineBuffered(PipeSession* session, const char* prefix);
+
+// Output targets of the current frame: the reply session, or every
+// ready session. Call inside a frame; returns the count.
+int PipeTargets(PipeSession** out, int max);
+// Append to one session's write buffer (flushed per the rules above)
+void PipeSessionSend(PipeSession* session, const char* data, int len);
+// Frame whose targets are only this session (not nestable across sessions)
+void PipeBeginReply(PipeSession* session);
+void PipeEndReply();
+
+// Binary framing (see PipeBinary.h). PipeEnableBinary sends V|BINARY|n and
+// switches the session's output to frames until it disconnects. The
+// senders below encode per target; callers building their own records
+// use the target's encoder inside a frame.
+void PipeEnableBinary(PipeSession* session);
+void PipeSendDone();                                     // D| / FRAME_DONE
+// One L| line / FRAME_LOG to the frame's targets only, e.g. why a reply's
+// client is about to be dropped; not written to the log file
+void PipeSendLogLine(const wchar_t* text);
+// tag >= 0 answers entry <tag> of a QB| batch: R|<tag>|FOUND|... / FRAME_RESULT_TAGGED.
+// stale: the answer comes from warm-start data (R|FOUND|...|STALE).
+// pending: a provisional C|SWR=1 answer; a background browse pushes the
+// final one later (R|FOUND|...|PENDING, R|NOTFOUND|path|PENDING). It
+// replaces STALE: the one trailing field says how far to trust the answer.
+void PipeSendResult(bool found, const char* classname, const char* deviceName,
+                    const char* ip, int slot, const char* path, int tag = -1,
+                    bool stale = false, bool pending = false);   // R| / FRAME_RESULT
+// C|STREAM=1 device record (see QueryWatch.h): I|ip|port|slot|classname|name,
+// port empty and slot -1 for an IP-level device, |STALE when the entry
+// comes from warm-start data / FRAME_DEVICE
+void PipeSendDevice(const char* ip, const char* portName, int slot,
+                    const char* classname, const char* deviceName, bool stale);
+// P| reply lines (see Perf.h) / FRAME_PERF, one per line
+void PipeSendPerf(const std::vector<std::string>& lines);
+// X| block pieces for one session; call inside a frame. lastByte: final
+// data byte sent (text mode adds a newline before X|END if it was not one)
+void PipeXmlBegin(PipeSession* session);
+void PipeXmlData(PipeSession* session, const char* data, int len);
+void PipeXmlEnd(PipeSession* session, char lastByte);
@@ -0,0 +1,111 @@
+#include "Perf.h"
+
+// ============================================================
+// Perf tables
+// ============================================================
+
+struct PerfHistogram {
+    volatile LONG64 count;
+    volatile LONG64 totalUs;
+    volatile LONG64 maxUs;
+    volatile LONG64 buckets[PERF_BUCKETS];
+};
+
+static PerfHistogram s_timers[PERF_ID_COUNT];
+static volatile LONG64 s_counters[PERF_COUNTER_COUNT];
+
+static const char* const s_timerNames[] = {
+    "MainSTAWait", "MainSTACall", "ConnectNewDevices", "MainSTABrowse",
+    "BusBrowse", "BackplaneBrowse", "Cleanup", "EngineHotLoad",
+    "Invoke", "SaveTopologyXML", "ParseXML", "CountDevices",
+    "CountTargets", "UpdateDeviceIPs", "PopulateQueryCache", "RefreshQueryCache",
+    "WalkTopologyTree", "PipeWrite", "QueryCache", "TopologyWalk",
+    "FindQuery",
+};
+
+static const char* const s_counterNames[] = {
+    "PipeBytes", "XmlBytes", "InvokeFailed", "QISkipped", "InvokeSkipped",
+};
+static_assert(sizeof(s_timerNames) / sizeof(s_timerNames[0]) == PERF_ID_COUNT, "PerfId names");
+static_assert(sizeof(s_counterNames) / sizeof(s_counterNames[0]) == PERF_COUNTER_COUNT, "PerfCounterId names");
+
+static LONGLONG QpcFrequency()
+{
+    static LONGLONG s_freq = 0;
+    if (s_freq == 0)
+    {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        s_freq = f.QuadPart;   // constant for the boot; a racing write stores the same value
+    }
+    return s_freq;
+}
+
+LONGLONG PerfNow()
+{
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
+
+void PerfRecord(PerfId id, LONGLONG startTicks)
+{
+    if (id < 0 || id >= PERF_ID_COUNT) return;
+    LONGLONG ticks = PerfNow() - startTicks;
+    if (ticks < 0) ticks = 0;
+    LONGLONG us = ticks * 1000000 / QpcFrequency();
+
+    int bucket = 0;
+    for (LONGLONG v = us; v > 1 && bucket < PERF_BUCKETS - 1; v >>= 1)
+        bucket++;
+
+    PerfHistogram& h = s_timers[id];
+    InterlockedIncrement64(&h.count);
+    InterlockedExchangeAdd64(&h.totalUs, us);
+    InterlockedIncrement64(&h.buckets[bucket]);
+    LONG64 seen = h.maxUs;
+    while (us > seen)
+    {
+        LONG64 prev = InterlockedCompareExchange64(&h.maxUs, us, seen);
+        if (prev == seen) break;
+        seen = prev;
+    }
+}
+
+void PerfAdd(PerfCounterId id, LONGLONG value)
+{
+    if (id < 0 || id >= PERF_COUNTER_COUNT) return;
+    InterlockedExchangeAdd64(&s_counters[id], value);
+}
+
+void PerfReset()
+{
+    // Not atomic as a whole: a sample landing mid-reset may be split
+    for (auto& h : s_timers)
+    {
+        InterlockedExchange64(&h.count, 0);
+        InterlockedExchange64(&h.totalUs, 0);
+        InterlockedExchange64(&h.maxUs, 0);
+        for (auto& b : h.buckets) InterlockedExchange64(&b, 0);
+    }
+    for (auto& c : s_counters) InterlockedExchange64(&c, 0);
+}
+
+void PerfFormat(std::vector<std::string>& lines)
+{
+    char buf[512];
+    for (int i = 0; i < PERF_ID_COUNT; i++)
+    {
+        const PerfHistogram& h = s_timers[i];
+        int n = snprintf(buf, sizeof(buf), "T|%s|%lld|%lld|%lld|", s_timerNames[i],
+                         (long long)h.count, (long long)h.totalUs, (long long)h.maxUs);
+        for (int b = 0; b < PERF_BUCKETS && n > 0 && n < (int)sizeof(buf); b++)
+            n += snprintf(buf + n, sizeof(buf) - n, b ? ",%lld" : "%lld", (long long)h.buckets[b]);
+        lines.push_back(buf);
+    }
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        snprintf(buf, sizeof(buf), "C|%s|%lld", s_counterNames[i], (long long)s_counters[i]);
+        lines.push_back(buf);
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "RSLinxHook_fwd.h"
+
+// ============================================================
+// Hot-path timing
+// PerfScope times a block with QueryPerformanceCounter into a fixed
+// histogram per PerfId: count, total, max and log2 buckets of
+// microseconds (bucket b holds [2^b, 2^(b+1)) us; bucket 0 also < 1 us,
+// the last bucket everything above). PerfAdd bumps a plain counter.
+// All updates are interlocked, so any thread may record: the worker,
+// the main STA inside Do*Browse, pipe session threads.
+// P| returns the tables; hook_results.txt gets one PERF: line each.
+// ============================================================
+
+enum PerfId {
+    PERF_MAIN_STA_WAIT,        // ExecuteOnMainSTA submit -> item starts on the main STA
+    PERF_MAIN_STA_CALL,        // ExecuteOnMainSTA round trip, wait included
+    PERF_CONNECT_NEW_DEVICES,  // DoConnectNewDevices
+    PERF_MAIN_STA_BROWSE,      // DoMainSTABrowse
+    PERF_BUS_BROWSE,           // DoBusBrowse
+    PERF_BACKPLANE_BROWSE,     // DoBackplaneBrowse
+    PERF_CLEANUP,              // DoCleanupOnMainSTA
+    PERF_ENGINE_HOTLOAD,       // DoEngineHotLoadOnMainSTA
+    PERF_INVOKE,               // IDispatch::Invoke in DispatchHelpers
+    PERF_SAVE_XML,             // SaveTopologyXML
+    PERF_PARSE_XML,            // stream parse of one snapshot
+    PERF_COUNT_DEVICES,        // CountDevicesInXML
+    PERF_COUNT_TARGETS,        // CountTargetsIdentifiedInXML
+    PERF_UPDATE_IPS,           // UpdateDeviceIPsFromXML
+    PERF_POPULATE_CACHE,       // PopulateQueryCache
+    PERF_REFRESH_CACHE,        // RefreshQueryCache
+    PERF_WALK_TOPOLOGY,        // WalkTopologyTree
+    PERF_PIPE_WRITE,           // WriteFile of one session buffer, waits included
+    PERF_QUERY_CACHE,          // Q| answered from the cache on a session thread
+    PERF_TOPOLOGY_WALK,        // DoTopologyWalk (C|WALK=1)
+    PERF_FIND_QUERY,           // F| answered from the store indexes on a session thread
+    PERF_ID_COUNT
+};
+
+enum PerfCounterId {
+    PERF_CTR_PIPE_BYTES,       // bytes written to pipe clients
+    PERF_CTR_XML_BYTES,        // snapshot XML bytes parsed
+    PERF_CTR_INVOKE_FAILED,    // DispatchHelpers Invoke calls that failed
+    PERF_CTR_QI_SKIPPED,       // QueryInterface calls the capability cache answered
+    PERF_CTR_INVOKE_SKIPPED,   // Invoke calls skipped: DISPID not a member of the class
+    PERF_COUNTER_COUNT
+};
+
+#define PERF_BUCKETS 24
+
+LONGLONG PerfNow();
+void PerfRecord(PerfId id, LONGLONG startTicks);
+void PerfAdd(PerfCounterId id, LONGLONG value);
+void PerfReset();
+
+// One line per timer, then one per counter (no prefix):
+//   T|<name>|<count>|<totalUs>|<maxUs>|<b0>,<b1>,...,<b23>
+//   C|<name>|<value>
+void PerfFormat(std::vector<std::string>& lines);
+
+class PerfScope
+{
+public:
+    explicit PerfScope(PerfId id) : m_id(id), m_start(PerfNow()) {}
+    ~PerfScope() { PerfRecord(m_id, m_start); }
+private:
+    PerfScope(const PerfScope&);
+    PerfScope& operator=(const PerfScope&);
+    PerfId m_id;
+    LONGLONG m_start;
+};
@@ -0,0 +1,165 @@
+#include "PipeBinary.h"
+
+// ============================================================
+// BinaryEncoder implementation
+// ============================================================
+
+void BinaryAppendVarint(std::string& out, unsigned v)
+{
+    while (v >= 0x80)
+    {
+        out += (char)(unsigned char)((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += (char)(unsigned char)v;
+}
+
+static unsigned ZigZag(int v)
+{
+    return ((unsigned)v << 1) ^ (unsigned)(v >> 31);
+}
+
+void BinaryEncoder::Reset()
+{
+    m_ids.clear();
+}
+
+void BinaryEncoder::Frame(std::string& out, PipeFrameType type, const std::string& payload)
+{
+    out += (char)type;
+    BinaryAppendVarint(out, (unsigned)payload.size());
+    out += payload;
+}
+
+unsigned BinaryEncoder::Intern(std::string& out, const std::string& s)
+{
+    auto it = m_ids.find(s);
+    if (it != m_ids.end()) return it->second;
+
+    unsigned id = (unsigned)m_ids.size();
+    m_ids.emplace(s, id);
+
+    std::string def;
+    BinaryAppendVarint(def, id);
+    def += s;
+    Frame(out, FRAME_STRING, def);
+    return id;
+}
+
+void BinaryEncoder::Log(std::string& out, const char* utf8, size_t len)
+{
+    Bytes(out, FRAME_LOG, utf8, len);
+}
+
+void BinaryEncoder::Status(std::string& out, int total, int identified, int events,
+                           unsigned addressSpaceKB, int sinks, int addresses)
+{
+    m_payload.clear();
+    BinaryAppendVarint(m_payload, (unsigned)total);
+    BinaryAppendVarint(m_payload, (unsigned)identified);
+    BinaryAppendVarint(m_payload, (unsigned)events);
+    BinaryAppendVarint(m_payload, addressSpaceKB);
+    BinaryAppendVarint(m_payload, (unsigned)sinks);
+    BinaryAppendVarint(m_payload, (unsigned)addresses);
+    Frame(out, FRAME_STATUS, m_payload);
+}
+
+void BinaryEncoder::Empty(std::string& out, PipeFrameType type)
+{
+    out += (char)type;
+    out += '\0';
+}
+
+void BinaryEncoder::Bytes(std::string& out, PipeFrameType type, const char* data, size_t len)
+{
+    out += (char)type;
+    BinaryAppendVarint(out, (unsigned)len);
+    out.append(data, len);
+}
+
+void BinaryEncoder::NodeBegin(std::string& out, bool delta)
+{
+    out += (char)FRAME_NODE_BEGIN;
+    out += '\x01';
+    out += delta ? '\x01' : '\0';
+}
+
+void BinaryEncoder::Node(std::string& out, BinaryNodeOp op, const std::string& path,
+                         const BinaryNodeRecord& rec)
+{
+    // Intern first: STRING frames must precede the record that uses them
+    unsigned pathRef = path.empty() ? 0 : Intern(out, path) + 1;
+    int fields = (rec.kind == NODE_ADDR) ? 4 : (rec.kind == NODE_ROOT || rec.kind == NODE_BUS) ? 2 : 0;
+    unsigned ids[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < fields; i++)
+        ids[i] = Intern(out, rec.f[i]);
+
+    m_payload.clear();
+    m_payload += (char)op;
+    BinaryAppendVarint(m_payload, pathRef);
+    m_payload += (char)rec.kind;
+    for (int i = 0; i < fields; i++)
+        BinaryAppendVarint(m_payload, ids[i]);
+    Frame(out, FRAME_NODE, m_payload);
+}
+
+void BinaryEncoder::NodeDel(std::string& out, const std::string& path)
+{
+    unsigned pathRef = Intern(out, path) + 1;
+    m_payload.clear();
+    m_payload += (char)NODE_OP_DEL;
+    BinaryAppendVarint(m_payload, pathRef);
+    Frame(out, FRAME_NODE, m_payload);
+}
+
+void BinaryEncoder::BeginResult(int tag)
+{
+    m_payload.clear();
+    if (tag >= 0) BinaryAppendVarint(m_payload, (unsigned)tag);
+}
+
+void BinaryEncoder::Result(std::string& out, const std::string& classname,
+                           const std::string& deviceName, const std::string& ip, int slot, int tag,
+                           bool stale, bool pending)
+{
+    unsigned c = Intern(out, classname);
+    unsigned n = Intern(out, deviceName);
+    unsigned i = Intern(out, ip);
+
+    BeginResult(tag);
+    m_payload += pending ? '\x03' : stale ? '\x02' : '\x01';
+    BinaryAppendVarint(m_payload, c);
+    BinaryAppendVarint(m_payload, n);
+    BinaryAppendVarint(m_payload, i);
+    BinaryAppendVarint(m_payload, ZigZag(slot));
+    Frame(out, tag >= 0 ? FRAME_RESULT_TAGGED : FRAME_RESULT, m_payload);
+}
+
+void BinaryEncoder::ResultNotFound(std::string& out, const std::string& path, int tag,
+                                   bool pending)
+{
+    unsigned p = Intern(out, path);
+    BeginResult(tag);
+    m_payload += pending ? '\x04' : '\0';
+    BinaryAppendVarint(m_payload, p);
+    Frame(out, tag >= 0 ? FRAME_RESULT_TAGGED : FRAME_RESULT, m_payload);
+}
+
+void BinaryEncoder::Device(std::string& out, const std::string& ip, const std::string& portName,
+                           int slot, const std::string& classname, const std::string& deviceName,
+                           bool stale)
+{
+    unsigned i = Intern(out, ip);
+    unsigned p = Intern(out, portName);
+    unsigned c = Intern(out, classname);
+    unsigned n = Intern(out, deviceName);
+
+    m_payload.clear();
+    m_payload += stale ? '\x01' : '\0';
+    BinaryAppendVarint(m_payload, i);
+    BinaryAppendVarint(m_payload, p);
+    BinaryAppendVarint(m_payload, c);
+    BinaryAppendVarint(m_payload, n);
+    BinaryAppendVarint(m_payload, ZigZag(slot));
+    Frame(out, FRAME_DEVICE, m_payload);
+}
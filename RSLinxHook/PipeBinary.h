@@ -0,0 +1,89 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+
+// ============================================================
+// Binary pipe framing (negotiated with C|BINARY=1)
+// Pure C++ (no Win32): builds frames into a std::string that the
+// transport then sends with PipeSend.
+//
+// After reading C|BINARY=1 the hook sends one text line
+// "V|BINARY|1\n"; every hook → client byte after it is a frame:
+//
+//   u8 type | varint payloadLen | payload
+//
+// varint = unsigned LEB128. Unknown types can be skipped by length.
+// Strings are interned per session: the first use of a string sends
+// a STRING frame (varint id, UTF-8 bytes) and records refer to the id.
+// Client → hook traffic stays text (C|, Q|, B|, STOP).
+// ============================================================
+
+#define PIPE_BINARY_VERSION 1
+
+enum PipeFrameType : unsigned char {
+    FRAME_LOG        = 0x01,   // UTF-8 text
+    FRAME_STATUS     = 0x02,   // varint total, identified, events, address space KB, sinks, addresses
+    FRAME_XML_BEGIN  = 0x03,   // (empty)
+    FRAME_XML_DATA   = 0x04,   // raw XML bytes
+    FRAME_XML_END    = 0x05,   // (empty)
+    FRAME_NODE_BEGIN = 0x06,   // u8 0 = full block, 1 = delta block
+    FRAME_NODE       = 0x07,   // see BinaryNodeRecord
+    FRAME_NODE_END   = 0x08,   // (empty)
+    FRAME_STRING     = 0x09,   // varint id, UTF-8 bytes
+    FRAME_RESULT     = 0x0A,   // u8 found (2 = found, stale; 3 = found, pending; 4 = not found, pending)
+                               //   found: varint class, name, ip ids, zigzag slot
+                               //   not found: varint path id
+    FRAME_DONE       = 0x0B,   // (empty)
+    FRAME_RESULT_TAGGED = 0x0C,   // varint request id, then a FRAME_RESULT payload (QB|)
+    FRAME_PERF       = 0x0D,   // UTF-8 text of one P| stats line, without "P|"
+    FRAME_DEVICE     = 0x0E,   // u8 stale, varint ip, port, class, name ids, zigzag slot (C|STREAM=1)
+};
+
+// FRAME_NODE payload: u8 op, varint pathId (0 = none, else id + 1), u8 kind,
+// then by kind: ROOT/BUS  varint name, classname
+//               ADDR      varint addrType, value, deviceName, classname
+//               PUSH/POP  (nothing)
+// op DEL carries only the path (kind byte omitted).
+enum BinaryNodeOp : unsigned char { NODE_OP_ENTRY = 0, NODE_OP_ADD, NODE_OP_MOD, NODE_OP_DEL };
+enum BinaryNodeKind : unsigned char { NODE_ROOT = 0, NODE_BUS, NODE_ADDR, NODE_PUSH, NODE_POP };
+
+struct BinaryNodeRecord {
+    BinaryNodeKind kind = NODE_ROOT;
+    std::string f[4];       // UTF-8, unescaped: ROOT/BUS use f[0..1], ADDR f[0..3]
+};
+
+class BinaryEncoder
+{
+public:
+    void Reset();           // new session: forget every interned string
+
+    void Log(std::string& out, const char* utf8, size_t len);
+    void Status(std::string& out, int total, int identified, int events,
+                unsigned addressSpaceKB, int sinks, int addresses);
+    void Empty(std::string& out, PipeFrameType type);
+    void Bytes(std::string& out, PipeFrameType type, const char* data, size_t len);
+    void NodeBegin(std::string& out, bool delta);
+    void Node(std::string& out, BinaryNodeOp op, const std::string& path, const BinaryNodeRecord& rec);
+    void NodeDel(std::string& out, const std::string& path);
+    // tag >= 0: a QB| batch answer, sent as FRAME_RESULT_TAGGED
+    void Result(std::string& out, const std::string& classname, const std::string& deviceName,
+                const std::string& ip, int slot, int tag = -1, bool stale = false,
+                bool pending = false);
+    void ResultNotFound(std::string& out, const std::string& path, int tag = -1,
+                        bool pending = false);
+    void Device(std::string& out, const std::string& ip, const std::string& portName, int slot,
+                const std::string& classname, const std::string& deviceName, bool stale);
+
+    size_t StringCount() const { return m_ids.size(); }
+
+private:
+    // Id for s, appending its STRING frame to out on first use
+    unsigned Intern(std::string& out, const std::string& s);
+    static void Frame(std::string& out, PipeFrameType type, const std::string& payload);
+    void BeginResult(int tag);  // m_payload = [varint tag]
+
+    std::unordered_map<std::string, unsigned> m_ids;
+    std::string m_payload;  // scratch, reused across records
+};
+
+void BinaryAppendVarint(std::string& out, unsigned v);
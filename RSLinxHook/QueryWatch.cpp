@@ -0,0 +1,348 @@
+#include "QueryWatch.h"
+#include "TopologyXML.h"
+#include "Logging.h"
+#include <unordered_map>
+
+// ============================================================
+// Watch list — written by session threads (W|, disconnect) and read
+// by the worker after each cache refresh, all under s_watchLock.
+// Replies are sent after s_watchLock is released, under the session's
+// sendLock, taken before the release so a session's answers cannot
+// overtake each other.
+// ============================================================
+
+struct QueryWatch {
+    std::string path;
+    int tag;                   // W|<id>|path; -1 for W|path
+    std::wstring ip, portName;
+    int slot;
+    // Last state sent to the session
+    bool found;
+    std::wstring classname, deviceName;
+};
+
+// One session's watches, indexed by path
+struct SessionWatches {
+    PipeSession* session;      // referenced while listed
+    SRWLOCK sendLock;
+    std::vector<QueryWatch> watches;
+    std::unordered_map<std::string, size_t> byPath;   // path -> index in watches
+};
+
+static SRWLOCK s_watchLock = SRWLOCK_INIT;
+static std::vector<SessionWatches*> s_watchSessions;   // at most PIPE_MAX_CLIENTS
+
+// s_watchLock held
+static SessionWatches* FindSessionWatches(PipeSession* session)
+{
+    for (SessionWatches* sw : s_watchSessions)
+        if (sw->session == session) return sw;
+    return nullptr;
+}
+
+// Same rule as a Q| answer. g_deviceStoreLock held shared.
+static bool LookupWatched(const QueryWatch& w, QueryResult& hit)
+{
+    bool found = g_deviceStore.Lookup(w.ip, w.portName, w.slot, hit);
+    hit.stale = g_cacheStale;
+    return found && hit.classname != L"Unrecognized Device";
+}
+
+// One R| line to the frame's targets, from the watch's recorded state
+static void SendWatched(const QueryWatch& w, bool stale)
+{
+    if (!w.found)
+    {
+        PipeSendResult(false, nullptr, nullptr, nullptr, 0, w.path.c_str(), w.tag);
+        return;
+    }
+    char classA[128] = {}, nameA[256] = {}, ipA[64] = {};
+    WideCharToMultiByte(CP_UTF8, 0, w.classname.c_str(), -1, classA, sizeof(classA), NULL, NULL);
+    WideCharToMultiByte(CP_UTF8, 0, w.deviceName.c_str(), -1, nameA, sizeof(nameA), NULL, NULL);
+    WideCharToMultiByte(CP_UTF8, 0, w.ip.c_str(), -1, ipA, sizeof(ipA), NULL, NULL);
+    PipeSendResult(true, classA, nameA, ipA, w.slot, w.path.c_str(), w.tag, stale);
+}
+
+bool AddQueryWatch(PipeSession* session, const char* path, int tag,
+                   const std::wstring& ip, const std::wstring& portName, int slot,
+                   bool cacheOnly)
+{
+    QueryWatch w = { path, tag, ip, portName, slot, false };
+    QueryResult hit;
+
+    AcquireSRWLockExclusive(&s_watchLock);
+    AcquireSRWLockShared(&g_deviceStoreLock);
+    w.found = LookupWatched(w, hit);
+    ReleaseSRWLockShared(&g_deviceStoreLock);
+    if (cacheOnly && !w.found)
+    {
+        ReleaseSRWLockExclusive(&s_watchLock);
+        return false;
+    }
+    w.classname = hit.classname;
+    w.deviceName = hit.deviceName;
+
+    SessionWatches* sw = FindSessionWatches(session);
+    if (!sw)
+    {
+        sw = new SessionWatches();
+        sw->session = session;
+        InitializeSRWLock(&sw->sendLock);
+        PipeSessionAddRef(session);
+        s_watchSessions.push_back(sw);
+    }
+    auto existing = sw->byPath.find(w.path);
+    if (existing != sw->byPath.end())
+    {
+        sw->watches[existing->second] = w;
+    }
+    else if (sw->watches.size() < QUERY_WATCH_MAX)
+    {
+        sw->byPath[w.path] = sw->watches.size();
+        sw->watches.push_back(w);
+    }
+    else
+    {
+        Log(L"[WATCH] Client %d: over the %d-path limit, '%hs' answered but not watched",
+            session->id, QUERY_WATCH_MAX, path);
+    }
+
+    // No refresh can push to the session between this state and its answer
+    AcquireSRWLockExclusive(&sw->sendLock);
+    ReleaseSRWLockExclusive(&s_watchLock);
+    PipeBeginReply(session);
+    SendWatched(w, hit.stale);
+    PipeSendDone();
+    PipeEndReply();
+    ReleaseSRWLockExclusive(&sw->sendLock);
+
+    Log(L"[WATCH] Client %d: watching '%hs' (%s)", session->id, path,
+        w.found ? L"found" : L"not found");
+    return true;
+}
+
+static int NotifyQueryWatches()
+{
+    struct Changes {
+        SessionWatches* sw;
+        std::vector<QueryWatch> watches;   // copies of the new states
+    };
+    std::vector<Changes> changes;
+    int changed = 0, watches = 0;
+
+    AcquireSRWLockExclusive(&s_watchLock);
+    AcquireSRWLockShared(&g_deviceStoreLock);
+    bool stale = g_cacheStale;
+    for (SessionWatches* sw : s_watchSessions)
+    {
+        Changes c = { sw };
+        for (QueryWatch& w : sw->watches)
+        {
+            QueryResult hit;
+            bool found = LookupWatched(w, hit);
+            if (found == w.found &&
+                (!found || (hit.classname == w.classname && hit.deviceName == w.deviceName)))
+                continue;
+            w.found = found;
+            w.classname = hit.classname;
+            w.deviceName = hit.deviceName;
+            c.watches.push_back(w);
+        }
+        watches += (int)sw->watches.size();
+        changed += (int)c.watches.size();
+        if (!c.watches.empty()) changes.push_back(std::move(c));
+    }
+    ReleaseSRWLockShared(&g_deviceStoreLock);
+    for (auto& c : changes)
+        AcquireSRWLockExclusive(&c.sw->sendLock);
+    ReleaseSRWLockExclusive(&s_watchLock);
+
+    // One reply frame per session
+    for (auto& c : changes)
+    {
+        PipeBeginReply(c.sw->session);
+        for (const auto& w : c.watches)
+            SendWatched(w, stale);
+        PipeEndReply();
+        ReleaseSRWLockExclusive(&c.sw->sendLock);
+    }
+
+    if (changed)
+        Log(L"[WATCH] %d of %d watched path(s) changed", changed, watches);
+    return changed;
+}
+
+// ============================================================
+// Device streams — added by session threads (C|STREAM=1), fed by the
+// worker after each cache refresh, all under s_streamLock
+// ============================================================
+
+struct StreamedEntry {
+    std::wstring classname, deviceName;
+    bool stale;
+};
+
+struct DeviceStream {
+    PipeSession* session;      // referenced while streamed
+    std::unordered_map<std::wstring, StreamedEntry> sent;   // path -> last record sent
+};
+
+struct StreamRecord {
+    std::wstring ip, portName, classname, deviceName;
+    int slot;
+};
+
+static SRWLOCK s_streamLock = SRWLOCK_INIT;
+static std::vector<DeviceStream> s_streams;
+
+// Identified store entries the stream has not been sent in their current
+// state; records them as sent. g_deviceStoreLock held shared.
+static void CollectStreamUpdates(DeviceStream& ds, bool stale, std::vector<StreamRecord>& out)
+{
+    auto consider = [&](const std::wstring& ip, const std::wstring& portName, int slot,
+                        const std::wstring& classname, const std::wstring& deviceName) {
+        if (!IsIdentifiedClassname(classname)) return;
+        std::wstring path = ip;
+        if (slot >= 0) path += L"\\" + portName + L"\\" + std::to_wstring(slot);
+        StreamedEntry& e = ds.sent[path];
+        if (e.classname == classname && e.deviceName == deviceName && e.stale == stale) return;
+        e.classname = classname;
+        e.deviceName = deviceName;
+        e.stale = stale;
+        out.push_back({ ip, portName, classname, deviceName, slot });
+    };
+
+    for (const auto& kv : g_deviceStore.Devices())
+    {
+        const DeviceRecord& dev = kv.second;
+        consider(dev.ip, std::wstring(), -1, dev.classname, dev.deviceName);
+        for (const auto& table : dev.ports)
+        {
+            const std::wstring& portName = g_deviceStore.PortName(table.portId);
+            for (size_t slot = 0; slot < table.slots.size(); slot++)
+            {
+                const SlotEntry& se = table.slots[slot];
+                if (se.present)
+                    consider(dev.ip, portName, (int)slot, se.classname, se.deviceName);
+            }
+        }
+    }
+}
+
+// One I| line to the frame's targets
+static void SendStreamed(const StreamRecord& r, bool stale)
+{
+    char ipA[64] = {}, portA[128] = {}, classA[128] = {}, nameA[256] = {};
+    WideCharToMultiByte(CP_UTF8, 0, r.ip.c_str(), -1, ipA, sizeof(ipA), NULL, NULL);
+    WideCharToMultiByte(CP_UTF8, 0, r.portName.c_str(), -1, portA, sizeof(portA), NULL, NULL);
+    WideCharToMultiByte(CP_UTF8, 0, r.classname.c_str(), -1, classA, sizeof(classA), NULL, NULL);
+    WideCharToMultiByte(CP_UTF8, 0, r.deviceName.c_str(), -1, nameA, sizeof(nameA), NULL, NULL);
+    PipeSendDevice(ipA, portA, r.slot, classA, nameA, stale);
+}
+
+void AddDeviceStream(PipeSession* session)
+{
+    AcquireSRWLockExclusive(&s_streamLock);
+    for (const auto& ds : s_streams)
+    {
+        if (ds.session == session)
+        {
+            ReleaseSRWLockExclusive(&s_streamLock);
+            return;
+        }
+    }
+    PipeSessionAddRef(session);
+    s_streams.push_back(DeviceStream());
+    DeviceStream& ds = s_streams.back();
+    ds.session = session;
+
+    std::vector<StreamRecord> records;
+    AcquireSRWLockShared(&g_deviceStoreLock);
+    bool stale = g_cacheStale;
+    CollectStreamUpdates(ds, stale, records);
+    ReleaseSRWLockShared(&g_deviceStoreLock);
+
+    // Sent under the lock: no refresh can push a record ahead of these
+    PipeBeginReply(session);
+    for (const auto& r : records)
+        SendStreamed(r, stale);
+    PipeEndReply();
+    ReleaseSRWLockExclusive(&s_streamLock);
+
+    Log(L"[STREAM] Client %d: streaming devices (%d cached)", session->id, (int)records.size());
+}
+
+bool HasDeviceStreams()
+{
+    AcquireSRWLockShared(&s_streamLock);
+    bool any = !s_streams.empty();
+    ReleaseSRWLockShared(&s_streamLock);
+    return any;
+}
+
+static int NotifyDeviceStreams()
+{
+    AcquireSRWLockExclusive(&s_streamLock);
+    if (s_streams.empty())
+    {
+        ReleaseSRWLockExclusive(&s_streamLock);
+        return 0;
+    }
+    std::vector<std::vector<StreamRecord>> records(s_streams.size());
+    AcquireSRWLockShared(&g_deviceStoreLock);
+    bool stale = g_cacheStale;
+    for (size_t i = 0; i < s_streams.size(); i++)
+        CollectStreamUpdates(s_streams[i], stale, records[i]);
+    ReleaseSRWLockShared(&g_deviceStoreLock);
+
+    int sent = 0;
+    for (size_t i = 0; i < s_streams.size(); i++)
+    {
+        if (records[i].empty()) continue;
+        PipeBeginReply(s_streams[i].session);
+        for (const auto& r : records[i])
+            SendStreamed(r, stale);
+        PipeEndReply();
+        sent += (int)records[i].size();
+    }
+    int streams = (int)s_streams.size();
+    ReleaseSRWLockExclusive(&s_streamLock);
+
+    if (sent)
+        Log(L"[STREAM] %d device record(s) to %d stream(s)", sent, streams);
+    return sent;
+}
+
+int NotifyCacheSubscribers()
+{
+    return NotifyQueryWatches() + NotifyDeviceStreams();
+}
+
+void DropCacheSubscriptions(PipeSession* session)
+{
+    AcquireSRWLockExclusive(&s_streamLock);
+    for (auto it = s_streams.begin(); it != s_streams.end(); ++it)
+    {
+        if (it->session != session) continue;
+        PipeSessionRelease(it->session);
+        s_streams.erase(it);
+        break;
+    }
+    ReleaseSRWLockExclusive(&s_streamLock);
+
+    AcquireSRWLockExclusive(&s_watchLock);
+    SessionWatches* sw = FindSessionWatches(session);
+    if (sw)
+        s_watchSessions.erase(std::find(s_watchSessions.begin(), s_watchSessions.end(), sw));
+    ReleaseSRWLockExclusive(&s_watchLock);
+    if (!sw) return;
+
+    // Wait out a reply still being sent from the list
+    AcquireSRWLockExclusive(&sw->sendLock);
+    ReleaseSRWLockExclusive(&sw->sendLock);
+    int dropped = (int)sw->watches.size();
+    PipeSessionRelease(sw->session);
+    delete sw;
+    if (dropped)
+        Log(L"[WATCH] Client %d: %d watch(es) dropped", session->id, dropped);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "RSLinxHook_fwd.h"
+
+// ============================================================
+// Cache subscriptions (W| pipe command, C|STREAM=1)
+// W|path (or W|<id>|path) answers like Q| — R| then D| — and keeps
+// the path's cache entry watched for the rest of the session. After
+// every query cache refresh the worker calls NotifyCacheSubscribers,
+// which pushes one unsolicited R| line (R|<id>|... when tagged, no D|)
+// to each session whose watched entry changed classname or device
+// name, or appeared or disappeared. A change of only the stale flag is
+// not pushed.
+// A device stream (C|STREAM=1) gets one I| record per identified cache
+// entry — every entry cached when it subscribes, then each entry that
+// becomes identified, changes classname or name, or is confirmed by a
+// browse (loses STALE). Entries that disappear are not reported.
+// Lock order: the subscription lists, then g_deviceStoreLock, then
+// g_logCS. Watch replies go out under the session's own send lock,
+// taken before the watch list's is released.
+// ============================================================
+
+// Watched paths per session; further W| lines are answered but not kept
+#define QUERY_WATCH_MAX 10000
+
+// Register the watch and send its first answer as one reply to session.
+// With cacheOnly (session thread) nothing is registered or sent if the
+// entry is not cached yet, and false is returned: hand the path to the
+// worker, which browses and calls again without cacheOnly.
+// Re-watching a path replaces its tag.
+bool AddQueryWatch(PipeSession* session, const char* path, int tag,
+                   const std::wstring& ip, const std::wstring& portName, int slot,
+                   bool cacheOnly);
+
+// Session thread, before its config reaches the worker: send every
+// identified entry cached so far, then keep the session streamed.
+void AddDeviceStream(PipeSession* session);
+// Any session streamed: the worker then feeds its poll snapshots into
+// the cache, so records go out while a browse is still running
+bool HasDeviceStreams();
+
+// Worker: after PopulateQueryCache, RefreshQueryCache or
+// ApplyTopologyWalk. Returns the number of R| and I| lines sent.
+int NotifyCacheSubscribers();
+
+// Session thread, on disconnect: forget the session's watches and stream
+void DropCacheSubscriptions(PipeSession* session);
@@ -15,7 +15,9 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <deque>
 #include <set>
+#include <algorithm>
 
 // Forward declarations
 enum class HookMode;
@@ -27,6 +29,7 @@ struct TopologyCounts;
 struct ConnectionPointInfo;
 struct EnumeratorInfo;
 class DualEventSink;
+struct PipeSession;
 
 // Function pointer type for main-STA execution
 typedef HRESULT (*MainSTAFunc)();
@@ -78,6 +78,40 @@ HRESULT TryStartAtSlot(void* pInterface, IUnknown* pPath, int slot)
     return hr;
 }
 
+// SEH-safe no-argument vtable call: pInterface->vtable[slot]()
+// E_UNEXPECTED if the call faulted
+HRESULT TryVtableStop(void* pInterface, int slot)
+{
+    typedef HRESULT (__stdcall *StopFunc)(void* pThis);
+    HRESULT hr = E_FAIL;
+    __try
+    {
+        void** vtable = *(void***)pInterface;
+        StopFunc pfn = (StopFunc)vtable[slot];
+        hr = pfn(pInterface);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        hr = E_UNEXPECTED;
+    }
+    return hr;
+}
+
+// SEH-safe IConnectionPoint::Unadvise, E_UNEXPECTED if the call faulted
+HRESULT TryUnadvise(IConnectionPoint* pCP, DWORD cookie)
+{
+    HRESULT hr = E_FAIL;
+    __try
+    {
+        hr = pCP->Unadvise(cookie);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        hr = E_UNEXPECTED;
+    }
+    return hr;
+}
+
 // SEH-safe vtable call: pInterface->vtable[slot](&ppResult)
 // For methods like GetBackplanePort, GetBus that return a single IUnknown** out param
 HRESULT TryVtableGetObject(void* pInterface, int slot, IUnknown** ppResult)
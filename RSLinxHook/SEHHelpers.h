@@ -11,6 +11,9 @@
 bool SafeVariantToString(VARIANT* pAddr, wchar_t* outBuf, int bufLen);
 bool SafeReadMemory(void* pAddr, BYTE* outBuf, int bytes);
 HRESULT TryStartAtSlot(void* pInterface, IUnknown* pPath, int slot);
+// pInterface->vtable[slot]() — enumerator Stop is slot 8
+HRESULT TryVtableStop(void* pInterface, int slot);
+HRESULT TryUnadvise(IConnectionPoint* pCP, DWORD cookie);
 HRESULT TryVtableGetObject(void* pInterface, int slot, IUnknown** ppResult);
 HRESULT TryVtableGetLabel(IUnknown* pObj, int slot, std::wstring& outLabel);
 HRESULT TryVtableAddPort(void* pDevice, int slot, GUID* pClsid,
@@ -1,5 +1,7 @@
 #include "STAHook.h"
 #include "Logging.h"
+#include "Perf.h"
+#include <malloc.h>
 
 // ============================================================
 // STAHook globals
@@ -13,6 +15,106 @@ volatile LONG g_browseResult = (LONG)E_PENDING;
 HookConfig* g_pSharedConfig = nullptr;
 WNDPROC g_origWndProc = nullptr;
 
+// ============================================================
+// Main-STA work queue
+// Producers push onto a lock-free SLIST (MPSC); the thread that
+// takes the list from empty to non-empty posts one WM_NULL, and the
+// hook drains everything queued by then in one pass (FIFO). The
+// WH_GETMESSAGE hook stays installed until ShutdownMainSTAQueue.
+// ============================================================
+
+enum MainSTAItemState : LONG { ItemQueued = 0, ItemRunning, ItemDone, ItemCancelled };
+
+struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) MainSTAWorkItem
+{
+    SLIST_ENTRY entry;          // must be first
+    MainSTAFunc func;
+    HANDLE hDone;               // manual-reset, set when ItemDone
+    volatile LONG state;
+    volatile LONG result;
+    volatile LONG refs;         // caller + queue
+    LONGLONG queuedAt;          // PerfNow at creation (PERF_MAIN_STA_WAIT)
+};
+
+static SLIST_HEADER s_workQueue;
+static volatile LONG s_queueInit = 0;   // 0 = no, 1 = initializing, 2 = ready
+static HHOOK s_hPersistentHook = NULL;
+static volatile LONG s_batchesRun = 0;
+
+static void InitWorkQueue()
+{
+    if (InterlockedCompareExchange(&s_queueInit, 1, 0) == 0)
+    {
+        InitializeSListHead(&s_workQueue);
+        InterlockedExchange(&s_queueInit, 2);
+    }
+    while (s_queueInit != 2) Sleep(0);
+}
+
+static MainSTAWorkItem* NewWorkItem(MainSTAFunc func)
+{
+    void* mem = _aligned_malloc(sizeof(MainSTAWorkItem), MEMORY_ALLOCATION_ALIGNMENT);
+    if (!mem) return nullptr;
+    MainSTAWorkItem* item = (MainSTAWorkItem*)mem;
+    memset(item, 0, sizeof(*item));
+    item->func = func;
+    item->hDone = CreateEventW(NULL, TRUE, FALSE, NULL);
+    item->state = ItemQueued;
+    item->result = (LONG)E_PENDING;
+    item->refs = 2;
+    item->queuedAt = PerfNow();
+    if (!item->hDone) { _aligned_free(mem); return nullptr; }
+    return item;
+}
+
+static void ReleaseWorkItem(MainSTAWorkItem* item)
+{
+    if (InterlockedDecrement(&item->refs) == 0)
+    {
+        CloseHandle(item->hDone);
+        _aligned_free(item);
+    }
+}
+
+// Runs on the main STA: execute every item queued so far, oldest first
+static void DrainWorkQueue()
+{
+    PSLIST_ENTRY list = InterlockedFlushSList(&s_workQueue);
+    if (!list) return;
+
+    // SLIST is LIFO — reverse to submission order
+    PSLIST_ENTRY fifo = nullptr;
+    while (list)
+    {
+        PSLIST_ENTRY next = list->Next;
+        list->Next = fifo;
+        fifo = list;
+        list = next;
+    }
+
+    int count = 0;
+    while (fifo)
+    {
+        MainSTAWorkItem* item = CONTAINING_RECORD(fifo, MainSTAWorkItem, entry);
+        fifo = fifo->Next;
+
+        if (InterlockedCompareExchange(&item->state, ItemRunning, ItemQueued) == ItemQueued)
+        {
+            PerfRecord(PERF_MAIN_STA_WAIT, item->queuedAt);
+            HRESULT hr = item->func ? item->func() : E_POINTER;
+            InterlockedExchange(&item->result, (LONG)hr);
+            InterlockedExchange(&item->state, ItemDone);
+            SetEvent(item->hDone);
+            count++;
+        }
+        ReleaseWorkItem(item);
+    }
+    InterlockedIncrement(&s_batchesRun);
+    if (count > 1)
+        Log(L"[HOOK] Batch of %d requests on TID=%d", count, GetCurrentThreadId());
+}
+
+
 // ============================================================
 // STAHook implementations
 // ============================================================
@@ -60,21 +162,13 @@ DWORD FindMainThreadId()
 // WH_GETMESSAGE hook callback — runs on MAIN STA thread
 LRESULT CALLBACK MainSTAHookProc(int code, WPARAM wp, LPARAM lp)
 {
-    if (code >= 0)
+    if (code >= 0 && wp == PM_REMOVE)
     {
         MSG* pMsg = (MSG*)lp;
         if (pMsg->message == WM_NULL && pMsg->wParam == HOOK_MAGIC_WPARAM)
-        {
-            if (InterlockedCompareExchange(&g_browseRequested, 0, 1) == 1)
-            {
-                Log(L"[HOOK] Processing request on TID=%d", GetCurrentThreadId());
-                HRESULT hr = g_pMainSTAFunc ? g_pMainSTAFunc() : E_POINTER;
-                InterlockedExchange(&g_browseResult, (LONG)hr);
-                Log(L"[HOOK] Result: 0x%08x", hr);
-            }
-        }
+            DrainWorkQueue();
     }
-    return CallNextHookEx(g_hHook, code, wp, lp);
+    return CallNextHookEx(s_hPersistentHook, code, wp, lp);
 }
 
 // Window subclass fallback WndProc
@@ -102,75 +196,9 @@ BOOL CALLBACK FindThreadWindowProc(HWND hwnd, LPARAM lParam)
     return FALSE;  // Stop after first window
 }
 
-// Execute a function on the main STA thread.
-// Tries SetWindowsHookEx first, falls back to window subclass.
-HRESULT ExecuteOnMainSTA(MainSTAFunc func)
+// Subclass fallback: run one function synchronously via SendMessage
+static HRESULT ExecuteViaSubclass(MainSTAFunc func)
 {
-    Log(L"=== ExecuteOnMainSTA ===");
-
-    g_pMainSTAFunc = func;
-
-    // Find main thread
-    g_mainThreadId = FindMainThreadId();
-    Log(L"  Main thread TID: %d (our TID: %d)", g_mainThreadId, GetCurrentThreadId());
-
-    if (g_mainThreadId == 0 || g_mainThreadId == GetCurrentThreadId())
-    {
-        Log(L"  FAIL: Could not find main thread (or we ARE the main thread)");
-        return E_FAIL;
-    }
-
-    // --- Try 1: SetWindowsHookEx(WH_GETMESSAGE) ---
-    Log(L"  Trying SetWindowsHookEx(WH_GETMESSAGE)...");
-    InterlockedExchange(&g_browseRequested, 1);
-    InterlockedExchange(&g_browseResult, (LONG)E_PENDING);
-
-    g_hHook = SetWindowsHookExW(WH_GETMESSAGE, MainSTAHookProc,
-                                 GetModuleHandle(NULL), g_mainThreadId);
-    if (g_hHook)
-    {
-        Log(L"  Hook installed: 0x%p", g_hHook);
-
-        // Post WM_NULL with magic wParam to trigger the hook
-        BOOL posted = PostThreadMessageW(g_mainThreadId, WM_NULL, HOOK_MAGIC_WPARAM, 0);
-        Log(L"  PostThreadMessage: %s", posted ? L"OK" : L"FAILED");
-
-        if (posted)
-        {
-            // Wait for result (up to 30s)
-            DWORD t0 = GetTickCount();
-            while (!g_shouldStop && InterlockedCompareExchange(&g_browseResult, 0, 0) == (LONG)E_PENDING)
-            {
-                if (GetTickCount() - t0 > 30000)
-                {
-                    Log(L"  TIMEOUT waiting for hook result after 30s");
-                    break;
-                }
-                Sleep(100);
-            }
-        }
-        else
-        {
-            Log(L"  PostThreadMessage failed (err=%d), will try fallback", GetLastError());
-            InterlockedExchange(&g_browseRequested, 1);
-        }
-
-        UnhookWindowsHookEx(g_hHook);
-        g_hHook = NULL;
-
-        HRESULT result = (HRESULT)InterlockedCompareExchange(&g_browseResult, 0, 0);
-        if (result != (LONG)E_PENDING)
-        {
-            Log(L"  Hook approach result: 0x%08x", result);
-            return result;
-        }
-    }
-    else
-    {
-        Log(L"  SetWindowsHookEx failed: %d", GetLastError());
-    }
-
-    // --- Try 2: Window subclass fallback ---
     Log(L"  Trying window subclass fallback...");
     HWND hTargetWnd = NULL;
     EnumThreadWindows(g_mainThreadId, FindThreadWindowProc, (LPARAM)&hTargetWnd);
@@ -186,6 +214,7 @@ HRESULT ExecuteOnMainSTA(MainSTAFunc func)
     Log(L"  Found window: HWND=0x%p class=\"%s\"", hTargetWnd, cls);
 
     // Subclass the window
+    g_pMainSTAFunc = func;
     InterlockedExchange(&g_browseRequested, 1);
     InterlockedExchange(&g_browseResult, (LONG)E_PENDING);
 
@@ -209,3 +238,167 @@ HRESULT ExecuteOnMainSTA(MainSTAFunc func)
         return E_FAIL;
     }
 }
+
+// Find the main thread and install the persistent WH_GETMESSAGE hook (once).
+static bool EnsureMainSTAHook()
+{
+    if (s_hPersistentHook) return true;
+
+    g_mainThreadId = FindMainThreadId();
+    Log(L"  Main thread TID: %d (our TID: %d)", g_mainThreadId, GetCurrentThreadId());
+    if (g_mainThreadId == 0 || g_mainThreadId == GetCurrentThreadId())
+    {
+        Log(L"  FAIL: Could not find main thread (or we ARE the main thread)");
+        return false;
+    }
+
+    s_hPersistentHook = SetWindowsHookExW(WH_GETMESSAGE, MainSTAHookProc,
+                                          GetModuleHandle(NULL), g_mainThreadId);
+    g_hHook = s_hPersistentHook;
+    if (!s_hPersistentHook)
+    {
+        Log(L"  SetWindowsHookEx failed: %d", GetLastError());
+        return false;
+    }
+    Log(L"  Persistent hook installed: 0x%p", s_hPersistentHook);
+    return true;
+}
+
+// Take every still-queued item off the queue and complete it as cancelled
+// with hr, so its waiter stops waiting (and may fall back).
+static void AbandonQueuedItems(HRESULT hr)
+{
+    PSLIST_ENTRY list = InterlockedFlushSList(&s_workQueue);
+    while (list)
+    {
+        MainSTAWorkItem* item = CONTAINING_RECORD(list, MainSTAWorkItem, entry);
+        list = list->Next;
+        if (InterlockedCompareExchange(&item->state, ItemCancelled, ItemQueued) == ItemQueued)
+        {
+            InterlockedExchange(&item->result, (LONG)hr);
+            SetEvent(item->hDone);
+        }
+        ReleaseWorkItem(item);
+    }
+}
+
+// Push items and post one wake-up if the queue was empty before them
+static bool SubmitWorkItems(MainSTAWorkItem** items, int count)
+{
+    bool wasEmpty = false;
+    for (int i = 0; i < count; i++)
+        if (InterlockedPushEntrySList(&s_workQueue, &items[i]->entry) == nullptr)
+            wasEmpty = true;
+    if (!wasEmpty) return true;   // a wake-up is already on its way
+
+    if (PostThreadMessageW(g_mainThreadId, WM_NULL, HOOK_MAGIC_WPARAM, 0))
+        return true;
+
+    // No wake-up coming: empty the queue so later submits post again
+    Log(L"  PostThreadMessage failed (err=%d)", GetLastError());
+    AbandonQueuedItems(E_PENDING);
+    return false;
+}
+
+// Wait for one item. Gives up only while it is still queued (cancelling
+// it); an item already running is waited out unless the DLL is stopping.
+// cancelled: the item never ran.
+static HRESULT WaitWorkItem(MainSTAWorkItem* item, DWORD timeoutMs, bool& cancelled)
+{
+    cancelled = false;
+    DWORD t0 = GetTickCount();
+    HANDLE handles[2] = { item->hDone, g_hStopEvent };
+    DWORD nHandles = g_hStopEvent ? 2 : 1;
+
+    while (true)
+    {
+        DWORD w = WaitForMultipleObjects(nHandles, handles, FALSE, 250);
+        if (w == WAIT_OBJECT_0)
+        {
+            cancelled = (item->state == ItemCancelled);
+            return (HRESULT)item->result;
+        }
+
+        if (!g_shouldStop && GetTickCount() - t0 <= timeoutMs) continue;
+        if (InterlockedCompareExchange(&item->state, ItemCancelled, ItemQueued) == ItemQueued)
+        {
+            cancelled = true;
+            return E_PENDING;
+        }
+        if (g_shouldStop) return E_ABORT;   // running; finishes on its own
+    }
+}
+
+HRESULT ExecuteOnMainSTABatch(const MainSTAFunc* funcs, int count, HRESULT* results)
+{
+    Log(L"=== ExecuteOnMainSTA (%d request%s) ===", count, count == 1 ? L"" : L"s");
+    PerfScope perf(PERF_MAIN_STA_CALL);
+    if (count <= 0) return S_OK;
+    InitWorkQueue();
+
+    std::vector<MainSTAWorkItem*> items;
+    items.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        MainSTAWorkItem* item = NewWorkItem(funcs[i]);
+        if (!item) break;
+        items.push_back(item);
+    }
+    if ((int)items.size() < count)
+    {
+        for (auto* item : items) { ReleaseWorkItem(item); ReleaseWorkItem(item); }
+        return E_OUTOFMEMORY;
+    }
+
+    bool hooked = EnsureMainSTAHook();
+    // Once pushed, the queue (drain or abandon) owns one reference
+    if (hooked) SubmitWorkItems(items.data(), count);
+
+    HRESULT first = S_OK;
+    for (int i = 0; i < count; i++)
+    {
+        MainSTAWorkItem* item = items[i];
+        bool cancelled = true;
+        HRESULT hr = E_PENDING;
+        if (hooked)
+        {
+            hr = WaitWorkItem(item, 30000, cancelled);
+            if (cancelled && item->result == (LONG)E_PENDING)
+                Log(L"  Request did not start on the main thread");
+        }
+
+        if (cancelled && !g_shouldStop)
+            hr = ExecuteViaSubclass(item->func);
+
+        if (results) results[i] = hr;
+        if (i == 0) first = hr;
+        ReleaseWorkItem(item);
+        if (!hooked) ReleaseWorkItem(item);   // never reached the queue
+    }
+    return first;
+}
+
+// Execute a function on the main STA thread via the persistent hook queue.
+// Falls back to a window subclass if the hook cannot be installed or the
+// request never starts within 30 s.
+HRESULT ExecuteOnMainSTA(MainSTAFunc func)
+{
+    HRESULT hr = E_PENDING;
+    ExecuteOnMainSTABatch(&func, 1, &hr);
+    Log(L"  Result: 0x%08x", hr);
+    return hr;
+}
+
+void ShutdownMainSTAQueue()
+{
+    if (s_hPersistentHook)
+    {
+        UnhookWindowsHookEx(s_hPersistentHook);
+        s_hPersistentHook = NULL;
+        g_hHook = NULL;
+        Log(L"[HOOK] Persistent hook removed (%d batches run)", (int)s_batchesRun);
+    }
+    // Anything still queued will never run now
+    if (s_queueInit == 2)
+        AbandonQueuedItems(E_ABORT);
+}
@@ -17,6 +17,12 @@ extern WNDPROC g_origWndProc;
 
 DWORD FindMainThreadId();
 HRESULT ExecuteOnMainSTA(MainSTAFunc func);
+// Queue several functions at once; they run back to back in one main-thread
+// pass, in order. results[i] gets each HRESULT; returns results[0].
+HRESULT ExecuteOnMainSTABatch(const MainSTAFunc* funcs, int count, HRESULT* results);
+// Remove the persistent hook and abandon anything still queued (E_ABORT).
+// Call once on the way out, after the last ExecuteOnMainSTA.
+void ShutdownMainSTAQueue();
 
 // Callbacks (accessible for hook registration)
 LRESULT CALLBACK MainSTAHookProc(int code, WPARAM wp, LPARAM lp);
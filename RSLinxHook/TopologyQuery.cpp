@@ -0,0 +1,413 @@
+#include "TopologyXML.h"
+#include "TopologySnapshot.h"
+#include "Config.h"
+#include "Logging.h"
+#include "Perf.h"
+
+// ============================================================
+// Topology queries and the device cache
+// The COM-free half of TopologyXML.h: everything that reads a parsed
+// TopologySnapshot or the device store. Kept apart from the capture
+// and N| walk code so TestQueryXML can link it without COM or the pipe.
+// ============================================================
+
+static std::string WideToUtf8(const std::wstring& w)
+{
+    if (w.empty()) return "";
+    int n = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(),
+                                nullptr, 0, nullptr, nullptr);
+    std::string s(n, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(),
+                        &s[0], n, nullptr, nullptr);
+    return s;
+}
+
+// Device attached at an <address> node: its first <device> child, with
+// <device reference="GUID"/> resolved through the objectid index. -1 if none.
+static int AddressDevice(const TopologySnapshot& snap, int addrIdx)
+{
+    return snap.ResolveDevice(snap.FirstChildOfKind(addrIdx, TopoKind::Device));
+}
+
+static bool IsIPAddress(const TopoNode& n)
+{
+    return n.kind == TopoKind::Address && n.type == "String";
+}
+
+static bool IsSlotAddress(const TopoNode& n)
+{
+    return n.kind == TopoKind::Address && n.type == "Short";
+}
+
+// ============================================================
+// TopologyQuery globals
+// ============================================================
+
+std::map<std::wstring, DeviceInfo> g_deviceDetails;
+DeviceStore g_deviceStore;
+SRWLOCK g_deviceStoreLock = SRWLOCK_INIT;
+volatile bool g_cacheStale = false;
+
+// ============================================================
+// Snapshot consumers — all read the tree built by ParseTopologyBuffer.
+// The filename overloads parse once and forward; callers that need
+// several results from the same file should load one TopologySnapshot
+// and pass it to each.
+// ============================================================
+
+TopologyCounts CountDevicesInXML(const TopologySnapshot& snap)
+{
+    PerfScope perf(PERF_COUNT_DEVICES);
+    TopologyCounts counts = { 0, 0 };
+    for (const auto& n : snap.nodes)
+    {
+        if (n.kind != TopoKind::Device || n.isReference) continue;
+        counts.totalDevices++;
+        if (IsIdentifiedClassname(n.classname))
+            counts.identifiedDevices++;
+    }
+    return counts;
+}
+
+TopologyCounts CountDevicesInXML(const wchar_t* filename)
+{
+    TopologySnapshot snap;
+    if (!LoadTopologySnapshot(filename, snap)) return { 0, 0 };
+    return CountDevicesInXML(snap);
+}
+
+// Count how many target IPs have been identified (non-Unrecognized) in topology XML
+int CountTargetsIdentifiedInXML(const TopologySnapshot& snap, const std::vector<std::wstring>& targetIPs)
+{
+    PerfScope perf(PERF_COUNT_TARGETS);
+    std::set<std::string> identifiedIPs;
+    for (int i = 0; i < (int)snap.nodes.size(); i++)
+    {
+        if (!IsIPAddress(snap.nodes[i])) continue;
+        int dev = AddressDevice(snap, i);
+        if (dev >= 0 && IsIdentifiedClassname(snap.nodes[dev].classname))
+            identifiedIPs.insert(snap.nodes[i].value);
+    }
+
+    int count = 0;
+    for (auto& wip : targetIPs)
+        if (identifiedIPs.count(WideToUtf8(wip))) count++;
+    return count;
+}
+
+int CountTargetsIdentifiedInXML(const wchar_t* filename, const std::vector<std::wstring>& targetIPs)
+{
+    TopologySnapshot snap;
+    if (!LoadTopologySnapshot(filename, snap)) return 0;
+    return CountTargetsIdentifiedInXML(snap, targetIPs);
+}
+
+// Check if ANY target IP has been identified — backwards compat wrapper
+bool IsTargetIdentifiedInXML(const TopologySnapshot& snap, const std::vector<std::wstring>& targetIPs)
+{
+    return CountTargetsIdentifiedInXML(snap, targetIPs) > 0;
+}
+
+bool IsTargetIdentifiedInXML(const wchar_t* filename, const std::vector<std::wstring>& targetIPs)
+{
+    return CountTargetsIdentifiedInXML(filename, targetIPs) > 0;
+}
+
+// ============================================================
+// Cache-based counting (fallback when SaveTopologyXML fails)
+// Uses g_deviceStore populated by PopulateQueryCache from the
+// last successful XML save.
+// ============================================================
+
+TopologyCounts CountDevicesFromCache()
+{
+    TopologyCounts counts = { 0, 0 };
+    for (const auto& kv : g_deviceStore.Devices())
+    {
+        counts.totalDevices++;
+        if (IsIdentifiedClassname(kv.second.classname))
+            counts.identifiedDevices++;
+    }
+    return counts;
+}
+
+int CountTargetsFromCache(const std::vector<std::wstring>& targetIPs)
+{
+    int count = 0;
+    for (const auto& ip : targetIPs)
+    {
+        const DeviceRecord* dev = g_deviceStore.FindDevice(ip);
+        if (dev && IsIdentifiedClassname(dev->classname))
+            count++;
+    }
+    return count;
+}
+
+// Query topology for a device at an IP/port/slot path.
+// Every <address type="String" value="IP"> is tried in document order
+// (the same device can appear under more than one driver).
+QueryResult QueryXMLForPath(const TopologySnapshot& snap,
+                             const std::wstring& ip,
+                             const std::wstring& portName,
+                             int slot)
+{
+    QueryResult result;
+    result.ip = ip;
+    result.portName = portName;
+    result.slot = slot;
+
+    std::string ipA = WideToUtf8(ip);
+    std::string portA = WideToUtf8(portName);
+
+    for (int i = 0; i < (int)snap.nodes.size(); i++)
+    {
+        const TopoNode& addr = snap.nodes[i];
+        if (!IsIPAddress(addr) || addr.value != ipA) continue;
+
+        int dev = AddressDevice(snap, i);
+        if (dev < 0) continue;
+
+        int target = -1;
+        if (portName.empty())
+        {
+            target = dev;
+        }
+        else
+        {
+            // device → <port name=portName> → <bus> → <address type="Short" value=slot> → device
+            for (int p = snap.nodes[dev].firstChild; p >= 0 && target < 0; p = snap.nodes[p].nextSibling)
+            {
+                if (snap.nodes[p].kind != TopoKind::Port || snap.nodes[p].name != portA) continue;
+                for (int b = snap.nodes[p].firstChild; b >= 0 && target < 0; b = snap.nodes[b].nextSibling)
+                {
+                    if (snap.nodes[b].kind != TopoKind::Bus) continue;
+                    for (int s = snap.nodes[b].firstChild; s >= 0; s = snap.nodes[s].nextSibling)
+                    {
+                        if (!IsSlotAddress(snap.nodes[s]) || atoi(snap.nodes[s].value.c_str()) != slot) continue;
+                        target = AddressDevice(snap, s);
+                        if (target >= 0) break;
+                    }
+                }
+            }
+        }
+        if (target < 0) continue;
+
+        result.found = true;
+        result.classname = Utf8ToWide(snap.nodes[target].classname.c_str());
+        result.deviceName = Utf8ToWide(snap.nodes[target].name.c_str());
+        return result;
+    }
+    return result;
+}
+
+QueryResult QueryXMLForPath(const wchar_t* xmlFile,
+                             const std::wstring& ip,
+                             const std::wstring& portName,
+                             int slot)
+{
+    TopologySnapshot snap;
+    if (!LoadTopologySnapshot(xmlFile, snap))
+    {
+        QueryResult result;
+        result.ip = ip;
+        result.portName = portName;
+        result.slot = slot;
+        return result;
+    }
+    return QueryXMLForPath(snap, ip, portName, slot);
+}
+
+// Cache one <address type="String" value="IP"> subtree: the device itself
+// and every slot device on its named backplane-style ports
+static void CacheAddressSubtree(const TopologySnapshot& snap, int addrIdx)
+{
+    int dev = AddressDevice(snap, addrIdx);
+    if (dev < 0) return;
+
+    DeviceRecord& rec = g_deviceStore.UpsertDevice(Utf8ToWide(snap.nodes[addrIdx].value.c_str()));
+    rec.classname = Utf8ToWide(snap.nodes[dev].classname.c_str());
+    rec.deviceName = Utf8ToWide(snap.nodes[dev].name.c_str());
+
+    // Walk into ports → buses → slots
+    for (int p = snap.nodes[dev].firstChild; p >= 0; p = snap.nodes[p].nextSibling)
+    {
+        if (snap.nodes[p].kind != TopoKind::Port) continue;
+        int portId = -1;
+
+        for (int b = snap.nodes[p].firstChild; b >= 0; b = snap.nodes[b].nextSibling)
+        {
+            if (snap.nodes[b].kind != TopoKind::Bus) continue;
+
+            for (int s = snap.nodes[b].firstChild; s >= 0; s = snap.nodes[s].nextSibling)
+            {
+                if (!IsSlotAddress(snap.nodes[s])) continue;
+                int slotDev = AddressDevice(snap, s);
+                if (slotDev < 0) continue;
+
+                if (portId < 0)
+                    portId = g_deviceStore.InternPort(Utf8ToWide(snap.nodes[p].name.c_str()));
+                g_deviceStore.SetSlot(rec, portId, atoi(snap.nodes[s].value.c_str()),
+                    Utf8ToWide(snap.nodes[slotDev].classname.c_str()),
+                    Utf8ToWide(snap.nodes[slotDev].name.c_str()));
+            }
+        }
+    }
+}
+
+// Populate g_deviceStore from a topology snapshot — called once after each browse phase.
+// Walks every <address type="String" value="IP"> node (see CacheAddressSubtree).
+void PopulateQueryCache(const TopologySnapshot& snap, bool complete)
+{
+    PerfScope perf(PERF_POPULATE_CACHE);
+    AcquireSRWLockExclusive(&g_deviceStoreLock);
+    if (complete && g_cacheStale)
+    {
+        // Devices only the warm-start file knew about are gone
+        g_deviceStore.Clear();
+        g_cacheStale = false;
+        Log(L"[CACHE] Warm-start data replaced by a completed browse");
+    }
+    for (int i = 0; i < (int)snap.nodes.size(); i++)
+        if (IsIPAddress(snap.nodes[i]))
+            CacheAddressSubtree(snap, i);
+    g_deviceStore.BuildIndexes();
+    ReleaseSRWLockExclusive(&g_deviceStoreLock);
+}
+
+bool RefreshQueryCache(const TopologySnapshot& snap, bool ethernetDirty,
+                       const std::set<std::wstring>& dirtyDevices, int& refreshed)
+{
+    PerfScope perf(PERF_REFRESH_CACHE);
+    refreshed = 0;
+    std::set<std::string> ips;
+    for (const auto& name : dirtyDevices)
+    {
+        auto it = g_deviceDetails.find(name);
+        if (it == g_deviceDetails.end() || it->second.ip.empty()) return false;
+        ips.insert(WideToUtf8(it->second.ip));
+    }
+
+    // Drop the dirty chassis' slots first so removed modules disappear
+    AcquireSRWLockExclusive(&g_deviceStoreLock);
+    for (const auto& ip : ips)
+        g_deviceStore.ClearSlots(Utf8ToWide(ip.c_str()));
+
+    for (int i = 0; i < (int)snap.nodes.size(); i++)
+    {
+        if (!IsIPAddress(snap.nodes[i])) continue;
+        bool dirty = ips.count(snap.nodes[i].value) > 0;
+        if (!dirty && ethernetDirty)
+        {
+            // Ethernet-level change: a device not cached yet is new and
+            // needs its whole subtree; known ones only refresh the "ip" entry
+            DeviceRecord* rec = g_deviceStore.FindDevice(Utf8ToWide(snap.nodes[i].value.c_str()));
+            dirty = (rec == nullptr);
+            if (rec)
+            {
+                int dev = AddressDevice(snap, i);
+                if (dev >= 0)
+                {
+                    rec->classname = Utf8ToWide(snap.nodes[dev].classname.c_str());
+                    rec->deviceName = Utf8ToWide(snap.nodes[dev].name.c_str());
+                }
+            }
+        }
+        if (!dirty) continue;
+        CacheAddressSubtree(snap, i);
+        refreshed++;
+    }
+    g_deviceStore.BuildIndexes();
+    ReleaseSRWLockExclusive(&g_deviceStoreLock);
+    return true;
+}
+
+bool LookupCachedPath(const std::wstring& ip, const std::wstring& portName, int slot,
+                      QueryResult& out)
+{
+    AcquireSRWLockShared(&g_deviceStoreLock);
+    bool found = g_deviceStore.Lookup(ip, portName, slot, out);
+    out.stale = g_cacheStale;
+    ReleaseSRWLockShared(&g_deviceStoreLock);
+    return found;
+}
+
+bool FindCachedPaths(const FindQuery& q, std::vector<QueryResult>& out, size_t max)
+{
+    AcquireSRWLockShared(&g_deviceStoreLock);
+    bool more = g_deviceStore.Find(q, out, max);
+    bool stale = g_cacheStale;
+    ReleaseSRWLockShared(&g_deviceStoreLock);
+    for (auto& r : out) r.stale = stale;
+    return more;
+}
+
+void PopulateQueryCache(const wchar_t* xmlFile)
+{
+    TopologySnapshot snap;
+    if (LoadTopologySnapshot(xmlFile, snap))
+        PopulateQueryCache(snap);
+}
+
+// Update g_deviceDetails with IP addresses from a topology snapshot
+void UpdateDeviceIPsFromXML(const TopologySnapshot& snap)
+{
+    PerfScope perf(PERF_UPDATE_IPS);
+    for (int i = 0; i < (int)snap.nodes.size(); i++)
+    {
+        if (!IsIPAddress(snap.nodes[i])) continue;
+
+        // Skip <device reference="..."> entries — the IP belongs to the
+        // referencing path, the device details live on the real element
+        int dev = snap.FirstChildOfKind(i, TopoKind::Device);
+        if (dev < 0 || snap.nodes[dev].isReference || snap.nodes[dev].name.empty()) continue;
+
+        std::wstring nameW = Utf8ToWide(snap.nodes[dev].name.c_str());
+        std::wstring ipW = Utf8ToWide(snap.nodes[i].value.c_str());
+
+        auto it = g_deviceDetails.find(nameW);
+        if (it != g_deviceDetails.end())
+            it->second.ip = ipW;
+        else
+        {
+            DeviceInfo info;
+            info.productName = nameW;
+            info.ip = ipW;
+            g_deviceDetails[nameW] = info;
+        }
+    }
+}
+
+void RefreshDeviceDetails(const std::wstring& name, const std::wstring& objectId)
+{
+    if (name.empty()) return;
+    DeviceInfo& info = g_deviceDetails[name];
+    info.productName = name;
+    info.objectId = objectId;
+}
+
+void CollectDriverAddresses(const TopologySnapshot& snap,
+                            std::map<std::wstring, std::set<std::wstring>>& out)
+{
+    out.clear();
+    for (int i = 0; i < (int)snap.nodes.size(); i++)
+    {
+        if (!IsIPAddress(snap.nodes[i])) continue;
+
+        // address → bus → port → workstation (top-level device)
+        int bus = snap.nodes[i].parent;
+        int port = (bus >= 0) ? snap.nodes[bus].parent : -1;
+        int ws = (port >= 0) ? snap.nodes[port].parent : -1;
+        if (ws < 0 || snap.nodes[ws].parent != -1 || snap.nodes[port].kind != TopoKind::Port)
+            continue;
+
+        out[Utf8ToWide(snap.nodes[port].name.c_str())].insert(
+            Utf8ToWide(snap.nodes[i].value.c_str()));
+    }
+}
+
+void UpdateDeviceIPsFromXML(const wchar_t* filename)
+{
+    TopologySnapshot snap;
+    if (LoadTopologySnapshot(filename, snap))
+        UpdateDeviceIPsFromXML(snap);
+}
@@ -0,0 +1,322 @@
+#include "TopologySnapshot.h"
+
+// ============================================================
+// Tokenizer helpers
+// ============================================================
+
+static bool IsXmlSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Find the first occurrence of seq in [p, end). Returns nullptr if absent.
+static const char* FindSeq(const char* p, const char* end, const char* seq, size_t seqLen)
+{
+    while (p + seqLen <= end)
+    {
+        const char* hit = (const char*)memchr(p, seq[0], (size_t)(end - p));
+        if (!hit || hit + seqLen > end) return nullptr;
+        if (memcmp(hit, seq, seqLen) == 0) return hit;
+        p = hit + 1;
+    }
+    return nullptr;
+}
+
+// Find the '>' that closes a start/end tag, skipping quoted attribute values
+// (a raw '>' is legal inside an attribute).
+static const char* FindTagEnd(const char* p, const char* end)
+{
+    char quote = 0;
+    for (; p < end; ++p)
+    {
+        if (quote) { if (*p == quote) quote = 0; }
+        else if (*p == '"' || *p == '\'') quote = *p;
+        else if (*p == '>') return p;
+    }
+    return nullptr;
+}
+
+static void AppendUtf8(std::string& out, unsigned long cp)
+{
+    if (cp < 0x80) out += (char)cp;
+    else if (cp < 0x800)
+    {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+// Copy [p, end) into out, decoding the five predefined entities and &#N; / &#xN;
+static void DecodeXmlValue(const char* p, const char* end, std::string& out)
+{
+    out.clear();
+    out.reserve((size_t)(end - p));
+    while (p < end)
+    {
+        if (*p != '&') { out += *p++; continue; }
+
+        const char* semi = (const char*)memchr(p, ';', (size_t)(end - p));
+        if (!semi || semi - p > 10) { out += *p++; continue; }
+
+        const char* e = p + 1;
+        size_t n = (size_t)(semi - e);
+        unsigned long cp = 0;
+        if (n == 3 && memcmp(e, "amp", 3) == 0)       cp = '&';
+        else if (n == 2 && memcmp(e, "lt", 2) == 0)   cp = '<';
+        else if (n == 2 && memcmp(e, "gt", 2) == 0)   cp = '>';
+        else if (n == 4 && memcmp(e, "quot", 4) == 0) cp = '"';
+        else if (n == 4 && memcmp(e, "apos", 4) == 0) cp = '\'';
+        else if (n > 1 && e[0] == '#')
+            cp = (e[1] == 'x' || e[1] == 'X') ? strtoul(e + 2, nullptr, 16)
+                                              : strtoul(e + 1, nullptr, 10);
+
+        if (cp == 0 || cp > 0x10FFFF) { out += *p++; continue; }
+        AppendUtf8(out, cp);
+        p = semi + 1;
+    }
+}
+
+static bool TagNameIs(const char* name, size_t len, const char* lit)
+{
+    return strlen(lit) == len && memcmp(name, lit, len) == 0;
+}
+
+// Handle one start/end tag. p points just past '<', end at the closing '>'.
+// stack holds, per open element, the index of the nearest tracked ancestor
+// (the element itself when it is a device/port/bus/address), -1 at top level.
+static void HandleTag(const char* p, const char* end,
+                      std::vector<int>& stack, TopologySnapshot& snap)
+{
+    if (p < end && *p == '/')
+    {
+        if (!stack.empty()) stack.pop_back();
+        return;
+    }
+
+    bool selfClosing = (end > p && end[-1] == '/');
+    if (selfClosing) --end;
+
+    const char* nameEnd = p;
+    while (nameEnd < end && !IsXmlSpace(*nameEnd)) ++nameEnd;
+    size_t nameLen = (size_t)(nameEnd - p);
+
+    int parent = stack.empty() ? -1 : stack.back();
+
+    TopoKind kind;
+    if (TagNameIs(p, nameLen, "device"))       kind = TopoKind::Device;
+    else if (TagNameIs(p, nameLen, "port"))    kind = TopoKind::Port;
+    else if (TagNameIs(p, nameLen, "bus"))     kind = TopoKind::Bus;
+    else if (TagNameIs(p, nameLen, "address")) kind = TopoKind::Address;
+    else
+    {
+        // Untracked element (<topology>, <tree>, ...): children attach to our parent
+        if (!selfClosing) stack.push_back(parent);
+        return;
+    }
+
+    int idx = (int)snap.nodes.size();
+    snap.nodes.emplace_back();
+    TopoNode& node = snap.nodes.back();
+    node.kind = kind;
+    node.parent = parent;
+
+    // Attributes: name="value" or name='value'
+    const char* a = nameEnd;
+    std::string decoded;
+    while (a < end)
+    {
+        while (a < end && IsXmlSpace(*a)) ++a;
+        const char* attrName = a;
+        while (a < end && *a != '=' && !IsXmlSpace(*a)) ++a;
+        size_t attrLen = (size_t)(a - attrName);
+        while (a < end && IsXmlSpace(*a)) ++a;
+        if (a >= end || *a != '=') break;
+        ++a;
+        while (a < end && IsXmlSpace(*a)) ++a;
+        if (a >= end || (*a != '"' && *a != '\'')) break;
+        char quote = *a++;
+        const char* valStart = a;
+        while (a < end && *a != quote) ++a;
+        if (a >= end) break;
+        DecodeXmlValue(valStart, a, decoded);
+        ++a;
+
+        if (TagNameIs(attrName, attrLen, "name"))           node.name = decoded;
+        else if (TagNameIs(attrName, attrLen, "classname")) node.classname = decoded;
+        else if (TagNameIs(attrName, attrLen, "objectid"))  node.objectId = decoded;
+        else if (TagNameIs(attrName, attrLen, "type"))      node.type = decoded;
+        else if (TagNameIs(attrName, attrLen, "value"))     node.value = decoded;
+        else if (TagNameIs(attrName, attrLen, "reference"))
+        {
+            node.objectId = decoded;
+            node.isReference = true;
+        }
+    }
+
+    if (kind == TopoKind::Device && !node.isReference && !node.objectId.empty())
+        snap.objectIndex.emplace(node.objectId, idx);
+
+    if (parent >= 0)
+    {
+        TopoNode& par = snap.nodes[parent];
+        if (par.lastChild >= 0) snap.nodes[par.lastChild].nextSibling = idx;
+        else par.firstChild = idx;
+        par.lastChild = idx;
+    }
+
+    if (!selfClosing) stack.push_back(idx);
+}
+
+// Tokenize [data, data+len). Returns the number of bytes consumed — anything
+// after that is an incomplete construct (truncated tag/comment) at the end.
+static size_t TokenizeTopology(const char* data, size_t len,
+                               std::vector<int>& stack, TopologySnapshot& snap)
+{
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end)
+    {
+        const char* lt = (const char*)memchr(p, '<', (size_t)(end - p));
+        if (!lt) return len;
+
+        const char* q = lt + 1;
+        const char* next = nullptr;
+        if (q < end && *q == '?')
+        {
+            const char* close = FindSeq(q, end, "?>", 2);
+            if (close) next = close + 2;
+        }
+        else if (end - q >= 3 && memcmp(q, "!--", 3) == 0)
+        {
+            const char* close = FindSeq(q + 3, end, "-->", 3);
+            if (close) next = close + 3;
+        }
+        else if (end - q >= 8 && memcmp(q, "![CDATA[", 8) == 0)
+        {
+            const char* close = FindSeq(q + 8, end, "]]>", 3);
+            if (close) next = close + 3;
+        }
+        else if (q < end && *q == '!')
+        {
+            const char* close = (const char*)memchr(q, '>', (size_t)(end - q));
+            if (close) next = close + 1;
+        }
+        else
+        {
+            const char* close = FindTagEnd(q, end);
+            if (close)
+            {
+                HandleTag(q, close, stack, snap);
+                next = close + 1;
+            }
+        }
+
+        if (!next) return (size_t)(lt - data);
+        p = next;
+    }
+    return len;
+}
+
+// ============================================================
+// TopologySnapshot implementations
+// ============================================================
+
+int TopologySnapshot::ResolveDevice(int idx) const
+{
+    if (idx < 0 || idx >= (int)nodes.size()) return -1;
+    const TopoNode& n = nodes[idx];
+    if (n.kind != TopoKind::Device) return -1;
+    if (!n.isReference) return idx;
+    auto it = objectIndex.find(n.objectId);
+    return (it != objectIndex.end()) ? it->second : -1;
+}
+
+int TopologySnapshot::FirstChildOfKind(int idx, TopoKind kind) const
+{
+    if (idx < 0 || idx >= (int)nodes.size()) return -1;
+    for (int c = nodes[idx].firstChild; c >= 0; c = nodes[c].nextSibling)
+        if (nodes[c].kind == kind) return c;
+    return -1;
+}
+
+bool IsIdentifiedClassname(const std::string& classname)
+{
+    return !classname.empty() &&
+           classname != "Unrecognized Device" &&
+           classname != "Workstation";
+}
+
+// ============================================================
+// TopologyStreamParser
+// ============================================================
+
+TopologyStreamParser::TopologyStreamParser(TopologySnapshot& snap)
+    : m_snap(snap)
+{
+    m_snap.Clear();
+    m_stack.reserve(32);
+}
+
+void TopologyStreamParser::Feed(const char* data, size_t len)
+{
+    if (!data || len == 0) return;
+
+    if (m_pending.empty())
+    {
+        // Common case: tokenize straight out of the caller's buffer and
+        // keep only the unfinished tail
+        size_t used = TokenizeTopology(data, len, m_stack, m_snap);
+        if (used < len) m_pending.assign(data + used, len - used);
+        return;
+    }
+
+    m_pending.append(data, len);
+    size_t used = TokenizeTopology(m_pending.data(), m_pending.size(), m_stack, m_snap);
+    m_pending.erase(0, used);
+}
+
+bool TopologyStreamParser::Finish()
+{
+    m_pending.clear();
+    m_pending.shrink_to_fit();
+    m_stack.clear();
+    return !m_snap.Empty();
+}
+
+bool ParseTopologyBuffer(const char* data, size_t len, TopologySnapshot& snap)
+{
+    TopologyStreamParser parser(snap);
+    parser.Feed(data, len);
+    return parser.Finish();
+}
+
+bool LoadTopologySnapshot(const wchar_t* filename, TopologySnapshot& snap)
+{
+    snap.Clear();
+    HANDLE hFile = CreateFileW(filename, GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    std::vector<char> chunk(TOPOLOGY_READ_CHUNK);
+    TopologyStreamParser parser(snap);
+    DWORD bytesRead = 0;
+    while (ReadFile(hFile, chunk.data(), (DWORD)chunk.size(), &bytesRead, nullptr) && bytesRead > 0)
+        parser.Feed(chunk.data(), bytesRead);
+    CloseHandle(hFile);
+
+    return parser.Finish();
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "RSLinxHook_fwd.h"
+#include <unordered_map>
+
+// ============================================================
+// Topology snapshot — single-pass index of SaveTopologyXML output
+//
+// One tokenizer pass over the XML builds a compact tree of the
+// <device>/<port>/<bus>/<address> elements plus an objectid → device
+// index, so <device reference="GUID"/> resolves in O(1). All XML
+// consumers in TopologyXML.cpp read from this tree instead of running
+// their own strstr scans over the file.
+//
+// No COM dependencies: attribute values are kept as UTF-8 with XML
+// entities decoded.
+// ============================================================
+
+enum class TopoKind : unsigned char { Device, Port, Bus, Address };
+
+struct TopoNode {
+    TopoKind kind = TopoKind::Device;
+    bool isReference = false;   // <device reference="GUID"/> — objectId holds the GUID
+    int parent = -1;            // index into TopologySnapshot::nodes, -1 = top level
+    int firstChild = -1;
+    int lastChild = -1;
+    int nextSibling = -1;
+    std::string name;           // device / port / bus name
+    std::string classname;      // device / bus classname
+    std::string objectId;       // device objectid (or reference target)
+    std::string type;           // address type: "String" (IP) or "Short" (slot)
+    std::string value;          // address value
+};
+
+struct TopologySnapshot {
+    std::vector<TopoNode> nodes;                        // document order
+    std::unordered_map<std::string, int> objectIndex;   // objectid → device node
+
+    void Clear() { nodes.clear(); objectIndex.clear(); }
+    bool Empty() const { return nodes.empty(); }
+
+    // Device node index for idx, following a reference to the device that
+    // owns the objectid. -1 if idx is not a device or the reference dangles.
+    int ResolveDevice(int idx) const;
+
+    // First direct child of idx with the given kind, -1 if none.
+    int FirstChildOfKind(int idx, TopoKind kind) const;
+};
+
+// classname is a real identification (not empty, "Unrecognized Device" or "Workstation")
+bool IsIdentifiedClassname(const std::string& classname);
+
+// Read size for LoadTopologySnapshot. Peak parse memory is the tree plus one
+// chunk plus at most one unfinished tag, independent of the file size.
+#define TOPOLOGY_READ_CHUNK 65536
+
+// Incremental parser: feed the XML in arbitrary pieces (file reads, or bytes
+// as SaveTopologyXML produces them). Only a tag or comment split across two
+// Feed calls is buffered; everything else is tokenized in place.
+class TopologyStreamParser {
+public:
+    explicit TopologyStreamParser(TopologySnapshot& snap);
+    void Feed(const char* data, size_t len);
+    // Returns false if no topology elements were found. Trailing unfinished
+    // markup (truncated file) is dropped.
+    bool Finish();
+
+private:
+    TopologySnapshot& m_snap;
+    std::vector<int> m_stack;
+    std::string m_pending;
+};
+
+// Parse an in-memory XML buffer. Returns false if no topology elements were found.
+bool ParseTopologyBuffer(const char* data, size_t len, TopologySnapshot& snap);
+
+// Stream a SaveTopologyXML file through TopologyStreamParser in
+// TOPOLOGY_READ_CHUNK reads — no size limit. Returns false if the file
+// could not be opened or contained no topology elements.
+bool LoadTopologySnapshot(const wchar_t* filename, TopologySnapshot& snap);
@@ -0,0 +1,304 @@
+#include "TopologyWalker.h"
+#include "BrowseOperations.h"
+#include "DispatchHelpers.h"
+#include "ComLayout.h"
+#include "SEHHelpers.h"
+#include "TopologyXML.h"
+#include "Logging.h"
+#include "STAHook.h"
+#include "Perf.h"
+
+// ============================================================
+// TopologyWalker globals
+// ============================================================
+
+TopologyWalkRequest g_walkRequest;
+TopologyWalkResult g_walkResult;
+
+// ============================================================
+// Property lookup — per object class: an Ethernet device and a backplane
+// module need not share a dispatch implementation. DispatchFindName
+// remembers each class's answer, so only its first object pays for the
+// GetIDsOfNames calls.
+// ============================================================
+
+struct WalkProps {
+    DISPID address = DISPID_UNKNOWN;
+    DISPID classname = DISPID_UNKNOWN;
+};
+
+static WalkProps ResolveWalkProps(IDispatch* pObj, bool module)
+{
+    static const wchar_t* const addressNames[] = {
+        L"Address", L"NetworkAddress", L"PortAddress", L"Addr",
+    };
+    static const wchar_t* const classNames[] = {
+        L"ClassName", L"Classname", L"classname", L"CatalogNumber", L"ProductName",
+    };
+    // The last pair logged, so each change shows once rather than per object
+    static WalkProps s_logged[2];
+    static bool s_anyLogged[2] = {};
+
+    int a = -1, c = -1;
+    WalkProps props;
+    props.address = DispatchFindName(pObj, addressNames, _countof(addressNames), &a);
+    props.classname = DispatchFindName(pObj, classNames, _countof(classNames), &c);
+
+    int k = module ? 1 : 0;
+    if (!s_anyLogged[k] || s_logged[k].address != props.address ||
+        s_logged[k].classname != props.classname)
+    {
+        s_anyLogged[k] = true;
+        s_logged[k] = props;
+        Log(L"[WALK] %s properties: address=%s (DISPID %d), classname=%s (DISPID %d)",
+            module ? L"Module" : L"Device",
+            a >= 0 ? addressNames[a] : L"none", props.address,
+            c >= 0 ? classNames[c] : L"none", props.classname);
+    }
+    return props;
+}
+
+static bool LooksLikeIP(const std::wstring& s)
+{
+    int dots = 0, digits = 0;
+    for (wchar_t ch : s)
+    {
+        if (ch == L'.') { if (digits == 0) return false; dots++; digits = 0; }
+        else if (iswdigit(ch)) { if (++digits > 3) return false; }
+        else return false;
+    }
+    return dots == 3 && digits > 0;
+}
+
+static int ParseSlot(const std::wstring& s)
+{
+    if (s.empty() || s.size() > 4) return -1;
+    for (wchar_t ch : s)
+        if (!iswdigit(ch)) return -1;
+    int slot = _wtoi(s.c_str());
+    return (slot <= DEVICE_STORE_MAX_SLOT) ? slot : -1;
+}
+
+// Ethernet device IP: address property, then what the last snapshot
+// recorded for this name, then the name itself
+static std::wstring DeviceIP(IDispatch* pDevice, DISPID addressDispid, const std::wstring& name)
+{
+    std::wstring ip = DispatchGetText(pDevice, addressDispid);
+    if (LooksLikeIP(ip)) return ip;
+    auto it = g_deviceDetails.find(name);
+    if (it != g_deviceDetails.end() && !it->second.ip.empty()) return it->second.ip;
+    return LooksLikeIP(name) ? name : L"";
+}
+
+// ============================================================
+// Backplane bus of one device — same path as DoBackplaneBrowse:
+// GetBackplanePort -> GetBus, GetBusEx by port name if that fails
+// ============================================================
+
+static IUnknown* GetBackplaneBus(IDispatch* pDevice, std::wstring& portName)
+{
+    IUnknown* pDevVtable = nullptr;
+    CachedQueryInterface(pDevice, IID_IRSTopologyDevice, (void**)&pDevVtable);
+    if (!pDevVtable) return nullptr;
+
+    IUnknown* pPort = nullptr;
+    HRESULT hr = TryVtableGetObject(pDevVtable, ComLayout::IRSTopologyDevice::GetBackplanePort.slot,
+                                    &pPort);
+    pDevVtable->Release();
+    if (FAILED(hr) || !pPort) return nullptr;
+
+    portName.clear();
+    IUnknown* pPortRSObj = nullptr;
+    if (SUCCEEDED(CachedQueryInterface(pPort, IID_IRSObject, (void**)&pPortRSObj)) && pPortRSObj)
+    {
+        TryVtableGetLabel(pPortRSObj, ComLayout::IRSObject::GetName.slot, portName);
+        pPortRSObj->Release();
+    }
+    if (portName.empty()) portName = L"Backplane";
+
+    IUnknown* pBus = nullptr;
+    IUnknown* pPortVtable = nullptr;
+    CachedQueryInterface(pPort, IID_IRSTopologyPort, (void**)&pPortVtable);
+    if (pPortVtable)
+    {
+        if (FAILED(TryVtableGetObject(pPortVtable, ComLayout::IRSTopologyPort::GetBus.slot, &pBus)))
+            pBus = nullptr;
+        pPortVtable->Release();
+    }
+    pPort->Release();
+    if (pBus) return pBus;
+
+    IDispatch* pDual = nullptr;
+    pDevice->QueryInterface(IID_ITopologyDevice_Dual, (void**)&pDual);
+    if (!pDual) return nullptr;
+
+    VARIANT argName;
+    VariantInit(&argName);
+    argName.vt = VT_BSTR;
+    argName.bstrVal = SysAllocString(portName.c_str());
+    DISPPARAMS dp = { &argName, nullptr, 1, 0 };
+    VARIANT varBus;
+    VariantInit(&varBus);
+    hr = ComLayout::Invoke(pDual, ComLayout::ITopologyDevice_Dual::GetBusEx, &dp, &varBus);
+    if (SUCCEEDED(hr) && (varBus.vt == VT_DISPATCH || varBus.vt == VT_UNKNOWN) && varBus.punkVal)
+    {
+        pBus = varBus.punkVal;
+        pBus->AddRef();
+    }
+    VariantClear(&varBus);
+    VariantClear(&argName);
+    pDual->Release();
+    return pBus;
+}
+
+static void WalkBackplane(IDispatch* pDevice, WalkedDevice& wd, TopologyWalkResult& result)
+{
+    IUnknown* pBus = GetBackplaneBus(pDevice, wd.portName);
+    if (!pBus) return;
+
+    IDispatch* pBusDisp = nullptr;
+    pBus->QueryInterface(IID_ITopologyBus, (void**)&pBusDisp);
+    pBus->Release();
+    if (!pBusDisp) return;
+
+    IDispatch* pModules = DispatchGetCollection(pBusDisp, ComLayout::ITopologyBus::Devices.id);
+    pBusDisp->Release();
+    if (!pModules) return;
+
+    CollectionEnumerator modules(pModules);
+    pModules->Release();
+    if (!modules.Opened()) return;
+    wd.slotsWalked = true;
+
+    IDispatch* pModule = nullptr;
+    while (modules.Next(&pModule))
+    {
+        result.objectsVisited++;
+        WalkProps mp = ResolveWalkProps(pModule, true);
+        WalkedSlot ws;
+        ws.slot = ParseSlot(DispatchGetText(pModule, mp.address));
+        if (ws.slot < 0)
+        {
+            result.missingAddress++;
+            wd.slotsMissingAddress++;
+            pModule->Release();
+            continue;
+        }
+        TopologyObjectProps props;
+        DispatchGetObjectProps(pModule, props, false);
+        ws.name = props.name;
+        ws.objectId = props.objectId;
+        ws.classname = DispatchGetText(pModule, mp.classname);
+        if (ws.classname.empty()) result.missingClass++;
+        wd.slots.push_back(ws);
+        pModule->Release();
+    }
+}
+
+// ============================================================
+// DoTopologyWalk  - runs on MAIN STA thread
+// ============================================================
+
+HRESULT DoTopologyWalk()
+{
+    PerfScope perf(PERF_TOPOLOGY_WALK);
+    const TopologyWalkRequest& req = g_walkRequest;
+    TopologyWalkResult& result = g_walkResult;
+    result = TopologyWalkResult();
+    if (!g_pSharedConfig) return E_INVALIDARG;
+
+    std::set<std::wstring> remaining = req.ips;
+    std::set<std::wstring> seen;
+    int busesReached = 0;
+
+    for (auto& drv : g_pSharedConfig->drivers)
+    {
+        if (!req.ips.empty() && remaining.empty()) break;
+
+        IDispatch* pEthBus = GetBusDispatch(drv.name.c_str());
+        if (!pEthBus) continue;
+        busesReached++;
+
+        IDispatch* pDevices = DispatchGetCollection(pEthBus, ComLayout::ITopologyBus::Devices.id);
+        pEthBus->Release();
+        if (!pDevices) continue;
+        // Stops fetching once every requested IP has been seen
+        CollectionEnumerator devices(pDevices);
+        pDevices->Release();
+
+        IDispatch* pDevice = nullptr;
+        while ((req.ips.empty() || !remaining.empty()) && devices.Next(&pDevice))
+        {
+            WalkProps dp = ResolveWalkProps(pDevice, false);
+            result.objectsVisited++;
+
+            WalkedDevice wd;
+            wd.driver = drv.name;
+            wd.name = DispatchGetString(pDevice, ComLayout::ITopologyObject::Name.id);
+            wd.ip = DeviceIP(pDevice, dp.address, wd.name);
+            if (wd.ip.empty())
+            {
+                // Only matters to a full walk; a limited one counts what it did not find
+                if (req.ips.empty()) result.missingAddress++;
+            }
+            else if ((req.ips.empty() || remaining.count(wd.ip)) && seen.insert(wd.ip).second)
+            {
+                // A chassis another driver also reaches is walked once
+                wd.objectId = DispatchGetString(pDevice, ComLayout::ITopologyObject::objectid.id);
+                wd.classname = DispatchGetText(pDevice, dp.classname);
+                if (wd.classname.empty()) result.missingClass++;
+                if (req.slots) WalkBackplane(pDevice, wd, result);
+                remaining.erase(wd.ip);
+                result.devices.push_back(wd);
+            }
+            pDevice->Release();
+        }
+    }
+
+    result.complete = busesReached > 0 && remaining.empty() &&
+                      result.missingAddress == 0 && result.missingClass == 0;
+    // A queried chassis whose backplane could not be opened is left to the
+    // snapshot, which may still list its slots
+    if (req.slots && !req.ips.empty())
+        for (const auto& wd : result.devices)
+            if (!wd.slotsWalked) result.complete = false;
+    Log(L"[WALK] %d device(s), %d object(s) read across %d bus(es)%s",
+        (int)result.devices.size(), result.objectsVisited, busesReached,
+        result.complete ? L"" : L" - incomplete");
+    return (busesReached > 0) ? S_OK : S_FALSE;
+}
+
+// ============================================================
+// ApplyTopologyWalk  - worker thread
+// ============================================================
+
+void ApplyTopologyWalk(const TopologyWalkResult& result)
+{
+    AcquireSRWLockExclusive(&g_deviceStoreLock);
+    for (const auto& wd : result.devices)
+    {
+        DeviceRecord& rec = g_deviceStore.UpsertDevice(wd.ip);
+        if (!wd.classname.empty()) rec.classname = wd.classname;
+        if (!wd.name.empty()) rec.deviceName = wd.name;
+        if (!wd.slotsWalked) continue;
+
+        // Only the walked port is rebuilt, and only when every module on it
+        // had a slot; otherwise the walk's modules are merged over the
+        // snapshot's
+        int portId = g_deviceStore.InternPort(wd.portName);
+        if (wd.slotsMissingAddress == 0) g_deviceStore.ClearPort(rec, portId);
+        for (const auto& ws : wd.slots)
+            g_deviceStore.SetSlot(rec, portId, ws.slot, ws.classname, ws.name);
+    }
+    g_deviceStore.BuildIndexes();
+    ReleaseSRWLockExclusive(&g_deviceStoreLock);
+
+    for (const auto& wd : result.devices)
+    {
+        if (wd.name.empty()) continue;
+        DeviceInfo& info = g_deviceDetails[wd.name];
+        info.productName = wd.name;
+        info.ip = wd.ip;
+        if (!wd.objectId.empty()) info.objectId = wd.objectId;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "RSLinxHook_fwd.h"
+#include "ComInterfaces.h"
+
+// ============================================================
+// Direct COM topology walker (C|WALK=1)
+// Reads devices straight from the topology objects on the main STA
+// instead of SaveTopologyXML + parse:
+//   driver bus (Workstation DISPID 38) -> Devices (50)
+//     -> Name (1), objectid (2), address, classname
+//     -> backplane port (IRSTopologyDevice[19]) -> bus (IRSTopologyPort[10],
+//        DISPID 38 fallback) -> Devices (50) -> slot modules
+// Address and classname have no DISPID known to this hook; they are found
+// by name once per object class. A device whose address cannot be read takes
+// its IP from g_deviceDetails or from its name (unrecognized devices are
+// named by IP). A walk limited to some IPs skips every other device's
+// ports and stops as soon as all of them have been seen, so one chassis
+// costs a few dozen COM calls rather than a full project serialization.
+// ============================================================
+
+struct WalkedSlot {
+    int slot = -1;
+    std::wstring classname;
+    std::wstring name;
+    std::wstring objectId;
+};
+
+struct WalkedDevice {
+    std::wstring driver;
+    std::wstring ip;
+    std::wstring classname;
+    std::wstring name;
+    std::wstring objectId;
+    std::wstring portName;           // backplane port ("Backplane")
+    bool slotsWalked = false;        // backplane bus found and enumerated
+    int slotsMissingAddress = 0;     // modules on it skipped: no slot
+    std::vector<WalkedSlot> slots;
+};
+
+struct TopologyWalkRequest {
+    std::set<std::wstring> ips;      // empty: every device on every driver
+    bool slots = true;               // descend into backplanes
+};
+
+struct TopologyWalkResult {
+    std::vector<WalkedDevice> devices;
+    int objectsVisited = 0;          // topology objects read (devices + modules)
+    int missingAddress = 0;          // devices or modules skipped: no address
+    int missingClass = 0;            // devices or modules without a classname
+    // Every requested IP was found (with its backplane, for a limited walk
+    // with slots), and nothing walked lacked an address or classname;
+    // otherwise callers fall back to a snapshot
+    bool complete = false;
+};
+
+// Written by the worker before, read by the worker after ExecuteOnMainSTA
+extern TopologyWalkRequest g_walkRequest;
+extern TopologyWalkResult g_walkResult;
+
+// Runs on the main STA: walk per g_walkRequest into g_walkResult.
+// S_FALSE if no driver bus could be reached.
+HRESULT DoTopologyWalk();
+
+// Worker: merge a walk into g_deviceStore (g_deviceStoreLock exclusive)
+// and g_deviceDetails. A walked backplane port gets its slot table
+// rebuilt (merged into, if a module had no slot); other ports and devices
+// outside the walk are left as they are.
+void ApplyTopologyWalk(const TopologyWalkResult& result);
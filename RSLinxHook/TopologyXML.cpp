@@ -1,65 +1,29 @@
 #include "TopologyXML.h"
+#include "TopologySnapshot.h"
+#include "Config.h"
 #include "Logging.h"
 #include "DispatchHelpers.h"
+#include "ComLayout.h"
 #include "STAHook.h"
+#include "PipeBinary.h"
+#include "WarmCache.h"
+#include "Perf.h"
 
-// Extract attribute value from position in buf: attr="value" → value into out[outMax]
-static bool ExtractAttr(const char* pos, const char* attrName, char* out, int outMax)
+static std::string WideToUtf8(const std::wstring& w)
 {
-    // Build search: " attrName=\""
-    char needle[128];
-    snprintf(needle, sizeof(needle), " %s=\"", attrName);
-    const char* found = strstr(pos, needle);
-    if (!found || found > pos + 400) return false;
-    found += strlen(needle);
-    const char* end = strchr(found, '"');
-    if (!end) return false;
-    int len = (int)(end - found);
-    if (len >= outMax) len = outMax - 1;
-    memcpy(out, found, len);
-    out[len] = '\0';
-    return true;
-}
-
-// Resolve a <device reference="GUID"/> by finding objectid="GUID" elsewhere in buf.
-// Fills cn and nm from the actual device element. Returns true if found.
-static bool ResolveReference(const char* buf, const char* refDevPos,
-                              char* cn, int cnMax, char* nm, int nmMax)
-{
-    // Extract GUID from reference="..."
-    const char* refAttr = strstr(refDevPos, "reference=\"");
-    if (!refAttr || refAttr > refDevPos + 200) return false;
-    refAttr += 11; // skip 'reference="'
-    const char* refEnd = strchr(refAttr, '"');
-    if (!refEnd) return false;
-    int guidLen = (int)(refEnd - refAttr);
-    if (guidLen < 1 || guidLen >= 120) return false;
-
-    // Build: objectid="GUID"
-    char oidPattern[140];
-    memcpy(oidPattern, "objectid=\"", 10);
-    memcpy(oidPattern + 10, refAttr, guidLen);
-    oidPattern[10 + guidLen] = '"';
-    oidPattern[11 + guidLen] = '\0';
-
-    const char* found = strstr(buf, oidPattern);
-    if (!found) return false;
-
-    // Walk back to the '<' that starts the <device> element
-    const char* devStart = found;
-    while (devStart > buf && *devStart != '<') devStart--;
-
-    ExtractAttr(devStart, "classname", cn, cnMax);
-    ExtractAttr(devStart, "name", nm, nmMax);
-    return (*cn != '\0' || *nm != '\0');
+    if (w.empty()) return "";
+    int n = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(),
+                                nullptr, 0, nullptr, nullptr);
+    std::string s(n, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, w.c_str(), (int)w.size(),
+                        &s[0], n, nullptr, nullptr);
+    return s;
 }
 
 // ============================================================
 // TopologyXML globals
 // ============================================================
 
-std::map<std::wstring, DeviceInfo> g_deviceDetails;
-std::map<std::wstring, QueryResult> g_queryCache;
 std::map<std::wstring, std::vector<std::wstring>> g_driverDeviceNames;
 
 // ============================================================
@@ -68,6 +32,7 @@ std::map<std::wstring, std::vector<std::wstring>> g_driverDeviceNames;
 
 bool SaveTopologyXML(IRSTopologyGlobals* pGlobals, const wchar_t* filename)
 {
+    PerfScope perf(PERF_SAVE_XML);
     IDispatch* pDisp = nullptr;
     HRESULT hr = pGlobals->QueryInterface(IID_IDispatch, (void**)&pDisp);
     if (FAILED(hr)) return false;
@@ -91,8 +56,8 @@ bool SaveTopologyXML(IRSTopologyGlobals* pGlobals, const wchar_t* filename)
     VariantInit(&result);
 
     EXCEPINFO excepInfo = {};
-    hr = pDisp->Invoke(1610743808, IID_NULL, LOCALE_USER_DEFAULT,
-                        DISPATCH_METHOD, &params, &result, &excepInfo, nullptr);
+    hr = ComLayout::Invoke(pDisp, ComLayout::RSTopologyGlobals::SaveTopologyXML,
+                           &params, &result, &excepInfo);
 
     if (FAILED(hr))
     {
@@ -118,345 +83,257 @@ bool SaveTopologyXML(IRSTopologyGlobals* pGlobals, const wchar_t* filename)
     return SUCCEEDED(hr);
 }
 
-TopologyCounts CountDevicesInXML(const wchar_t* filename)
+// ============================================================
+// CaptureTopologySnapshot — SaveTopologyXML straight into the parser
+//
+// SaveTopologyXML only accepts a path, so the in-memory path uses a
+// scratch file under %TEMP% (not the log dir) with
+// FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE. We create it
+// first and keep the handle; RSLinx writes into it, we parse from the
+// same handle, and closing it deletes the file — its pages stay in the
+// cache manager and are never flushed.
+//
+// That only works if RSLinx opens the file with FILE_SHARE_DELETE. If
+// the held-handle save fails or yields no topology, that capture falls
+// back to saving to the scratch path normally and reopening it
+// delete-on-close. A failure the fallback shares (the save itself
+// failed) is not held against the handle. Otherwise the held handle is
+// retried after 2, 4, ... up to 64 fallback captures, and one success
+// clears the backoff.
+// ============================================================
+
+#define HELD_RETRY_MAX_SHIFT 6
+
+static int s_heldFailures = 0;       // consecutive held-handle-only failures
+static int s_capturesSinceHeld = 0;  // fallback captures since the last try
+
+static const std::wstring& ScratchSnapshotPath()
 {
-    TopologyCounts counts = { 0, 0 };
-    FILE* f = _wfopen(filename, L"r");
-    if (!f) return counts;
-    fseek(f, 0, SEEK_END);
-    long fileSize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    size_t allocSize = (fileSize > 0) ? (size_t)fileSize + 1 : 262144;
-    char* buf = (char*)malloc(allocSize);
-    if (!buf) { fclose(f); return counts; }
-    size_t n = fread(buf, 1, allocSize - 1, f);
-    buf[n] = 0;
-    fclose(f);
-    char* p = buf;
-    while ((p = strstr(p, "<device ")) != nullptr)
+    static std::wstring path;
+    if (path.empty())
     {
-        counts.totalDevices++;
-        char* cn = strstr(p, "classname=\"");
-        if (cn && cn < p + 300)
-        {
-            cn += 11;
-            if (strncmp(cn, "Unrecognized Device", 19) != 0 &&
-                strncmp(cn, "Workstation", 11) != 0)
-                counts.identifiedDevices++;
-        }
-        p++;
+        wchar_t dir[MAX_PATH];
+        DWORD n = GetTempPathW(MAX_PATH, dir);
+        if (n == 0 || n >= MAX_PATH) wcscpy(dir, L"C:\\temp\\");
+        wchar_t name[64];
+        swprintf(name, 64, L"RSLinxHook_snap_%u.xml", GetCurrentProcessId());
+        path = std::wstring(dir) + name;
     }
-    free(buf);
-    return counts;
+    return path;
 }
 
-// Count how many target IPs have been identified (non-Unrecognized) in topology XML
-int CountTargetsIdentifiedInXML(const wchar_t* filename, const std::vector<std::wstring>& targetIPs)
+// Per-client pipe state, keyed by PipeSession::id (worker thread only):
+// the N| tree last sent, keyed by path, and the FNV-1a of the last XML
+// streamed as an X| block, so an identical snapshot is not resent.
+// Dropped by ResetTopologyDiff when the client goes away.
+struct ClientTopologyState {
+    std::map<std::string, std::string> walkSent;
+    bool haveBaseline = false;
+    int sinceResync = 0;
+    unsigned long long xmlHash = 0;
+};
+static std::map<int, ClientTopologyState> s_clientTopology;
+
+static void HashBytes(unsigned long long& h, const char* p, DWORD n)
 {
-    FILE* f = _wfopen(filename, L"r");
-    if (!f) return 0;
-    fseek(f, 0, SEEK_END);
-    long fileSize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    size_t allocSize = (fileSize > 0) ? (size_t)fileSize + 1 : 262144;
-    char* buf = (char*)malloc(allocSize);
-    if (!buf) { fclose(f); return 0; }
-    size_t n = fread(buf, 1, allocSize - 1, f);
-    buf[n] = 0;
-    fclose(f);
-
-    int count = 0;
-    for (auto& wip : targetIPs)
+    for (DWORD i = 0; i < n; i++)
     {
-        // Convert wide IP to narrow
-        char ipNarrow[64];
-        WideCharToMultiByte(CP_ACP, 0, wip.c_str(), -1, ipNarrow, 64, NULL, NULL);
-
-        // Build search pattern: value="IP"
-        char pattern[128];
-        snprintf(pattern, sizeof(pattern), "value=\"%s\"", ipNarrow);
-
-        // Find the address element containing this IP
-        char* addrPos = strstr(buf, pattern);
-        if (!addrPos) continue;
-
-        // Look for a <device> with a non-Unrecognized classname after this address
-        char* p = addrPos;
-        char* searchEnd = addrPos + 2000;
-        if (searchEnd > buf + n) searchEnd = buf + n;
-
-        while (p < searchEnd && (p = strstr(p, "<device ")) != nullptr && p < searchEnd)
-        {
-            char* cn = strstr(p, "classname=\"");
-            if (cn && cn < p + 500)
-            {
-                cn += 11;
-                if (strncmp(cn, "Unrecognized Device", 19) != 0 &&
-                    strncmp(cn, "Workstation", 11) != 0 &&
-                    strncmp(cn, "\"", 1) != 0)  // empty classname
-                {
-                    count++;
-                    break;  // This target IP is identified, move to next
-                }
-            }
-            p++;
-        }
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
     }
-    free(buf);
-    return count;
 }
 
-// Check if ANY target IP has been identified — backwards compat wrapper
-bool IsTargetIdentifiedInXML(const wchar_t* filename, const std::vector<std::wstring>& targetIPs)
+static bool ParseSnapshotHandle(HANDLE hFile, TopologySnapshot& snap, bool sendXml)
 {
-    return CountTargetsIdentifiedInXML(filename, targetIPs) > 0;
-}
+    SetFilePointer(hFile, 0, nullptr, FILE_BEGIN);
 
-// ============================================================
-// Cache-based counting (fallback when SaveTopologyXML fails)
-// Uses g_queryCache populated by PopulateQueryCache from the
-// last successful XML save.
-// ============================================================
-
-TopologyCounts CountDevicesFromCache()
-{
-    TopologyCounts counts = { 0, 0 };
-    for (const auto& kv : g_queryCache)
+    std::vector<char> chunk(TOPOLOGY_READ_CHUNK);
+    TopologyStreamParser parser(snap);
+    unsigned long long hash = 14695981039346656037ULL;
+    DWORD bytesRead = 0;
+    bool ok;
     {
-        // Only count IP-level entries (no backslash = top-level device)
-        if (kv.first.find(L'\\') != std::wstring::npos) continue;
-
-        counts.totalDevices++;
-        if (!kv.second.classname.empty() &&
-            kv.second.classname != L"Unrecognized Device" &&
-            kv.second.classname != L"Workstation")
+        PerfScope perf(PERF_PARSE_XML);
+        while (ReadFile(hFile, chunk.data(), (DWORD)chunk.size(), &bytesRead, nullptr) && bytesRead > 0)
         {
-            counts.identifiedDevices++;
+            parser.Feed(chunk.data(), bytesRead);
+            PerfAdd(PERF_CTR_XML_BYTES, bytesRead);
+            if (sendXml) HashBytes(hash, chunk.data(), bytesRead);
         }
+        ok = parser.Finish();
     }
-    return counts;
-}
 
-int CountTargetsFromCache(const std::vector<std::wstring>& targetIPs)
-{
+    if (!ok || !sendXml || !g_pipeConnected) return ok;
+
+    PipeBeginFrame();
+    PipeSession* targets[PIPE_MAX_CLIENTS];
     int count = 0;
-    for (const auto& ip : targetIPs)
     {
-        auto it = g_queryCache.find(ip);
-        if (it != g_queryCache.end() &&
-            !it->second.classname.empty() &&
-            it->second.classname != L"Unrecognized Device" &&
-            it->second.classname != L"Workstation")
+        PipeSession* all[PIPE_MAX_CLIENTS];
+        int n = PipeTargets(all, PIPE_MAX_CLIENTS);
+        for (int i = 0; i < n; i++)
+            if (s_clientTopology[all[i]->id].xmlHash != hash) targets[count++] = all[i];
+    }
+    if (count > 0)
+    {
+        // Changed since a client's last X| block: stream it from the same
+        // handle (still in the file cache after the parse pass)
+        SetFilePointer(hFile, 0, nullptr, FILE_BEGIN);
+        char lastByte = '\n';
+        for (int i = 0; i < count; i++) PipeXmlBegin(targets[i]);
+        while (ReadFile(hFile, chunk.data(), (DWORD)chunk.size(), &bytesRead, nullptr) && bytesRead > 0)
         {
-            count++;
+            for (int i = 0; i < count; i++) PipeXmlData(targets[i], chunk.data(), (int)bytesRead);
+            lastByte = chunk[bytesRead - 1];
+        }
+        for (int i = 0; i < count; i++)
+        {
+            PipeXmlEnd(targets[i], lastByte);
+            s_clientTopology[targets[i]->id].xmlHash = hash;
         }
     }
-    return count;
+    PipeEndFrame();
+    return ok;
 }
 
-// Query topology XML for a device at an IP/port/slot path
-QueryResult QueryXMLForPath(const wchar_t* xmlFile,
-                             const std::wstring& ip,
-                             const std::wstring& portName,
-                             int slot)
+static bool CaptureViaHeldHandle(IRSTopologyGlobals* pGlobals, TopologySnapshot& snap, bool sendXml)
 {
-    QueryResult result;
-    result.ip = ip;
-    result.portName = portName;
-    result.slot = slot;
-
-    FILE* f = _wfopen(xmlFile, L"r");
-    if (!f) return result;
-
-    static char buf[262144];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
-    buf[n] = '\0';
-    fclose(f);
-
-    // Convert ip to narrow
-    char ipA[64];
-    WideCharToMultiByte(CP_ACP, 0, ip.c_str(), -1, ipA, sizeof(ipA), NULL, NULL);
-
-    // Find <address type="String" value="IP">
-    char addrPattern[128];
-    snprintf(addrPattern, sizeof(addrPattern), "value=\"%s\"", ipA);
-    char* pos1 = strstr(buf, addrPattern);
-    if (!pos1) return result;
-
-    if (portName.empty())
-    {
-        // IP-only query: find first <device> after the address element
-        char* devPos = strstr(pos1, "<device ");
-        if (!devPos || devPos > pos1 + 500) return result;
-        // Skip <device reference="..."> entries
-        if (strncmp(devPos + 8, "reference", 9) == 0) {
-            devPos = strstr(devPos + 1, "<device ");
-            if (!devPos || devPos > pos1 + 800) return result;
-        }
+    const std::wstring& path = ScratchSnapshotPath();
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE | DELETE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    bool ok = SaveTopologyXML(pGlobals, path.c_str()) && ParseSnapshotHandle(hFile, snap, sendXml);
+    CloseHandle(hFile);
+    return ok;
+}
 
-        char cn[256] = {}, nm[256] = {};
-        ExtractAttr(devPos, "classname", cn, sizeof(cn));
-        ExtractAttr(devPos, "name", nm, sizeof(nm));
+static bool CaptureViaReopen(IRSTopologyGlobals* pGlobals, const wchar_t* path,
+                             TopologySnapshot& snap, bool sendXml, bool deleteAfter)
+{
+    if (!SaveTopologyXML(pGlobals, path)) return false;
+
+    DWORD access = GENERIC_READ | (deleteAfter ? DELETE : 0);
+    DWORD flags = FILE_FLAG_SEQUENTIAL_SCAN | (deleteAfter ? FILE_FLAG_DELETE_ON_CLOSE : 0);
+    HANDLE hFile = CreateFileW(path, access,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, flags, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    bool ok = ParseSnapshotHandle(hFile, snap, sendXml);
+    CloseHandle(hFile);
+    return ok;
+}
 
-        result.found = true;
-        result.classname = std::wstring(cn, cn + strlen(cn));
-        result.deviceName = std::wstring(nm, nm + strlen(nm));
-        return result;
-    }
+bool CaptureTopologySnapshot(IRSTopologyGlobals* pGlobals, const wchar_t* keepPath,
+                             TopologySnapshot& snap, bool sendXml)
+{
+    snap.Clear();
+    if (!pGlobals) return false;
 
-    // portName + slot query: find name="portName" then value="slot" then <device>
-    char portA[128];
-    WideCharToMultiByte(CP_ACP, 0, portName.c_str(), -1, portA, sizeof(portA), NULL, NULL);
+    if (keepPath)
+        return CaptureViaReopen(pGlobals, keepPath, snap, sendXml, false);
 
-    char portPattern[256];
-    snprintf(portPattern, sizeof(portPattern), "name=\"%s\"", portA);
-    char* pos2 = strstr(pos1, portPattern);
-    if (!pos2) return result;
+    int shift = s_heldFailures < HELD_RETRY_MAX_SHIFT ? s_heldFailures : HELD_RETRY_MAX_SHIFT;
+    bool tryHeld = s_heldFailures == 0 || s_capturesSinceHeld >= (1 << shift);
+    if (tryHeld)
+    {
+        if (CaptureViaHeldHandle(pGlobals, snap, sendXml))
+        {
+            if (s_heldFailures)
+                Log(L"  >> Held-handle snapshot works again");
+            s_heldFailures = 0;
+            return true;
+        }
+        snap.Clear();
+        s_capturesSinceHeld = 0;
+    }
+    else
+        s_capturesSinceHeld++;
 
-    char slotPattern[64];
-    snprintf(slotPattern, sizeof(slotPattern), "value=\"%d\"", slot);
-    char* pos3 = strstr(pos2, slotPattern);
-    if (!pos3) return result;
+    bool ok = CaptureViaReopen(pGlobals, ScratchSnapshotPath().c_str(), snap, sendXml, true);
+    if (tryHeld && ok)
+    {
+        s_heldFailures++;
+        Log(L"  >> Held-handle snapshot failed (%d in a row) - using save + delete-on-close reopen, retry after %d captures",
+            s_heldFailures, 1 << (s_heldFailures < HELD_RETRY_MAX_SHIFT ? s_heldFailures : HELD_RETRY_MAX_SHIFT));
+    }
+    return ok;
+}
 
-    // Find <device> within 300 bytes of slot address element
-    char* pos4 = strstr(pos3, "<device ");
-    if (!pos4 || pos4 > pos3 + 300) return result;
+// ============================================================
+// Warm-start cache file (see WarmCache.h)
+// ============================================================
 
-    char cn[256] = {}, nm[256] = {};
-    if (strncmp(pos4 + 8, "reference", 9) == 0)
+bool SaveWarmCache()
+{
+    std::string image;
+    AcquireSRWLockShared(&g_deviceStoreLock);
+    bool stale = g_cacheStale;
+    if (!stale) SerializeWarmCache(g_deviceStore, g_deviceDetails, g_driverDeviceNames, image);
+    ReleaseSRWLockShared(&g_deviceStoreLock);
+    if (stale) return false;   // nothing new since the file was loaded
+
+    // Write a temporary file and rename it over the old one, so a crash
+    // mid-write never leaves a torn cache behind
+    std::wstring tmp = std::wstring(WARM_CACHE_FILE) + L".tmp";
+    HANDLE hFile = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
     {
-        if (!ResolveReference(buf, pos4, cn, sizeof(cn), nm, sizeof(nm)))
-            return result;
+        Log(L"[CACHE] Cannot write %s: %d", tmp.c_str(), GetLastError());
+        return false;
     }
-    else
+    DWORD written = 0;
+    BOOL ok = WriteFile(hFile, image.data(), (DWORD)image.size(), &written, NULL) &&
+              written == (DWORD)image.size() && FlushFileBuffers(hFile);
+    CloseHandle(hFile);
+    if (!ok || !MoveFileExW(tmp.c_str(), WARM_CACHE_FILE, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
     {
-        ExtractAttr(pos4, "classname", cn, sizeof(cn));
-        ExtractAttr(pos4, "name", nm, sizeof(nm));
+        Log(L"[CACHE] Saving %s failed: %d", WARM_CACHE_FILE, GetLastError());
+        DeleteFileW(tmp.c_str());
+        return false;
     }
-
-    result.found = true;
-    result.classname = std::wstring(cn, cn + strlen(cn));
-    result.deviceName = std::wstring(nm, nm + strlen(nm));
-    return result;
+    LogDebug(L"[CACHE] Saved %d devices (%d bytes)", (int)g_deviceStore.DeviceCount(), (int)image.size());
+    return true;
 }
 
-// Populate g_queryCache from topology XML — called once after each browse phase.
-// Walks every <address type="String" value="IP"> block and extracts:
-//   "ip"              -> top-level device (classname, name)
-//   "ip\Port\slot"    -> per-slot device on any named backplane-style bus
-void PopulateQueryCache(const wchar_t* xmlFile)
+bool LoadWarmCache()
 {
-    FILE* f = _wfopen(xmlFile, L"r");
-    if (!f) return;
-    static char buf[262144];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
-    buf[n] = '\0';
-    fclose(f);
-
-    char* p = buf;
-    while ((p = strstr(p, "<address type=\"String\" value=\"")) != nullptr)
+    HANDLE hFile = CreateFileW(WARM_CACHE_FILE, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    std::string image;
+    LARGE_INTEGER size = {};
+    bool ok = GetFileSizeEx(hFile, &size) && size.QuadPart > 0 && size.QuadPart < (64LL << 20);
+    if (ok)
     {
-        p += 30; // skip to start of IP value
-        char* ipEnd = strchr(p, '"');
-        if (!ipEnd) break;
-        std::string ipA(p, ipEnd);
-        std::wstring ipW(ipA.begin(), ipA.end());
-        p = ipEnd;
-
-        // Find top-level <device> for this IP (within 500 bytes)
-        char* searchEnd = p + 500;
-        if (searchEnd > buf + n) searchEnd = buf + n;
-        char* devPos = strstr(p, "<device ");
-        if (!devPos || devPos >= searchEnd) continue;
-        if (strncmp(devPos + 8, "reference", 9) == 0) {
-            devPos = strstr(devPos + 1, "<device ");
-            if (!devPos || devPos >= searchEnd) continue;
-        }
-
-        char cn[256] = {}, nm[256] = {};
-        ExtractAttr(devPos, "classname", cn, sizeof(cn));
-        ExtractAttr(devPos, "name", nm, sizeof(nm));
-
-        // Store IP-only entry
-        QueryResult ipResult;
-        ipResult.found = true;
-        ipResult.ip = ipW;
-        ipResult.classname = std::wstring(cn, cn + strlen(cn));
-        ipResult.deviceName = std::wstring(nm, nm + strlen(nm));
-        ipResult.slot = -1;
-        g_queryCache[ipW] = ipResult;
-
-        // Walk into ports → buses → slots
-        // Find end of this device's block: next top-level <address type="String" (next IP)
-        // or end of buffer, whichever comes first
-        char* portSearch = devPos;
-        char* nextIp = strstr(devPos + 1, "<address type=\"String\" value=\"");
-        char* portEnd = nextIp ? nextIp : buf + n;
-
-        while (portSearch < portEnd)
-        {
-            char* portPos = strstr(portSearch, "<port ");
-            if (!portPos || portPos >= portEnd) break;
-
-            char portName[128] = {};
-            ExtractAttr(portPos, "name", portName, sizeof(portName));
-            std::wstring portNameW(portName, portName + strlen(portName));
-
-            // Find <bus> within the next 200 bytes of this port
-            char* busPos = strstr(portPos, "<bus ");
-            if (!busPos || busPos > portPos + 200) { portSearch = portPos + 1; continue; }
-
-            // Enumerate <address type="Short" value="N"> within the bus block
-            // Use </bus> as boundary instead of fixed window
-            char* slotSearch = busPos;
-            char* busClose = strstr(busPos, "</bus>");
-            char* slotEnd = busClose ? busClose : portEnd;
-
-            while (slotSearch < slotEnd)
-            {
-                char* slotPos = strstr(slotSearch, "<address type=\"Short\" value=\"");
-                if (!slotPos || slotPos >= slotEnd) break;
-
-                char slotStr[16] = {};
-                // value is right after 'value="'
-                char* sv = slotPos + 29; // skip '<address type="Short" value="' (29 chars)
-                char* svEnd = strchr(sv, '"');
-                if (!svEnd) { slotSearch = slotPos + 1; continue; }
-                int slotLen = (int)(svEnd - sv < 15 ? svEnd - sv : 15);
-                memcpy(slotStr, sv, slotLen);
-                int slotN = atoi(slotStr);
-
-                // Find <device> within 200 bytes of this slot address
-                char* slotDevPos = strstr(slotPos, "<device ");
-                if (!slotDevPos || slotDevPos > slotPos + 200) { slotSearch = slotPos + 1; continue; }
-                char scn[256] = {}, snm[256] = {};
-                if (strncmp(slotDevPos + 8, "reference", 9) == 0) {
-                    if (!ResolveReference(buf, slotDevPos, scn, sizeof(scn), snm, sizeof(snm)))
-                    { slotSearch = slotPos + 1; continue; }
-                } else {
-                    ExtractAttr(slotDevPos, "classname", scn, sizeof(scn));
-                    ExtractAttr(slotDevPos, "name", snm, sizeof(snm));
-                }
-
-                // Build cache key: "ip\portName\slot"
-                wchar_t slotKeyBuf[512];
-                swprintf(slotKeyBuf, 512, L"%s\\%s\\%d", ipW.c_str(), portNameW.c_str(), slotN);
+        image.resize((size_t)size.QuadPart);
+        DWORD read = 0;
+        ok = ReadFile(hFile, &image[0], (DWORD)image.size(), &read, NULL) && read == (DWORD)image.size();
+    }
+    CloseHandle(hFile);
 
-                QueryResult slotResult;
-                slotResult.found = true;
-                slotResult.ip = ipW;
-                slotResult.portName = portNameW;
-                slotResult.slot = slotN;
-                slotResult.classname = std::wstring(scn, scn + strlen(scn));
-                slotResult.deviceName = std::wstring(snm, snm + strlen(snm));
-                g_queryCache[slotKeyBuf] = slotResult;
+    WarmCacheData data;
+    if (!ok || !ParseWarmCache(image.data(), image.size(), data))
+    {
+        Log(L"[CACHE] Ignoring %s (unreadable, or not version %d)", WARM_CACHE_FILE, WARM_CACHE_VERSION);
+        return false;
+    }
 
-                slotSearch = slotDevPos + 1;
-            }
+    AcquireSRWLockExclusive(&g_deviceStoreLock);
+    g_deviceStore = std::move(data.store);
+    g_deviceStore.BuildIndexes();
+    g_cacheStale = true;
+    ReleaseSRWLockExclusive(&g_deviceStoreLock);
+    g_deviceDetails = std::move(data.deviceDetails);
+    g_driverDeviceNames = std::move(data.driverDeviceNames);
 
-            portSearch = portPos + 1;
-        }
-    }
+    Log(L"[CACHE] Warm start: %d devices from %s (stale until the first browse)",
+        (int)g_deviceStore.DeviceCount(), WARM_CACHE_FILE);
+    return true;
 }
 
 // ============================================================
@@ -499,18 +376,76 @@ static std::string WalkAddrLine(const char* addrType,
            WalkWideToUtf8(classname) + "\n";
 }
 
-// Emit N|BEGIN...N|END block using g_driverDeviceNames (set by DoBusBrowse),
-// g_deviceDetails (set by UpdateDeviceIPsFromXML), and g_queryCache (set by PopulateQueryCache).
-// No COM calls made here — all data comes from in-memory caches.
-// pGlobals is accepted for API consistency and null-guard only.
-void WalkTopologyTree(IRSTopologyGlobals* pGlobals)
+// Path key segment: pipe-safe, with '\' (the key separator) mapped to '/'
+static std::string WalkKeySegment(const std::wstring& w)
 {
-    if (!g_pipeConnected || !pGlobals || !g_pSharedConfig) return;
+    std::string s = WalkWideToUtf8(w);
+    for (char& c : s)
+        if (c == '\\') c = '/';
+    return s;
+}
+
+// One emitted node. path identifies it across snapshots (driver, driver\ip,
+// driver\ip\port, driver\ip\port\slot); empty for ROOT/PUSH/POP lines.
+struct WalkEntry {
+    std::string path;
+    std::string line;       // full N| line including '\n' (also the diff key)
+    BinaryNodeRecord rec;   // same node, unescaped fields, for binary clients
+};
+
+static WalkEntry WalkNodeEntry(std::string path, const char* msgType, BinaryNodeKind kind,
+                               const std::wstring& f1, const std::wstring& f2)
+{
+    WalkEntry e;
+    e.path = std::move(path);
+    e.line = WalkNodeLine(msgType, f1, f2);
+    e.rec.kind = kind;
+    e.rec.f[0] = WideToUtf8(f1);
+    e.rec.f[1] = WideToUtf8(f2);
+    return e;
+}
+
+static WalkEntry WalkAddrEntry(std::string path, const char* addrType, const std::wstring& addrVal,
+                               const std::wstring& devName, const std::wstring& classname)
+{
+    WalkEntry e;
+    e.path = std::move(path);
+    e.line = WalkAddrLine(addrType, addrVal, devName, classname);
+    e.rec.kind = NODE_ADDR;
+    e.rec.f[0] = addrType;
+    e.rec.f[1] = WideToUtf8(addrVal);
+    e.rec.f[2] = WideToUtf8(devName);
+    e.rec.f[3] = WideToUtf8(classname);
+    return e;
+}
+
+static WalkEntry WalkMarkerEntry(const char* line, BinaryNodeKind kind)
+{
+    WalkEntry e;
+    e.line = line;
+    e.rec.kind = kind;
+    return e;
+}
+
+// One step of an N| block: an entry (full block), ADD/MOD of an entry,
+// or DEL of a path
+struct WalkOp {
+    BinaryNodeOp op;
+    const WalkEntry* entry;   // null for DEL
+    std::string path;         // DEL only
+};
+
+void ResetTopologyDiff(int sessionId)
+{
+    s_clientTopology.erase(sessionId);
+}
 
-    std::vector<std::string> out;
+// Build the ordered node list using g_driverDeviceNames (set by DoBusBrowse),
+// g_deviceDetails (set by UpdateDeviceIPsFromXML), and g_deviceStore (set by PopulateQueryCache).
+static void BuildWalkEntries(std::vector<WalkEntry>& out)
+{
     out.reserve(64);
-    out.push_back("N|BEGIN\n");
-    out.push_back(WalkNodeLine("N|ROOT", L"WORKSTATION", L"Workstation"));
+    out.push_back(WalkNodeEntry("", "N|ROOT", NODE_ROOT, L"WORKSTATION", L"Workstation"));
 
     // Dedup by network address (IP, or devName when IP is unknown) so that
     // two driver configs pointing at the same device don't emit it twice.
@@ -538,7 +473,8 @@ void WalkTopologyTree(IRSTopologyGlobals* pGlobals)
         }
         if (newDevices.empty()) continue;
 
-        out.push_back(WalkNodeLine("N|BUS", drv.name, L""));
+        std::string drvPath = WalkKeySegment(drv.name);
+        out.push_back(WalkNodeEntry(drvPath, "N|BUS", NODE_BUS, drv.name, L""));
 
         for (const auto& devName : newDevices)
         {
@@ -550,118 +486,167 @@ void WalkTopologyTree(IRSTopologyGlobals* pGlobals)
                     ip = it->second.ip;
             }
 
-            // Classname from g_queryCache (keyed by IP)
-            std::wstring classname;
-            if (!ip.empty())
-            {
-                auto it = g_queryCache.find(ip);
-                if (it != g_queryCache.end())
-                    classname = it->second.classname;
-            }
+            // Classname from g_deviceStore (keyed by IP)
+            const DeviceRecord* rec = ip.empty() ? nullptr : g_deviceStore.FindDevice(ip);
+            std::wstring classname = rec ? rec->classname : L"";
 
             std::wstring addrVal = ip.empty() ? devName : ip;
             emittedAddrs.insert(addrVal);
-            out.push_back(WalkAddrLine("String", addrVal, devName, classname));
+            std::string devPath = drvPath + "\\" + WalkKeySegment(addrVal);
+            out.push_back(WalkAddrEntry(devPath, "String", addrVal, devName, classname));
 
-            if (ip.empty()) continue;
+            if (!rec) continue;   // no IP yet, or not in the last snapshot
 
-            // Find backplane slot entries: g_queryCache keys "ip\portName\slot"
-            std::map<std::wstring, std::map<int, QueryResult>> ports;
-            for (const auto& kv : g_queryCache)
+            // Backplane ports in name order, each slot table in slot order
+            std::vector<const SlotTable*> ports;
+            for (const auto& t : rec->ports)
             {
-                const std::wstring& key = kv.first;
-                if (key.size() <= ip.size() + 1) continue;
-                if (key.compare(0, ip.size(), ip) != 0) continue;
-                if (key[ip.size()] != L'\\') continue;
-                size_t portEnd = key.find(L'\\', ip.size() + 1);
-                if (portEnd == std::wstring::npos) continue;
-                std::wstring portName = key.substr(ip.size() + 1, portEnd - ip.size() - 1);
-                if (!portName.empty() && kv.second.slot >= 0)
-                    ports[portName][kv.second.slot] = kv.second;
+                for (const auto& e : t.slots)
+                    if (e.present) { ports.push_back(&t); break; }
             }
-
             if (!ports.empty())
             {
-                out.push_back("N|PUSH\n");
-                for (const auto& portKv : ports)
+                std::sort(ports.begin(), ports.end(), [](const SlotTable* a, const SlotTable* b) {
+                    return g_deviceStore.PortName(a->portId) < g_deviceStore.PortName(b->portId);
+                });
+
+                out.push_back(WalkMarkerEntry("N|PUSH\n", NODE_PUSH));
+                for (const SlotTable* t : ports)
                 {
-                    out.push_back(WalkNodeLine("N|BUS", portKv.first, L""));
-                    for (const auto& slotKv : portKv.second)
+                    const std::wstring& portName = g_deviceStore.PortName(t->portId);
+                    std::string portPath = devPath + "\\" + WalkKeySegment(portName);
+                    out.push_back(WalkNodeEntry(portPath, "N|BUS", NODE_BUS, portName, L""));
+                    for (int slot = 0; slot < (int)t->slots.size(); slot++)
                     {
-                        const QueryResult& qr = slotKv.second;
-                        out.push_back(WalkAddrLine("Short",
-                            std::to_wstring(slotKv.first),
-                            qr.deviceName,
-                            qr.classname));
+                        const SlotEntry& e = t->slots[slot];
+                        if (!e.present) continue;
+                        out.push_back(WalkAddrEntry(portPath + "\\" + std::to_string(slot),
+                            "Short", std::to_wstring(slot), e.deviceName, e.classname));
                     }
                 }
-                out.push_back("N|POP\n");
+                out.push_back(WalkMarkerEntry("N|POP\n", NODE_POP));
             }
         }
     }
-
-    out.push_back("N|END\n");
-
-    EnterCriticalSection(&g_logCS);
-    for (const auto& line : out)
-        PipeSend(line.c_str(), (int)line.size());
-    LeaveCriticalSection(&g_logCS);
-
-    Log(L"[WALK] N| block sent: %d lines", (int)out.size());
 }
 
-// Update g_deviceDetails with IP addresses extracted from topology XML
-void UpdateDeviceIPsFromXML(const wchar_t* filename)
+// Diff the walk against what this client last received and send the
+// N| block (full or delta) in its encoding. Call inside a frame.
+static void WalkSendTo(PipeSession* session, const std::vector<WalkEntry>& entries,
+                       const std::map<std::string, std::string>& current)
 {
-    FILE* f = _wfopen(filename, L"r");
-    if (!f) return;
-    char buf[65536];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
-    buf[n] = 0;
-    fclose(f);
-
-    // Find each <address type="String" value="IP">
-    char* p = buf;
-    while ((p = strstr(p, "<address type=\"String\" value=\"")) != nullptr)
+    ClientTopologyState& st = s_clientTopology[session->id];
+    std::vector<WalkOp> ops;
+    bool fullBlock = !session->delta || !st.haveBaseline ||
+                     ++st.sinceResync >= TOPOLOGY_RESYNC_INTERVAL;
+    int added = 0, removed = 0, modified = 0;
+
+    if (!fullBlock)
     {
-        p += 30;  // skip past '<address type="String" value="' to start of IP
-        char* ipEnd = strchr(p, '"');
-        if (!ipEnd) break;
-        std::string ipA(p, ipEnd);
-        p = ipEnd;
-
-        // Look for <device name="..." within this address block (next 2KB)
-        char* searchEnd = p + 2000;
-        if (searchEnd > buf + n) searchEnd = buf + n;
-        char* dev = strstr(p, "<device ");
-        if (dev && dev < searchEnd)
+        // Removals first, deepest paths first (map order puts parents before children)
+        for (auto it = st.walkSent.rbegin(); it != st.walkSent.rend(); ++it)
+        {
+            if (current.count(it->first)) continue;
+            ops.push_back({ NODE_OP_DEL, nullptr, it->first });
+            removed++;
+        }
+
+        // Additions and changes in tree order, so a parent precedes its children
+        for (const auto& e : entries)
         {
-            // Skip <device reference="..."> entries (no name attribute)
-            if (strncmp(dev + 8, "reference", 9) == 0) continue;
+            if (e.path.empty()) continue;
+            auto it = st.walkSent.find(e.path);
+            if (it != st.walkSent.end() && it->second == e.line) continue;
+            bool isNew = (it == st.walkSent.end());
+            ops.push_back({ isNew ? NODE_OP_ADD : NODE_OP_MOD, &e, std::string() });
+            if (isNew) added++; else modified++;
+        }
+
+        int changes = added + removed + modified;
+        if (changes == 0)
+        {
+            Log(L"[WALK] Client %d: no topology changes (%d nodes)", session->id, (int)current.size());
+            return;
+        }
+        // A delta larger than half the tree costs more than a resync
+        if (changes * 2 > (int)current.size())
+            fullBlock = true;
+    }
 
-            char* nameAttr = strstr(dev, "name=\"");
-            if (nameAttr && nameAttr < dev + 200)
+    if (fullBlock)
+    {
+        ops.clear();
+        ops.reserve(entries.size());
+        for (const auto& e : entries)
+            ops.push_back({ NODE_OP_ENTRY, &e, std::string() });
+        st.sinceResync = 0;
+        st.haveBaseline = true;
+    }
+
+    if (session->binary)
+    {
+        BinaryEncoder& enc = session->encoder;
+        std::string buf;
+        buf.reserve(PIPE_WRITE_BUFFER);
+        enc.NodeBegin(buf, !fullBlock);
+        for (const auto& op : ops)
+        {
+            if (op.op == NODE_OP_DEL) enc.NodeDel(buf, op.path);
+            else enc.Node(buf, op.op, op.entry->path, op.entry->rec);
+            if (buf.size() >= PIPE_WRITE_BUFFER / 2)
             {
-                nameAttr += 6;
-                char* nameEnd = strchr(nameAttr, '"');
-                if (nameEnd)
-                {
-                    std::string nameA(nameAttr, nameEnd);
-                    std::wstring nameW(nameA.begin(), nameA.end());
-                    std::wstring ipW(ipA.begin(), ipA.end());
-
-                    auto it = g_deviceDetails.find(nameW);
-                    if (it != g_deviceDetails.end())
-                        it->second.ip = ipW;
-                    else
-                    {
-                        DeviceInfo info;
-                        info.productName = nameW;
-                        info.ip = ipW;
-                        g_deviceDetails[nameW] = info;
-                    }
-                }
+                PipeSessionSend(session, buf.data(), (int)buf.size());
+                buf.clear();
             }
         }
+        enc.Empty(buf, FRAME_NODE_END);
+        PipeSessionSend(session, buf.data(), (int)buf.size());
     }
+    else
+    {
+        PipeSessionSend(session, fullBlock ? "N|BEGIN\n" : "N|DELTA\n", 8);
+        std::string line;
+        for (const auto& op : ops)
+        {
+            if (op.op == NODE_OP_DEL)
+                line = "N|DEL|" + op.path + "\n";
+            else if (op.op == NODE_OP_ENTRY)
+                line = op.entry->line;
+            else    // "N|BUS|..." -> "N|ADD|path|BUS|..."
+                line = std::string(op.op == NODE_OP_ADD ? "N|ADD|" : "N|MOD|") +
+                       op.entry->path + "|" + op.entry->line.substr(2);
+            PipeSessionSend(session, line.c_str(), (int)line.size());
+        }
+        PipeSessionSend(session, "N|END\n", 6);
+    }
+
+    st.walkSent = current;
+
+    if (fullBlock)
+        Log(L"[WALK] Client %d: N| block sent: %d lines", session->id, (int)ops.size() + 2);
+    else
+        Log(L"[WALK] Client %d: N| delta sent: +%d -%d ~%d", session->id, added, removed, modified);
+}
+
+// No COM calls: everything comes from the in-memory caches, and pGlobals
+// is only null-checked
+void WalkTopologyTree(IRSTopologyGlobals* pGlobals)
+{
+    PerfScope perf(PERF_WALK_TOPOLOGY);
+    if (!g_pipeConnected || !pGlobals || !g_pSharedConfig) return;
+
+    std::vector<WalkEntry> entries;
+    BuildWalkEntries(entries);
+
+    std::map<std::string, std::string> current;
+    for (const auto& e : entries)
+        if (!e.path.empty()) current[e.path] = e.line;
+
+    // One walk, diffed per client: each has its own baseline and encoding
+    PipeBeginFrame();
+    PipeSession* targets[PIPE_MAX_CLIENTS];
+    int n = PipeTargets(targets, PIPE_MAX_CLIENTS);
+    for (int i = 0; i < n; i++)
+        WalkSendTo(targets[i], entries, current);
+    PipeEndFrame();
 }
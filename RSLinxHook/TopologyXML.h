@@ -1,10 +1,16 @@
 #pragma once
 #include "RSLinxHook_fwd.h"
 #include "ComInterfaces.h"
+#include "DeviceStore.h"
+
+struct TopologySnapshot;
 
 // ============================================================
 // XML topology handling — save, parse, and analyze
-// Globals defined in TopologyXML.cpp
+// Capture, warm cache and the N| walk live in TopologyXML.cpp; the
+// snapshot consumers, the device cache and their globals (except
+// g_driverDeviceNames) in TopologyQuery.cpp, which has no COM or pipe
+// dependencies beyond Log().
 // ============================================================
 
 struct TopologyCounts {
@@ -12,34 +18,93 @@ struct TopologyCounts {
     int identifiedDevices;
 };
 
-struct DeviceInfo {
-    std::wstring ip;           // "10.39.31.200" (from topology XML address mapping)
-    std::wstring productName;  // DISPID 1 = Name (e.g. "5069-L310ER LOGIX310ER")
-    std::wstring objectId;     // DISPID 2 = topology objectid GUID
-};
-
 extern std::map<std::wstring, DeviceInfo> g_deviceDetails;
 
-// Path query result: ip-only (portName="", slot=-1) or backplane slot
-struct QueryResult {
-    bool found = false;
-    std::wstring classname;
-    std::wstring deviceName;
+// Browse-time refresh of one device's entry: name and objectId from COM.
+// The IP the last snapshot recorded (UpdateDeviceIPsFromXML) is kept, so
+// C|SKIP and backplane priority still match by address after a bus browse.
+void RefreshDeviceDetails(const std::wstring& name, const std::wstring& objectId);
+
+// devName is one of ips: by the IP g_deviceDetails holds for the name, or
+// by a name that starts with the IP (RSLinx names unidentified Node Table
+// entries after their address).
+template <typename IPs>
+bool DeviceMatchesIP(const std::wstring& devName, const IPs& ips)
+{
+    if (ips.empty() || devName.empty()) return false;
     std::wstring ip;
-    std::wstring portName;
-    int slot = -1;
-};
+    auto it = g_deviceDetails.find(devName);
+    if (it != g_deviceDetails.end()) ip = it->second.ip;
+    for (const auto& match : ips)
+    {
+        if (!ip.empty() && ip == match) return true;
+        if (devName.compare(0, match.length(), match) == 0 &&
+            (devName.length() == match.length() ||
+             (devName[match.length()] != L'.' && !iswdigit(devName[match.length()]))))
+            return true;
+    }
+    return false;
+}
 
-// In-memory query cache: key = "ip" or "ip\PortName\slot"
+// In-memory device store: IP hash map with per-port slot tables (see DeviceStore.h).
 // Populated once after each browse phase; queried without any file I/O.
-extern std::map<std::wstring, QueryResult> g_queryCache;
+extern DeviceStore g_deviceStore;
+// The worker holds g_deviceStoreLock exclusive while it refreshes the store;
+// pipe session threads read it through LookupCachedPath.
+extern SRWLOCK g_deviceStoreLock;
+bool LookupCachedPath(const std::wstring& ip, const std::wstring& portName, int slot,
+                      QueryResult& out);
+// F| under the shared lock (DeviceStore::Find); results carry g_cacheStale
+bool FindCachedPaths(const FindQuery& q, std::vector<QueryResult>& out, size_t max);
+
+// Warm start: the query cache, g_deviceDetails and g_driverDeviceNames as
+// of the last completed browse, kept across RSLinx restarts (WarmCache.h).
+// LoadWarmCache runs at hook start; until a completed browse replaces the
+// data (PopulateQueryCache with complete), g_cacheStale is set and
+// answers carry QueryResult::stale. SaveWarmCache follows each completed
+// browse; the file is replaced atomically.
+#define WARM_CACHE_FILE L"C:\\temp\\hook_topology.cache"
+extern volatile bool g_cacheStale;
+bool LoadWarmCache();
+bool SaveWarmCache();
 
 bool SaveTopologyXML(IRSTopologyGlobals* pGlobals, const wchar_t* filename);
+
+// Save + parse one snapshot without leaving a file in the log dir.
+// keepPath == nullptr: XML goes through a delete-on-close temporary file
+// and is parsed from the open handle. keepPath set (debugXml): XML is
+// written there and kept. sendXml also streams it as an X| block, unless it
+// is byte-identical to the last block sent to this client.
+bool CaptureTopologySnapshot(IRSTopologyGlobals* pGlobals, const wchar_t* keepPath,
+                             TopologySnapshot& snap, bool sendXml);
+
+// Snapshot consumers. The TopologySnapshot overloads read an already-parsed
+// tree (see TopologySnapshot.h); the filename overloads parse the file once
+// and forward. Load one snapshot when several results are needed from it.
+TopologyCounts CountDevicesInXML(const TopologySnapshot& snap);
 TopologyCounts CountDevicesInXML(const wchar_t* filename);
+int CountTargetsIdentifiedInXML(const TopologySnapshot& snap, const std::vector<std::wstring>& targetIPs);
 int CountTargetsIdentifiedInXML(const wchar_t* filename, const std::vector<std::wstring>& targetIPs);
+bool IsTargetIdentifiedInXML(const TopologySnapshot& snap, const std::vector<std::wstring>& targetIPs);
 bool IsTargetIdentifiedInXML(const wchar_t* filename, const std::vector<std::wstring>& targetIPs);
+void UpdateDeviceIPsFromXML(const TopologySnapshot& snap);
+// IP addresses already in the topology per driver (workstation port name).
+void CollectDriverAddresses(const TopologySnapshot& snap,
+                            std::map<std::wstring, std::set<std::wstring>>& out);
 void UpdateDeviceIPsFromXML(const wchar_t* filename);
+void PopulateQueryCache(const TopologySnapshot& snap, bool complete = false);
 void PopulateQueryCache(const wchar_t* xmlFile);
+// Incremental PopulateQueryCache driven by the sinks' dirty state (see
+// TakeDirtyDevices). Rebuilds the slot tables of dirtyDevices,
+// dropping slots no longer in the snapshot. With ethernetDirty it also
+// refreshes every IP-level record and caches the full subtree of new IPs.
+// Returns false without touching the cache if a dirty device has no known IP.
+bool RefreshQueryCache(const TopologySnapshot& snap, bool ethernetDirty,
+                       const std::set<std::wstring>& dirtyDevices, int& refreshed);
+QueryResult QueryXMLForPath(const TopologySnapshot& snap,
+                             const std::wstring& ip,
+                             const std::wstring& portName,
+                             int slot);
 QueryResult QueryXMLForPath(const wchar_t* xmlFile,
                              const std::wstring& ip,
                              const std::wstring& portName,
@@ -53,6 +118,14 @@ int CountTargetsFromCache(const std::vector<std::wstring>& targetIPs);
 // Used by WalkTopologyTree so no COM calls are needed from the worker thread.
 extern std::map<std::wstring, std::vector<std::wstring>> g_driverDeviceNames;
 
-// Emit the topology as N| messages (N|BEGIN...N|END) on the pipe.
+// Walks between forced full N|BEGIN blocks for delta-capable clients
+#define TOPOLOGY_RESYNC_INTERVAL 30
+
+// Emit the topology as N| messages to each output target (see PipeTargets):
+// a full N|BEGIN...N|END block, or an N|DELTA...N|END block of changes for
+// a client that sent C|DELTA=1 and already holds a tree.
 // Must be called AFTER UpdateDeviceIPsFromXML + PopulateQueryCache for the current snapshot.
 void WalkTopologyTree(IRSTopologyGlobals* pGlobals);
+
+// Forget what was sent to a client (it disconnected).
+void ResetTopologyDiff(int sessionId);
@@ -0,0 +1,181 @@
+#pragma once
+// ============================================================
+// Type library lookups shared by VerifyComLayout (ComLayoutCheck.cpp)
+// and TypeLibDump --header, so the startup check and the generator
+// resolve a ComLayout binding the same way. Header-only: TypeLibDump is
+// built as a single file.
+// ============================================================
+
+#include <windows.h>
+#include <oleauto.h>
+
+namespace TypeInfoLookup {
+
+// Base interface of pTI, AddRef'd; null at IUnknown/IDispatch's root
+inline ITypeInfo* BaseTypeInfo(ITypeInfo* pTI)
+{
+    TYPEATTR* pAttr = nullptr;
+    if (FAILED(pTI->GetTypeAttr(&pAttr))) return nullptr;
+    WORD implTypes = pAttr->cImplTypes;
+    pTI->ReleaseTypeAttr(pAttr);
+    if (implTypes == 0) return nullptr;
+
+    HREFTYPE hRef = 0;
+    ITypeInfo* pBase = nullptr;
+    if (SUCCEEDED(pTI->GetRefTypeOfImplType(0, &hRef)))
+        pTI->GetRefTypeInfo(hRef, &pBase);
+    return pBase;
+}
+
+// The vtable interface behind pTI: itself for TKIND_INTERFACE, the
+// interface half of a dual dispinterface, else null. AddRef'd.
+inline ITypeInfo* VtableTypeInfo(ITypeInfo* pTI)
+{
+    TYPEATTR* pAttr = nullptr;
+    if (FAILED(pTI->GetTypeAttr(&pAttr))) return nullptr;
+    TYPEKIND kind = pAttr->typekind;
+    bool dual = (pAttr->wTypeFlags & TYPEFLAG_FDUAL) != 0;
+    pTI->ReleaseTypeAttr(pAttr);
+
+    if (kind == TKIND_INTERFACE) { pTI->AddRef(); return pTI; }
+    if (kind != TKIND_DISPATCH || !dual) return nullptr;
+    HREFTYPE hRef = 0;
+    ITypeInfo* pVtbl = nullptr;
+    if (SUCCEEDED(pTI->GetRefTypeOfImplType((UINT)-1, &hRef)))
+        pTI->GetRefTypeInfo(hRef, &pVtbl);
+    return pVtbl;
+}
+
+inline bool NameIs(ITypeInfo* pTI, MEMBERID memid, const wchar_t* name)
+{
+    BSTR bstr = nullptr;
+    if (FAILED(pTI->GetDocumentation(memid, &bstr, nullptr, nullptr, nullptr)) || !bstr)
+        return false;
+    bool same = _wcsicmp(bstr, name) == 0;
+    SysFreeString(bstr);
+    return same;
+}
+
+// Member name with a matching invoke kind in pTI or its bases. A
+// dispinterface property counts as PROPGET. Returns DISPID_UNKNOWN
+// when there is none.
+inline DISPID FindDispMember(ITypeInfo* pTI, const wchar_t* name, WORD kind)
+{
+    pTI->AddRef();
+    while (pTI)
+    {
+        TYPEATTR* pAttr = nullptr;
+        if (SUCCEEDED(pTI->GetTypeAttr(&pAttr)))
+        {
+            DISPID found = DISPID_UNKNOWN;
+            for (UINT i = 0; i < pAttr->cFuncs && found == DISPID_UNKNOWN; i++)
+            {
+                FUNCDESC* pFunc = nullptr;
+                if (FAILED(pTI->GetFuncDesc(i, &pFunc))) continue;
+                if ((WORD)pFunc->invkind == kind && NameIs(pTI, pFunc->memid, name))
+                    found = pFunc->memid;
+                pTI->ReleaseFuncDesc(pFunc);
+            }
+            for (UINT i = 0; i < pAttr->cVars && found == DISPID_UNKNOWN; i++)
+            {
+                VARDESC* pVar = nullptr;
+                if (FAILED(pTI->GetVarDesc(i, &pVar))) continue;
+                if (kind == DISPATCH_PROPERTYGET && pVar->varkind == VAR_DISPATCH &&
+                    NameIs(pTI, pVar->memid, name))
+                    found = pVar->memid;
+                pTI->ReleaseVarDesc(pVar);
+            }
+            pTI->ReleaseTypeAttr(pAttr);
+            if (found != DISPID_UNKNOWN) { pTI->Release(); return found; }
+        }
+        ITypeInfo* pBase = BaseTypeInfo(pTI);
+        pTI->Release();
+        pTI = pBase;
+    }
+    return DISPID_UNKNOWN;
+}
+
+// Parameter count of the function at vtable slot in pTI or its bases;
+// -1 when no function sits there
+inline int SlotParams(ITypeInfo* pTI, int slot)
+{
+    pTI->AddRef();
+    while (pTI)
+    {
+        TYPEATTR* pAttr = nullptr;
+        int params = -1;
+        if (SUCCEEDED(pTI->GetTypeAttr(&pAttr)))
+        {
+            for (UINT i = 0; i < pAttr->cFuncs && params < 0; i++)
+            {
+                FUNCDESC* pFunc = nullptr;
+                if (FAILED(pTI->GetFuncDesc(i, &pFunc))) continue;
+                if (pFunc->oVft / (int)sizeof(void*) == slot) params = pFunc->cParams;
+                pTI->ReleaseFuncDesc(pFunc);
+            }
+            pTI->ReleaseTypeAttr(pAttr);
+        }
+        if (params >= 0) { pTI->Release(); return params; }
+        ITypeInfo* pBase = BaseTypeInfo(pTI);
+        pTI->Release();
+        pTI = pBase;
+    }
+    return -1;
+}
+
+// DISPID of name and kind in the type of iid (the first library that
+// has it), or with a null iid in the first type of any library that has
+// the member. described is false when no library has the type (or, for
+// a null iid, the member). libs may hold nulls.
+inline DISPID LookupDispMember(ITypeLib* const* libs, int count, const GUID& iid,
+                               const wchar_t* name, WORD kind, bool& described)
+{
+    described = false;
+    for (int i = 0; i < count; i++)
+    {
+        if (!libs[i]) continue;
+        if (iid != GUID_NULL)
+        {
+            ITypeInfo* pTI = nullptr;
+            if (FAILED(libs[i]->GetTypeInfoOfGuid(iid, &pTI)) || !pTI) continue;
+            described = true;
+            DISPID id = FindDispMember(pTI, name, kind);
+            pTI->Release();
+            return id;
+        }
+        UINT types = libs[i]->GetTypeInfoCount();
+        for (UINT t = 0; t < types; t++)
+        {
+            ITypeInfo* pTI = nullptr;
+            if (FAILED(libs[i]->GetTypeInfo(t, &pTI)) || !pTI) continue;
+            DISPID id = FindDispMember(pTI, name, kind);
+            pTI->Release();
+            if (id != DISPID_UNKNOWN) { described = true; return id; }
+        }
+    }
+    return DISPID_UNKNOWN;
+}
+
+// Parameter count at slot of iid's vtable interface (the first library
+// that has the type); -1 when no function sits there. described is false
+// when no library has the type or its description is dispatch-only.
+inline int LookupSlotParams(ITypeLib* const* libs, int count, const GUID& iid, int slot,
+                            bool& described)
+{
+    described = false;
+    for (int i = 0; i < count; i++)
+    {
+        ITypeInfo* pTI = nullptr;
+        if (!libs[i] || FAILED(libs[i]->GetTypeInfoOfGuid(iid, &pTI)) || !pTI) continue;
+        ITypeInfo* pVtbl = VtableTypeInfo(pTI);
+        pTI->Release();
+        if (!pVtbl) return -1;
+        described = true;
+        int params = SlotParams(pVtbl, slot);
+        pVtbl->Release();
+        return params;
+    }
+    return -1;
+}
+
+} // namespace TypeInfoLookup
@@ -0,0 +1,206 @@
+#include "WarmCache.h"
+#include <cstring>
+
+// ============================================================
+// WarmCache implementation
+// ============================================================
+
+static const char s_magic[4] = { 'R', 'L', 'W', 'C' };
+static const size_t s_headerSize = 16;
+
+static void PutVarint(std::string& out, unsigned v)
+{
+    while (v >= 0x80)
+    {
+        out += (char)(unsigned char)((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += (char)(unsigned char)v;
+}
+
+static void PutString(std::string& out, const std::wstring& s)
+{
+    PutVarint(out, (unsigned)s.size());
+    for (wchar_t c : s) PutVarint(out, (unsigned)c);
+}
+
+static void PutU32(std::string& out, unsigned v)
+{
+    for (int i = 0; i < 4; i++) out += (char)(unsigned char)(v >> (8 * i));
+}
+
+static unsigned GetU32(const char* p)
+{
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) v |= (unsigned)(unsigned char)p[i] << (8 * i);
+    return v;
+}
+
+static unsigned Fnv1a(const char* p, size_t len)
+{
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) { h ^= (unsigned char)p[i]; h *= 16777619u; }
+    return h;
+}
+
+// Bounds-checked reader over the payload; any overrun sets ok = false
+struct WarmReader {
+    const char* p;
+    const char* end;
+    bool ok = true;
+
+    unsigned Varint()
+    {
+        unsigned v = 0;
+        for (int shift = 0; shift <= 28; shift += 7)
+        {
+            if (p >= end) { ok = false; return 0; }
+            unsigned char b = (unsigned char)*p++;
+            v |= (unsigned)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) return v;
+        }
+        ok = false;
+        return 0;
+    }
+
+    // Element count, rejected if it can't fit in what is left
+    unsigned Count()
+    {
+        unsigned n = Varint();
+        if (n > (unsigned)(end - p)) { ok = false; return 0; }
+        return n;
+    }
+
+    std::wstring String()
+    {
+        unsigned n = Count();
+        std::wstring s;
+        s.reserve(n);
+        for (unsigned i = 0; i < n && ok; i++) s += (wchar_t)Varint();
+        return s;
+    }
+};
+
+void SerializeWarmCache(const DeviceStore& store,
+                        const std::map<std::wstring, DeviceInfo>& deviceDetails,
+                        const std::map<std::wstring, std::vector<std::wstring>>& driverDeviceNames,
+                        std::string& out)
+{
+    std::string payload;
+    payload.reserve(4096);
+
+    PutVarint(payload, (unsigned)store.PortCount());
+    for (size_t i = 0; i < store.PortCount(); i++)
+        PutString(payload, store.PortName((int)i));
+
+    PutVarint(payload, (unsigned)store.DeviceCount());
+    for (const auto& kv : store.Devices())
+    {
+        const DeviceRecord& dev = kv.second;
+        PutString(payload, dev.ip);
+        PutString(payload, dev.classname);
+        PutString(payload, dev.deviceName);
+        PutVarint(payload, (unsigned)dev.ports.size());
+        for (const auto& t : dev.ports)
+        {
+            unsigned present = 0;
+            for (const auto& e : t.slots)
+                if (e.present) present++;
+            PutVarint(payload, (unsigned)t.portId);
+            PutVarint(payload, present);
+            for (size_t slot = 0; slot < t.slots.size(); slot++)
+            {
+                if (!t.slots[slot].present) continue;
+                PutVarint(payload, (unsigned)slot);
+                PutString(payload, t.slots[slot].classname);
+                PutString(payload, t.slots[slot].deviceName);
+            }
+        }
+    }
+
+    PutVarint(payload, (unsigned)deviceDetails.size());
+    for (const auto& kv : deviceDetails)
+    {
+        PutString(payload, kv.first);
+        PutString(payload, kv.second.ip);
+        PutString(payload, kv.second.productName);
+        PutString(payload, kv.second.objectId);
+    }
+
+    PutVarint(payload, (unsigned)driverDeviceNames.size());
+    for (const auto& kv : driverDeviceNames)
+    {
+        PutString(payload, kv.first);
+        PutVarint(payload, (unsigned)kv.second.size());
+        for (const auto& name : kv.second) PutString(payload, name);
+    }
+
+    out.clear();
+    out.reserve(s_headerSize + payload.size());
+    out.append(s_magic, sizeof(s_magic));
+    PutU32(out, WARM_CACHE_VERSION);
+    PutU32(out, (unsigned)payload.size());
+    PutU32(out, Fnv1a(payload.data(), payload.size()));
+    out += payload;
+}
+
+bool ParseWarmCache(const char* data, size_t len, WarmCacheData& out)
+{
+    if (len < s_headerSize || memcmp(data, s_magic, sizeof(s_magic)) != 0) return false;
+    if (GetU32(data + 4) != WARM_CACHE_VERSION) return false;
+    unsigned payloadLen = GetU32(data + 8);
+    if (payloadLen != len - s_headerSize) return false;
+    const char* payload = data + s_headerSize;
+    if (GetU32(data + 12) != Fnv1a(payload, payloadLen)) return false;
+
+    WarmReader r = { payload, payload + payloadLen };
+
+    // Port ids in the file are positions in this list; re-intern them
+    std::vector<int> portIds;
+    unsigned ports = r.Count();
+    for (unsigned i = 0; i < ports && r.ok; i++)
+        portIds.push_back(out.store.InternPort(r.String()));
+
+    unsigned devices = r.Count();
+    for (unsigned i = 0; i < devices && r.ok; i++)
+    {
+        std::wstring ip = r.String();
+        DeviceRecord& dev = out.store.UpsertDevice(ip);
+        dev.classname = r.String();
+        dev.deviceName = r.String();
+        unsigned tables = r.Count();
+        for (unsigned t = 0; t < tables && r.ok; t++)
+        {
+            unsigned portRef = r.Varint();
+            unsigned present = r.Count();
+            if (portRef >= portIds.size()) { r.ok = false; break; }
+            for (unsigned e = 0; e < present && r.ok; e++)
+            {
+                unsigned slot = r.Varint();
+                std::wstring classname = r.String();
+                std::wstring deviceName = r.String();
+                out.store.SetSlot(dev, portIds[portRef], (int)slot, classname, deviceName);
+            }
+        }
+    }
+
+    unsigned details = r.Count();
+    for (unsigned i = 0; i < details && r.ok; i++)
+    {
+        std::wstring name = r.String();
+        DeviceInfo& info = out.deviceDetails[name];
+        info.ip = r.String();
+        info.productName = r.String();
+        info.objectId = r.String();
+    }
+
+    unsigned drivers = r.Count();
+    for (unsigned i = 0; i < drivers && r.ok; i++)
+    {
+        std::vector<std::wstring>& names = out.driverDeviceNames[r.String()];
+        unsigned n = r.Count();
+        for (unsigned k = 0; k < n && r.ok; k++) names.push_back(r.String());
+    }
+
+    return r.ok && r.p == r.end;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include "DeviceStore.h"
+
+// ============================================================
+// Warm-start topology cache file
+// Pure C++ (no Win32): the byte image of what Q| and N| are served
+// from, so a freshly injected hook can answer before its first
+// browse. TopologyXML.cpp writes it after each successful browse
+// and loads it at hook start.
+//
+//   header   "RLWC", u32 version, u32 payload length, u32 FNV-1a of payload
+//   payload  port names, devices (with slot tables), device details,
+//            driver → device names
+//
+// Strings are varint unit count + varint UTF-16 units, integers
+// unsigned LEB128. A file of another version, or one that fails
+// its checksum, is ignored.
+// ============================================================
+
+#define WARM_CACHE_VERSION 1
+
+struct WarmCacheData {
+    DeviceStore store;
+    std::map<std::wstring, DeviceInfo> deviceDetails;
+    std::map<std::wstring, std::vector<std::wstring>> driverDeviceNames;
+};
+
+void SerializeWarmCache(const DeviceStore& store,
+                        const std::map<std::wstring, DeviceInfo>& deviceDetails,
+                        const std::map<std::wstring, std::vector<std::wstring>>& driverDeviceNames,
+                        std::string& out);
+
+// False (out left partly filled) on a bad header, version, checksum or record
+bool ParseWarmCache(const char* data, size_t len, WarmCacheData& out);
@@ -0,0 +1,200 @@
+using System.Text;
+
+namespace RSLinxViewer;
+
+/// <summary>
+/// Hook → client frame types after "V|BINARY|1" (see RSLinxHook/PipeBinary.h).
+/// Each frame is: u8 type, varint payload length, payload.
+/// </summary>
+enum FrameType : byte
+{
+    Log       = 0x01,
+    Status    = 0x02,
+    XmlBegin  = 0x03,
+    XmlData   = 0x04,
+    XmlEnd    = 0x05,
+    NodeBegin = 0x06,
+    Node      = 0x07,
+    NodeEnd   = 0x08,
+    String    = 0x09,
+    Result    = 0x0A,
+    Done      = 0x0B,
+    ResultTagged = 0x0C,   // QB| batch answers; the viewer sends no batches
+    Perf      = 0x0D,      // P| stats lines; the viewer does not ask for them
+    Device    = 0x0E,      // C|STREAM=1 records; the viewer does not ask for them
+}
+
+/// <summary>
+/// Buffered reader over the pipe that serves both halves of a session:
+/// UTF-8 text lines until the hook switches to frames, then length-prefixed frames.
+/// </summary>
+sealed class FrameReader
+{
+    readonly Stream _stream;
+    readonly byte[] _buf = new byte[65536];
+    int _pos;
+    int _len;
+
+    public FrameReader(Stream stream) => _stream = stream;
+
+    bool Fill()
+    {
+        if (_pos > 0)
+        {
+            Buffer.BlockCopy(_buf, _pos, _buf, 0, _len - _pos);
+            _len -= _pos;
+            _pos = 0;
+        }
+        if (_len == _buf.Length) return false;
+        int n = _stream.Read(_buf, _len, _buf.Length - _len);
+        if (n <= 0) return false;
+        _len += n;
+        return true;
+    }
+
+    /// <summary>Next '\n'-terminated line without the terminator, or null at EOF.</summary>
+    public string? ReadLine()
+    {
+        var overflow = new List<byte>();
+        while (true)
+        {
+            int nl = Array.IndexOf(_buf, (byte)'\n', _pos, _len - _pos);
+            if (nl >= 0)
+            {
+                int end = nl > _pos && _buf[nl - 1] == '\r' ? nl - 1 : nl;
+                overflow.AddRange(new ArraySegment<byte>(_buf, _pos, end - _pos));
+                _pos = nl + 1;
+                return Encoding.UTF8.GetString(overflow.ToArray());
+            }
+            // Line longer than the buffer: keep what we have and read on
+            if (_pos == 0 && _len == _buf.Length)
+            {
+                overflow.AddRange(_buf);
+                _len = 0;
+            }
+            if (!Fill())
+                return overflow.Count > 0 ? Encoding.UTF8.GetString(overflow.ToArray()) : null;
+        }
+    }
+
+    byte? ReadByte()
+    {
+        if (_pos == _len && !Fill()) return null;
+        return _buf[_pos++];
+    }
+
+    /// <summary>Next frame, or false at EOF. The payload array is owned by the caller.</summary>
+    public bool ReadFrame(out FrameType type, out byte[] payload)
+    {
+        type = 0;
+        payload = Array.Empty<byte>();
+        var t = ReadByte();
+        if (t == null) return false;
+        type = (FrameType)t.Value;
+
+        uint length = 0;
+        for (int shift = 0; ; shift += 7)
+        {
+            var b = ReadByte();
+            if (b == null || shift > 28) return false;
+            length |= (uint)(b.Value & 0x7F) << shift;
+            if ((b.Value & 0x80) == 0) break;
+        }
+
+        payload = new byte[length];
+        int copied = 0;
+        while (copied < payload.Length)
+        {
+            if (_pos == _len && !Fill()) return false;
+            int n = Math.Min(_len - _pos, payload.Length - copied);
+            Buffer.BlockCopy(_buf, _pos, payload, copied, n);
+            _pos += n;
+            copied += n;
+        }
+        return true;
+    }
+}
+
+/// <summary>
+/// Per-session frame decoding state: the interned string table, and the
+/// conversion of NODE records back to the N| lines NodeModel and TreeBuilder read.
+/// </summary>
+sealed class FrameDecoder
+{
+    readonly List<string> _strings = new();
+
+    public static uint ReadVarint(byte[] p, ref int pos)
+    {
+        uint v = 0;
+        for (int shift = 0; pos < p.Length && shift <= 28; shift += 7)
+        {
+            byte b = p[pos++];
+            v |= (uint)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) break;
+        }
+        return v;
+    }
+
+    /// <summary>STRING frame: varint id, UTF-8 bytes. Ids arrive in order.</summary>
+    public void AddString(byte[] p)
+    {
+        int pos = 0;
+        int id = (int)ReadVarint(p, ref pos);
+        string s = Encoding.UTF8.GetString(p, pos, p.Length - pos);
+        while (_strings.Count <= id) _strings.Add("");
+        _strings[id] = s;
+    }
+
+    string Str(byte[] p, ref int pos)
+    {
+        int id = (int)ReadVarint(p, ref pos);
+        return id < _strings.Count ? _strings[id] : "";
+    }
+
+    // Same substitution the hook applies to text N| fields
+    static string Field(string s) => s.Replace('|', ' ').Replace('\n', ' ').Replace('\r', ' ');
+
+    /// <summary>NODE frame as the equivalent N| text line (full-block or delta form).</summary>
+    public string? NodeLine(byte[] p)
+    {
+        int pos = 0;
+        if (p.Length < 2) return null;
+        byte op = p[pos++];
+        uint pathRef = ReadVarint(p, ref pos);
+        string path = pathRef == 0 || pathRef > _strings.Count ? "" : _strings[(int)pathRef - 1];
+
+        if (op == 3)
+            return "N|DEL|" + path;
+        if (pos >= p.Length) return null;
+
+        string body;
+        switch (p[pos++])
+        {
+            case 0: body = $"ROOT|{Field(Str(p, ref pos))}|{Field(Str(p, ref pos))}"; break;
+            case 1: body = $"BUS|{Field(Str(p, ref pos))}|{Field(Str(p, ref pos))}"; break;
+            case 2:
+                body = $"ADDR|{Field(Str(p, ref pos))}|{Field(Str(p, ref pos))}|" +
+                       $"{Field(Str(p, ref pos))}|{Field(Str(p, ref pos))}";
+                break;
+            case 3: body = "PUSH"; break;
+            case 4: body = "POP"; break;
+            default: return null;
+        }
+        return op switch
+        {
+            1 => $"N|ADD|{path}|{body}",
+            2 => $"N|MOD|{path}|{body}",
+            _ => "N|" + body,
+        };
+    }
+
+    /// <summary>STATUS frame: varint total, identified, events.</summary>
+    public static (int total, int identified, int events) Status(byte[] p)
+    {
+        int pos = 0;
+        int total = (int)ReadVarint(p, ref pos);
+        int identified = (int)ReadVarint(p, ref pos);
+        int events = (int)ReadVarint(p, ref pos);
+        return (total, identified, events);
+    }
+}
@@ -0,0 +1,195 @@
+namespace RSLinxViewer;
+
+/// <summary>
+/// Client-side copy of the hook's N| topology, patched in place by delta blocks.
+///
+/// Nodes are keyed by path, '\'-separated, with depth implying the kind:
+///   driver                      N|BUS (driver bus)
+///   driver\addr                 N|ADDR|String (Ethernet device; addr = IP or device name)
+///   driver\addr\port            N|BUS (backplane port of that device)
+///   driver\addr\port\slot       N|ADDR|Short (backplane module)
+/// Segment text is the field as sent with '\' mapped to '/', matching the hook.
+///
+/// Delta block (between N|DELTA and N|END):
+///   N|ADD|path|BUS|...  or  N|ADD|path|ADDR|...   — new node (parent sent first)
+///   N|MOD|path|...                                — node text changed
+///   N|DEL|path                                    — node and its sub-tree removed
+/// </summary>
+sealed class NodeModel
+{
+    sealed class Node
+    {
+        public required string Path;
+        public required string Line;   // N| line as it appears in a full block
+        public Node? Parent;
+        public readonly List<Node> Children = new();
+    }
+
+    string _rootLine = "N|ROOT|WORKSTATION|Workstation";
+    readonly List<Node> _drivers = new();
+    readonly Dictionary<string, Node> _byPath = new();
+
+    /// <summary>Replace the model with a full block (lines between N|BEGIN and N|END).</summary>
+    public void Reset(IReadOnlyList<string> lines)
+    {
+        _drivers.Clear();
+        _byPath.Clear();
+
+        Node? driver = null;     // current driver bus
+        Node? lastDevice = null; // last Ethernet device (PUSH target)
+        Node? device = null;     // device whose backplane we are inside
+        Node? port = null;       // current backplane bus
+
+        foreach (var raw in lines)
+        {
+            var line = raw.TrimEnd('\n', '\r');
+            var parts = line.Split('|');
+            if (parts.Length < 2 || parts[0] != "N") continue;
+
+            switch (parts[1])
+            {
+                case "ROOT":
+                    _rootLine = line;
+                    break;
+
+                case "BUS" when parts.Length >= 3:
+                    if (device == null)
+                    {
+                        driver = Add(null, Segment(parts[2]), line);
+                        lastDevice = null;
+                    }
+                    else
+                    {
+                        port = Add(device, Segment(parts[2]), line);
+                    }
+                    break;
+
+                case "ADDR" when parts.Length >= 4 && parts[2] == "String":
+                    if (driver != null && device == null)
+                        lastDevice = Add(driver, Segment(parts[3]), line);
+                    break;
+
+                case "ADDR" when parts.Length >= 4 && parts[2] == "Short":
+                    if (port != null)
+                        Add(port, Segment(parts[3]), line);
+                    break;
+
+                case "PUSH":
+                    device = lastDevice;
+                    port = null;
+                    break;
+
+                case "POP":
+                    device = null;
+                    port = null;
+                    break;
+            }
+        }
+    }
+
+    /// <summary>Apply a delta block (lines between N|DELTA and N|END).</summary>
+    public void Apply(IReadOnlyList<string> lines)
+    {
+        foreach (var raw in lines)
+        {
+            var line = raw.TrimEnd('\n', '\r');
+            if (line.StartsWith("N|DEL|"))
+            {
+                if (_byPath.TryGetValue(line[6..], out var node))
+                    Remove(node);
+                continue;
+            }
+
+            bool isAdd = line.StartsWith("N|ADD|");
+            if (!isAdd && !line.StartsWith("N|MOD|")) continue;
+
+            // N|ADD|path|BUS|name|cls -> path + "N|BUS|name|cls"
+            int sep = line.IndexOf('|', 6);
+            if (sep < 0) continue;
+            string path = line[6..sep];
+            string nodeLine = "N|" + line[(sep + 1)..];
+
+            if (_byPath.TryGetValue(path, out var existing))
+            {
+                existing.Line = nodeLine;
+                continue;
+            }
+            if (!isAdd) continue;
+
+            int slash = path.LastIndexOf('\\');
+            Node? parent = null;
+            if (slash >= 0 && !_byPath.TryGetValue(path[..slash], out parent))
+                continue; // parent unknown — the next full resync repairs it
+            Add(parent, slash >= 0 ? path[(slash + 1)..] : path, nodeLine);
+        }
+    }
+
+    /// <summary>
+    /// Render the model back to full-block lines for TreeBuilder.Build.
+    /// Returns a new list on every call.
+    /// </summary>
+    public List<string> ToLines()
+    {
+        var lines = new List<string>(_byPath.Count + 8) { _rootLine };
+        foreach (var driver in _drivers)
+        {
+            lines.Add(driver.Line);
+            foreach (var device in driver.Children)
+            {
+                lines.Add(device.Line);
+                if (device.Children.Count == 0) continue;
+                lines.Add("N|PUSH");
+                foreach (var port in device.Children)
+                {
+                    lines.Add(port.Line);
+                    foreach (var slot in port.Children)
+                        lines.Add(slot.Line);
+                }
+                lines.Add("N|POP");
+            }
+        }
+        return lines;
+    }
+
+    static string Segment(string field) => field.Replace('\\', '/');
+
+    Node Add(Node? parent, string segment, string line)
+    {
+        string path = parent == null ? segment : parent.Path + "\\" + segment;
+        var node = new Node { Path = path, Line = line, Parent = parent };
+        _byPath[path] = node;
+
+        var siblings = parent?.Children ?? _drivers;
+        siblings.Insert(InsertIndex(siblings, node), node);
+        return node;
+    }
+
+    // Drivers and Ethernet devices keep arrival order; backplane ports sort by
+    // name and slots by number, the same order the hook emits them in.
+    static int InsertIndex(List<Node> siblings, Node node)
+    {
+        int depth = node.Path.Count(c => c == '\\');
+        if (depth < 2) return siblings.Count;
+
+        string key = LastSegment(node.Path);
+        for (int i = 0; i < siblings.Count; i++)
+        {
+            string other = LastSegment(siblings[i].Path);
+            bool before = depth == 3 && int.TryParse(key, out int a) && int.TryParse(other, out int b)
+                ? a < b
+                : string.CompareOrdinal(key, other) < 0;
+            if (before) return i;
+        }
+        return siblings.Count;
+    }
+
+    static string LastSegment(string path) => path[(path.LastIndexOf('\\') + 1)..];
+
+    void Remove(Node node)
+    {
+        foreach (var child in node.Children.ToList())
+            Remove(child);
+        _byPath.Remove(node.Path);
+        (node.Parent?.Children ?? _drivers).Remove(node);
+    }
+}
@@ -8,7 +8,8 @@ namespace RSLinxViewer;
 /// Protocol: UTF-8, line-based with type prefix:
 ///
 /// Client → Hook (after connection):
-///   C|KEY=VALUE  — config line
+///   C|KEY=VALUE  — config line (C|DELTA=1: this client applies N|DELTA blocks,
+///                  C|BINARY=1: hook output switches to frames, see BinaryFrames.cs)
 ///   C|END        — config complete, hook proceeds
 ///   STOP         — stop signal (on Ctrl+C)
 ///
@@ -18,12 +19,17 @@ namespace RSLinxViewer;
 ///   X|BEGIN       — start of topology XML block
 ///   ...xml...    — raw XML lines (inside block)
 ///   X|END        — end of topology XML block
+///   N|BEGIN      — start of full node block (see TreeBuilder)
+///   N|DELTA      — start of node delta block (see NodeModel)
+///   N|END        — end of either node block
 ///   D|           — done signal
+///   V|BINARY|1   — every later byte is a binary frame (reply to C|BINARY=1)
 /// </summary>
 sealed class PipeClient : IDisposable
 {
     const string PipeName = "RSLinxHook";
     const int MaxLogLines = 200;
+    const int BinaryVersion = 1;
 
     readonly NamedPipeClientStream _pipe;
     readonly object _lock = new();
@@ -31,6 +37,7 @@ sealed class PipeClient : IDisposable
     readonly List<string> _logLines = new(MaxLogLines);
     string? _latestXml;
     List<string>? _latestNodeBlock;
+    readonly NodeModel _nodeModel = new();
     int _totalDevices;
     int _identifiedDevices;
     int _eventCount;
@@ -70,6 +77,8 @@ sealed class PipeClient : IDisposable
     {
         var sb = new StringBuilder();
         sb.AppendLine(monitorMode ? "C|MODE=monitor" : "C|MODE=inject");
+        sb.AppendLine("C|DELTA=1");
+        sb.AppendLine("C|BINARY=1");
         if (logDir != @"C:\temp")
             sb.AppendLine($"C|LOGDIR={logDir}");
         if (debugXml)
@@ -111,7 +120,8 @@ sealed class PipeClient : IDisposable
     }
 
     /// <summary>
-    /// Main read loop — reads lines from pipe and routes by prefix.
+    /// Main read loop — reads lines from pipe and routes by prefix, then
+    /// frames once the hook acknowledges C|BINARY=1 with V|BINARY|1.
     /// Runs until pipe disconnects, done signal, or cancellation.
     /// Runs on a thread-pool thread (sync I/O on non-overlapped handle).
     /// </summary>
@@ -119,107 +129,184 @@ sealed class PipeClient : IDisposable
     {
         return Task.Run(() =>
         {
-            using var reader = new StreamReader(_pipe, Encoding.UTF8, leaveOpen: true);
-            var xmlBuilder = new StringBuilder();
-            bool inXmlBlock = false;
-            var nodeLines = new List<string>();
-            bool inNodeBlock = false;
+            var reader = new FrameReader(_pipe);
+            try
+            {
+                if (ReadTextLines(reader, ct))
+                    ReadFrames(reader, ct);
+            }
+            catch (IOException) { /* pipe broken */ }
+            catch (ObjectDisposedException) { /* pipe closed */ }
+
+            _connected = false;
+        }, CancellationToken.None);
+    }
+
+    /// <summary>Text protocol. Returns true when the hook switched to binary frames.</summary>
+    bool ReadTextLines(FrameReader reader, CancellationToken ct)
+    {
+        var xmlBuilder = new StringBuilder();
+        bool inXmlBlock = false;
+        var nodeLines = new List<string>();
+        bool inNodeBlock = false;
+        bool nodeBlockIsDelta = false;
+
+        while (!ct.IsCancellationRequested)
+        {
+            string? line = reader.ReadLine();
+            if (line == null)
+                break; // EOF / disconnect
 
-            while (!ct.IsCancellationRequested)
+            if (inXmlBlock)
             {
-                string? line;
-                try
-                {
-                    line = reader.ReadLine();
-                }
-                catch (IOException)
+                if (line == "X|END")
                 {
-                    break; // pipe broken
+                    inXmlBlock = false;
+                    lock (_lock)
+                    {
+                        _latestXml = xmlBuilder.ToString();
+                    }
                 }
-                catch (ObjectDisposedException)
+                else
                 {
-                    break; // pipe closed
+                    xmlBuilder.AppendLine(line);
                 }
+                continue;
+            }
 
-                if (line == null)
-                    break; // EOF / disconnect
-
-                if (inXmlBlock)
+            if (inNodeBlock)
+            {
+                if (line == "N|END")
                 {
-                    if (line == "X|END")
-                    {
-                        inXmlBlock = false;
-                        lock (_lock)
-                        {
-                            _latestXml = xmlBuilder.ToString();
-                        }
-                    }
-                    else
-                    {
-                        xmlBuilder.AppendLine(line);
-                    }
-                    continue;
+                    inNodeBlock = false;
+                    CompleteNodeBlock(nodeLines, nodeBlockIsDelta);
                 }
-
-                if (inNodeBlock)
+                else
                 {
-                    if (line == "N|END")
-                    {
-                        inNodeBlock = false;
-                        lock (_lock)
-                        {
-                            _latestNodeBlock = new List<string>(nodeLines);
-                        }
-                    }
-                    else
-                    {
-                        nodeLines.Add(line);
-                    }
-                    continue;
+                    nodeLines.Add(line);
                 }
+                continue;
+            }
 
-                if (line.StartsWith("L|"))
+            if (line.StartsWith("L|"))
+            {
+                AddLog(line[2..]);
+            }
+            else if (line.StartsWith("S|"))
+            {
+                var parts = line[2..].Split('|');
+                if (parts.Length >= 3)
                 {
-                    string msg = line[2..];
                     lock (_lock)
                     {
-                        _logLines.Add(msg);
-                        if (_logLines.Count > MaxLogLines)
-                            _logLines.RemoveAt(0);
+                        int.TryParse(parts[0], out _totalDevices);
+                        int.TryParse(parts[1], out _identifiedDevices);
+                        int.TryParse(parts[2], out _eventCount);
                     }
                 }
-                else if (line.StartsWith("S|"))
-                {
-                    var parts = line[2..].Split('|');
-                    if (parts.Length >= 3)
+            }
+            else if (line == "X|BEGIN")
+            {
+                inXmlBlock = true;
+                xmlBuilder.Clear();
+            }
+            else if (line == "N|BEGIN" || line == "N|DELTA")
+            {
+                inNodeBlock = true;
+                nodeBlockIsDelta = line == "N|DELTA";
+                nodeLines.Clear();
+            }
+            else if (line.StartsWith("D|"))
+            {
+                lock (_lock) { _done = true; }
+                // session continues — pipe stays open for B|/STOP
+            }
+            else if (line == $"V|BINARY|{BinaryVersion}")
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// <summary>Binary framed protocol (see BinaryFrames.cs); same state updates as the text loop.</summary>
+    void ReadFrames(FrameReader reader, CancellationToken ct)
+    {
+        var decoder = new FrameDecoder();
+        var xml = new MemoryStream();
+        var nodeLines = new List<string>();
+        bool nodeBlockIsDelta = false;
+
+        while (!ct.IsCancellationRequested && reader.ReadFrame(out var type, out var payload))
+        {
+            switch (type)
+            {
+                case FrameType.String:
+                    decoder.AddString(payload);
+                    break;
+                case FrameType.Log:
+                    AddLog(Encoding.UTF8.GetString(payload));
+                    break;
+                case FrameType.Status:
+                    var (total, identified, events) = FrameDecoder.Status(payload);
+                    lock (_lock)
                     {
-                        lock (_lock)
-                        {
-                            int.TryParse(parts[0], out _totalDevices);
-                            int.TryParse(parts[1], out _identifiedDevices);
-                            int.TryParse(parts[2], out _eventCount);
-                        }
+                        _totalDevices = total;
+                        _identifiedDevices = identified;
+                        _eventCount = events;
                     }
-                }
-                else if (line == "X|BEGIN")
-                {
-                    inXmlBlock = true;
-                    xmlBuilder.Clear();
-                }
-                else if (line == "N|BEGIN")
-                {
-                    inNodeBlock = true;
+                    break;
+                case FrameType.XmlBegin:
+                    xml.SetLength(0);
+                    break;
+                case FrameType.XmlData:
+                    xml.Write(payload, 0, payload.Length);
+                    break;
+                case FrameType.XmlEnd:
+                    string text = Encoding.UTF8.GetString(xml.GetBuffer(), 0, (int)xml.Length);
+                    lock (_lock) { _latestXml = text; }
+                    break;
+                case FrameType.NodeBegin:
+                    nodeBlockIsDelta = payload.Length > 0 && payload[0] != 0;
                     nodeLines.Clear();
-                }
-                else if (line.StartsWith("D|"))
-                {
+                    break;
+                case FrameType.Node:
+                    var line = decoder.NodeLine(payload);
+                    if (line != null) nodeLines.Add(line);
+                    break;
+                case FrameType.NodeEnd:
+                    CompleteNodeBlock(nodeLines, nodeBlockIsDelta);
+                    break;
+                case FrameType.Done:
                     lock (_lock) { _done = true; }
-                    // session continues — pipe stays open for B|/STOP
-                }
+                    break;
+                // Result (query replies) and unknown types: skipped by length
             }
+        }
+    }
 
-            _connected = false;
-        }, CancellationToken.None);
+    void AddLog(string msg)
+    {
+        lock (_lock)
+        {
+            _logLines.Add(msg);
+            if (_logLines.Count > MaxLogLines)
+                _logLines.RemoveAt(0);
+        }
+    }
+
+    void CompleteNodeBlock(List<string> nodeLines, bool isDelta)
+    {
+        if (isDelta)
+            _nodeModel.Apply(nodeLines);
+        else
+            _nodeModel.Reset(nodeLines);
+        // Fresh list each time so the display sees a new reference
+        var rendered = _nodeModel.ToLines();
+        lock (_lock)
+        {
+            _latestNodeBlock = rendered;
+        }
     }
 
     /// <summary>Get the last N log lines (thread-safe copy).</summary>
@@ -241,7 +328,10 @@ sealed class PipeClient : IDisposable
         }
     }
 
-    /// <summary>Get the latest node block lines (N| messages between N|BEGIN and N|END), or null if none received yet.</summary>
+    /// <summary>
+    /// Get the current node tree as full-block lines (N| messages as between N|BEGIN and N|END,
+    /// with any deltas already applied), or null if none received yet.
+    /// </summary>
     public List<string>? GetLatestNodeBlock()
     {
         lock (_lock)
@@ -1,11 +1,22 @@
 // MinimalFTArchiveDir.cpp
 // Build x86: cl /EHsc /W4 MinimalFTArchiveDir.cpp ole32.lib oleaut32.lib
+//
+// Single archive:  RockwellFTArchiveDirTesting <path-to-mer> <extraction-dir>
+// Bulk:            RockwellFTArchiveDirTesting --bulk <dir|glob|list.txt> <output-root>
+//                      [--threads N] [--force]
 
 #include <windows.h>
 #include <ole2.h>
 #include <oleauto.h>
 #include <cstdio>
 #include <cwchar>
+#include <cwctype>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include "../Common/BatchFiles.h"
 
 static void PrintHresult(const char* label, HRESULT hr) {
     std::printf("%s: 0x%08lX (%ld)\n", label, hr, (long)hr);
@@ -54,9 +65,336 @@ static bool EnsureDirExists(const wchar_t* path) {
     return false;
 }
 
+// ---------------------------------------------------------------------------
+// Bulk mode: a pool of STA workers, each with one IFTArchiveDir instance for
+// its lifetime. Every archive goes to <output-root>\<archive name>. The
+// manifest in <output-root> records each archive's size, write time and
+// content hash plus the entries it extracted; on the next run an archive
+// whose write time (with size), or else content hash, still matches a
+// successful manifest row is skipped.
+// ---------------------------------------------------------------------------
+
+#define BULK_MAX_THREADS 32
+#define BULK_MANIFEST L"extract_manifest.txt"
+
+struct ManifestEntry {
+    std::wstring path;         // relative to the archive's output directory
+    unsigned long long size;
+};
+
+struct ManifestArchive {
+    std::wstring merPath;
+    unsigned long long size = 0;
+    unsigned long long writeTime = 0;   // FILETIME
+    unsigned long long hash = 0;        // FNV-1a 64 of the file contents
+    std::wstring outDir;
+    HRESULT hr = E_PENDING;
+    std::vector<ManifestEntry> entries;
+};
+
+enum class BulkStatus { Pending, Extracted, SkippedTime, SkippedHash, Failed };
+
+struct BulkItem {
+    ManifestArchive rec;
+    const ManifestArchive* prev = nullptr;   // last run's row for this path
+    BulkStatus status = BulkStatus::Pending;
+    double ms = 0.0;
+    int worker = -1;
+};
+
+// Manifest lines, tab-separated (paths cannot contain tabs):
+//   A <mer path> <size> <write time hex> <hash hex> <output dir> <hresult hex>
+//   E <entry path relative to the output dir> <size>      (entries of the A above)
+static std::vector<std::wstring> SplitTabs(const std::wstring& line) {
+    std::vector<std::wstring> f;
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find(L'\t', start);
+        f.push_back(line.substr(start, tab == std::wstring::npos ? std::wstring::npos : tab - start));
+        if (tab == std::wstring::npos) return f;
+        start = tab + 1;
+    }
+}
+
+static void ReadManifest(const std::wstring& file, std::map<std::wstring, ManifestArchive>& out) {
+    FILE* f = _wfopen(file.c_str(), L"r, ccs=UTF-8");
+    if (!f) return;
+    ManifestArchive* cur = nullptr;
+    wchar_t line[MAX_PATH * 3];
+    while (fgetws(line, _countof(line), f)) {
+        std::wstring l(line);
+        while (!l.empty() && (l.back() == L'\n' || l.back() == L'\r')) l.pop_back();
+        std::vector<std::wstring> fld = SplitTabs(l);
+        if (fld[0] == L"A" && fld.size() == 7) {
+            ManifestArchive a;
+            a.merPath = fld[1];
+            a.size = _wcstoui64(fld[2].c_str(), nullptr, 10);
+            a.writeTime = _wcstoui64(fld[3].c_str(), nullptr, 16);
+            a.hash = _wcstoui64(fld[4].c_str(), nullptr, 16);
+            a.outDir = fld[5];
+            a.hr = (HRESULT)wcstoul(fld[6].c_str(), nullptr, 16);
+            cur = &(out[a.merPath] = a);
+        } else if (fld[0] == L"E" && fld.size() == 3 && cur) {
+            cur->entries.push_back({ fld[1], _wcstoui64(fld[2].c_str(), nullptr, 10) });
+        }
+    }
+    fclose(f);
+}
+
+// Written next to the old one and moved over it, so a crash keeps the last run's
+static bool WriteManifest(const std::wstring& file, const std::vector<BulkItem>& items) {
+    std::wstring tmp = file + L".tmp";
+    FILE* f = _wfopen(tmp.c_str(), L"w, ccs=UTF-8");
+    if (!f) return false;
+    std::fwprintf(f, L"# FTArchiveDir extraction manifest v1\n");
+    for (const auto& item : items) {
+        const ManifestArchive& a = item.rec;
+        std::fwprintf(f, L"A\t%ls\t%llu\t%llx\t%016llx\t%ls\t%08lx\n", a.merPath.c_str(), a.size,
+            a.writeTime, a.hash, a.outDir.c_str(), (unsigned long)a.hr);
+        for (const auto& e : a.entries)
+            std::fwprintf(f, L"E\t%ls\t%llu\n", e.path.c_str(), e.size);
+    }
+    bool ok = fclose(f) == 0;
+    return ok && MoveFileExW(tmp.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+static bool StatFile(const std::wstring& path, unsigned long long& size, unsigned long long& writeTime) {
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fa)) return false;
+    size = ((unsigned long long)fa.nFileSizeHigh << 32) | fa.nFileSizeLow;
+    writeTime = ((unsigned long long)fa.ftLastWriteTime.dwHighDateTime << 32) | fa.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+static bool HashFile(const std::wstring& path, unsigned long long& hash) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    std::vector<unsigned char> buf(1 << 20);
+    unsigned long long v = 14695981039346656037ULL;
+    DWORD got = 0;
+    bool ok = true;
+    while ((ok = ReadFile(h, buf.data(), (DWORD)buf.size(), &got, nullptr) != FALSE) && got > 0) {
+        for (DWORD i = 0; i < got; i++) {
+            v ^= buf[i];
+            v *= 1099511628211ULL;
+        }
+    }
+    CloseHandle(h);
+    hash = v;
+    return ok;
+}
+
+// Every file under root, relative to it
+static void ListTree(const std::wstring& root, const std::wstring& rel, std::vector<ManifestEntry>& out) {
+    WIN32_FIND_DATAW fd;
+    HANDLE hFind = FindFirstFileW((root + rel + L"*").c_str(), &fd);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+    do {
+        if (wcscmp(fd.cFileName, L".") == 0 || wcscmp(fd.cFileName, L"..") == 0) continue;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            ListTree(root, rel + fd.cFileName + L"\\", out);
+        else
+            out.push_back({ rel + fd.cFileName, ((unsigned long long)fd.nFileSizeHigh << 32) | fd.nFileSizeLow });
+    } while (FindNextFileW(hFind, &fd));
+    FindClose(hFind);
+}
+
+// Clear an archive's previous output so removed entries do not linger
+static void RemoveTree(const std::wstring& dir) {
+    WIN32_FIND_DATAW fd;
+    HANDLE hFind = FindFirstFileW((dir + L"\\*").c_str(), &fd);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+    do {
+        if (wcscmp(fd.cFileName, L".") == 0 || wcscmp(fd.cFileName, L"..") == 0) continue;
+        std::wstring child = dir + L"\\" + fd.cFileName;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            RemoveTree(child);
+            RemoveDirectoryW(child.c_str());
+        } else {
+            SetFileAttributesW(child.c_str(), FILE_ATTRIBUTE_NORMAL);
+            DeleteFileW(child.c_str());
+        }
+    } while (FindNextFileW(hFind, &fd));
+    FindClose(hFind);
+}
+
+struct BulkShared {
+    std::vector<BulkItem>* items;
+    std::atomic<size_t> next;
+    GUID clsid, iid;
+    bool force;
+};
+
+using FnSetFlags = HRESULT(__stdcall*)(void* thisPtr, ULONG a, ULONG b, ULONG c, ULONG d);
+using FnArchiveOp = HRESULT(__stdcall*)(void* thisPtr, BSTR extractionPath, BSTR merNameOrPath);
+using FnRelease = ULONG(__stdcall*)(void*);
+
+// Same call sequence as single-archive mode: SetFlags(0xC,3,0,0), then ArchiveOp
+static HRESULT ExtractArchive(void* pIf, const std::wstring& merPath, const std::wstring& outDir) {
+    void** vtbl = *(void***)pIf;
+    HRESULT hr = reinterpret_cast<FnSetFlags>(vtbl[13])(pIf, 0xC, 3, 0, 0);
+    if (FAILED(hr)) return hr;
+    if (!EnsureDirExists(outDir.c_str())) return HRESULT_FROM_WIN32(GetLastError());
+    BSTR bstrOut = SysAllocString(outDir.c_str());
+    BSTR bstrMer = SysAllocString(merPath.c_str());
+    hr = (bstrOut && bstrMer) ? reinterpret_cast<FnArchiveOp>(vtbl[5])(pIf, bstrOut, bstrMer) : E_OUTOFMEMORY;
+    SysFreeString(bstrMer);
+    SysFreeString(bstrOut);
+    return hr;
+}
+
+static void BulkWorker(int id, BulkShared* shared) {
+    HRESULT hrInit = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    void* pIf = nullptr;
+    HRESULT hrCreate = FAILED(hrInit) ? hrInit
+        : CoCreateInstance(shared->clsid, nullptr, CLSCTX_INPROC_SERVER, shared->iid, &pIf);
+    if (SUCCEEDED(hrCreate) && !pIf) hrCreate = E_NOINTERFACE;
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    std::vector<BulkItem>& items = *shared->items;
+    for (size_t i = shared->next++; i < items.size(); i = shared->next++) {
+        BulkItem& item = items[i];
+        ManifestArchive& rec = item.rec;
+        item.worker = id;
+        LARGE_INTEGER t0, t1;
+        QueryPerformanceCounter(&t0);
+
+        // Only a successful extraction whose output is still there can be kept
+        const ManifestArchive* prev = item.prev;
+        DWORD outAttrs = GetFileAttributesW(rec.outDir.c_str());
+        bool reusable = !shared->force && prev && SUCCEEDED(prev->hr) && prev->outDir == rec.outDir &&
+            outAttrs != INVALID_FILE_ATTRIBUTES && (outAttrs & FILE_ATTRIBUTE_DIRECTORY);
+        if (!StatFile(rec.merPath, rec.size, rec.writeTime)) {
+            rec.hr = HRESULT_FROM_WIN32(GetLastError());
+            item.status = BulkStatus::Failed;
+        } else if (reusable && prev->size == rec.size && prev->writeTime == rec.writeTime) {
+            rec.hash = prev->hash;
+            rec.hr = prev->hr;
+            rec.entries = prev->entries;
+            item.status = BulkStatus::SkippedTime;
+        } else if (!HashFile(rec.merPath, rec.hash)) {
+            rec.hr = HRESULT_FROM_WIN32(GetLastError());
+            item.status = BulkStatus::Failed;
+        } else if (reusable && prev->size == rec.size && prev->hash == rec.hash) {
+            // Touched but not changed: keep the output, record the new time
+            rec.hr = prev->hr;
+            rec.entries = prev->entries;
+            item.status = BulkStatus::SkippedHash;
+        } else if (!pIf) {
+            rec.hr = hrCreate;
+            item.status = BulkStatus::Failed;
+        } else {
+            RemoveTree(rec.outDir);
+            rec.hr = ExtractArchive(pIf, rec.merPath, rec.outDir);
+            if (SUCCEEDED(rec.hr))
+                ListTree(rec.outDir + L"\\", L"", rec.entries);
+            item.status = SUCCEEDED(rec.hr) ? BulkStatus::Extracted : BulkStatus::Failed;
+
+            // Serve calls other apartments may have marshaled to this one
+            MSG msg;
+            while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) DispatchMessageW(&msg);
+        }
+
+        QueryPerformanceCounter(&t1);
+        item.ms = (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / (double)freq.QuadPart;
+    }
+
+    if (pIf) reinterpret_cast<FnRelease>((*(void***)pIf)[2])(pIf);
+    if (SUCCEEDED(hrInit)) CoUninitialize();
+}
+
+static int RunBulk(const std::wstring& spec, const std::wstring& outRoot, int threads, bool force,
+                   const GUID& clsid, const GUID& iid) {
+    std::vector<std::wstring> paths;
+    if (!BatchFiles::Collect(spec, L"*.mer", paths)) {
+        std::fwprintf(stderr, L"Cannot read archive source: %ls\n", spec.c_str());
+        return 2;
+    }
+    if (paths.empty()) {
+        std::fwprintf(stderr, L"No MER files in: %ls\n", spec.c_str());
+        return 2;
+    }
+    if (!EnsureDirExists(outRoot.c_str())) return 8;
+
+    std::wstring root = outRoot;
+    if (root.back() != L'\\' && root.back() != L'/') root += L'\\';
+    std::wstring manifestFile = root + BULK_MANIFEST;
+    std::map<std::wstring, ManifestArchive> previous;
+    ReadManifest(manifestFile, previous);
+
+    // One output directory per archive, named after it (name_2, ... on a clash)
+    std::vector<BulkItem> items(paths.size());
+    std::map<std::wstring, int> usedNames;
+    for (size_t i = 0; i < paths.size(); i++) {
+        BulkItem& item = items[i];
+        item.rec.merPath = paths[i];
+        size_t slash = paths[i].find_last_of(L"\\/");
+        std::wstring name = paths[i].substr(slash == std::wstring::npos ? 0 : slash + 1);
+        size_t dot = name.find_last_of(L'.');
+        if (dot != std::wstring::npos && dot > 0) name.erase(dot);
+        std::wstring key = name;
+        for (auto& ch : key) ch = towlower(ch);
+        int n = ++usedNames[key];
+        if (n > 1) name += L"_" + std::to_wstring(n);
+        item.rec.outDir = root + name;
+        auto it = previous.find(paths[i]);
+        if (it != previous.end()) item.prev = &it->second;
+    }
+
+    threads = BatchFiles::PoolSize(threads, BULK_MAX_THREADS, items.size());
+
+    BulkShared shared;
+    shared.items = &items;
+    shared.next = 0;
+    shared.clsid = clsid;
+    shared.iid = iid;
+    shared.force = force;
+    double wallMs = BatchFiles::RunPool(threads, [&](int id) { BulkWorker(id, &shared); });
+
+    int extracted = 0, skipped = 0, failed = 0;
+    std::printf("%-6s %-9s %-10s %8s %12s %10s  %s\n", "#", "status", "hr", "entries", "bytes", "ms", "path");
+    for (size_t i = 0; i < items.size(); i++) {
+        const BulkItem& item = items[i];
+        const char* status = "FAIL";
+        switch (item.status) {
+        case BulkStatus::Extracted:   status = "extracted"; extracted++; break;
+        case BulkStatus::SkippedTime: status = "same-time"; skipped++; break;
+        case BulkStatus::SkippedHash: status = "same-hash"; skipped++; break;
+        default:                      failed++; break;
+        }
+        unsigned long long bytes = 0;
+        for (const auto& e : item.rec.entries) bytes += e.size;
+        std::printf("%-6u %-9s 0x%08lX %8u %12llu %10.1f  %ls\n", (unsigned)i + 1, status,
+            (unsigned long)item.rec.hr, (unsigned)item.rec.entries.size(), bytes, item.ms,
+            item.rec.merPath.c_str());
+    }
+    std::printf("%u archive(s): %d extracted, %d unchanged, %d failed, %d thread(s), %.1f ms wall\n",
+        (unsigned)items.size(), extracted, skipped, failed, threads, wallMs);
+
+    if (!WriteManifest(manifestFile, items)) {
+        std::fwprintf(stderr, L"Cannot write manifest: %ls\n", manifestFile.c_str());
+        return 11;
+    }
+    return failed ? 1 : 0;
+}
+
 int wmain(int argc, wchar_t** argv) {
+    const wchar_t* bulkSpec = nullptr;
+    const wchar_t* bulkRoot = nullptr;
+    int threads = 0;
+    bool force = false;
+    for (int i = 1; i < argc; i++) {
+        if (_wcsicmp(argv[i], L"--bulk") == 0 && i + 2 < argc) { bulkSpec = argv[++i]; bulkRoot = argv[++i]; }
+        else if (_wcsicmp(argv[i], L"--threads") == 0 && i + 1 < argc) threads = _wtoi(argv[++i]);
+        else if (_wcsicmp(argv[i], L"--force") == 0) force = true;
+    }
+
     if (argc < 3) {
-        std::fwprintf(stderr, L"Usage: %s <path-to-mer> <extraction-dir>\n", argv[0]);
+        std::fwprintf(stderr, L"Usage: %s <path-to-mer> <extraction-dir>\n"
+                              L"       %s --bulk <dir|glob|list.txt> <output-root> [--threads N] [--force]\n",
+                      argv[0], argv[0]);
         return 2;
     }
 
@@ -78,6 +416,9 @@ int wmain(int argc, wchar_t** argv) {
         return 4;
     }
 
+    if (bulkSpec)
+        return RunBulk(bulkSpec, bulkRoot, threads, force, clsidFTArchiveDir, iidIFTArchiveDir);
+
     hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
     if (FAILED(hr)) {
         PrintHresult("CoInitializeEx failed", hr);
@@ -1,11 +1,18 @@
 // MinimalRsvCRC.cpp
 // Build x86: cl /EHsc /W4 MinimalRsvCRC.cpp ole32.lib oleaut32.lib
+//
+// Single file:  RockwellRsvCRCValidateSigniture <path-to-mer>
+// Batch:        RockwellRsvCRCValidateSigniture --batch <dir|glob|list.txt> [--threads N]
 
 #include <windows.h>
 #include <ole2.h>
 #include <oleauto.h>
 #include <cstdio>
 #include <stdio.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "../Common/BatchFiles.h"
 
 static void PrintHresult(const char* label, HRESULT hr) {
     std::printf("%s: 0x%08lX (%ld)\n", label, hr, (long)hr);
@@ -43,13 +50,115 @@ static void PrintFuncLocation(const char* label, void* fnPtr) {
         (n ? path : "<unknown>"));
 }
 
+// ---------------------------------------------------------------------------
+// Batch mode: a pool of STA workers, each holding one IRsvCRC instance for
+// its lifetime and taking the next file from a shared index. No vtable dumps.
+// ---------------------------------------------------------------------------
+
+#define BATCH_MAX_THREADS 32
+
+struct BatchItem {
+    std::wstring path;
+    HRESULT raw = E_PENDING;   // vtbl[4] return, before the raw==1 rule
+    HRESULT hr = E_PENDING;
+    double ms = 0.0;
+    int worker = -1;
+};
+
+static void BatchWorker(int id, std::vector<BatchItem>* items, std::atomic<size_t>* next,
+                        const GUID* clsid, const GUID* iid) {
+    HRESULT hrInit = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    void* pObj = nullptr;
+    HRESULT hrCreate = FAILED(hrInit) ? hrInit
+        : CoCreateInstance(*clsid, nullptr, CLSCTX_INPROC_SERVER, *iid, &pObj);
+    if (SUCCEEDED(hrCreate) && !pObj) hrCreate = E_NOINTERFACE;
+
+    using FnCheckMer = HRESULT(__stdcall*)(void* thisPtr, BSTR merPath);
+    FnCheckMer CheckMer = pObj ? reinterpret_cast<FnCheckMer>((*(void***)pObj)[4]) : nullptr;
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    for (size_t i = (*next)++; i < items->size(); i = (*next)++) {
+        BatchItem& item = (*items)[i];
+        item.worker = id;
+        if (!CheckMer) {
+            item.raw = item.hr = hrCreate;
+            continue;
+        }
+        BSTR bstrMer = SysAllocString(item.path.c_str());
+        if (!bstrMer) {
+            item.raw = item.hr = E_OUTOFMEMORY;
+            continue;
+        }
+        LARGE_INTEGER t0, t1;
+        QueryPerformanceCounter(&t0);
+        item.raw = CheckMer(pObj, bstrMer);
+        QueryPerformanceCounter(&t1);
+        SysFreeString(bstrMer);
+        item.ms = (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / (double)freq.QuadPart;
+        item.hr = (item.raw == 1) ? E_FAIL : item.raw;   // raw==1 -> failure, as in single-file mode
+
+        // Serve calls other apartments may have marshaled to this one
+        MSG msg;
+        while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) DispatchMessageW(&msg);
+    }
+
+    if (pObj) {
+        using FnRelease = ULONG(__stdcall*)(void*);
+        reinterpret_cast<FnRelease>((*(void***)pObj)[2])(pObj);
+    }
+    if (SUCCEEDED(hrInit)) CoUninitialize();
+}
+
+static int RunBatch(const std::wstring& spec, int threads, const GUID& clsid, const GUID& iid) {
+    std::vector<std::wstring> paths;
+    if (!BatchFiles::Collect(spec, L"*.mer", paths)) {
+        fwprintf(stderr, L"Cannot read batch source: %s\n", spec.c_str());
+        return 2;
+    }
+    if (paths.empty()) {
+        fwprintf(stderr, L"No MER files in: %s\n", spec.c_str());
+        return 2;
+    }
+    std::vector<BatchItem> items(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) items[i].path = paths[i];
+    threads = BatchFiles::PoolSize(threads, BATCH_MAX_THREADS, items.size());
+
+    std::atomic<size_t> next(0);
+    double wallMs = BatchFiles::RunPool(threads, [&](int id) {
+        BatchWorker(id, &items, &next, &clsid, &iid);
+    });
+
+    int failed = 0;
+    double sumMs = 0.0;
+    std::printf("%-6s %-4s %-10s %10s %3s  %s\n", "#", "OK", "raw", "ms", "w", "path");
+    for (size_t i = 0; i < items.size(); i++) {
+        const BatchItem& item = items[i];
+        bool ok = SUCCEEDED(item.hr);
+        if (!ok) failed++;
+        sumMs += item.ms;
+        std::printf("%-6u %-4s 0x%08lX %10.1f %3d  %ls\n", (unsigned)i + 1, ok ? "ok" : "FAIL",
+            (unsigned long)item.raw, item.ms, item.worker, item.path.c_str());
+    }
+    std::printf("%u file(s), %d failed, %d thread(s), %.1f ms wall, %.1f ms in CheckMerSigniture\n",
+        (unsigned)items.size(), failed, threads, wallMs, sumMs);
+    return failed ? 1 : 0;
+}
+
 int wmain(int argc, wchar_t** argv) {
     if (argc < 2) {
-        fwprintf(stderr, L"Usage: %s <path-to-mer>\n", argv[0]);
+        fwprintf(stderr, L"Usage: %s <path-to-mer>\n"
+                         L"       %s --batch <dir|glob|list.txt> [--threads N]\n", argv[0], argv[0]);
         return 2;
     }
 
     const wchar_t* merPathW = argv[1];
+    const wchar_t* batchSpec = nullptr;
+    int threads = 0;
+    for (int i = 1; i < argc; i++) {
+        if (_wcsicmp(argv[i], L"--batch") == 0 && i + 1 < argc) batchSpec = argv[++i];
+        else if (_wcsicmp(argv[i], L"--threads") == 0 && i + 1 < argc) threads = _wtoi(argv[++i]);
+    }
 
     GUID clsidRsvCRC{};
     // {D19BE1A7-1D25-40F8-A71B-3E08AC7C219D}
@@ -66,6 +175,9 @@ int wmain(int argc, wchar_t** argv) {
         return 4;
     }
 
+    if (batchSpec)
+        return RunBatch(batchSpec, threads, clsidRsvCRC, iidIRsvCRC);
+
     hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
     if (FAILED(hr)) {
         PrintHresult("CoInitializeEx failed", hr);
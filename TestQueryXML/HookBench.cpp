@@ -0,0 +1,1117 @@
+/**
+ * Stress and latency benchmark for a live RSLinxHook
+ * Talks the pipe protocol directly (no RSLinxBrowse, no text scraping):
+ *
+ *   cl /O2 /EHsc /std:c++17 /D_CRT_SECURE_NO_WARNINGS HookBench.cpp
+ *      psapi.lib advapi32.lib
+ *
+ * Usage: HookBench [--workloads cold,warm,batch,rebrowse,monitor]
+ *                  [--driver NAME] [--ip IP]... [--paths FILE] [--port NAME]
+ *                  [--iters N] [--batch-iters N] [--rebrowse-iters N]
+ *                  [--cold-iters N] [--restart] [--settle SECONDS]
+ *                  [--soak SECONDS] [--probe-ms MS] [--mem-interval MS]
+ *                  [--dll PATH] [--label TEXT] [--out FILE]
+ *        (defaults: warm,batch,rebrowse; driver Test; 1000 queries,
+ *         20 batches, 5 re-browses, 3 cold starts, 300 s soak,
+ *         out C:\temp\hook_bench.json)
+ *
+ * Workloads run in the order listed above, whatever order they are given in:
+ *   cold      inject into RSLinx.exe, time inject / pipe up / C|END -> D|.
+ *             A resident hook cannot be unloaded safely, so each cold start
+ *             after the first needs --restart (stop and start the RSLinx
+ *             service through the SCM, then wait --settle seconds, default 8).
+ *   warm      attach with H| and time Q| -> D| for each query path.
+ *   batch     time one QB| batch of every query path -> D|.
+ *   rebrowse  time B| -> D|.
+ *   monitor   C|MODE=monitor session for --soak seconds: time to the first
+ *             S| line, the gap between S| lines, and one Q| probe every
+ *             --probe-ms on the query session while the loop runs.
+ * --driver must name a driver RSLinx already has (nothing is hot-loaded).
+ * Query paths come from --paths (one per line, like --batch-query), or from
+ * an F|* find over the hook's cache (ip, or ip\<--port>\slot; --port
+ * defaults to Backplane).
+ *
+ * Every series reports count, min, p50, p95, p99, max and mean in ms. A
+ * sampler thread records RSLinx.exe working set and private bytes every
+ * --mem-interval ms (default 1000), tagged with the running workload. The
+ * hook's own P| tables are reset before the first workload and captured
+ * after the last. Everything goes to --out as JSON; --label (e.g. a build
+ * id) is stored with it so runs of different builds can be compared.
+ * Exit code 0 only if no workload had an error.
+ */
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+static const wchar_t* const PIPE_NAME = L"\\\\.\\pipe\\RSLinxHook";
+static const DWORD BROWSE_TIMEOUT_MS = 600000;
+static const DWORD QUERY_TIMEOUT_MS = 60000;
+
+// ============================================================
+// Clock
+// ============================================================
+
+static double s_qpcPerMs = 0;
+
+static double NowMs()
+{
+    LARGE_INTEGER c;
+    QueryPerformanceCounter(&c);
+    return (double)c.QuadPart / s_qpcPerMs;
+}
+
+// ============================================================
+// Pipe client — overlapped reads, so a reply is timed when it arrives
+// rather than at the next poll
+// ============================================================
+
+struct HookPipe {
+    HANDLE h = INVALID_HANDLE_VALUE;
+    HANDLE ev = NULL;
+    std::string pending;       // read but not yet split into lines
+    bool broken = false;       // last ReadLine failed on the pipe, not a timeout
+
+    ~HookPipe() { Close(); }
+
+    bool Connect(DWORD timeoutMs)
+    {
+        ULONGLONG deadline = GetTickCount64() + timeoutMs;
+        while (GetTickCount64() < deadline)
+        {
+            h = CreateFileW(PIPE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                            OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+            if (h != INVALID_HANDLE_VALUE)
+            {
+                if (!ev) ev = CreateEventW(NULL, TRUE, FALSE, NULL);
+                pending.clear();
+                broken = false;
+                return true;
+            }
+            if (GetLastError() == ERROR_PIPE_BUSY)
+                WaitNamedPipeW(PIPE_NAME, 1000);
+            else
+                Sleep(50);
+        }
+        return false;
+    }
+
+    bool Connected() const { return h != INVALID_HANDLE_VALUE; }
+
+    void Close()
+    {
+        if (h != INVALID_HANDLE_VALUE)
+        {
+            DWORD written = 0;
+            OVERLAPPED ov = {};
+            ov.hEvent = ev;
+            if (WriteFile(h, "STOP\n", 5, NULL, &ov) || GetLastError() == ERROR_IO_PENDING)
+                GetOverlappedResult(h, &ov, &written, TRUE);
+            CloseHandle(h);
+            h = INVALID_HANDLE_VALUE;
+        }
+        if (ev)
+        {
+            CloseHandle(ev);
+            ev = NULL;
+        }
+    }
+
+    bool Send(const std::string& text)
+    {
+        std::string data = text + "\n";
+        OVERLAPPED ov = {};
+        ov.hEvent = ev;
+        DWORD written = 0;
+        if (!WriteFile(h, data.c_str(), (DWORD)data.size(), NULL, &ov) &&
+            GetLastError() != ERROR_IO_PENDING)
+            return false;
+        return GetOverlappedResult(h, &ov, &written, TRUE) && written == data.size();
+    }
+
+    // Next complete line (CR/LF stripped); false on timeout or a broken pipe
+    bool ReadLine(std::string& line, DWORD timeoutMs)
+    {
+        broken = false;
+        ULONGLONG deadline = GetTickCount64() + timeoutMs;
+        char buf[4096];
+        while (true)
+        {
+            size_t nl = pending.find('\n');
+            if (nl != std::string::npos)
+            {
+                line.assign(pending, 0, nl);
+                pending.erase(0, nl + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+
+            OVERLAPPED ov = {};
+            ov.hEvent = ev;
+            DWORD got = 0;
+            if (!ReadFile(h, buf, sizeof(buf), NULL, &ov))
+            {
+                DWORD err = GetLastError();
+                if (err != ERROR_IO_PENDING && err != ERROR_MORE_DATA) return Broken();
+                ULONGLONG now = GetTickCount64();
+                DWORD wait = (now < deadline) ? (DWORD)(deadline - now) : 0;
+                if (WaitForSingleObject(ev, wait) != WAIT_OBJECT_0)
+                {
+                    CancelIo(h);
+                    GetOverlappedResult(h, &ov, &got, TRUE);
+                    if (got) pending.append(buf, got);
+                    return false;
+                }
+            }
+            if (!GetOverlappedResult(h, &ov, &got, TRUE) && GetLastError() != ERROR_MORE_DATA)
+                return Broken();
+            if (got == 0) return Broken();
+            pending.append(buf, got);
+        }
+    }
+
+    bool Broken()
+    {
+        broken = true;
+        return false;
+    }
+};
+
+static bool StartsWith(const std::string& s, const char* prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+/**
+ * Read to the D| that ends a reply. R| lines (and P| lines with keepPerf)
+ * go to lines; broadcast output is dropped. False on timeout or a broken
+ * pipe.
+ */
+static bool ReadReply(HookPipe& pipe, DWORD timeoutMs, std::vector<std::string>* lines,
+                      bool keepPerf = false)
+{
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    std::string line;
+    while (true)
+    {
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline) return false;
+        if (!pipe.ReadLine(line, (DWORD)(deadline - now))) return false;
+        if (StartsWith(line, "D|")) return true;
+        if (!lines) continue;
+        if (StartsWith(line, "R|") || (keepPerf && StartsWith(line, "P|")))
+            lines->push_back(line);
+    }
+}
+
+// ============================================================
+// Process helpers — same calls as RSLinxBrowse's injector
+// ============================================================
+
+static DWORD FindProcessByName(const wchar_t* processName)
+{
+    HANDLE hSnap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (hSnap == INVALID_HANDLE_VALUE) return 0;
+
+    PROCESSENTRY32W pe;
+    pe.dwSize = sizeof(pe);
+    DWORD pid = 0;
+    if (Process32FirstW(hSnap, &pe))
+    {
+        do
+        {
+            if (_wcsicmp(pe.szExeFile, processName) == 0)
+            {
+                pid = pe.th32ProcessID;
+                break;
+            }
+        } while (Process32NextW(hSnap, &pe));
+    }
+    CloseHandle(hSnap);
+    return pid;
+}
+
+static void KillProcessByName(const wchar_t* processName)
+{
+    DWORD pid = FindProcessByName(processName);
+    if (!pid) return;
+    HANDLE hProcess = OpenProcess(PROCESS_TERMINATE | SYNCHRONIZE, FALSE, pid);
+    if (!hProcess) return;
+    TerminateProcess(hProcess, 1);
+    WaitForSingleObject(hProcess, 5000);
+    CloseHandle(hProcess);
+}
+
+static bool EnableDebugPrivilege()
+{
+    HANDLE hToken = NULL;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+        return false;
+
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    if (!LookupPrivilegeValueW(NULL, SE_DEBUG_NAME, &tp.Privileges[0].Luid))
+    {
+        CloseHandle(hToken);
+        return false;
+    }
+    BOOL ok = AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(tp), NULL, NULL);
+    DWORD err = GetLastError();
+    CloseHandle(hToken);
+    return ok && err != ERROR_NOT_ALL_ASSIGNED;
+}
+
+// RSLinxHook.dll already mapped into pid
+static bool HookLoaded(DWORD pid)
+{
+    HANDLE hSnap = CreateToolhelp32Snapshot(TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32, pid);
+    if (hSnap == INVALID_HANDLE_VALUE) return false;
+
+    MODULEENTRY32W me;
+    me.dwSize = sizeof(me);
+    bool found = false;
+    if (Module32FirstW(hSnap, &me))
+    {
+        do
+        {
+            if (_wcsicmp(me.szModule, L"RSLinxHook.dll") == 0)
+            {
+                found = true;
+                break;
+            }
+        } while (Module32NextW(hSnap, &me));
+    }
+    CloseHandle(hSnap);
+    return found;
+}
+
+// LoadLibraryW(dllPath) on a remote thread; true once it returned a module
+static bool InjectDLL(DWORD pid, const std::wstring& dllPath)
+{
+    const DWORD access = PROCESS_CREATE_THREAD | PROCESS_VM_OPERATION | PROCESS_VM_WRITE |
+                         PROCESS_VM_READ | PROCESS_QUERY_INFORMATION;
+    HANDLE hProcess = OpenProcess(access, FALSE, pid);
+    if (!hProcess && GetLastError() == ERROR_ACCESS_DENIED && EnableDebugPrivilege())
+        hProcess = OpenProcess(access, FALSE, pid);
+    if (!hProcess)
+    {
+        printf("  [FAIL] OpenProcess(%lu) failed: %lu\n", pid, GetLastError());
+        return false;
+    }
+
+    size_t pathBytes = (dllPath.length() + 1) * sizeof(wchar_t);
+    void* pRemotePath = VirtualAllocEx(hProcess, NULL, pathBytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    bool ok = false;
+    if (pRemotePath && WriteProcessMemory(hProcess, pRemotePath, dllPath.c_str(), pathBytes, NULL))
+    {
+        FARPROC pLoadLibraryW = GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "LoadLibraryW");
+        HANDLE hThread = CreateRemoteThread(hProcess, NULL, 0,
+            (LPTHREAD_START_ROUTINE)pLoadLibraryW, pRemotePath, 0, NULL);
+        if (hThread)
+        {
+            WaitForSingleObject(hThread, 10000);
+            DWORD exitCode = 0;
+            GetExitCodeThread(hThread, &exitCode);
+            ok = (exitCode != 0);
+            CloseHandle(hThread);
+        }
+    }
+    if (!ok) printf("  [FAIL] Injection into PID %lu failed: %lu\n", pid, GetLastError());
+    if (pRemotePath) VirtualFreeEx(hProcess, pRemotePath, 0, MEM_RELEASE);
+    CloseHandle(hProcess);
+    return ok;
+}
+
+static bool WaitServiceState(SC_HANDLE hSvc, DWORD state, DWORD timeoutMs)
+{
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    SERVICE_STATUS ss;
+    while (QueryServiceStatus(hSvc, &ss))
+    {
+        if (ss.dwCurrentState == state) return true;
+        if (GetTickCount64() >= deadline) return false;
+        Sleep(250);
+    }
+    return false;
+}
+
+/**
+ * Stop and start the RSLinx service, as stress_test.ps1 does: RSOBSERV
+ * first (it holds the hook), RSLinx.exe killed if the stop does not finish
+ * within 15 s.
+ */
+static bool RestartRSLinx()
+{
+    SC_HANDLE hScm = OpenSCManagerW(NULL, NULL, SC_MANAGER_CONNECT);
+    if (!hScm)
+    {
+        printf("  [FAIL] OpenSCManager failed: %lu (run as Administrator)\n", GetLastError());
+        return false;
+    }
+    SC_HANDLE hSvc = OpenServiceW(hScm, L"RSLinx", SERVICE_STOP | SERVICE_START | SERVICE_QUERY_STATUS);
+    if (!hSvc)
+    {
+        printf("  [FAIL] OpenService(RSLinx) failed: %lu\n", GetLastError());
+        CloseServiceHandle(hScm);
+        return false;
+    }
+
+    KillProcessByName(L"RSOBSERV.exe");
+    SERVICE_STATUS ss;
+    ControlService(hSvc, SERVICE_CONTROL_STOP, &ss);
+    if (!WaitServiceState(hSvc, SERVICE_STOPPED, 15000))
+    {
+        KillProcessByName(L"RSLinx.exe");
+        KillProcessByName(L"RSOBSERV.exe");
+        WaitServiceState(hSvc, SERVICE_STOPPED, 5000);
+    }
+
+    bool ok = StartServiceW(hSvc, 0, NULL) || GetLastError() == ERROR_SERVICE_ALREADY_RUNNING;
+    ok = ok && WaitServiceState(hSvc, SERVICE_RUNNING, 30000);
+    if (!ok) printf("  [FAIL] RSLinx service did not start: %lu\n", GetLastError());
+    CloseServiceHandle(hSvc);
+    CloseServiceHandle(hScm);
+    return ok;
+}
+
+// ============================================================
+// Results
+// ============================================================
+
+struct SeriesStats {
+    size_t count = 0;
+    double min = 0, p50 = 0, p95 = 0, p99 = 0, max = 0, mean = 0;
+};
+
+// Nearest-rank percentiles
+static SeriesStats Summarize(std::vector<double> ms)
+{
+    SeriesStats st;
+    st.count = ms.size();
+    if (ms.empty()) return st;
+    std::sort(ms.begin(), ms.end());
+    auto rank = [&](double p) {
+        size_t i = (size_t)ceil(p / 100.0 * ms.size());
+        return ms[(i > 0 ? i : 1) - 1];
+    };
+    double sum = 0;
+    for (double v : ms) sum += v;
+    st.min = ms.front();
+    st.max = ms.back();
+    st.p50 = rank(50);
+    st.p95 = rank(95);
+    st.p99 = rank(99);
+    st.mean = sum / ms.size();
+    return st;
+}
+
+struct Series {
+    std::string name;
+    std::vector<double> ms;
+};
+
+struct Workload {
+    std::string name;
+    int errors = 0;
+    std::string note;          // first error, or why the workload was cut short
+    std::deque<Series> series;      // deque: Get() references stay valid as series are added
+    std::vector<std::pair<std::string, double>> metrics;
+
+    std::vector<double>& Get(const char* seriesName)
+    {
+        for (auto& s : series)
+            if (s.name == seriesName) return s.ms;
+        series.push_back({ seriesName, {} });
+        return series.back().ms;
+    }
+    void Fail(const char* why)
+    {
+        errors++;
+        if (note.empty()) note = why;
+        printf("  [FAIL] %s\n", why);
+    }
+    void Metric(const char* metricName, double value) { metrics.push_back({ metricName, value }); }
+};
+
+// ============================================================
+// Memory sampler — RSLinx.exe working set and private bytes
+// ============================================================
+
+struct MemSample {
+    double tMs;
+    int workload;              // index into the run's workload list, -1 between workloads
+    SIZE_T workingSetKB;
+    SIZE_T privateKB;
+};
+
+static CRITICAL_SECTION s_memCS;
+static std::vector<MemSample> s_memSamples;
+static volatile LONG s_currentWorkload = -1;
+static HANDLE s_hSamplerStop = NULL;
+static DWORD s_memIntervalMs = 1000;
+static double s_runStartMs = 0;
+
+static DWORD WINAPI MemorySampler(LPVOID)
+{
+    DWORD openPid = 0;
+    HANDLE hProcess = NULL;
+    do
+    {
+        // Re-found on every tick: a cold start with --restart changes the PID
+        DWORD pid = FindProcessByName(L"RSLinx.exe");
+        if (pid != openPid)
+        {
+            if (hProcess) CloseHandle(hProcess);
+            hProcess = pid ? OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, pid) : NULL;
+            openPid = pid;
+        }
+        PROCESS_MEMORY_COUNTERS_EX pmc = {};
+        pmc.cb = sizeof(pmc);
+        if (hProcess && GetProcessMemoryInfo(hProcess, (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc)))
+        {
+            MemSample s = { NowMs() - s_runStartMs, (int)s_currentWorkload,
+                            pmc.WorkingSetSize / 1024, pmc.PrivateUsage / 1024 };
+            EnterCriticalSection(&s_memCS);
+            s_memSamples.push_back(s);
+            LeaveCriticalSection(&s_memCS);
+        }
+    } while (WaitForSingleObject(s_hSamplerStop, s_memIntervalMs) == WAIT_TIMEOUT);
+    if (hProcess) CloseHandle(hProcess);
+    return 0;
+}
+
+// ============================================================
+// Options
+// ============================================================
+
+struct Options {
+    bool cold = false, warm = true, batch = true, rebrowse = true, monitor = false;
+    std::string driver = "Test";
+    std::vector<std::string> ips;
+    std::wstring pathsFile;
+    std::string port = "Backplane";
+    int iters = 1000;
+    int batchIters = 20;
+    int rebrowseIters = 5;
+    int coldIters = 3;
+    bool restart = false;
+    DWORD settleMs = 8000;
+    DWORD soakMs = 300000;
+    DWORD probeMs = 1000;
+    std::wstring dllPath;
+    std::string label;
+    std::wstring outPath = L"C:\\temp\\hook_bench.json";
+};
+
+static std::string Narrow(const wchar_t* s)
+{
+    char buf[1024] = {};
+    WideCharToMultiByte(CP_UTF8, 0, s, -1, buf, sizeof(buf), NULL, NULL);
+    return buf;
+}
+
+static bool ParseWorkloads(const std::string& list, Options& o)
+{
+    o.cold = o.warm = o.batch = o.rebrowse = o.monitor = false;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t comma = list.find(',', start);
+        std::string w = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (w == "cold") o.cold = true;
+        else if (w == "warm") o.warm = true;
+        else if (w == "batch") o.batch = true;
+        else if (w == "rebrowse") o.rebrowse = true;
+        else if (w == "monitor") o.monitor = true;
+        else if (w == "all") o.cold = o.warm = o.batch = o.rebrowse = o.monitor = true;
+        else
+        {
+            printf("Unknown workload '%s'\n", w.c_str());
+            return false;
+        }
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return true;
+}
+
+// Config lines naming the benchmark's driver, after C|MODE and before C|END
+static void SendDriverConfig(HookPipe& pipe, const Options& o)
+{
+    pipe.Send("C|DRIVER=" + o.driver);
+    for (const auto& ip : o.ips)
+        pipe.Send("C|IP=" + ip);
+}
+
+static std::wstring DefaultDllPath()
+{
+    wchar_t exePath[MAX_PATH];
+    GetModuleFileNameW(NULL, exePath, MAX_PATH);
+    std::wstring dll(exePath);
+    size_t slash = dll.rfind(L'\\');
+    if (slash != std::wstring::npos) dll.resize(slash + 1);
+    return dll + L"RSLinxHook.dll";
+}
+
+/**
+ * Connect to the hook, injecting it first if nothing is listening. For a
+ * query session the config ends with H|; a COLD answer (or a fresh inject)
+ * gets the full config and waits for the initial D|. hello receives the
+ * H| answer. Setup only: nothing here is timed.
+ */
+static bool AttachQuerySession(HookPipe& pipe, const Options& o, std::string& hello)
+{
+    if (!pipe.Connect(1000))
+    {
+        DWORD pid = FindProcessByName(L"RSLinx.exe");
+        if (!pid)
+        {
+            printf("  [FAIL] RSLinx.exe not running\n");
+            return false;
+        }
+        printf("  Hook not resident - injecting into PID %lu\n", pid);
+        if (!InjectDLL(pid, o.dllPath) || !pipe.Connect(10000))
+            return false;
+    }
+    pipe.Send("H|" + o.driver);
+    std::string line;
+    ULONGLONG deadline = GetTickCount64() + 5000;
+    while (GetTickCount64() < deadline && pipe.ReadLine(line, 5000))
+    {
+        if (!StartsWith(line, "H|")) continue;
+        hello = line;
+        if (line.find("|READY|") != std::string::npos) return true;
+        break;
+    }
+    printf("  Hook is cold - running the initial browse first\n");
+    pipe.Send("C|MODE=inject");
+    SendDriverConfig(pipe, o);
+    pipe.Send("C|END");
+    return ReadReply(pipe, BROWSE_TIMEOUT_MS, nullptr);
+}
+
+// ============================================================
+// Query paths
+// ============================================================
+
+static bool LoadPaths(const std::wstring& file, std::vector<std::string>& paths)
+{
+    FILE* f = _wfopen(file.c_str(), L"r");
+    if (!f) return false;
+    char line[1024];
+    while (fgets(line, sizeof(line), f))
+    {
+        size_t n = strlen(line);
+        while (n && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (n) paths.push_back(line);
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Every identified entry in the hook's cache, from one F|*. R|FOUND carries
+ * class|name|ip|slot (plus |STALE); a device name may hold '|', so ip and
+ * slot are taken from the end. The port is not reported: slots are
+ * queried as ip\<port>\slot.
+ */
+static void DiscoverPaths(HookPipe& pipe, const Options& o, std::vector<std::string>& paths)
+{
+    std::vector<std::string> lines;
+    pipe.Send("F|*");
+    if (!ReadReply(pipe, QUERY_TIMEOUT_MS, &lines)) return;
+    for (const auto& r : lines)
+    {
+        if (!StartsWith(r, "R|FOUND|") || StartsWith(r, "R|FOUND|Unrecognized Device|")) continue;
+        std::vector<std::string> f;
+        size_t start = 0, sep;
+        while ((sep = r.find('|', start)) != std::string::npos)
+        {
+            f.push_back(r.substr(start, sep - start));
+            start = sep + 1;
+        }
+        f.push_back(r.substr(start));
+        while (!f.empty() && (f.back() == "STALE" || f.back() == "PENDING")) f.pop_back();
+        if (f.size() < 6) continue;
+        const std::string& ip = f[f.size() - 2];
+        int slot = atoi(f.back().c_str());
+        paths.push_back(slot < 0 ? ip : ip + "\\" + o.port + "\\" + std::to_string(slot));
+    }
+}
+
+// ============================================================
+// Workloads
+// ============================================================
+
+static void RunCold(const Options& o, Workload& w)
+{
+    for (int i = 0; i < o.coldIters; i++)
+    {
+        DWORD pid = FindProcessByName(L"RSLinx.exe");
+        if (pid && HookLoaded(pid))
+        {
+            if (!o.restart)
+            {
+                if (i == 0) w.Fail("hook already resident - pass --restart for cold starts");
+                else w.note = "later cold starts need --restart";
+                return;
+            }
+            printf("  [%d] restarting RSLinx service\n", i + 1);
+            double t = NowMs();
+            if (!RestartRSLinx())
+            {
+                w.Fail("RSLinx service restart failed");
+                return;
+            }
+            w.Get("restart").push_back(NowMs() - t);
+            Sleep(o.settleMs);  // COM objects not ready straight after start
+            pid = FindProcessByName(L"RSLinx.exe");
+        }
+        if (!pid)
+        {
+            w.Fail("RSLinx.exe not running");
+            return;
+        }
+
+        double t0 = NowMs();
+        if (!InjectDLL(pid, o.dllPath))
+        {
+            w.Fail("DLL injection failed");
+            return;
+        }
+        double t1 = NowMs();
+        HookPipe pipe;
+        if (!pipe.Connect(10000))
+        {
+            w.Fail("hook pipe did not appear within 10 s");
+            return;
+        }
+        double t2 = NowMs();
+        pipe.Send("C|MODE=inject");
+        SendDriverConfig(pipe, o);
+        pipe.Send("C|END");
+        if (!ReadReply(pipe, BROWSE_TIMEOUT_MS, nullptr))
+        {
+            w.Fail("no D| after the initial browse");
+            return;
+        }
+        double t3 = NowMs();
+
+        w.Get("inject").push_back(t1 - t0);
+        w.Get("pipe").push_back(t2 - t1);
+        w.Get("browse").push_back(t3 - t2);
+        w.Get("total").push_back(t3 - t0);
+        printf("  [%d] inject %.0f ms, pipe %.0f ms, browse %.0f ms\n",
+               i + 1, t1 - t0, t2 - t1, t3 - t2);
+    }
+}
+
+static void RunWarm(HookPipe& pipe, const Options& o, const std::vector<std::string>& paths, Workload& w)
+{
+    std::vector<double>& ms = w.Get("query");
+    int found = 0, stale = 0;
+    std::vector<std::string> lines;
+    for (int i = 0; i < o.iters; i++)
+    {
+        lines.clear();
+        double t = NowMs();
+        if (!pipe.Send("Q|" + paths[i % paths.size()]) || !ReadReply(pipe, QUERY_TIMEOUT_MS, &lines))
+        {
+            w.Fail("query timed out or the pipe broke");
+            break;
+        }
+        ms.push_back(NowMs() - t);
+        if (!lines.empty() && StartsWith(lines.back(), "R|FOUND|"))
+        {
+            found++;
+            if (lines.back().find("|STALE") != std::string::npos) stale++;
+        }
+    }
+    w.Metric("paths", (double)paths.size());
+    w.Metric("found", found);
+    w.Metric("notFound", (double)ms.size() - found);
+    w.Metric("stale", stale);
+}
+
+static void RunBatch(HookPipe& pipe, const Options& o, const std::vector<std::string>& paths, Workload& w)
+{
+    std::string batch = "QB|BEGIN\n";
+    for (size_t i = 0; i < paths.size(); i++)
+        batch += "QB|" + std::to_string(i) + "|" + paths[i] + "\n";
+    batch += "QB|END";
+
+    std::vector<double>& ms = w.Get("batch");
+    std::vector<std::string> lines;
+    size_t answered = 0;
+    for (int i = 0; i < o.batchIters; i++)
+    {
+        lines.clear();
+        double t = NowMs();
+        if (!pipe.Send(batch) || !ReadReply(pipe, BROWSE_TIMEOUT_MS, &lines))
+        {
+            w.Fail("batch timed out or the pipe broke");
+            break;
+        }
+        ms.push_back(NowMs() - t);
+        answered += lines.size();
+        if (lines.size() != paths.size())
+            w.Fail("batch answered a different number of entries than it sent");
+    }
+    w.Metric("paths", (double)paths.size());
+    if (!ms.empty())
+    {
+        SeriesStats st = Summarize(ms);
+        w.Metric("answersPerBatch", (double)answered / ms.size());
+        w.Metric("p50UsPerPath", st.p50 * 1000.0 / paths.size());
+    }
+}
+
+static void RunRebrowse(HookPipe& pipe, const Options& o, Workload& w)
+{
+    std::vector<double>& ms = w.Get("browse");
+    for (int i = 0; i < o.rebrowseIters; i++)
+    {
+        double t = NowMs();
+        if (!pipe.Send("B|") || !ReadReply(pipe, BROWSE_TIMEOUT_MS, nullptr))
+        {
+            // The hook drops the client when a browse leaves COM state unusable
+            w.Fail("re-browse timed out or the hook closed the session");
+            break;
+        }
+        ms.push_back(NowMs() - t);
+        printf("  [%d] re-browse %.0f ms\n", i + 1, ms.back());
+    }
+}
+
+/**
+ * Monitor session for the soak duration. S| is total|identified|events|
+ * address space KB|sinks|addresses; the largest address space it reports
+ * and the last sink and address counts become metrics, so a leak in the
+ * hook's own bookkeeping shows next to the process working set.
+ */
+static void RunMonitor(HookPipe* query, const Options& o, const std::vector<std::string>& paths,
+                       Workload& w)
+{
+    HookPipe mon;
+    if (!mon.Connect(2000))
+    {
+        w.Fail("hook pipe not available");
+        return;
+    }
+    double t0 = NowMs();
+    mon.Send("C|MODE=monitor");
+    mon.Send("C|LOGLEVEL=warn");
+    SendDriverConfig(mon, o);
+    mon.Send("C|END");
+
+    bool probing = query && !paths.empty();
+    std::vector<double>& firstStatus = w.Get("firstStatus");
+    std::vector<double>& statusGap = w.Get("statusInterval");
+    std::vector<double>& probeMs = w.Get("query");
+    int statusLines = 0, xmlBlocks = 0, nodeBlocks = 0;
+    double lastStatus = 0, maxAddrKB = 0, sinks = 0, addresses = 0;
+    // The first monitor client gets no D| until its loop ends: the soak
+    // starts at C|END
+    double soakEnd = t0 + o.soakMs, nextProbe = t0 + o.probeMs;
+    size_t probeIndex = 0;
+    std::string line;
+    std::vector<std::string> lines;
+
+    while (NowMs() < soakEnd)
+    {
+        // Drain the monitor pipe for one probe period: the hook drops a
+        // client that leaves its pipe full for 5 s
+        double wait = nextProbe - NowMs();
+        if (wait > 0)
+        {
+            if (!mon.ReadLine(line, (DWORD)wait + 1))
+            {
+                if (!mon.broken) continue;
+                w.Fail("monitor session closed during the soak");
+                break;
+            }
+            if (StartsWith(line, "S|"))
+            {
+                double now = NowMs();
+                if (statusLines++) statusGap.push_back(now - lastStatus);
+                else firstStatus.push_back(now - t0);
+                lastStatus = now;
+                double f[6] = {};
+                sscanf(line.c_str() + 2, "%lf|%lf|%lf|%lf|%lf|%lf", &f[0], &f[1], &f[2], &f[3], &f[4], &f[5]);
+                if (f[3] > maxAddrKB) maxAddrKB = f[3];
+                sinks = f[4];
+                addresses = f[5];
+            }
+            else if (line == "X|BEGIN") xmlBlocks++;
+            else if (line == "N|BEGIN" || line == "N|DELTA") nodeBlocks++;
+            continue;
+        }
+        nextProbe = NowMs() + o.probeMs;
+        if (!probing) continue;
+        lines.clear();
+        double t = NowMs();
+        if (!query->Send("Q|" + paths[probeIndex++ % paths.size()]) || !ReadReply(*query, 2000, &lines))
+        {
+            w.Fail("query probe timed out during the soak");
+            probing = false;
+            continue;
+        }
+        probeMs.push_back(NowMs() - t);
+    }
+
+    w.Metric("soakSeconds", o.soakMs / 1000.0);
+    w.Metric("statusLines", statusLines);
+    w.Metric("xmlBlocks", xmlBlocks);
+    w.Metric("nodeBlocks", nodeBlocks);
+    w.Metric("peakAddressSpaceKB", maxAddrKB);
+    w.Metric("sinks", sinks);
+    w.Metric("addresses", addresses);
+}
+
+// ============================================================
+// Report
+// ============================================================
+
+static std::string JsonString(const std::string& s)
+{
+    std::string out = "\"";
+    for (char ch : s)
+    {
+        if (ch == '"' || ch == '\\') { out += '\\'; out += ch; }
+        else if ((unsigned char)ch < 0x20)
+        {
+            char esc[8];
+            sprintf(esc, "\\u%04x", (unsigned char)ch);
+            out += esc;
+        }
+        else out += ch;
+    }
+    return out + "\"";
+}
+
+static void PrintWorkload(const Workload& w)
+{
+    printf("\n--- %s%s ---\n", w.name.c_str(), w.errors ? " (errors)" : "");
+    printf("  %-16s %7s %9s %9s %9s %9s %9s %9s\n", "series", "count", "min", "p50", "p95", "p99", "max", "mean");
+    for (const auto& s : w.series)
+    {
+        SeriesStats st = Summarize(s.ms);
+        printf("  %-16s %7zu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", s.name.c_str(), st.count,
+               st.min, st.p50, st.p95, st.p99, st.max, st.mean);
+    }
+    for (const auto& m : w.metrics)
+        printf("  %-16s %g\n", m.first.c_str(), m.second);
+    if (!w.note.empty()) printf("  note: %s\n", w.note.c_str());
+}
+
+static bool WriteJson(const Options& o, const std::string& hello, const std::vector<Workload>& workloads,
+                      const std::vector<std::string>& perf)
+{
+    FILE* f = _wfopen(o.outPath.c_str(), L"w");
+    if (!f) return false;
+
+    SYSTEMTIME st;
+    GetSystemTime(&st);
+    char stamp[32], host[MAX_COMPUTERNAME_LENGTH + 1] = {};
+    DWORD hostLen = sizeof(host);
+    sprintf(stamp, "%04u-%02u-%02uT%02u:%02u:%02uZ", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+    GetComputerNameA(host, &hostLen);
+
+    fprintf(f, "{\n  \"tool\": \"HookBench\",\n  \"schema\": 1,\n");
+    fprintf(f, "  \"label\": %s,\n  \"timestamp\": \"%s\",\n  \"host\": %s,\n  \"hook\": %s,\n",
+            JsonString(o.label).c_str(), stamp, JsonString(host).c_str(), JsonString(hello).c_str());
+    fprintf(f, "  \"options\": {\"driver\": %s, \"ips\": %zu, \"iters\": %d, \"batchIters\": %d, "
+               "\"rebrowseIters\": %d, \"coldIters\": %d, \"restart\": %s, \"soakSeconds\": %lu, "
+               "\"probeMs\": %lu, \"memIntervalMs\": %lu},\n",
+            JsonString(o.driver).c_str(), o.ips.size(), o.iters, o.batchIters, o.rebrowseIters,
+            o.coldIters, o.restart ? "true" : "false", o.soakMs / 1000, o.probeMs, s_memIntervalMs);
+
+    fprintf(f, "  \"workloads\": [");
+    for (size_t wi = 0; wi < workloads.size(); wi++)
+    {
+        const Workload& w = workloads[wi];
+        fprintf(f, "%s\n    {\"name\": %s, \"errors\": %d, \"note\": %s,\n     \"series\": [",
+                wi ? "," : "", JsonString(w.name).c_str(), w.errors, JsonString(w.note).c_str());
+        for (size_t si = 0; si < w.series.size(); si++)
+        {
+            SeriesStats s = Summarize(w.series[si].ms);
+            fprintf(f, "%s\n       {\"name\": %s, \"count\": %zu, \"minMs\": %.3f, \"p50Ms\": %.3f, "
+                       "\"p95Ms\": %.3f, \"p99Ms\": %.3f, \"maxMs\": %.3f, \"meanMs\": %.3f}",
+                    si ? "," : "", JsonString(w.series[si].name).c_str(), s.count,
+                    s.min, s.p50, s.p95, s.p99, s.max, s.mean);
+        }
+        fprintf(f, "],\n     \"metrics\": {");
+        for (size_t mi = 0; mi < w.metrics.size(); mi++)
+            fprintf(f, "%s%s: %g", mi ? ", " : "", JsonString(w.metrics[mi].first).c_str(), w.metrics[mi].second);
+        fprintf(f, "}}");
+    }
+    fprintf(f, "\n  ],\n");
+
+    SIZE_T peakWS = 0, peakPrivate = 0;
+    for (const auto& s : s_memSamples)
+    {
+        if (s.workingSetKB > peakWS) peakWS = s.workingSetKB;
+        if (s.privateKB > peakPrivate) peakPrivate = s.privateKB;
+    }
+    fprintf(f, "  \"memory\": {\"peakWorkingSetKB\": %zu, \"peakPrivateKB\": %zu, \"samples\": [",
+            peakWS, peakPrivate);
+    for (size_t i = 0; i < s_memSamples.size(); i++)
+    {
+        const MemSample& s = s_memSamples[i];
+        const char* name = (s.workload >= 0 && s.workload < (int)workloads.size())
+                         ? workloads[s.workload].name.c_str() : "";
+        fprintf(f, "%s\n    {\"tMs\": %.0f, \"workload\": \"%s\", \"workingSetKB\": %zu, \"privateKB\": %zu}",
+                i ? "," : "", s.tMs, name, s.workingSetKB, s.privateKB);
+    }
+    fprintf(f, "]},\n  \"hookPerf\": [");
+    for (size_t i = 0; i < perf.size(); i++)
+        fprintf(f, "%s\n    %s", i ? "," : "", JsonString(perf[i].substr(2)).c_str());
+    fprintf(f, "]\n}\n");
+    fclose(f);
+    return true;
+}
+
+// ============================================================
+// Main
+// ============================================================
+
+static void Usage()
+{
+    printf("Usage: HookBench [--workloads cold,warm,batch,rebrowse,monitor|all]\n"
+           "                 [--driver NAME] [--ip IP]... [--paths FILE] [--port NAME]\n"
+           "                 [--iters N] [--batch-iters N] [--rebrowse-iters N]\n"
+           "                 [--cold-iters N] [--restart] [--settle SECONDS]\n"
+           "                 [--soak SECONDS] [--probe-ms MS] [--mem-interval MS]\n"
+           "                 [--dll PATH] [--label TEXT] [--out FILE]\n");
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    Options o;
+    o.dllPath = DefaultDllPath();
+    for (int i = 1; i < argc; i++)
+    {
+        const wchar_t* a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (_wcsicmp(a, L"--restart") == 0) o.restart = true;
+        else if (!hasValue) { Usage(); return 2; }
+        else if (_wcsicmp(a, L"--workloads") == 0) { if (!ParseWorkloads(Narrow(argv[++i]), o)) return 2; }
+        else if (_wcsicmp(a, L"--driver") == 0) o.driver = Narrow(argv[++i]);
+        else if (_wcsicmp(a, L"--ip") == 0) o.ips.push_back(Narrow(argv[++i]));
+        else if (_wcsicmp(a, L"--paths") == 0) o.pathsFile = argv[++i];
+        else if (_wcsicmp(a, L"--port") == 0) o.port = Narrow(argv[++i]);
+        else if (_wcsicmp(a, L"--iters") == 0) o.iters = _wtoi(argv[++i]);
+        else if (_wcsicmp(a, L"--batch-iters") == 0) o.batchIters = _wtoi(argv[++i]);
+        else if (_wcsicmp(a, L"--rebrowse-iters") == 0) o.rebrowseIters = _wtoi(argv[++i]);
+        else if (_wcsicmp(a, L"--cold-iters") == 0) o.coldIters = _wtoi(argv[++i]);
+        else if (_wcsicmp(a, L"--settle") == 0) o.settleMs = (DWORD)_wtoi(argv[++i]) * 1000;
+        else if (_wcsicmp(a, L"--soak") == 0) o.soakMs = (DWORD)_wtoi(argv[++i]) * 1000;
+        else if (_wcsicmp(a, L"--probe-ms") == 0) o.probeMs = (DWORD)_wtoi(argv[++i]);
+        else if (_wcsicmp(a, L"--mem-interval") == 0) s_memIntervalMs = (DWORD)_wtoi(argv[++i]);
+        else if (_wcsicmp(a, L"--dll") == 0) o.dllPath = argv[++i];
+        else if (_wcsicmp(a, L"--label") == 0) o.label = Narrow(argv[++i]);
+        else if (_wcsicmp(a, L"--out") == 0) o.outPath = argv[++i];
+        else { Usage(); return 2; }
+    }
+    if (o.probeMs == 0) o.probeMs = 1000;
+    if (s_memIntervalMs == 0) s_memIntervalMs = 1000;
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    s_qpcPerMs = (double)freq.QuadPart / 1000.0;
+    s_runStartMs = NowMs();
+    EnableDebugPrivilege();
+
+    InitializeCriticalSection(&s_memCS);
+    s_hSamplerStop = CreateEventW(NULL, TRUE, FALSE, NULL);
+    HANDLE hSampler = CreateThread(NULL, 0, MemorySampler, NULL, 0, NULL);
+
+    std::vector<Workload> workloads;
+    auto begin = [&](const char* name) -> Workload& {
+        printf("\n=== %s ===\n", name);
+        workloads.push_back(Workload());
+        workloads.back().name = name;
+        InterlockedExchange(&s_currentWorkload, (LONG)workloads.size() - 1);
+        return workloads.back();
+    };
+    auto end = [&]() { InterlockedExchange(&s_currentWorkload, -1); };
+
+    if (o.cold)
+    {
+        RunCold(o, begin("cold"));
+        end();
+    }
+
+    // One query session for warm, batch, rebrowse and the monitor soak's probes
+    HookPipe query;
+    std::string hello;
+    std::vector<std::string> paths, perf;
+    bool needQuery = o.warm || o.batch || o.rebrowse || o.monitor;
+    bool attached = needQuery && AttachQuerySession(query, o, hello);
+    if (attached)
+    {
+        query.Send("P|RESET");
+        ReadReply(query, QUERY_TIMEOUT_MS, nullptr);
+        if (!o.pathsFile.empty())
+        {
+            if (!LoadPaths(o.pathsFile, paths))
+                printf("[FAIL] Cannot open %s\n", Narrow(o.pathsFile.c_str()).c_str());
+        }
+        else
+        {
+            DiscoverPaths(query, o, paths);
+        }
+        printf("%zu query path(s)\n", paths.size());
+    }
+    else if (needQuery)
+    {
+        printf("[FAIL] Cannot attach to the hook\n");
+    }
+
+    auto runQuery = [&](const char* name, auto body) {
+        Workload& w = begin(name);
+        if (!attached) w.Fail("no hook session");
+        else if (paths.empty() && strcmp(name, "rebrowse") != 0) w.Fail("no query paths (pass --paths, or browse first)");
+        else body(w);
+        end();
+    };
+    if (o.warm) runQuery("warm", [&](Workload& w) { RunWarm(query, o, paths, w); });
+    if (o.batch) runQuery("batch", [&](Workload& w) { RunBatch(query, o, paths, w); });
+    if (o.rebrowse) runQuery("rebrowse", [&](Workload& w) { RunRebrowse(query, o, w); });
+    if (o.monitor)
+    {
+        RunMonitor(attached ? &query : nullptr, o, paths, begin("monitor"));
+        end();
+    }
+
+    if (attached && query.Connected())
+    {
+        query.Send("P|");
+        ReadReply(query, QUERY_TIMEOUT_MS, &perf, true);
+    }
+    query.Close();
+
+    SetEvent(s_hSamplerStop);
+    WaitForSingleObject(hSampler, 5000);
+    CloseHandle(hSampler);
+
+    int errors = 0;
+    for (const auto& w : workloads)
+    {
+        PrintWorkload(w);
+        errors += w.errors;
+    }
+    if (WriteJson(o, hello, workloads, perf))
+        printf("\nResults: %s (%zu memory samples)\n", Narrow(o.outPath.c_str()).c_str(), s_memSamples.size());
+    else
+        printf("\n[FAIL] Cannot write %s\n", Narrow(o.outPath.c_str()).c_str());
+    return errors ? 1 : 0;
+}
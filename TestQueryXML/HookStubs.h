@@ -0,0 +1,37 @@
+/**
+ * HookStubs.h
+ *
+ * The RSLinxHook symbols that the COM-free hook sources (TopologyQuery.cpp,
+ * TopologySnapshot.cpp, DeviceStore.cpp, Perf.cpp) call outside themselves,
+ * for the standalone programs in this directory. Include from exactly one
+ * .cpp per program.
+ */
+#pragma once
+#include <windows.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string>
+
+// Hook Log() lines are printed only when set (e.g. by a -v flag)
+static bool g_stubLogEnabled = false;
+
+void Log(const wchar_t* fmt, ...)
+{
+    if (!g_stubLogEnabled) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vwprintf(fmt, ap);
+    va_end(ap);
+    wprintf(L"\n");
+}
+
+// Config.cpp
+std::wstring Utf8ToWide(const char* utf8)
+{
+    if (!utf8 || !*utf8) return L"";
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, utf8, -1, NULL, 0);
+    if (wlen <= 0) return L"";
+    std::wstring result(wlen - 1, 0);
+    MultiByteToWideChar(CP_UTF8, 0, utf8, -1, &result[0], wlen);
+    return result;
+}
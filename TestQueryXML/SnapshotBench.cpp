@@ -0,0 +1,205 @@
+/**
+ * Benchmark for the streaming topology snapshot reader
+ * Links the real parser from RSLinxHook (no COM dependencies):
+ *
+ *   cl /O2 /EHsc /std:c++17 /D_CRT_SECURE_NO_WARNINGS /I..\RSLinxHook
+ *      SnapshotBench.cpp ..\RSLinxHook\TopologySnapshot.cpp psapi.lib
+ *
+ * Usage: SnapshotBench [sizeMB] [iterations]     (defaults: 10 MB, 5)
+ *
+ * Generates a synthetic SaveTopologyXML-shaped file of the requested size
+ * (Ethernet devices with 17-slot backplanes, every 8th slot a
+ * <device reference>), then reports parse throughput and how far peak
+ * working set grows relative to the file size.
+ */
+#include <windows.h>
+#include <psapi.h>
+#include <stdio.h>
+#include "TestHarness.h"
+#include "TopologySnapshot.h"
+
+struct GenStats {
+    size_t bytes = 0;
+    int ethernetDevices = 0;
+    int slotDevices = 0;
+    int references = 0;
+    std::string lastIP;
+};
+
+// Write the synthetic topology straight to disk so the generator itself
+// does not inflate the peak working set measured afterwards.
+static bool GenerateTopology(const wchar_t* path, size_t targetBytes, GenStats& st)
+{
+    FILE* f = _wfopen(path, L"wb");
+    if (!f) return false;
+
+    char line[512];
+    auto emit = [&](const char* s) { size_t n = strlen(s); fwrite(s, 1, n, f); st.bytes += n; };
+
+    emit("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<topology>\n<tree>\n");
+    emit("<device name=\"Workstation\" classname=\"Workstation\">\n");
+    emit("<port name=\"Bench\">\n<bus name=\"Ethernet\" classname=\"AB_ETH\">\n");
+
+    while (st.bytes < targetBytes)
+    {
+        int d = st.ethernetDevices++;
+        snprintf(line, sizeof(line), "10.%d.%d.%d", (d >> 16) & 0xFF, (d >> 8) & 0xFF, d & 0xFF);
+        st.lastIP = line;
+
+        snprintf(line, sizeof(line),
+            "<address type=\"String\" value=\"%s\">\n"
+            "<device name=\"1756-EN2T %d\" classname=\"1756-EN2T/D\" objectid=\"{E%08X-0000-0000-0000-000000000000}\" online=\"true\">\n"
+            "<port name=\"Backplane\">\n<bus name=\"Backplane (17)\" classname=\"AB_BP\">\n",
+            st.lastIP.c_str(), d, d);
+        emit(line);
+
+        for (int slot = 0; slot < 17; slot++)
+        {
+            if (slot > 0 && slot % 8 == 0)
+            {
+                snprintf(line, sizeof(line),
+                    "<address type=\"Short\" value=\"%d\">\n"
+                    "<device reference=\"{E%08X-0000-0000-0000-000000000000}\"/>\n</address>\n",
+                    slot, d);
+                st.references++;
+            }
+            else
+            {
+                snprintf(line, sizeof(line),
+                    "<address type=\"Short\" value=\"%d\">\n"
+                    "<device name=\"1756-IB16 Slot %d\" classname=\"1756-IB16/B\" objectid=\"{S%08X-%04X-0000-0000-000000000000}\"/>\n</address>\n",
+                    slot, slot, d, slot);
+            }
+            emit(line);
+            st.slotDevices++;
+        }
+        emit("</bus>\n</port>\n</device>\n</address>\n");
+    }
+
+    emit("</bus>\n</port>\n</device>\n</tree>\n</topology>\n");
+    fclose(f);
+    return true;
+}
+
+static SIZE_T PeakWorkingSet()
+{
+    PROCESS_MEMORY_COUNTERS pmc = { sizeof(pmc) };
+    GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+    return pmc.PeakWorkingSetSize;
+}
+
+// Feed a buffer in tiny slices and compare against a one-shot parse —
+// exercises every tag/comment/attribute split across chunk boundaries.
+static void TestChunkBoundaries()
+{
+    printf("\n-- Chunk boundary handling --\n");
+    const char* xml =
+        "<?xml version=\"1.0\"?><!-- snapshot > comment --><topology><tree>"
+        "<device name=\"Workstation\" classname=\"Workstation\"><port name=\"T\">"
+        "<bus name=\"Ethernet\" classname=\"AB_ETH\"><address type=\"String\" value=\"1.2.3.4\">"
+        "<device name=\"A &amp; B\" classname=\"1756-EN2T/D\" objectid=\"{X}\"><port name=\"Backplane\">"
+        "<bus name=\"Backplane (4)\"><address type='Short' value='2'><device reference=\"{X}\"/></address>"
+        "</bus></port></device></address></bus></port></device></tree></topology>";
+    size_t len = strlen(xml);
+
+    TopologySnapshot whole;
+    ParseTopologyBuffer(xml, len, whole);
+
+    bool allMatch = true;
+    for (size_t step = 1; step <= 13; step++)
+    {
+        TopologySnapshot snap;
+        TopologyStreamParser parser(snap);
+        for (size_t off = 0; off < len; off += step)
+            parser.Feed(xml + off, (len - off < step) ? len - off : step);
+        parser.Finish();
+
+        if (snap.nodes.size() != whole.nodes.size()) { allMatch = false; continue; }
+        for (size_t i = 0; i < snap.nodes.size(); i++)
+        {
+            if (snap.nodes[i].name != whole.nodes[i].name ||
+                snap.nodes[i].parent != whole.nodes[i].parent ||
+                snap.nodes[i].value != whole.nodes[i].value)
+                allMatch = false;
+        }
+    }
+    Check("B1 one-shot parse found 9 nodes", whole.nodes.size() == 9);
+    Check("B2 1..13 byte feeds match one-shot parse", allMatch);
+    Check("B3 entity decoded", whole.nodes.size() > 4 && whole.nodes[4].name == "A & B");
+    Check("B4 reference resolves", whole.nodes.size() == 9 && whole.ResolveDevice(8) == 4);
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    int sizeMB = (argc > 1) ? _wtoi(argv[1]) : 10;
+    int iterations = (argc > 2) ? _wtoi(argv[2]) : 5;
+    if (sizeMB <= 0) sizeMB = 10;
+    if (iterations <= 0) iterations = 5;
+
+    TestChunkBoundaries();
+
+    wchar_t tempDir[MAX_PATH], path[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    swprintf(path, MAX_PATH, L"%ssnapshot_bench_%dmb.xml", tempDir, sizeMB);
+
+    printf("\n-- Synthetic topology (%d MB) --\n", sizeMB);
+    GenStats gen;
+    if (!GenerateTopology(path, (size_t)sizeMB * 1024 * 1024, gen))
+    {
+        printf("  [FAIL] cannot write %ls\n", path);
+        return 1;
+    }
+    printf("  File: %ls\n", path);
+    printf("  %.2f MB, %d Ethernet devices, %d slot entries (%d references)\n",
+        gen.bytes / (1024.0 * 1024.0), gen.ethernetDevices, gen.slotDevices, gen.references);
+
+    LARGE_INTEGER freq, t0, t1;
+    QueryPerformanceFrequency(&freq);
+
+    SIZE_T peakBefore = PeakWorkingSet();
+    double bestMs = 1e30, totalMs = 0;
+    size_t nodeCount = 0, indexCount = 0;
+    bool lastIPFound = false, refsResolve = true;
+
+    for (int it = 0; it < iterations; it++)
+    {
+        TopologySnapshot snap;
+        QueryPerformanceCounter(&t0);
+        bool ok = LoadTopologySnapshot(path, snap);
+        QueryPerformanceCounter(&t1);
+        double ms = (t1.QuadPart - t0.QuadPart) * 1000.0 / freq.QuadPart;
+        totalMs += ms;
+        if (ms < bestMs) bestMs = ms;
+        if (!ok) continue;
+
+        nodeCount = snap.nodes.size();
+        indexCount = snap.objectIndex.size();
+        lastIPFound = false;
+        for (size_t i = snap.nodes.size(); i-- > 0; )
+        {
+            const TopoNode& n = snap.nodes[i];
+            if (n.kind == TopoKind::Address && n.type == "String") { lastIPFound = (n.value == gen.lastIP); break; }
+        }
+        for (size_t i = 0; i < snap.nodes.size(); i++)
+            if (snap.nodes[i].isReference && snap.ResolveDevice((int)i) < 0) refsResolve = false;
+    }
+    SIZE_T peakAfter = PeakWorkingSet();
+
+    double mb = gen.bytes / (1024.0 * 1024.0);
+    printf("  Parse: best %.1f ms, avg %.1f ms over %d runs (%.0f MB/s)\n",
+        bestMs, totalMs / iterations, iterations, mb / (bestMs / 1000.0));
+    printf("  Nodes: %d, objectid index: %d\n", (int)nodeCount, (int)indexCount);
+    printf("  Peak working set: %.2f MB -> %.2f MB (+%.2f MB, file %.2f MB)\n",
+        peakBefore / (1024.0 * 1024.0), peakAfter / (1024.0 * 1024.0),
+        (peakAfter - peakBefore) / (1024.0 * 1024.0), mb);
+
+    // 1 Workstation + port + bus, then per Ethernet device: address, device,
+    // port, bus, and 17 × (address, device)
+    size_t expectedNodes = 3 + (size_t)gen.ethernetDevices * 4 + (size_t)gen.slotDevices * 2;
+    Check("S1 every element indexed (no size ceiling)", nodeCount == expectedNodes);
+    Check("S2 last Ethernet device present", lastIPFound);
+    Check("S3 all references resolve", refsResolve);
+
+    DeleteFileW(path);
+    return TestResults();
+}
@@ -0,0 +1,24 @@
+/**
+ * TestHarness.h
+ *
+ * The [PASS]/[FAIL] checks shared by the standalone programs in this
+ * directory. Include from exactly one .cpp per program; main returns
+ * TestResults().
+ */
+#pragma once
+#include <stdio.h>
+
+static int pass = 0, fail = 0;
+
+static void Check(const char* desc, bool condition)
+{
+    if (condition) { printf("  [PASS] %s\n", desc); pass++; }
+    else           { printf("  [FAIL] %s\n", desc); fail++; }
+}
+
+// Prints the totals; the process exit code (1 if any check failed)
+static int TestResults()
+{
+    printf("\n--- Results: %d passed, %d failed ---\n", pass, fail);
+    return fail > 0 ? 1 : 0;
+}
@@ -1,310 +1,333 @@
 /**
- * Standalone test for QueryXMLForPath
- * Compiles without COM dependencies — copies the implementation inline.
+ * Standalone test for the hook's topology queries
+ * Links the real query code from RSLinxHook (no COM dependencies):
+ *
+ *   cl /O2 /EHsc /std:c++17 /D_CRT_SECURE_NO_WARNINGS /I..\RSLinxHook
+ *      TestQueryXML.cpp ..\RSLinxHook\TopologyQuery.cpp ..\RSLinxHook\TopologySnapshot.cpp
+ *      ..\RSLinxHook\DeviceStore.cpp ..\RSLinxHook\Perf.cpp ..\RSLinxHook\PipeBinary.cpp
+ *      ..\RSLinxHook\WarmCache.cpp
+ *
+ * Usage: TestQueryXML [topology.xml]     (default: C:\temp\test_topo.xml)
+ *
+ * The built-in fixture runs first, so reference handling is covered even
+ * without a captured topology file.
  */
-#include <windows.h>
-#include <stdio.h>
-#include <string>
-#include <map>
-
-// ---- Inline copy of ExtractAttr + QueryXMLForPath ----
-
-struct QueryResult {
-    bool found = false;
-    std::wstring classname;
-    std::wstring deviceName;
-    std::wstring ip;
-    std::wstring portName;
-    int slot = -1;
-};
-
-static bool ExtractAttr(const char* pos, const char* attrName, char* out, int outMax)
+#include "HookStubs.h"
+#include "TestHarness.h"
+#include "TopologyXML.h"
+#include "TopologySnapshot.h"
+#include "PipeBinary.h"
+#include "WarmCache.h"
+
+static void ResetCache()
 {
-    char needle[128];
-    snprintf(needle, sizeof(needle), " %s=\"", attrName);
-    const char* found = strstr(pos, needle);
-    if (!found || found > pos + 400) return false;
-    found += strlen(needle);
-    const char* end = strchr(found, '"');
-    if (!end) return false;
-    int len = (int)(end - found);
-    if (len >= outMax) len = outMax - 1;
-    memcpy(out, found, len);
-    out[len] = '\0';
-    return true;
+    g_deviceStore.Clear();
+    g_deviceDetails.clear();
+    g_cacheStale = false;
 }
 
-static QueryResult QueryXMLForPath(const wchar_t* xmlFile,
-                                    const std::wstring& ip,
-                                    const std::wstring& portName,
-                                    int slot)
+// Two drivers see the same chassis; the second lists it by reference, and
+// slot 0 of the chassis references the Ethernet device itself.
+static void TestReferences()
 {
-    QueryResult result;
-    result.ip = ip;
-    result.portName = portName;
-    result.slot = slot;
-
-    FILE* f = _wfopen(xmlFile, L"r");
-    if (!f) { wprintf(L"  [ERR] Cannot open XML\n"); return result; }
-    static char buf[262144];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
-    buf[n] = '\0';
-    fclose(f);
+    printf("\n-- References (built-in fixture) --\n");
+    const char* xml =
+        "<?xml version=\"1.0\"?><topology><tree>"
+        "<device name=\"Workstation\" classname=\"Workstation\">"
+        "<port name=\"AB_ETH-1\"><bus name=\"Ethernet\" classname=\"AB_ETH\">"
+        "<address type=\"String\" value=\"10.0.0.5\">"
+        "<device name=\"1756-EN2T/D\" classname=\"1756-EN2T/D\" objectid=\"{EN2T}\">"
+        "<port name=\"Backplane\"><bus name=\"Backplane (4)\" classname=\"AB_BP\">"
+        "<address type=\"Short\" value=\"0\"><device reference=\"{EN2T}\"/></address>"
+        "<address type=\"Short\" value=\"1\"><device name=\"1756-L85E LOGIX5585E\" classname=\"1756-L85E/B\" objectid=\"{L85}\"/></address>"
+        "</bus></port></device></address>"
+        "</bus></port>"
+        "<port name=\"AB_ETH-2\"><bus name=\"Ethernet\" classname=\"AB_ETH\">"
+        "<address type=\"String\" value=\"10.0.0.5\"><device reference=\"{EN2T}\"/></address>"
+        "<address type=\"String\" value=\"10.0.0.6\"><device name=\"10.0.0.6\" classname=\"Unrecognized Device\"/></address>"
+        "</bus></port>"
+        "</device></tree></topology>";
+
+    TopologySnapshot snap;
+    Check("R1 fixture parses", ParseTopologyBuffer(xml, strlen(xml), snap));
+
+    QueryResult r = QueryXMLForPath(snap, L"10.0.0.5", L"Backplane", 0);
+    Check("R2 slot reference resolves to the EN2T", r.found && r.classname == L"1756-EN2T/D");
+    r = QueryXMLForPath(snap, L"10.0.0.5", L"Backplane", 1);
+    Check("R3 real slot device", r.found && r.classname == L"1756-L85E/B");
+
+    TopologyCounts c = CountDevicesInXML(snap);
+    Check("R4 references are not counted as devices", c.totalDevices == 4);
+    Check("R5 identified excludes Workstation/Unrecognized", c.identifiedDevices == 2);
+
+    std::vector<std::wstring> targets = { L"10.0.0.5", L"10.0.0.6", L"10.0.0.7" };
+    Check("R6 one of three targets identified", CountTargetsIdentifiedInXML(snap, targets) == 1);
+
+    std::map<std::wstring, std::set<std::wstring>> byDriver;
+    CollectDriverAddresses(snap, byDriver);
+    Check("R7 both drivers list 10.0.0.5",
+          byDriver[L"AB_ETH-1"].count(L"10.0.0.5") && byDriver[L"AB_ETH-2"].count(L"10.0.0.5"));
+
+    ResetCache();
+    PopulateQueryCache(snap, true);
+    QueryResult hit;
+    Check("R8 cached slot 0 via reference",
+          LookupCachedPath(L"10.0.0.5", L"Backplane", 0, hit) && hit.classname == L"1756-EN2T/D");
+    Check("R9 cached Unrecognized IP",
+          LookupCachedPath(L"10.0.0.6", L"", -1, hit) && hit.classname == L"Unrecognized Device");
+
+    UpdateDeviceIPsFromXML(snap);
+    auto it = g_deviceDetails.find(L"1756-EN2T/D");
+    Check("R10 device IP taken from the real element", it != g_deviceDetails.end() && it->second.ip == L"10.0.0.5");
+
+    // F| finds go through the indexes PopulateQueryCache rebuilt
+    FindQuery fq;
+    std::vector<QueryResult> found;
+    fq.classname = L"1756-l8*";
+    Check("R11 classname prefix, any case",
+          !FindCachedPaths(fq, found, 10) && found.size() == 1 && found[0].slot == 1);
+    found.clear();
+    fq = FindQuery();
+    fq.slot = 0;
+    Check("R12 slot 0 of every chassis",
+          !FindCachedPaths(fq, found, 10) && found.size() == 1 && found[0].classname == L"1756-EN2T/D");
+    found.clear();
+    fq = FindQuery();
+    fq.deviceName = L"*LOGIX55?5E";
+    Check("R13 name wildcard", !FindCachedPaths(fq, found, 10) && found.size() == 1 && found[0].ip == L"10.0.0.5");
+    found.clear();
+    fq = FindQuery();
+    fq.ip = L"10.0.0.*";
+    Check("R14 limit reports more", FindCachedPaths(fq, found, 2) && found.size() == 2);
+
+    // A bus browse refreshes the entry from COM; C|SKIP and backplane
+    // priority must still match the chassis by the snapshot's IP
+    RefreshDeviceDetails(L"1756-EN2T/D", L"{EN2T}");
+    std::vector<std::wstring> skip = { L"10.0.0.5" };
+    Check("R15 skip by IP after a browse refresh", DeviceMatchesIP(L"1756-EN2T/D", skip));
+    skip = { L"10.0.0.6" };
+    Check("R16 unidentified device skipped by name, not a longer IP",
+          DeviceMatchesIP(L"10.0.0.6", skip) && !DeviceMatchesIP(L"10.0.0.60", skip));
+
+    // A walk rebuilds the backplane it walked, not the device's other ports
+    DeviceRecord* rec = g_deviceStore.FindDevice(L"10.0.0.5");
+    int other = g_deviceStore.InternPort(L"A");
+    if (rec) g_deviceStore.SetSlot(*rec, other, 2, L"1756-ENBT/A", L"ENBT");
+    if (rec) g_deviceStore.ClearPort(*rec, g_deviceStore.FindPort(L"Backplane"));
+    g_deviceStore.BuildIndexes();
+    Check("R17 clearing one port keeps the others",
+          rec && !LookupCachedPath(L"10.0.0.5", L"Backplane", 1, hit) &&
+          LookupCachedPath(L"10.0.0.5", L"A", 2, hit) && hit.classname == L"1756-ENBT/A");
+}
 
-    char ipA[64]; WideCharToMultiByte(CP_ACP, 0, ip.c_str(), -1, ipA, sizeof(ipA), NULL, NULL);
-    char addrPattern[128]; snprintf(addrPattern, sizeof(addrPattern), "value=\"%s\"", ipA);
-    char* pos1 = strstr(buf, addrPattern);
-    if (!pos1) return result;
+// Client side of the binary framing, enough to read back what the
+// encoder wrote: frames in order, STRING frames applied as they come
+struct FrameReader {
+    const std::string& buf;
+    size_t pos = 0;
+    std::map<unsigned, std::string> strings;
 
-    if (portName.empty())
+    unsigned Varint(const std::string& s, size_t& at)
     {
-        char* devPos = strstr(pos1, "<device ");
-        if (!devPos || devPos > pos1 + 500) return result;
-        if (strncmp(devPos + 8, "reference", 9) == 0) {
-            devPos = strstr(devPos + 1, "<device ");
-            if (!devPos || devPos > pos1 + 800) return result;
+        unsigned v = 0;
+        for (int shift = 0; at < s.size(); shift += 7)
+        {
+            unsigned char b = (unsigned char)s[at++];
+            v |= (unsigned)(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
         }
-        char cn[256] = {}, nm[256] = {};
-        ExtractAttr(devPos, "classname", cn, sizeof(cn));
-        ExtractAttr(devPos, "name", nm, sizeof(nm));
-        result.found = true;
-        result.classname = std::wstring(cn, cn + strlen(cn));
-        result.deviceName = std::wstring(nm, nm + strlen(nm));
-        return result;
+        return v;
     }
 
-    char portA[128]; WideCharToMultiByte(CP_ACP, 0, portName.c_str(), -1, portA, sizeof(portA), NULL, NULL);
-    char portPattern[256]; snprintf(portPattern, sizeof(portPattern), "name=\"%s\"", portA);
-    char* pos2 = strstr(pos1, portPattern);
-    if (!pos2) return result;
-
-    char slotPattern[64]; snprintf(slotPattern, sizeof(slotPattern), "value=\"%d\"", slot);
-    char* pos3 = strstr(pos2, slotPattern);
-    if (!pos3) return result;
-
-    char* pos4 = strstr(pos3, "<device ");
-    if (!pos4 || pos4 > pos3 + 300) return result;
-    if (strncmp(pos4 + 8, "reference", 9) == 0) {
-        pos4 = strstr(pos4 + 1, "<device ");
-        if (!pos4 || pos4 > pos3 + 500) return result;
+    // Next frame that is not a STRING definition; false at the end
+    bool Next(unsigned char& type, std::string& payload)
+    {
+        while (pos < buf.size())
+        {
+            type = (unsigned char)buf[pos++];
+            unsigned len = Varint(buf, pos);
+            payload = buf.substr(pos, len);
+            pos += len;
+            if (type != FRAME_STRING) return true;
+            size_t at = 0;
+            unsigned id = Varint(payload, at);
+            strings[id] = payload.substr(at);
+        }
+        return false;
     }
+};
 
-    char cn[256] = {}, nm[256] = {};
-    ExtractAttr(pos4, "classname", cn, sizeof(cn));
-    ExtractAttr(pos4, "name", nm, sizeof(nm));
-    result.found = true;
-    result.classname = std::wstring(cn, cn + strlen(cn));
-    result.deviceName = std::wstring(nm, nm + strlen(nm));
-    return result;
-}
-
-// ---- Inline PopulateQueryCache for test ----
-
-static std::map<std::wstring, QueryResult> g_queryCache;
-
-static std::wstring MakeCacheKey(const std::wstring& ip, const std::wstring& portName, int slot)
+static int StringFrames(const std::string& buf)
 {
-    if (portName.empty()) return ip;
-    wchar_t buf[512];
-    swprintf(buf, 512, L"%s\\%s\\%d", ip.c_str(), portName.c_str(), slot);
-    return buf;
+    FrameReader fr{ buf };
+    unsigned char type;
+    std::string payload;
+    while (fr.Next(type, payload)) {}
+    return (int)fr.strings.size();
 }
 
-static void PopulateQueryCache(const wchar_t* xmlFile)
+static void TestBinaryFrames()
 {
-    FILE* f = _wfopen(xmlFile, L"r");
-    if (!f) return;
-    static char buf[262144];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
-    buf[n] = '\0';
-    fclose(f);
-
-    char* p = buf;
-    while ((p = strstr(p, "<address type=\"String\" value=\"")) != nullptr)
-    {
-        p += 30;
-        char* ipEnd = strchr(p, '"');
-        if (!ipEnd) break;
-        std::string ipA(p, ipEnd);
-        std::wstring ipW(ipA.begin(), ipA.end());
-        p = ipEnd;
-
-        char* searchEnd = p + 500;
-        if (searchEnd > buf + n) searchEnd = buf + n;
-        char* devPos = strstr(p, "<device ");
-        if (!devPos || devPos >= searchEnd) continue;
-        if (strncmp(devPos + 8, "reference", 9) == 0) {
-            devPos = strstr(devPos + 1, "<device ");
-            if (!devPos || devPos >= searchEnd) continue;
-        }
-
-        char cn[256] = {}, nm[256] = {};
-        ExtractAttr(devPos, "classname", cn, sizeof(cn));
-        ExtractAttr(devPos, "name", nm, sizeof(nm));
-
-        QueryResult ipResult;
-        ipResult.found = true; ipResult.ip = ipW; ipResult.slot = -1;
-        ipResult.classname = std::wstring(cn, cn + strlen(cn));
-        ipResult.deviceName = std::wstring(nm, nm + strlen(nm));
-        g_queryCache[ipW] = ipResult;
-
-        char* portSearch = devPos;
-        char* portEnd = devPos + 8192;
-        if (portEnd > buf + n) portEnd = buf + n;
-
-        while (portSearch < portEnd)
-        {
-            char* portPos = strstr(portSearch, "<port ");
-            if (!portPos || portPos >= portEnd) break;
-            char portName[128] = {};
-            ExtractAttr(portPos, "name", portName, sizeof(portName));
-            std::wstring portNameW(portName, portName + strlen(portName));
-
-            char* busPos = strstr(portPos, "<bus ");
-            if (!busPos || busPos > portPos + 200) { portSearch = portPos + 1; continue; }
-
-            char* slotSearch = busPos;
-            char* slotEnd = busPos + 4096;
-            if (slotEnd > buf + n) slotEnd = buf + n;
-
-            while (slotSearch < slotEnd)
-            {
-                char* slotPos = strstr(slotSearch, "<address type=\"Short\" value=\"");
-                if (!slotPos || slotPos >= slotEnd) break;
-                char* sv = slotPos + 29;
-                char* svEnd = strchr(sv, '"');
-                if (!svEnd) { slotSearch = slotPos + 1; continue; }
-                char slotStr[16] = {};
-                int slotLen = (int)(svEnd - sv < 15 ? svEnd - sv : 15);
-                memcpy(slotStr, sv, slotLen);
-                int slotN = atoi(slotStr);
-
-                char* slotDevPos = strstr(slotPos, "<device ");
-                if (!slotDevPos || slotDevPos > slotPos + 200) { slotSearch = slotPos + 1; continue; }
-                if (strncmp(slotDevPos + 8, "reference", 9) == 0) {
-                    slotDevPos = strstr(slotDevPos + 1, "<device ");
-                    if (!slotDevPos || slotDevPos > slotPos + 300) { slotSearch = slotPos + 1; continue; }
-                }
-                char scn[256] = {}, snm[256] = {};
-                ExtractAttr(slotDevPos, "classname", scn, sizeof(scn));
-                ExtractAttr(slotDevPos, "name", snm, sizeof(snm));
-
-                std::wstring key = MakeCacheKey(ipW, portNameW, slotN);
-                QueryResult sr;
-                sr.found = true; sr.ip = ipW; sr.portName = portNameW; sr.slot = slotN;
-                sr.classname = std::wstring(scn, scn + strlen(scn));
-                sr.deviceName = std::wstring(snm, snm + strlen(snm));
-                g_queryCache[key] = sr;
-
-                slotSearch = slotDevPos + 1;
-            }
-            portSearch = portPos + 1;
-        }
-    }
+    printf("\n-- Binary framing (PipeBinary) --\n");
+    BinaryEncoder enc;
+    std::string out;
+    enc.Result(out, "1756-L85E/B", "1756-L85E LOGIX5585E", "10.0.0.5", 1, -1, true);
+    enc.Status(out, 12, 9, 400, 81920, 3, 2);
+
+    FrameReader fr{ out };
+    unsigned char type = 0;
+    std::string payload;
+    bool ok = fr.Next(type, payload) && type == FRAME_RESULT && payload[0] == '\x02';
+    size_t at = 1;
+    std::string classname = fr.strings[fr.Varint(payload, at)];
+    std::string name = fr.strings[fr.Varint(payload, at)];
+    std::string ip = fr.strings[fr.Varint(payload, at)];
+    unsigned slot = fr.Varint(payload, at);
+    Check("R18 stale result reads back through its interned strings",
+          ok && classname == "1756-L85E/B" && name == "1756-L85E LOGIX5585E" && ip == "10.0.0.5" &&
+          slot == 2);   // zigzag(1)
+
+    ok = fr.Next(type, payload) && type == FRAME_STATUS;
+    unsigned v[6] = {};
+    at = 0;
+    for (int i = 0; i < 6; i++) v[i] = fr.Varint(payload, at);
+    Check("R19 status frame carries all six counts",
+          ok && v[0] == 12 && v[1] == 9 && v[2] == 400 && v[3] == 81920 && v[4] == 3 && v[5] == 2 &&
+          at == payload.size() && !fr.Next(type, payload));
+
+    std::string again;
+    enc.Result(again, "1756-L85E/B", "1756-L85E LOGIX5585E", "10.0.0.5", 1);
+    enc.ResultNotFound(again, "10.0.0.7", 4, true);
+    Check("R20 known strings are not resent, new ones are", StringFrames(again) == 1);
+    enc.Reset();
+    again.clear();
+    enc.Result(again, "1756-L85E/B", "1756-L85E LOGIX5585E", "10.0.0.5", 1);
+    Check("R21 a reset session gets every string again", StringFrames(again) == 3);
 }
 
-// ---- Test harness ----
-
-static int pass = 0, fail = 0;
-
-static void Check(const char* desc, bool condition)
+static void TestWarmCache()
 {
-    if (condition) { printf("  [PASS] %s\n", desc); pass++; }
-    else           { printf("  [FAIL] %s\n", desc); fail++; }
+    printf("\n-- Warm-start cache file (WarmCache) --\n");
+    DeviceStore store;
+    DeviceRecord& rec = store.UpsertDevice(L"10.0.0.5");
+    rec.classname = L"1756-EN2T/D";
+    rec.deviceName = L"1756-EN2T/D";
+    store.SetSlot(rec, store.InternPort(L"Backplane"), 3, L"1756-IB16/A", L"1756-IB16 \u00c4");
+    store.BuildIndexes();
+    std::map<std::wstring, DeviceInfo> details;
+    details[L"1756-EN2T/D"] = { L"10.0.0.5", L"1756-EN2T/D", L"{EN2T}" };
+    std::map<std::wstring, std::vector<std::wstring>> drivers;
+    drivers[L"AB_ETH-1"] = { L"1756-EN2T/D" };
+
+    std::string image;
+    SerializeWarmCache(store, details, drivers, image);
+    WarmCacheData data;
+    bool parsed = ParseWarmCache(image.data(), image.size(), data);
+    data.store.BuildIndexes();
+    QueryResult r;
+    Check("R22 cache file round-trips slots, details and drivers",
+          parsed && data.store.Lookup(L"10.0.0.5", L"Backplane", 3, r) &&
+          r.classname == L"1756-IB16/A" && r.deviceName == L"1756-IB16 \u00c4" &&
+          data.deviceDetails[L"1756-EN2T/D"].objectId == L"{EN2T}" &&
+          data.driverDeviceNames[L"AB_ETH-1"].size() == 1);
+
+    std::string bad = image;
+    bad[bad.size() - 1] ^= 0x01;
+    WarmCacheData rejected;
+    Check("R23 a corrupted payload fails its checksum",
+          !ParseWarmCache(bad.data(), bad.size(), rejected));
+    bad = image;
+    bad[4] = (char)(WARM_CACHE_VERSION + 1);
+    Check("R24 another version is ignored", !ParseWarmCache(bad.data(), bad.size(), rejected));
+    Check("R25 a truncated file is ignored", !ParseWarmCache(image.data(), image.size() - 1, rejected));
 }
 
 static void RunTests(const wchar_t* xmlFile)
 {
     printf("\nXML: %ls\n\n", xmlFile);
 
+    TopologySnapshot snap;
+    if (!LoadTopologySnapshot(xmlFile, snap))
+    {
+        printf("  [SKIP] cannot load %ls\n", xmlFile);
+        return;
+    }
+
     // === QueryXMLForPath tests ===
     printf("-- QueryXMLForPath --\n");
 
     // T1: IP-only query — known device
     {
-        QueryResult r = QueryXMLForPath(xmlFile, L"192.168.1.55", L"", -1);
+        QueryResult r = QueryXMLForPath(snap, L"192.168.1.55", L"", -1);
         Check("T1 found=true",               r.found);
         Check("T1 classname=1756-L85E/B",    r.classname == L"1756-L85E/B");
         Check("T1 deviceName has LOGIX5585E", r.deviceName.find(L"LOGIX5585E") != std::wstring::npos);
     }
     {
-        QueryResult r = QueryXMLForPath(xmlFile, L"192.168.1.99", L"", -1);
+        QueryResult r = QueryXMLForPath(snap, L"192.168.1.99", L"", -1);
         Check("T2 found=true (Unrecognized)", r.found);
         Check("T2 classname=Unrecognized Device", r.classname == L"Unrecognized Device");
     }
     {
-        QueryResult r = QueryXMLForPath(xmlFile, L"192.168.1.55", L"Backplane", 0);
+        QueryResult r = QueryXMLForPath(snap, L"192.168.1.55", L"Backplane", 0);
         Check("T3 Backplane/0 found",         r.found);
         Check("T3 classname=1756-L85E/B",     r.classname == L"1756-L85E/B");
         Check("T3 deviceName=1756-L85E",      r.deviceName == L"1756-L85E");
     }
     {
-        QueryResult r = QueryXMLForPath(xmlFile, L"192.168.1.55", L"Backplane", 1);
+        QueryResult r = QueryXMLForPath(snap, L"192.168.1.55", L"Backplane", 1);
         Check("T4 Backplane/1 classname=1756-EN2T/D", r.classname == L"1756-EN2T/D");
     }
     {
-        QueryResult r = QueryXMLForPath(xmlFile, L"192.168.1.55", L"Backplane", 2);
+        QueryResult r = QueryXMLForPath(snap, L"192.168.1.55", L"Backplane", 2);
         Check("T5 Backplane/2 classname=1756-IA16I/B", r.classname == L"1756-IA16I/B");
     }
     {
-        QueryResult r = QueryXMLForPath(xmlFile, L"10.0.0.1", L"", -1);
+        QueryResult r = QueryXMLForPath(snap, L"10.0.0.1", L"", -1);
         Check("T6 non-existent IP → not found", !r.found);
     }
     {
-        QueryResult r = QueryXMLForPath(xmlFile, L"192.168.1.55", L"Backplane", 99);
+        QueryResult r = QueryXMLForPath(snap, L"192.168.1.55", L"Backplane", 99);
         Check("T7 non-existent slot → not found", !r.found);
     }
 
     // === PopulateQueryCache tests ===
     printf("\n-- PopulateQueryCache (cache-first lookups) --\n");
-    g_queryCache.clear();
-    PopulateQueryCache(xmlFile);
-    printf("  Cache entries: %d\n", (int)g_queryCache.size());
+    ResetCache();
+    PopulateQueryCache(snap, true);
+    printf("  Cache devices: %d\n", (int)g_deviceStore.DeviceCount());
 
+    QueryResult hit;
     {
-        auto it = g_queryCache.find(L"192.168.1.55");
-        Check("C1 IP key exists",            it != g_queryCache.end());
-        if (it != g_queryCache.end()) {
-            Check("C1 classname=1756-L85E/B", it->second.classname == L"1756-L85E/B");
-        }
-    }
-    {
-        auto it = g_queryCache.find(L"192.168.1.99");
-        Check("C2 Unrecognized IP in cache", it != g_queryCache.end());
-        if (it != g_queryCache.end())
-            Check("C2 classname=Unrecognized Device", it->second.classname == L"Unrecognized Device");
-    }
-    {
-        auto it = g_queryCache.find(L"192.168.1.55\\Backplane\\0");
-        Check("C3 Backplane\\0 in cache",    it != g_queryCache.end());
-        if (it != g_queryCache.end())
-            Check("C3 classname=1756-L85E/B", it->second.classname == L"1756-L85E/B");
-    }
-    {
-        auto it = g_queryCache.find(L"192.168.1.55\\Backplane\\1");
-        Check("C4 Backplane\\1 classname=1756-EN2T/D",
-              it != g_queryCache.end() && it->second.classname == L"1756-EN2T/D");
-    }
-    {
-        auto it = g_queryCache.find(L"192.168.1.55\\Backplane\\2");
-        Check("C5 Backplane\\2 classname=1756-IA16I/B",
-              it != g_queryCache.end() && it->second.classname == L"1756-IA16I/B");
+        bool found = LookupCachedPath(L"192.168.1.55", L"", -1, hit);
+        Check("C1 IP key exists",            found);
+        if (found) Check("C1 classname=1756-L85E/B", hit.classname == L"1756-L85E/B");
     }
     {
-        auto it = g_queryCache.find(L"192.168.1.55\\Backplane\\3");
-        Check("C6 Backplane\\3 classname=Unrecognized Device",
-              it != g_queryCache.end() && it->second.classname == L"Unrecognized Device");
+        bool found = LookupCachedPath(L"192.168.1.99", L"", -1, hit);
+        Check("C2 Unrecognized IP in cache", found);
+        if (found) Check("C2 classname=Unrecognized Device", hit.classname == L"Unrecognized Device");
     }
     {
-        Check("C7 non-existent key absent",
-              g_queryCache.find(L"10.0.0.1") == g_queryCache.end());
+        bool found = LookupCachedPath(L"192.168.1.55", L"Backplane", 0, hit);
+        Check("C3 Backplane\\0 in cache",    found);
+        if (found) Check("C3 classname=1756-L85E/B", hit.classname == L"1756-L85E/B");
     }
+    Check("C4 Backplane\\1 classname=1756-EN2T/D",
+          LookupCachedPath(L"192.168.1.55", L"Backplane", 1, hit) && hit.classname == L"1756-EN2T/D");
+    Check("C5 Backplane\\2 classname=1756-IA16I/B",
+          LookupCachedPath(L"192.168.1.55", L"Backplane", 2, hit) && hit.classname == L"1756-IA16I/B");
+    Check("C6 Backplane\\3 classname=Unrecognized Device",
+          LookupCachedPath(L"192.168.1.55", L"Backplane", 3, hit) && hit.classname == L"Unrecognized Device");
+    Check("C7 non-existent key absent", !LookupCachedPath(L"10.0.0.1", L"", -1, hit));
 }
 
-int main()
+int wmain(int argc, wchar_t* argv[])
 {
-    RunTests(L"C:\\temp\\test_topo.xml");
+    TestReferences();
+    TestBinaryFrames();
+    TestWarmCache();
+    RunTests(argc > 1 ? argv[1] : L"C:\\temp\\test_topo.xml");
 
-    printf("\n--- Results: %d passed, %d failed ---\n", pass, fail);
-    return fail > 0 ? 1 : 0;
+    return TestResults();
 }
@@ -0,0 +1,353 @@
+/**
+ * Benchmark for every topology parse/query path in the hook
+ * Links the real query code from RSLinxHook (no COM dependencies):
+ *
+ *   cl /O2 /EHsc /std:c++17 /D_CRT_SECURE_NO_WARNINGS /I..\RSLinxHook
+ *      TopologyBench.cpp ..\RSLinxHook\TopologyQuery.cpp ..\RSLinxHook\TopologySnapshot.cpp
+ *      ..\RSLinxHook\DeviceStore.cpp ..\RSLinxHook\Perf.cpp psapi.lib
+ *
+ * Usage: TopologyBench [drivers] [chassis] [slots] [iterations]
+ *        (defaults: 4 drivers x 250 chassis x 17 slots, 5 iterations)
+ *
+ * Generates a SaveTopologyXML-shaped tree: one workstation port per
+ * driver, each with its own Ethernet chassis (every 8th slot a
+ * <device reference> back to the adapter), and every 10th chassis also
+ * seen from the next driver as a reference. Each path reports the best
+ * run time, throughput, heap allocations and bytes per run, and the peak
+ * heap growth during the run (operator new is counted below); peak
+ * working set is printed at the end. Path numbers are comparable across
+ * builds on the same tree size only.
+ */
+#include "HookStubs.h"
+#include "TestHarness.h"
+#include <psapi.h>
+#include <functional>
+#include <new>
+#include "TopologyXML.h"
+#include "TopologySnapshot.h"
+
+// ============================================================
+// Heap accounting — every operator new in the process is counted.
+// Single-threaded: the hook code under test starts no threads.
+// ============================================================
+
+static size_t s_allocCount = 0, s_allocBytes = 0;
+static size_t s_liveBytes = 0, s_peakLiveBytes = 0;
+
+void* operator new(size_t size)
+{
+    // Size header in front of the block so delete can track live bytes
+    size_t* p = (size_t*)malloc(size + sizeof(size_t) * 2);
+    if (!p) throw std::bad_alloc();
+    p[0] = size;
+    s_allocCount++;
+    s_allocBytes += size;
+    s_liveBytes += size;
+    if (s_liveBytes > s_peakLiveBytes) s_peakLiveBytes = s_liveBytes;
+    return p + 2;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (!ptr) return;
+    size_t* p = (size_t*)ptr - 2;
+    s_liveBytes -= p[0];
+    free(p);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+static SIZE_T PeakWorkingSet()
+{
+    PROCESS_MEMORY_COUNTERS pmc = { sizeof(pmc) };
+    GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+    return pmc.PeakWorkingSetSize;
+}
+
+// ============================================================
+// Synthetic topology
+// ============================================================
+
+struct BenchShape {
+    int drivers = 4;
+    int chassis = 250;   // per driver
+    int slots = 17;      // per chassis, slot 0..slots-1
+};
+
+struct GenStats {
+    int chassis = 0;
+    int slotDevices = 0;      // real slot devices
+    int slotReferences = 0;   // slots that reference their adapter
+    int sharedReferences = 0; // chassis seen again from the next driver
+    size_t nodes = 0;         // elements the parser should produce
+};
+
+static void ChassisIP(char* buf, size_t size, int d, int c)
+{
+    snprintf(buf, size, "10.%d.%d.%d", d, (c >> 8) & 0xFF, c & 0xFF);
+}
+
+static bool IsSharedChassis(const BenchShape& shape, int c)
+{
+    return shape.drivers > 1 && c % 10 == 0;
+}
+
+static std::string GenerateTopology(const BenchShape& shape, GenStats& st)
+{
+    std::string xml;
+    char ip[32], line[512];
+
+    xml += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<topology>\n<tree>\n";
+    xml += "<device name=\"Workstation\" classname=\"Workstation\">\n";
+    st.nodes = 1;
+
+    for (int d = 0; d < shape.drivers; d++)
+    {
+        snprintf(line, sizeof(line),
+            "<port name=\"AB_ETH-%d\">\n<bus name=\"Ethernet\" classname=\"AB_ETH\">\n", d + 1);
+        xml += line;
+        st.nodes += 2;
+
+        for (int c = 0; c < shape.chassis; c++)
+        {
+            ChassisIP(ip, sizeof(ip), d, c);
+            snprintf(line, sizeof(line),
+                "<address type=\"String\" value=\"%s\">\n"
+                "<device name=\"1756-EN2T %d-%d\" classname=\"1756-EN2T/D\" objectid=\"{E%04X%04X-0000-0000-0000-000000000000}\">\n"
+                "<port name=\"Backplane\">\n<bus name=\"Backplane (%d)\" classname=\"AB_BP\">\n",
+                ip, d, c, d, c, shape.slots);
+            xml += line;
+            st.nodes += 4;
+            st.chassis++;
+
+            for (int slot = 0; slot < shape.slots; slot++)
+            {
+                if (slot > 0 && slot % 8 == 0)
+                {
+                    snprintf(line, sizeof(line),
+                        "<address type=\"Short\" value=\"%d\">\n"
+                        "<device reference=\"{E%04X%04X-0000-0000-0000-000000000000}\"/>\n</address>\n",
+                        slot, d, c);
+                    st.slotReferences++;
+                }
+                else
+                {
+                    snprintf(line, sizeof(line),
+                        "<address type=\"Short\" value=\"%d\">\n"
+                        "<device name=\"1756-IB16 Slot %d\" classname=\"1756-IB16/B\" objectid=\"{S%04X%04X-%04X-0000-0000-000000000000}\"/>\n</address>\n",
+                        slot, slot, d, c, slot);
+                    st.slotDevices++;
+                }
+                xml += line;
+                st.nodes += 2;
+            }
+            xml += "</bus>\n</port>\n</device>\n</address>\n";
+        }
+
+        // Chassis of the previous driver that this driver also reaches
+        int prev = (d + shape.drivers - 1) % shape.drivers;
+        for (int c = 0; c < shape.chassis; c++)
+        {
+            if (!IsSharedChassis(shape, c)) continue;
+            ChassisIP(ip, sizeof(ip), prev, c);
+            snprintf(line, sizeof(line),
+                "<address type=\"String\" value=\"%s\">\n"
+                "<device reference=\"{E%04X%04X-0000-0000-0000-000000000000}\"/>\n</address>\n",
+                ip, prev, c);
+            xml += line;
+            st.nodes += 2;
+            st.sharedReferences++;
+        }
+        xml += "</bus>\n</port>\n";
+    }
+
+    xml += "</device>\n</tree>\n</topology>\n";
+    return xml;
+}
+
+// ============================================================
+// Measurement
+// ============================================================
+
+// Runs setup (untimed, uncounted) then body, iterations times. Reports the
+// best run and the heap activity of the last one.
+static void Measure(const char* name, int iterations, double units, const char* unit,
+                    const std::function<void()>& setup, const std::function<void()>& body)
+{
+    LARGE_INTEGER freq, t0, t1;
+    QueryPerformanceFrequency(&freq);
+
+    double bestMs = 1e30;
+    size_t allocs = 0, bytes = 0, peak = 0;
+    for (int it = 0; it < iterations; it++)
+    {
+        if (setup) setup();
+
+        size_t allocBase = s_allocCount, bytesBase = s_allocBytes, liveBase = s_liveBytes;
+        s_peakLiveBytes = s_liveBytes;
+        QueryPerformanceCounter(&t0);
+        body();
+        QueryPerformanceCounter(&t1);
+
+        double ms = (t1.QuadPart - t0.QuadPart) * 1000.0 / freq.QuadPart;
+        if (ms < bestMs) bestMs = ms;
+        allocs = s_allocCount - allocBase;
+        bytes = s_allocBytes - bytesBase;
+        peak = s_peakLiveBytes - liveBase;
+    }
+
+    double rate = (bestMs > 0) ? units / (bestMs / 1000.0) : 0;
+    printf("  %-30s %9.2f ms  %12.0f %s/s  %9d allocs  %10.1f KB  peak +%.1f KB\n",
+        name, bestMs, rate, unit, (int)allocs, bytes / 1024.0, peak / 1024.0);
+}
+
+static void ResetCache()
+{
+    g_deviceStore.Clear();
+    g_deviceDetails.clear();
+    g_cacheStale = false;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    BenchShape shape;
+    if (argc > 1) shape.drivers = _wtoi(argv[1]);
+    if (argc > 2) shape.chassis = _wtoi(argv[2]);
+    if (argc > 3) shape.slots = _wtoi(argv[3]);
+    int iterations = (argc > 4) ? _wtoi(argv[4]) : 5;
+    if (shape.drivers <= 0 || shape.drivers > 255) shape.drivers = 4;
+    if (shape.chassis <= 0 || shape.chassis > 65536) shape.chassis = 250;
+    if (shape.slots <= 0 || shape.slots > DEVICE_STORE_MAX_SLOT + 1) shape.slots = 17;
+    if (iterations <= 0) iterations = 5;
+
+    GenStats gen;
+    std::string xml = GenerateTopology(shape, gen);
+    double mb = xml.size() / (1024.0 * 1024.0);
+
+    wchar_t tempDir[MAX_PATH], path[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    swprintf(path, MAX_PATH, L"%stopology_bench_%d_%d_%d.xml", tempDir,
+             shape.drivers, shape.chassis, shape.slots);
+    FILE* f = _wfopen(path, L"wb");
+    if (!f || fwrite(xml.data(), 1, xml.size(), f) != xml.size())
+    {
+        if (f) fclose(f);
+        printf("  [FAIL] cannot write %ls\n", path);
+        return 1;
+    }
+    fclose(f);
+
+    printf("\n-- Synthetic topology: %d drivers x %d chassis x %d slots --\n",
+        shape.drivers, shape.chassis, shape.slots);
+    printf("  %.2f MB, %d chassis, %d slot devices, %d slot references, %d shared chassis\n\n",
+        mb, gen.chassis, gen.slotDevices, gen.slotReferences, gen.sharedReferences);
+
+    TopologySnapshot snap;
+    ParseTopologyBuffer(xml.data(), xml.size(), snap);
+    double nodes = (double)snap.nodes.size();
+
+    std::vector<std::wstring> targets;
+    for (int d = 0; d < shape.drivers; d++)
+        for (int c = 0; c < shape.chassis; c++)
+        {
+            char ip[32];
+            ChassisIP(ip, sizeof(ip), d, c);
+            targets.push_back(Utf8ToWide(ip));
+        }
+
+    // ---- Parse paths ----
+    Measure("LoadTopologySnapshot", iterations, mb, "MB",
+        nullptr, [&] { TopologySnapshot s; LoadTopologySnapshot(path, s); });
+    Measure("ParseTopologyBuffer", iterations, mb, "MB",
+        nullptr, [&] { TopologySnapshot s; ParseTopologyBuffer(xml.data(), xml.size(), s); });
+
+    // ---- Snapshot consumers ----
+    TopologyCounts counts = {};
+    int identified = 0;
+    Measure("CountDevicesInXML", iterations, nodes, "node",
+        nullptr, [&] { counts = CountDevicesInXML(snap); });
+    Measure("CountTargetsIdentifiedInXML", iterations, nodes, "node",
+        nullptr, [&] { identified = CountTargetsIdentifiedInXML(snap, targets); });
+
+    std::map<std::wstring, std::set<std::wstring>> byDriver;
+    Measure("CollectDriverAddresses", iterations, nodes, "node",
+        nullptr, [&] { CollectDriverAddresses(snap, byDriver); });
+
+    Measure("UpdateDeviceIPsFromXML", iterations, nodes, "node",
+        [&] { g_deviceDetails.clear(); }, [&] { UpdateDeviceIPsFromXML(snap); });
+    Measure("PopulateQueryCache", iterations, nodes, "node",
+        [&] { g_deviceStore.Clear(); }, [&] { PopulateQueryCache(snap, true); });
+
+    // One chassis in ten reported dirty by the sinks (none of them shared,
+    // so each dirty IP has exactly one address element)
+    std::set<std::wstring> dirty;
+    for (int d = 0; d < shape.drivers; d++)
+        for (int c = 5; c < shape.chassis; c += 10)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "1756-EN2T %d-%d", d, c);
+            dirty.insert(Utf8ToWide(name));
+        }
+    int refreshed = 0;
+    bool refreshOk = false;
+    Measure("RefreshQueryCache (10% dirty)", iterations, nodes, "node",
+        nullptr, [&] { refreshOk = RefreshQueryCache(snap, false, dirty, refreshed); });
+
+    // ---- Query paths ----
+    const int xmlQueries = 1000;
+    int xmlHits = 0;
+    Measure("QueryXMLForPath", iterations, xmlQueries, "query",
+        nullptr, [&] {
+            xmlHits = 0;
+            for (int q = 0; q < xmlQueries; q++)
+            {
+                const std::wstring& ip = targets[(q * 7919) % targets.size()];
+                if (QueryXMLForPath(snap, ip, L"Backplane", q % shape.slots).found) xmlHits++;
+            }
+        });
+
+    const int cacheQueries = 100000;
+    int cacheHits = 0;
+    Measure("LookupCachedPath", iterations, cacheQueries, "query",
+        nullptr, [&] {
+            cacheHits = 0;
+            QueryResult r;
+            for (int q = 0; q < cacheQueries; q++)
+            {
+                const std::wstring& ip = targets[(q * 7919) % targets.size()];
+                if (LookupCachedPath(ip, L"Backplane", q % shape.slots, r)) cacheHits++;
+            }
+        });
+
+    printf("\n  Peak working set: %.2f MB (XML %.2f MB)\n",
+        PeakWorkingSet() / (1024.0 * 1024.0), mb);
+
+    // ---- Results match the generated shape ----
+    printf("\n-- Correctness --\n");
+    int deviceElements = 1 + gen.chassis + gen.slotDevices;
+    Check("G1 every element parsed", snap.nodes.size() == gen.nodes);
+    Check("G2 references not counted as devices", counts.totalDevices == deviceElements);
+    Check("G3 all chassis identified", identified == (int)targets.size());
+    Check("G4 one address set per driver", (int)byDriver.size() == shape.drivers);
+    Check("G5 every chassis has its IP", (int)g_deviceDetails.size() == gen.chassis);
+    Check("G6 cache holds every chassis", (int)g_deviceStore.DeviceCount() == gen.chassis);
+    Check("G7 refresh used the sink names", refreshOk && refreshed == (int)dirty.size());
+    Check("G8 every query path hits", xmlHits == xmlQueries && cacheHits == cacheQueries);
+
+    char ip[32];
+    ChassisIP(ip, sizeof(ip), shape.drivers - 1, shape.chassis - 1);
+    std::wstring lastIP = Utf8ToWide(ip);
+    QueryResult viaXml = QueryXMLForPath(snap, lastIP, L"Backplane", shape.slots > 8 ? 8 : 0);
+    QueryResult viaCache;
+    bool cached = LookupCachedPath(lastIP, L"Backplane", shape.slots > 8 ? 8 : 0, viaCache);
+    Check("G9 slot reference resolves to the adapter", viaXml.found && viaXml.classname == L"1756-EN2T/D");
+    Check("G10 cache agrees with the snapshot",
+          cached && viaCache.classname == viaXml.classname && viaCache.deviceName == viaXml.deviceName);
+
+    ResetCache();
+    DeleteFileW(path);
+    return TestResults();
+}